@@ -0,0 +1,22 @@
+// © 2024 NVIDIA Corporation
+
+#include "NRICompatibility.hlsli"
+
+NRI_RESOURCE( Texture2D<float4>, g_Texture, t, 0, 0 );
+
+struct outputVS
+{
+    float4 position : SV_Position;
+    float2 texCoord : TEXCOORD0;
+};
+
+// The viewport matches the texture size, a texel per pixel
+float4 main( in outputVS input ) : SV_Target
+{
+    uint2 size;
+    g_Texture.GetDimensions( size.x, size.y );
+
+    uint2 texel = min( uint2( input.texCoord * float2( size ) ), size - 1 );
+
+    return g_Texture[ texel ];
+}
@@ -0,0 +1,19 @@
+// © 2024 NVIDIA Corporation
+
+struct outputVS
+{
+    float4 position : SV_Position;
+    float2 texCoord : TEXCOORD0;
+};
+
+// Full screen triangle, covers the viewport
+outputVS main( uint vertexId : SV_VertexID )
+{
+    float2 uv = float2( ( vertexId << 1 ) & 2, vertexId & 2 );
+
+    outputVS output;
+    output.position = float4( uv * float2( 2.0, -2.0 ) + float2( -1.0, 1.0 ), 0.0, 1.0 );
+    output.texCoord = uv;
+
+    return output;
+}
@@ -8,6 +8,11 @@ struct Input
     float2 TexCoord : TEXCOORD0;
     float3 Normal : NORMAL;
     float4 Tangent : TANGENT;
+
+    // Per instance
+    float4 InstanceRow0 : TEXCOORD1;
+    float4 InstanceRow1 : TEXCOORD2;
+    float4 InstanceRow2 : TEXCOORD3;
 };
 
 struct Attributes
@@ -28,11 +33,16 @@ Attributes main( in Input input )
 {
     Attributes output;
 
-    float3 N = input.Normal * 2.0 - 1.0;
+    float3x4 objectToWorld = float3x4( input.InstanceRow0, input.InstanceRow1, input.InstanceRow2 );
+    float3 position = mul( objectToWorld, float4( input.Position, 1 ) );
+
+    // Transforms are rigid (+uniform scale), no need for the inverse transpose
+    float3 N = mul( ( float3x3 )objectToWorld, input.Normal * 2.0 - 1.0 );
     float4 T = input.Tangent * 2.0 - 1.0;
-    float3 V = gCameraPos - input.Position;
+    T.xyz = mul( ( float3x3 )objectToWorld, T.xyz );
+    float3 V = gCameraPos - position;
 
-    output.Position = mul( gWorldToClip, float4( input.Position, 1 ) );
+    output.Position = mul( gWorldToClip, float4( position, 1 ) );
     output.Normal = float4( N, input.TexCoord.x );
     output.View = float4( V, input.TexCoord.y );
     output.Tangent = T;
@@ -0,0 +1,41 @@
+// © 2024 NVIDIA Corporation
+
+#include "NRICompatibility.hlsli"
+#include "SceneViewerMeshletStructs.h"
+#include "Meshlet.hlsli"
+
+NRI_RESOURCE( cbuffer, Global, b, 0, 0 )
+{
+    float4x4 gWorldToClip;
+    float3 gCameraPos;
+};
+
+NRI_PUSH_CONSTANTS( MeshletDrawConstants, DrawConstants, 1 );
+NRI_RESOURCE( StructuredBuffer<MeshletData>, Meshlets, t, 0, 2 );
+
+groupshared MeshletPayload s_Payload;
+groupshared uint s_VisibleMeshletNum;
+
+[numthreads( MESHLET_TASK_GROUP_SIZE, 1, 1 )]
+void main( uint threadId : SV_DispatchThreadId, uint localThreadId : SV_GroupThreadID )
+{
+    if( localThreadId == 0 )
+        s_VisibleMeshletNum = 0;
+
+    GroupMemoryBarrierWithGroupSync( );
+
+    if( threadId < DrawConstants.meshletNum )
+    {
+        uint meshletIndex = DrawConstants.meshletOffset + threadId;
+        if( IsMeshletVisible( Meshlets[ meshletIndex ], gWorldToClip, gCameraPos, DrawConstants.enableConeCulling != 0 ) )
+        {
+            uint slot;
+            InterlockedAdd( s_VisibleMeshletNum, 1, slot );
+            s_Payload.meshletIndices[ slot ] = meshletIndex;
+        }
+    }
+
+    GroupMemoryBarrierWithGroupSync( );
+
+    DispatchMesh( s_VisibleMeshletNum, 1, 1, s_Payload );
+}
@@ -0,0 +1,40 @@
+// © 2024 NVIDIA Corporation
+
+struct MeshletPayload
+{
+    uint meshletIndices[ MESHLET_TASK_GROUP_SIZE ];
+};
+
+bool IsMeshletVisible( MeshletData meshlet, float4x4 worldToClip, float3 cameraPos, bool enableConeCulling )
+{
+    float3 center = meshlet.sphere.xyz;
+    float radius = meshlet.sphere.w;
+
+    // Frustum (reversed infinite depth: side planes and near plane only)
+    float4 planes[ 5 ] =
+    {
+        worldToClip[ 3 ] + worldToClip[ 0 ],
+        worldToClip[ 3 ] - worldToClip[ 0 ],
+        worldToClip[ 3 ] + worldToClip[ 1 ],
+        worldToClip[ 3 ] - worldToClip[ 1 ],
+        worldToClip[ 3 ] - worldToClip[ 2 ],
+    };
+
+    [unroll]
+    for( uint i = 0; i < 5; i++ )
+    {
+        float4 plane = planes[ i ] / length( planes[ i ].xyz );
+        if( dot( plane.xyz, center ) + plane.w < -radius )
+            return false;
+    }
+
+    // Backface cone
+    if( enableConeCulling )
+    {
+        float3 v = center - cameraPos;
+        if( dot( v, meshlet.cone.xyz ) >= meshlet.cone.w * length( v ) + radius )
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,77 @@
+// © 2024 NVIDIA Corporation
+
+#include "NRICompatibility.hlsli"
+#include "SceneViewerMeshletStructs.h"
+#include "Meshlet.hlsli"
+
+struct Vertex
+{
+    float3 Position;
+    uint TexCoord; // 2x FP16
+    uint Normal; // R10G10B10A2_UNORM
+    uint Tangent; // R10G10B10A2_UNORM
+};
+
+struct Attributes
+{
+    float4 Position : SV_Position;
+    float4 Normal : TEXCOORD0; //.w = TexCoord.x
+    float4 View : TEXCOORD1; //.w = TexCoord.y
+    float4 Tangent : TEXCOORD2;
+};
+
+NRI_RESOURCE( cbuffer, Global, b, 0, 0 )
+{
+    float4x4 gWorldToClip;
+    float3 gCameraPos;
+};
+
+NRI_RESOURCE( StructuredBuffer<MeshletData>, Meshlets, t, 0, 2 );
+NRI_RESOURCE( StructuredBuffer<uint>, MeshletVertices, t, 1, 2 );
+NRI_RESOURCE( StructuredBuffer<uint>, MeshletPrimitives, t, 2, 2 );
+NRI_RESOURCE( StructuredBuffer<Vertex>, Vertices, t, 3, 2 );
+
+float4 UnpackUnorm1010102( uint packed )
+{
+    return float4( packed & 1023, ( packed >> 10 ) & 1023, ( packed >> 20 ) & 1023, packed >> 30 ) / float4( 1023.0, 1023.0, 1023.0, 3.0 );
+}
+
+[numthreads( MESHLET_MESH_GROUP_SIZE, 1, 1 )]
+[outputtopology( "triangle" )]
+void main
+(
+    uint threadId : SV_GroupThreadID,
+    uint groupId : SV_GroupID,
+    in payload MeshletPayload payload,
+    out vertices Attributes outVertices[ MESHLET_VERTEX_MAX_NUM ],
+    out indices uint3 outPrimitives[ MESHLET_PRIMITIVE_MAX_NUM ]
+)
+{
+    MeshletData meshlet = Meshlets[ payload.meshletIndices[ groupId ] ];
+
+    SetMeshOutputCounts( meshlet.vertexNum, meshlet.primitiveNum );
+
+    if( threadId < meshlet.vertexNum )
+    {
+        Vertex input = Vertices[ MeshletVertices[ meshlet.vertexOffset + threadId ] ];
+
+        float2 uv = float2( f16tof32( input.TexCoord ), f16tof32( input.TexCoord >> 16 ) );
+        float3 N = UnpackUnorm1010102( input.Normal ).xyz * 2.0 - 1.0;
+        float4 T = UnpackUnorm1010102( input.Tangent ) * 2.0 - 1.0;
+        float3 V = gCameraPos - input.Position;
+
+        Attributes output;
+        output.Position = mul( gWorldToClip, float4( input.Position, 1 ) );
+        output.Normal = float4( N, uv.x );
+        output.View = float4( V, uv.y );
+        output.Tangent = T;
+
+        outVertices[ threadId ] = output;
+    }
+
+    if( threadId < meshlet.primitiveNum )
+    {
+        uint packed = MeshletPrimitives[ meshlet.primitiveOffset + threadId ];
+        outPrimitives[ threadId ] = uint3( packed & 0xFF, ( packed >> 8 ) & 0xFF, ( packed >> 16 ) & 0xFF );
+    }
+}
@@ -0,0 +1,32 @@
+// © 2024 NVIDIA Corporation
+
+#include "NRICompatibility.hlsli"
+#include "SceneViewerMeshletStructs.h"
+#include "Meshlet.hlsli"
+
+NRI_PUSH_CONSTANTS( MeshletCullingConstants, Constants, 0 );
+NRI_RESOURCE( StructuredBuffer<MeshletData>, Meshlets, t, 0, 0 );
+NRI_RESOURCE( StructuredBuffer<MeshletCullingItem>, CullingItems, t, 1, 0 );
+NRI_RESOURCE( RWBuffer<uint>, Commands, u, 0, 0 );
+
+// One command per item: culled meshlets get "instanceNum = 0", so no draw count buffer is needed
+[numthreads( MESHLET_CULLING_GROUP_SIZE, 1, 1 )]
+void main( uint threadId : SV_DispatchThreadId )
+{
+    if( threadId >= Constants.itemNum )
+        return;
+
+    MeshletCullingItem item = CullingItems[ threadId ];
+    MeshletData meshlet = Meshlets[ item.meshletIndex ];
+
+    bool enableConeCulling = Constants.enableConeCulling != 0 && item.allowConeCulling != 0;
+    bool isVisible = IsMeshletVisible( meshlet, Constants.worldToClip, Constants.cameraPos.xyz, enableConeCulling );
+
+    NRI_FILL_DRAW_INDEXED_DESC( Commands, threadId,
+        meshlet.primitiveNum * 3,
+        isVisible ? 1 : 0,
+        meshlet.primitiveOffset * 3,
+        0, // indices are absolute
+        0
+    );
+}
@@ -1,10 +1,18 @@
 // © 2021 NVIDIA Corporation
 
 #include "NRICompatibility.hlsli"
+#include "RayTracingBoxesStructs.h"
 
+// Per-geometry tables
 NRI_RESOURCE(Buffer<float2>, vertexBuffers[], t, 0, 1);
 NRI_RESOURCE(Buffer<uint4>, indexBuffers[], t, 0, 2);
 
+// The hit record tells which entry to use. NRI pipelines have no local root signatures, so D3D12 can't read it and
+// falls back to "InstanceID" (the geometry index) with zero offsets
+#ifdef __spirv__
+    [[vk::shader_record_ext]] ConstantBuffer<HitRecordData> HitRecord;
+#endif
+
 struct Payload
 {
     float3 hitValue;
@@ -18,14 +26,23 @@ struct IntersectionAttributes
 [shader( "closesthit" )]
 void closest_hit( inout Payload payload : SV_RayPayload, in IntersectionAttributes intersectionAttributes : SV_IntersectionAttributes )
 {
-    uint instanceID = InstanceID( );
-    uint primitiveIndex = PrimitiveIndex( );
-
-    uint3 indices = indexBuffers[instanceID][primitiveIndex].xyz;
-
-    float2 texCoords0 = vertexBuffers[instanceID][indices.x];
-    float2 texCoords1 = vertexBuffers[instanceID][indices.y];
-    float2 texCoords2 = vertexBuffers[instanceID][indices.z];
+#ifdef __spirv__
+    uint geometryIndex = HitRecord.geometryIndex;
+    uint triangleOffset = HitRecord.triangleOffset;
+    uint vertexOffset = HitRecord.vertexOffset;
+#else
+    uint geometryIndex = InstanceID( );
+    uint triangleOffset = 0;
+    uint vertexOffset = 0;
+#endif
+
+    uint primitiveIndex = PrimitiveIndex( ) + triangleOffset;
+
+    uint3 indices = indexBuffers[geometryIndex][primitiveIndex].xyz + vertexOffset;
+
+    float2 texCoords0 = vertexBuffers[geometryIndex][indices.x];
+    float2 texCoords1 = vertexBuffers[geometryIndex][indices.y];
+    float2 texCoords2 = vertexBuffers[geometryIndex][indices.z];
 
     float3 barycentrics;
     barycentrics.yz = intersectionAttributes.barycentrics.xy;
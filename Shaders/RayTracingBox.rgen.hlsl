@@ -1,9 +1,12 @@
 // © 2021 NVIDIA Corporation
 
 #include "NRICompatibility.hlsli"
+#include "RayTracingBoxesStructs.h"
 
+NRI_PUSH_CONSTANTS( RayGenConstants, Constants, 0 );
 NRI_RESOURCE(RWTexture2D<float4>, outputImage, u, 0, 0);
 NRI_RESOURCE(RaytracingAccelerationStructure, topLevelAS, t, 1, 0);
+NRI_RESOURCE(RWTexture2D<float4>, historyImage, u, 2, 0); // sum of samples, sample num
 
 struct Payload
 {
@@ -13,14 +16,34 @@ struct Payload
 [shader( "raygeneration" )]
 void raygen( )
 {
-    uint2 dispatchRaysIndex = DispatchRaysIndex( ).xy;
-    uint2 dispatchRaysDimensions = DispatchRaysDimensions( ).xy;
+    uint3 dispatchRaysIndex = DispatchRaysIndex( );
+    uint2 screenSize = uint2( Constants.screenWidth, Constants.screenHeight );
 
-    const float2 pixelCenter = float2( dispatchRaysIndex.xy ) + float2( 0.5, 0.5 );
-    const float2 inUV = pixelCenter / float2( dispatchRaysDimensions.xy );
+    // Progressive: a tile per "z", tiles rotate over frames. Each sample gets a subpixel offset from the R2 sequence
+    uint2 pixelPos = dispatchRaysIndex.xy;
+    float2 subpixel = 0.5;
+    float4 history = 0;
+
+    if( Constants.isProgressive )
+    {
+        uint tileIndex = ( Constants.firstTile + dispatchRaysIndex.z ) % Constants.tileNum;
+        uint2 tile = uint2( tileIndex % Constants.tileNumX, tileIndex / Constants.tileNumX );
+
+        pixelPos = tile * PROGRESSIVE_TILE_SIZE + dispatchRaysIndex.xy;
+        if( any( pixelPos >= screenSize ) )
+            return;
+
+        if( dispatchRaysIndex.z >= Constants.resetTileNum )
+            history = historyImage[ pixelPos ];
+
+        subpixel = frac( 0.5 + history.w * float2( 0.7548776662, 0.5698402910 ) );
+    }
+
+    const float2 pixelCenter = float2( pixelPos ) + subpixel;
+    const float2 inUV = pixelCenter / float2( screenSize );
 
     float2 d = inUV * 2.0 - 1.0;
-    float aspectRatio = float( dispatchRaysDimensions.x ) / float( dispatchRaysDimensions.y );
+    float aspectRatio = float( screenSize.x ) / float( screenSize.y );
 
     RayDesc rayDesc;
     rayDesc.Origin = float3( 0, 0, -2.0 );
@@ -37,5 +60,13 @@ void raygen( )
     Payload payload = (Payload)0;
     TraceRay( topLevelAS, rayFlags, instanceInclusionMask, rayContributionToHitGroupIndex, multiplierForGeometryContributionToHitGroupIndex, missShaderIndex, rayDesc, payload );
 
-    outputImage[dispatchRaysIndex] = float4( payload.hitValue, 0 );
+    if( Constants.isProgressive )
+    {
+        history += float4( payload.hitValue, 1.0 );
+        historyImage[ pixelPos ] = history;
+
+        outputImage[ pixelPos ] = float4( history.xyz / history.w, 0 );
+    }
+    else
+        outputImage[ pixelPos ] = float4( payload.hitValue, 0 );
 }
@@ -0,0 +1,21 @@
+#define PROGRESSIVE_TILE_SIZE 32
+
+struct RayGenConstants
+{
+    uint32_t screenWidth;
+    uint32_t screenHeight;
+    uint32_t tileNumX;
+    uint32_t tileNum;
+    uint32_t firstTile;
+    uint32_t isProgressive; // "0" - a ray per pixel, straight into the output
+    uint32_t resetTileNum;  // the first tiles of the dispatch drop their history
+    uint32_t padding;
+};
+
+// Inline data of a hit record, the geometry table entry it stands for
+struct HitRecordData
+{
+    uint32_t geometryIndex;
+    uint32_t triangleOffset; // in "indexBuffers[geometryIndex]"
+    uint32_t vertexOffset;   // in "vertexBuffers[geometryIndex]"
+};
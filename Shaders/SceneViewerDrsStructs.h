@@ -0,0 +1,7 @@
+struct UpscaleConstants
+{
+    float2 uvScale; // render resolution / scene color texture size
+    float2 texelSize; // 1 / scene color texture size
+    float sharpness;
+    uint32_t padding[3];
+};
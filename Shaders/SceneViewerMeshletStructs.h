@@ -0,0 +1,38 @@
+
+#define MESHLET_VERTEX_MAX_NUM 64
+#define MESHLET_PRIMITIVE_MAX_NUM 124
+#define MESHLET_TASK_GROUP_SIZE 32
+#define MESHLET_MESH_GROUP_SIZE 128
+#define MESHLET_CULLING_GROUP_SIZE 64
+
+struct MeshletData
+{
+    float4 sphere; // xyz - center, w - radius
+    float4 cone; // xyz - axis, w - cutoff ( 1 - disabled )
+    uint32_t vertexOffset;
+    uint32_t vertexNum;
+    uint32_t primitiveOffset;
+    uint32_t primitiveNum;
+};
+
+struct MeshletDrawConstants
+{
+    uint32_t meshletOffset;
+    uint32_t meshletNum;
+    uint32_t enableConeCulling;
+    uint32_t padding;
+};
+
+struct MeshletCullingConstants
+{
+    float4x4 worldToClip;
+    float4 cameraPos;
+    uint32_t itemNum;
+    uint32_t enableConeCulling;
+};
+
+struct MeshletCullingItem
+{
+    uint32_t meshletIndex;
+    uint32_t allowConeCulling;
+};
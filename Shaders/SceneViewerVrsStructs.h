@@ -0,0 +1,12 @@
+
+#define VRS_GROUP_SIZE 8
+
+struct VrsConstants
+{
+    float4x4 prevClipToClip;
+    uint32_t screenWidth;
+    uint32_t screenHeight;
+    uint32_t tileSize;
+    float threshold;
+    float motionSensitivity;
+};
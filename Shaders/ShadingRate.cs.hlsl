@@ -0,0 +1,87 @@
+// © 2024 NVIDIA Corporation
+
+#include "NRICompatibility.hlsli"
+#include "SceneViewerVrsStructs.h"
+
+NRI_PUSH_CONSTANTS( VrsConstants, Constants, 0 );
+NRI_RESOURCE( Texture2D<float4>, g_History, t, 0, 0 );
+NRI_RESOURCE( Texture2D<float>, g_Depth, t, 1, 0 );
+NRI_RESOURCE( RWTexture2D<uint>, g_ShadingRate, u, 0, 0 );
+NRI_RESOURCE( RWBuffer<uint>, g_Counters, u, 1, 0 );
+
+groupshared float4 s_Sums[ VRS_GROUP_SIZE * VRS_GROUP_SIZE ]; // luminance, luminance^2, motion, pixel num
+groupshared float2 s_Gradients[ VRS_GROUP_SIZE * VRS_GROUP_SIZE ];
+
+float GetLuminance( uint2 pixelPos )
+{
+    return dot( g_History[ pixelPos ].xyz, float3( 0.2126, 0.7152, 0.0722 ) );
+}
+
+// One group per shading rate tile. Inputs are previous frame luminance and camera motion reconstructed from previous frame depth
+[numthreads( VRS_GROUP_SIZE, VRS_GROUP_SIZE, 1 )]
+void main( uint2 tileId : SV_GroupID, uint2 threadId : SV_GroupThreadID, uint threadIndex : SV_GroupIndex )
+{
+    uint2 screenSize = uint2( Constants.screenWidth, Constants.screenHeight );
+    uint2 tileOrigin = tileId * Constants.tileSize;
+
+    float4 sums = 0;
+    float2 gradients = 0;
+    for( uint y = threadId.y; y < Constants.tileSize; y += VRS_GROUP_SIZE )
+    {
+        for( uint x = threadId.x; x < Constants.tileSize; x += VRS_GROUP_SIZE )
+        {
+            uint2 pixelPos = tileOrigin + uint2( x, y );
+            if( any( pixelPos >= screenSize ) )
+                continue;
+
+            float L = GetLuminance( pixelPos );
+            float Lx = GetLuminance( min( pixelPos + uint2( 1, 0 ), screenSize - 1 ) );
+            float Ly = GetLuminance( min( pixelPos + uint2( 0, 1 ), screenSize - 1 ) );
+
+            // Camera motion (depth is reversed, "0" is at infinity)
+            float depth = max( g_Depth[ pixelPos ], 1e-6 );
+            float2 uv = ( float2( pixelPos ) + 0.5 ) / float2( screenSize );
+            float4 clip = mul( Constants.prevClipToClip, float4( uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, depth, 1.0 ) );
+            float2 uvCurr = float2( clip.x, -clip.y ) / clip.w * 0.5 + 0.5;
+            float motion = clip.w > 0.0 ? length( ( uvCurr - uv ) * float2( screenSize ) ) : 0.0;
+
+            sums += float4( L, L * L, motion, 1.0 );
+            gradients += abs( float2( Lx - L, Ly - L ) );
+        }
+    }
+
+    s_Sums[ threadIndex ] = sums;
+    s_Gradients[ threadIndex ] = gradients;
+
+    GroupMemoryBarrierWithGroupSync( );
+
+    if( threadIndex != 0 )
+        return;
+
+    for( uint i = 1; i < VRS_GROUP_SIZE * VRS_GROUP_SIZE; i++ )
+    {
+        sums += s_Sums[ i ];
+        gradients += s_Gradients[ i ];
+    }
+
+    float pixelNum = max( sums.w, 1.0 );
+    float mean = sums.x / pixelNum;
+    float variance = max( sums.y / pixelNum - mean * mean, 0.0 );
+    float contrast = sqrt( variance ) / ( mean + 0.01 );
+    float motion = sums.z / pixelNum;
+
+    // Motion hides details, so the threshold grows with it
+    float threshold = Constants.threshold * ( 1.0 + motion * Constants.motionSensitivity );
+
+    uint2 log2Rate = 0;
+    if( contrast < threshold * 0.5 )
+        log2Rate = uint2( 1, 1 );
+    else if( contrast < threshold )
+        log2Rate = gradients.x < gradients.y ? uint2( 1, 0 ) : uint2( 0, 1 );
+
+    g_ShadingRate[ tileId ] = NRI_SHADING_RATE( log2Rate.x, log2Rate.y );
+
+    uint savedNum = uint( sums.w * ( 1.0 - 1.0 / float( 1 << ( log2Rate.x + log2Rate.y ) ) ) );
+    if( savedNum )
+        InterlockedAdd( g_Counters[ 0 ], savedNum ); // zeroed before the pass
+}
@@ -0,0 +1,40 @@
+// © 2024 NVIDIA Corporation
+
+#include "NRICompatibility.hlsli"
+#include "SceneViewerDrsStructs.h"
+
+NRI_PUSH_CONSTANTS( UpscaleConstants, Constants, 0 );
+
+NRI_RESOURCE( Texture2D<float4>, g_SceneColor, t, 0, 0 );
+NRI_RESOURCE( SamplerState, g_LinearClamp, s, 0, 0 );
+
+struct outputVS
+{
+    float4 position : SV_Position;
+    float2 texCoord : TEXCOORD0;
+};
+
+// Bilinear upscale followed by contrast adaptive sharpening (CAS-like): the sharpening weight shrinks where
+// the local neighborhood is already close to black or white, so edges don't ring
+float4 main( in outputVS input ) : SV_Target
+{
+    // Texels outside of the rendered area hold stale data
+    float2 uvMax = Constants.uvScale - Constants.texelSize * 0.5;
+    float2 uv = min( input.texCoord, uvMax );
+
+    float3 c = g_SceneColor.SampleLevel( g_LinearClamp, uv, 0 ).xyz;
+    float3 n = g_SceneColor.SampleLevel( g_LinearClamp, min( uv - float2( 0.0, Constants.texelSize.y ), uvMax ), 0 ).xyz;
+    float3 s = g_SceneColor.SampleLevel( g_LinearClamp, min( uv + float2( 0.0, Constants.texelSize.y ), uvMax ), 0 ).xyz;
+    float3 w = g_SceneColor.SampleLevel( g_LinearClamp, min( uv - float2( Constants.texelSize.x, 0.0 ), uvMax ), 0 ).xyz;
+    float3 e = g_SceneColor.SampleLevel( g_LinearClamp, min( uv + float2( Constants.texelSize.x, 0.0 ), uvMax ), 0 ).xyz;
+
+    float3 minColor = min( c, min( min( n, s ), min( w, e ) ) );
+    float3 maxColor = max( c, max( max( n, s ), max( w, e ) ) );
+
+    float3 amplitude = sqrt( saturate( min( minColor, 1.0 - maxColor ) / max( maxColor, 1e-5 ) ) );
+    float3 weight = amplitude * ( -1.0 / lerp( 8.0, 5.0, Constants.sharpness ) );
+
+    float3 result = ( c + ( n + s + w + e ) * weight ) / ( 1.0 + 4.0 * weight );
+
+    return float4( saturate( result ), 1.0 );
+}
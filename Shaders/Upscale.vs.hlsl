@@ -0,0 +1,24 @@
+// © 2024 NVIDIA Corporation
+
+#include "NRICompatibility.hlsli"
+#include "SceneViewerDrsStructs.h"
+
+NRI_PUSH_CONSTANTS( UpscaleConstants, Constants, 0 );
+
+struct outputVS
+{
+    float4 position : SV_Position;
+    float2 texCoord : TEXCOORD0;
+};
+
+// Full screen triangle, UVs cover the rendered part of the scene color texture
+outputVS main( uint vertexId : SV_VertexID )
+{
+    float2 uv = float2( ( vertexId << 1 ) & 2, vertexId & 2 );
+
+    outputVS output;
+    output.position = float4( uv * float2( 2.0, -2.0 ) + float2( -1.0, 1.0 ), 0.0, 1.0 );
+    output.texCoord = uv * Constants.uvScale;
+
+    return output;
+}
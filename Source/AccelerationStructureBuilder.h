@@ -0,0 +1,453 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include "DeletionQueue.h"
+#include "MemoryAllocator.h"
+
+// Batches acceleration structure builds. Queued builds are recorded into one command buffer and submitted once by
+// "Flush", or recorded into a frame command buffer by "Record". BLAS builds are packed into one scratch buffer at
+// different offsets, so they can overlap on the GPU, and a barrier is only needed when the scratch buffer wraps around.
+// All TLAS builds go after all BLAS builds. The scratch buffer and the command buffer are kept for the next flush, which
+// waits for the previous one (if still in flight). Structures built with "ALLOW_COMPACTION" get their compacted sizes
+// queried by the flush, so "AddCompaction" can replace them with right-sized copies
+class AccelerationStructureBuilder {
+public:
+    struct Stats {
+        uint64_t scratchSize;
+        uint32_t bottomLevelNum; // built so far
+        uint32_t topLevelNum;
+        uint32_t barrierNum;
+        uint32_t submitNum;
+        uint32_t compactionNum;
+    };
+
+    ~AccelerationStructureBuilder() {
+        Destroy();
+    }
+
+    inline const Stats& GetStats() const {
+        return m_Stats;
+    }
+
+    // "scratchBudget" limits how much scratch memory overlapping builds can take, a single build can still exceed it.
+    // "Record" needs "deletionQueue" to retire an outgrown scratch buffer, which frames in flight may still use
+    void Create(const nri::CoreInterface& NRI, const nri::RayTracingInterface& RT, nri::Device& device, nri::CommandQueue& commandQueue, MemoryAllocator& memoryAllocator, DeletionQueue* deletionQueue = nullptr, uint64_t scratchBudget = 32 * 1024 * 1024) {
+        m_NRI = &NRI;
+        m_RT = &RT;
+        m_Device = &device;
+        m_CommandQueue = &commandQueue;
+        m_MemoryAllocator = &memoryAllocator;
+        m_DeletionQueue = deletionQueue;
+        m_ScratchBudget = scratchBudget;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateFence(device, 0, m_Fence));
+        NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(commandQueue, m_CommandAllocator));
+        NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*m_CommandAllocator, m_CommandBuffer));
+    }
+
+    void Destroy() {
+        if (!m_NRI)
+            return;
+
+        m_NRI->Wait(*m_Fence, m_FenceValue);
+
+        DestroyScratch();
+        DestroyQueries();
+
+        m_NRI->DestroyCommandBuffer(*m_CommandBuffer);
+        m_NRI->DestroyCommandAllocator(*m_CommandAllocator);
+        m_NRI->DestroyFence(*m_Fence);
+
+        m_BottomLevelBuilds.clear();
+        m_TopLevelBuilds.clear();
+        m_GeometryObjects.clear();
+        m_QueriedStructures.clear();
+        m_Compactions.clear();
+        m_NRI = nullptr;
+    }
+
+    // "objects" are copied, but the buffers they reference must stay alive until the flushed builds are done
+    void AddBottomLevel(nri::AccelerationStructure& accelerationStructure, const nri::GeometryObject* objects, uint32_t objectNum, nri::AccelerationStructureBuildBits flags) {
+        BottomLevelBuild build = {};
+        build.accelerationStructure = &accelerationStructure;
+        build.objectOffset = (uint32_t)m_GeometryObjects.size();
+        build.objectNum = objectNum;
+        build.flags = flags;
+        build.scratchSize = GetScratchSize(accelerationStructure);
+
+        m_GeometryObjects.insert(m_GeometryObjects.end(), objects, objects + objectNum);
+        m_BottomLevelBuilds.push_back(build);
+    }
+
+    // Can reference bottom level structures queued in the same flush
+    void AddTopLevel(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer, uint64_t instanceOffset, nri::AccelerationStructureBuildBits flags) {
+        TopLevelBuild build = {};
+        build.accelerationStructure = &accelerationStructure;
+        build.instanceBuffer = &instanceBuffer;
+        build.instanceOffset = instanceOffset;
+        build.instanceNum = instanceNum;
+        build.flags = flags;
+        build.scratchSize = GetScratchSize(accelerationStructure);
+
+        m_TopLevelBuilds.push_back(build);
+    }
+
+    // In-place update (refit) of a TLAS built with "ALLOW_UPDATE". The instance number and flags must match the last build
+    void AddTopLevelUpdate(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer, uint64_t instanceOffset, nri::AccelerationStructureBuildBits flags) {
+        TopLevelBuild build = {};
+        build.accelerationStructure = &accelerationStructure;
+        build.instanceBuffer = &instanceBuffer;
+        build.instanceOffset = instanceOffset;
+        build.instanceNum = instanceNum;
+        build.flags = flags;
+        build.scratchSize = helper::Align(m_RT->GetAccelerationStructureUpdateScratchBufferSize(accelerationStructure), SCRATCH_ALIGNMENT);
+        build.isUpdate = true;
+
+        m_TopLevelBuilds.push_back(build);
+    }
+
+    // Replaces "accelerationStructure", built with "ALLOW_COMPACTION" by the last flush, with a compacted copy, which gets
+    // filled by the next flush. Waits for the last flush to read the compacted size back. "desc" is the one the structure
+    // was created with. The original and its memory go to the deletion queue. Returns the memory size of the copy
+    uint64_t AddCompaction(nri::AccelerationStructure*& accelerationStructure, MemoryAllocator::Allocation& allocation, const nri::AccelerationStructureDesc& desc) {
+        NRI_ABORT_ON_FALSE(m_DeletionQueue);
+
+        uint32_t queryIndex = 0;
+        while (queryIndex < m_QueriedStructures.size() && m_QueriedStructures[queryIndex] != accelerationStructure)
+            queryIndex++;
+
+        NRI_ABORT_ON_FALSE(queryIndex < m_QueriedStructures.size()); // not built with "ALLOW_COMPACTION" by the last flush
+
+        m_NRI->Wait(*m_Fence, m_FenceValue);
+
+        const uint64_t* sizes = (uint64_t*)m_NRI->MapBuffer(*m_ReadbackBuffer, 0, m_QueriedStructures.size() * sizeof(uint64_t));
+        nri::AccelerationStructureDesc compactedDesc = desc;
+        compactedDesc.optimizedSize = sizes[queryIndex];
+        m_NRI->UnmapBuffer(*m_ReadbackBuffer);
+
+        Compaction compaction = {};
+        compaction.src = accelerationStructure;
+        NRI_ABORT_ON_FAILURE(m_RT->CreateAccelerationStructure(*m_Device, compactedDesc, compaction.dst));
+
+        nri::MemoryDesc memoryDesc = {};
+        m_RT->GetAccelerationStructureMemoryDesc(*m_Device, compactedDesc, nri::MemoryLocation::DEVICE, memoryDesc);
+
+        const MemoryAllocator::Allocation srcAllocation = allocation;
+        const nri::RayTracingInterface* RT = m_RT;
+        MemoryAllocator* memoryAllocator = m_MemoryAllocator;
+        m_DeletionQueue->Push([RT, memoryAllocator, compaction, srcAllocation]() {
+            RT->DestroyAccelerationStructure(*compaction.src);
+            memoryAllocator->Free(srcAllocation);
+        });
+
+        accelerationStructure = compaction.dst;
+        allocation = m_MemoryAllocator->AllocateAndBind(*compaction.dst, memoryDesc);
+        m_Compactions.push_back(compaction);
+
+        return memoryDesc.size;
+    }
+
+    // Doesn't wait. Work submitted to the same queue afterwards sees the results in ray tracing shaders
+    void Flush() {
+        if (m_BottomLevelBuilds.empty() && m_TopLevelBuilds.empty() && m_Compactions.empty())
+            return;
+
+        // The command buffer, the scratch buffer and the queries may still be used by the previous flush
+        m_NRI->Wait(*m_Fence, m_FenceValue);
+
+        m_NRI->ResetCommandAllocator(*m_CommandAllocator);
+        m_NRI->BeginCommandBuffer(*m_CommandBuffer, nullptr);
+        {
+            // Compacted copies go first, builds queued after "AddCompaction" may reference them
+            if (!m_Compactions.empty())
+                Barrier(*m_CommandBuffer, BUILD_BARRIER);
+
+            for (const Compaction& compaction : m_Compactions)
+                m_RT->CmdCopyAccelerationStructure(*m_CommandBuffer, *compaction.dst, *compaction.src, nri::CopyMode::COMPACT);
+
+            m_Stats.compactionNum += (uint32_t)m_Compactions.size();
+            m_Compactions.clear();
+
+            RecordBuilds(*m_CommandBuffer, true);
+        }
+        m_NRI->EndCommandBuffer(*m_CommandBuffer);
+
+        m_FenceValue++;
+
+        nri::FenceSubmitDesc signalFence = {};
+        signalFence.fence = m_Fence;
+        signalFence.value = m_FenceValue;
+
+        nri::QueueSubmitDesc queueSubmitDesc = {};
+        queueSubmitDesc.commandBuffers = &m_CommandBuffer;
+        queueSubmitDesc.commandBufferNum = 1;
+        queueSubmitDesc.signalFences = &signalFence;
+        queueSubmitDesc.signalFenceNum = 1;
+
+        m_NRI->QueueSubmit(*m_CommandQueue, queueSubmitDesc);
+        m_Stats.submitNum++;
+    }
+
+    // Records queued builds into a command buffer of the graphics queue, ray tracing shaders recorded later see the results
+    void Record(nri::CommandBuffer& commandBuffer) {
+        if (m_BottomLevelBuilds.empty() && m_TopLevelBuilds.empty())
+            return;
+
+        NRI_ABORT_ON_FALSE(m_DeletionQueue);
+
+        RecordBuilds(commandBuffer, false);
+    }
+
+private:
+    struct BottomLevelBuild {
+        nri::AccelerationStructure* accelerationStructure;
+        uint64_t scratchSize;
+        uint32_t objectOffset;
+        uint32_t objectNum;
+        nri::AccelerationStructureBuildBits flags;
+    };
+
+    struct TopLevelBuild {
+        nri::AccelerationStructure* accelerationStructure;
+        nri::Buffer* instanceBuffer;
+        uint64_t instanceOffset;
+        uint64_t scratchSize;
+        uint32_t instanceNum;
+        nri::AccelerationStructureBuildBits flags;
+        bool isUpdate;
+    };
+
+    struct Compaction {
+        nri::AccelerationStructure* src;
+        nri::AccelerationStructure* dst;
+    };
+
+    // Orders previous builds (and their scratch memory accesses) before following builds or ray tracing
+    static inline const nri::GlobalBarrierDesc BUILD_BARRIER = {
+        {nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::ACCELERATION_STRUCTURE},
+        {nri::AccessBits::ACCELERATION_STRUCTURE_READ | nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::ACCELERATION_STRUCTURE},
+    };
+
+    static inline const nri::GlobalBarrierDesc FINAL_BARRIER = {
+        {nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::ACCELERATION_STRUCTURE},
+        {nri::AccessBits::ACCELERATION_STRUCTURE_READ, nri::StageBits::RAY_TRACING_SHADERS},
+    };
+
+    // Meets D3D12 requirements and "minAccelerationStructureScratchOffsetAlignment" of existing Vulkan drivers
+    static constexpr uint64_t SCRATCH_ALIGNMENT = 256;
+
+    uint64_t GetScratchSize(nri::AccelerationStructure& accelerationStructure) const {
+        return helper::Align(m_RT->GetAccelerationStructureBuildScratchBufferSize(accelerationStructure), SCRATCH_ALIGNMENT);
+    }
+
+    static bool AllowsCompaction(nri::AccelerationStructureBuildBits flags) {
+        return ((uint32_t)flags & (uint32_t)nri::AccelerationStructureBuildBits::ALLOW_COMPACTION) != 0;
+    }
+
+    void RecordBuilds(nri::CommandBuffer& commandBuffer, bool querySizes) {
+        uint64_t largest = 0;
+        uint64_t bottomLevelSum = 0;
+        uint64_t topLevelSum = 0;
+
+        for (const BottomLevelBuild& build : m_BottomLevelBuilds) {
+            largest = std::max(largest, build.scratchSize);
+            bottomLevelSum += build.scratchSize;
+        }
+
+        for (const TopLevelBuild& build : m_TopLevelBuilds) {
+            largest = std::max(largest, build.scratchSize);
+            topLevelSum += build.scratchSize;
+        }
+
+        const uint64_t scratchSize = std::max(largest, std::min(std::max(bottomLevelSum, topLevelSum), m_ScratchBudget));
+        if (scratchSize > m_Stats.scratchSize)
+            CreateScratch(scratchSize);
+
+        // Builds recorded earlier may still use the scratch buffer, and ray tracing may still read rebuilt structures
+        if (m_Stats.bottomLevelNum + m_Stats.topLevelNum) {
+            nri::GlobalBarrierDesc globalBarrier = {};
+            globalBarrier.before = {nri::AccessBits::ACCELERATION_STRUCTURE_READ | nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::ACCELERATION_STRUCTURE | nri::StageBits::RAY_TRACING_SHADERS};
+            globalBarrier.after = {nri::AccessBits::ACCELERATION_STRUCTURE_READ | nri::AccessBits::ACCELERATION_STRUCTURE_WRITE, nri::StageBits::ACCELERATION_STRUCTURE};
+
+            Barrier(commandBuffer, globalBarrier);
+        }
+
+        uint64_t scratchOffset = 0;
+
+        for (const BottomLevelBuild& build : m_BottomLevelBuilds) {
+            if (scratchOffset + build.scratchSize > m_Stats.scratchSize) {
+                Barrier(commandBuffer, BUILD_BARRIER);
+                scratchOffset = 0;
+            }
+
+            m_RT->CmdBuildBottomLevelAccelerationStructure(commandBuffer, build.objectNum, m_GeometryObjects.data() + build.objectOffset, build.flags, *build.accelerationStructure, *m_ScratchBuffer, scratchOffset);
+            scratchOffset += build.scratchSize;
+        }
+
+        // TLAS builds read the BLAS, and the scratch buffer starts over
+        if (!m_BottomLevelBuilds.empty() && !m_TopLevelBuilds.empty()) {
+            Barrier(commandBuffer, BUILD_BARRIER);
+            scratchOffset = 0;
+        }
+
+        for (const TopLevelBuild& build : m_TopLevelBuilds) {
+            if (scratchOffset + build.scratchSize > m_Stats.scratchSize) {
+                Barrier(commandBuffer, BUILD_BARRIER);
+                scratchOffset = 0;
+            }
+
+            if (build.isUpdate)
+                m_RT->CmdUpdateTopLevelAccelerationStructure(commandBuffer, build.instanceNum, *build.instanceBuffer, build.instanceOffset, build.flags, *build.accelerationStructure, *build.accelerationStructure, *m_ScratchBuffer, scratchOffset);
+            else
+                m_RT->CmdBuildTopLevelAccelerationStructure(commandBuffer, build.instanceNum, *build.instanceBuffer, build.instanceOffset, build.flags, *build.accelerationStructure, *m_ScratchBuffer, scratchOffset);
+
+            scratchOffset += build.scratchSize;
+        }
+
+        // Compacted sizes, the query pool and the readback buffer are free after the wait in "Flush"
+        if (querySizes) {
+            m_QueriedStructures.clear();
+
+            for (const BottomLevelBuild& build : m_BottomLevelBuilds) {
+                if (AllowsCompaction(build.flags))
+                    m_QueriedStructures.push_back(build.accelerationStructure);
+            }
+
+            for (const TopLevelBuild& build : m_TopLevelBuilds) {
+                if (AllowsCompaction(build.flags))
+                    m_QueriedStructures.push_back(build.accelerationStructure);
+            }
+
+            if (!m_QueriedStructures.empty()) {
+                const uint32_t queryNum = (uint32_t)m_QueriedStructures.size();
+                if (queryNum > m_QueryCapacity)
+                    CreateQueries(queryNum);
+
+                Barrier(commandBuffer, BUILD_BARRIER);
+
+                m_NRI->CmdResetQueries(commandBuffer, *m_QueryPool, 0, queryNum);
+                m_RT->CmdWriteAccelerationStructureSize(commandBuffer, m_QueriedStructures.data(), queryNum, *m_QueryPool, 0);
+                m_NRI->CmdCopyQueries(commandBuffer, *m_QueryPool, 0, queryNum, *m_ReadbackBuffer, 0);
+            }
+        }
+
+        Barrier(commandBuffer, FINAL_BARRIER);
+
+        m_Stats.bottomLevelNum += (uint32_t)m_BottomLevelBuilds.size();
+        m_Stats.topLevelNum += (uint32_t)m_TopLevelBuilds.size();
+
+        m_BottomLevelBuilds.clear();
+        m_TopLevelBuilds.clear();
+        m_GeometryObjects.clear();
+    }
+
+    void Barrier(nri::CommandBuffer& commandBuffer, const nri::GlobalBarrierDesc& globalBarrier) {
+        nri::BarrierGroupDesc barrierGroupDesc = {};
+        barrierGroupDesc.globalNum = 1;
+        barrierGroupDesc.globals = &globalBarrier;
+
+        m_NRI->CmdBarrier(commandBuffer, barrierGroupDesc);
+        m_Stats.barrierNum++;
+    }
+
+    void CreateScratch(uint64_t size) {
+        if (m_DeletionQueue && m_ScratchBuffer) {
+            nri::Buffer* scratchBuffer = m_ScratchBuffer;
+            const MemoryAllocator::Allocation scratchAllocation = m_ScratchAllocation;
+            MemoryAllocator* memoryAllocator = m_MemoryAllocator;
+
+            m_DeletionQueue->Push(*scratchBuffer);
+            m_DeletionQueue->Push([memoryAllocator, scratchAllocation]() { memoryAllocator->Free(scratchAllocation); });
+
+            m_ScratchBuffer = nullptr;
+        } else
+            DestroyScratch();
+
+        const nri::BufferDesc bufferDesc = {size, 0, nri::BufferUsageBits::RAY_TRACING_BUFFER};
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateBuffer(*m_Device, bufferDesc, m_ScratchBuffer));
+
+        nri::MemoryDesc memoryDesc = {};
+        m_NRI->GetBufferMemoryDesc(*m_Device, bufferDesc, nri::MemoryLocation::DEVICE, memoryDesc);
+
+        m_ScratchAllocation = m_MemoryAllocator->Allocate(memoryDesc);
+
+        const nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {m_ScratchAllocation.memory, m_ScratchBuffer, m_ScratchAllocation.offset};
+        NRI_ABORT_ON_FAILURE(m_NRI->BindBufferMemory(*m_Device, &bufferMemoryBindingDesc, 1));
+
+        m_Stats.scratchSize = size;
+    }
+
+    void CreateQueries(uint32_t capacity) {
+        DestroyQueries();
+
+        nri::QueryPoolDesc queryPoolDesc = {};
+        queryPoolDesc.queryType = nri::QueryType::ACCELERATION_STRUCTURE_COMPACTED_SIZE;
+        queryPoolDesc.capacity = capacity;
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateQueryPool(*m_Device, queryPoolDesc, m_QueryPool));
+
+        const nri::BufferDesc bufferDesc = {capacity * sizeof(uint64_t), 0, nri::BufferUsageBits::NONE};
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateBuffer(*m_Device, bufferDesc, m_ReadbackBuffer));
+
+        nri::MemoryDesc memoryDesc = {};
+        m_NRI->GetBufferMemoryDesc(*m_Device, bufferDesc, nri::MemoryLocation::HOST_READBACK, memoryDesc);
+
+        m_ReadbackAllocation = m_MemoryAllocator->Allocate(memoryDesc);
+
+        const nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {m_ReadbackAllocation.memory, m_ReadbackBuffer, m_ReadbackAllocation.offset};
+        NRI_ABORT_ON_FAILURE(m_NRI->BindBufferMemory(*m_Device, &bufferMemoryBindingDesc, 1));
+
+        m_QueryCapacity = capacity;
+    }
+
+    void DestroyQueries() {
+        if (!m_QueryPool)
+            return;
+
+        m_NRI->DestroyQueryPool(*m_QueryPool);
+        m_NRI->DestroyBuffer(*m_ReadbackBuffer);
+        m_MemoryAllocator->Free(m_ReadbackAllocation);
+
+        m_QueryPool = nullptr;
+        m_ReadbackBuffer = nullptr;
+        m_QueryCapacity = 0;
+    }
+
+    void DestroyScratch() {
+        if (!m_ScratchBuffer)
+            return;
+
+        m_NRI->DestroyBuffer(*m_ScratchBuffer);
+        m_MemoryAllocator->Free(m_ScratchAllocation);
+
+        m_ScratchBuffer = nullptr;
+        m_Stats.scratchSize = 0;
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    const nri::RayTracingInterface* m_RT = nullptr;
+    nri::Device* m_Device = nullptr;
+    nri::CommandQueue* m_CommandQueue = nullptr;
+    MemoryAllocator* m_MemoryAllocator = nullptr;
+    DeletionQueue* m_DeletionQueue = nullptr;
+    nri::Fence* m_Fence = nullptr;
+    nri::CommandAllocator* m_CommandAllocator = nullptr;
+    nri::CommandBuffer* m_CommandBuffer = nullptr;
+    nri::Buffer* m_ScratchBuffer = nullptr;
+    MemoryAllocator::Allocation m_ScratchAllocation = {};
+    nri::QueryPool* m_QueryPool = nullptr;
+    nri::Buffer* m_ReadbackBuffer = nullptr;
+    MemoryAllocator::Allocation m_ReadbackAllocation = {};
+    std::vector<BottomLevelBuild> m_BottomLevelBuilds;
+    std::vector<TopLevelBuild> m_TopLevelBuilds;
+    std::vector<nri::GeometryObject> m_GeometryObjects;
+    std::vector<const nri::AccelerationStructure*> m_QueriedStructures;
+    std::vector<Compaction> m_Compactions;
+    uint64_t m_ScratchBudget = 0;
+    uint64_t m_FenceValue = 0;
+    uint32_t m_QueryCapacity = 0;
+    Stats m_Stats = {};
+};
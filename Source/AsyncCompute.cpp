@@ -2,9 +2,14 @@
 
 #include "NRIFramework.h"
 
+#include "DescriptorAllocator.h"
+#include "FrameGraph.h"
+#include "MemoryAllocator.h"
+
 #include <array>
 
 constexpr uint32_t VERTEX_NUM = 1000000 * 3;
+constexpr float TIMELINE_WIDTH = 400.0f;
 
 struct NRIInterface
     : public nri::CoreInterface,
@@ -12,13 +17,6 @@ struct NRIInterface
       public nri::StreamerInterface,
       public nri::SwapChainInterface {};
 
-struct Frame {
-    nri::CommandAllocator* commandAllocatorGraphics;
-    nri::CommandAllocator* commandAllocatorCompute;
-    std::array<nri::CommandBuffer*, 3> commandBufferGraphics;
-    nri::CommandBuffer* commandBufferCompute;
-};
-
 struct Vertex {
     float position[3];
 };
@@ -42,54 +40,56 @@ private:
     nri::CommandQueue* m_GraphicsQueue = nullptr;
     nri::CommandQueue* m_ComputeQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
-    nri::Fence* m_ComputeFence = nullptr;
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::PipelineLayout* m_GraphicsPipelineLayout = nullptr;
     nri::PipelineLayout* m_ComputePipelineLayout = nullptr;
+    nri::PipelineLayout* m_CompositePipelineLayout = nullptr;
     nri::Pipeline* m_GraphicsPipeline = nullptr;
     nri::Pipeline* m_ComputePipeline = nullptr;
+    nri::Pipeline* m_CompositePipeline = nullptr;
     nri::Buffer* m_GeometryBuffer = nullptr;
     nri::Texture* m_Texture = nullptr;
     nri::DescriptorSet* m_DescriptorSet = nullptr;
+    nri::DescriptorSet* m_CompositeDescriptorSet = nullptr;
     nri::Descriptor* m_Descriptor = nullptr;
+    nri::Descriptor* m_TextureView = nullptr;
 
-    std::array<Frame, BUFFERED_FRAME_MAX_NUM> m_Frames = {};
     std::vector<BackBuffer> m_SwapChainBuffers;
-    std::vector<nri::Memory*> m_MemoryAllocations;
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
+    FrameGraph m_FrameGraph;
 
+    std::array<double, 2> m_GpuTimes = {}; // cache off, on
+    double m_OverlapEfficiency = 0.0;
     bool m_IsAsyncMode = true;
+    bool m_IsCacheEnabled = false;
+    bool m_IsDrawComposition = true;
 };
 
 Sample::~Sample() {
     NRI.WaitForIdle(*m_GraphicsQueue);
 
-    for (Frame& frame : m_Frames) {
-        for (size_t i = 0; i < frame.commandBufferGraphics.size(); i++)
-            NRI.DestroyCommandBuffer(*frame.commandBufferGraphics[i]);
-
-        NRI.DestroyCommandBuffer(*frame.commandBufferCompute);
-        NRI.DestroyCommandAllocator(*frame.commandAllocatorCompute);
-        NRI.DestroyCommandAllocator(*frame.commandAllocatorGraphics);
-    }
+    m_FrameGraph.Release(*m_Texture);
+    m_FrameGraph.Destroy();
 
     for (uint32_t i = 0; i < m_SwapChainBuffers.size(); i++)
         NRI.DestroyDescriptor(*m_SwapChainBuffers[i].colorAttachment);
 
     NRI.DestroyDescriptor(*m_Descriptor);
+    NRI.DestroyDescriptor(*m_TextureView);
     NRI.DestroyTexture(*m_Texture);
     NRI.DestroyBuffer(*m_GeometryBuffer);
     NRI.DestroyPipeline(*m_GraphicsPipeline);
     NRI.DestroyPipeline(*m_ComputePipeline);
+    NRI.DestroyPipeline(*m_CompositePipeline);
     NRI.DestroyPipelineLayout(*m_GraphicsPipelineLayout);
     NRI.DestroyPipelineLayout(*m_ComputePipelineLayout);
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
-    NRI.DestroyFence(*m_ComputeFence);
+    NRI.DestroyPipelineLayout(*m_CompositePipelineLayout);
+    m_DescriptorAllocator.Destroy();
     NRI.DestroyFence(*m_FrameFence);
     NRI.DestroySwapChain(*m_SwapChain);
     NRI.DestroyStreamer(*m_Streamer);
 
-    for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
-        NRI.FreeMemory(*m_MemoryAllocations[i]);
+    m_MemoryAllocator.Destroy();
 
     DestroyUI(NRI);
 
@@ -128,6 +128,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     streamerDesc.frameInFlightNum = BUFFERED_FRAME_MAX_NUM;
     NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
+    // Memory allocator
+    m_MemoryAllocator.Create(NRI, *m_Device);
+
+    // Descriptor allocator
+    m_DescriptorAllocator.Create(NRI, *m_Device);
+
     // Command queue
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_GraphicsQueue));
     NRI.SetCommandQueueDebugName(*m_GraphicsQueue, "GraphicsQueue");
@@ -139,9 +145,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     }
 
     // Fences
-    NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_ComputeFence));
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
+    // Frame graph, owns command buffers and cross-queue fences
+    m_FrameGraph.Create(NRI, *m_Device, *m_GraphicsQueue, deviceDesc.isComputeQueueSupported ? m_ComputeQueue : nullptr);
+    m_FrameGraph.EnableTimestamps(*m_Device, m_MemoryAllocator, 4);
+
     // Swap chain
     nri::Format swapChainFormat;
     {
@@ -170,18 +179,6 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         }
     }
 
-    // Buffered resources
-    for (Frame& frame : m_Frames) {
-        NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_GraphicsQueue, frame.commandAllocatorGraphics));
-        for (size_t i = 0; i < frame.commandBufferGraphics.size(); i++)
-            NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*frame.commandAllocatorGraphics, frame.commandBufferGraphics[i]));
-
-        if (deviceDesc.isComputeQueueSupported) {
-            NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_ComputeQueue, frame.commandAllocatorCompute));
-            NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*frame.commandAllocatorCompute, frame.commandBufferCompute));
-        }
-    }
-
     utils::ShaderCodeStorage shaderCodeStorage;
     { // Graphics pipeline
         nri::PipelineLayoutDesc pipelineLayoutDesc = {};
@@ -249,6 +246,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
         pipelineLayoutDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
         NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_ComputePipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_ComputePipelineLayout, pipelineLayoutDesc);
 
         nri::ComputePipelineDesc computePipelineDesc = {};
         computePipelineDesc.pipelineLayout = m_ComputePipelineLayout;
@@ -256,9 +254,52 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_ComputePipeline));
     }
 
+    { // Composite pipeline (vertices come from "SV_VertexID")
+        nri::DescriptorRangeDesc descriptorRangeTexture = {0, 1, nri::DescriptorType::TEXTURE, nri::StageBits::FRAGMENT_SHADER};
+
+        nri::DescriptorSetDesc descriptorSetDesc = {0, &descriptorRangeTexture, 1};
+
+        nri::PipelineLayoutDesc pipelineLayoutDesc = {};
+        pipelineLayoutDesc.descriptorSetNum = 1;
+        pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
+        pipelineLayoutDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
+        NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_CompositePipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_CompositePipelineLayout, pipelineLayoutDesc);
+
+        nri::InputAssemblyDesc inputAssemblyDesc = {};
+        inputAssemblyDesc.topology = nri::Topology::TRIANGLE_LIST;
+
+        nri::RasterizationDesc rasterizationDesc = {};
+        rasterizationDesc.viewportNum = 1;
+        rasterizationDesc.fillMode = nri::FillMode::SOLID;
+        rasterizationDesc.cullMode = nri::CullMode::NONE;
+
+        nri::ColorAttachmentDesc colorAttachmentDesc = {};
+        colorAttachmentDesc.format = swapChainFormat;
+        colorAttachmentDesc.colorWriteMask = nri::ColorWriteBits::RGBA;
+
+        nri::OutputMergerDesc outputMergerDesc = {};
+        outputMergerDesc.colorNum = 1;
+        outputMergerDesc.color = &colorAttachmentDesc;
+
+        nri::ShaderDesc shaderStages[] = {
+            utils::LoadShader(deviceDesc.graphicsAPI, "Composite.vs", shaderCodeStorage),
+            utils::LoadShader(deviceDesc.graphicsAPI, "Composite.fs", shaderCodeStorage),
+        };
+
+        nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
+        graphicsPipelineDesc.pipelineLayout = m_CompositePipelineLayout;
+        graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
+        graphicsPipelineDesc.rasterization = rasterizationDesc;
+        graphicsPipelineDesc.outputMerger = outputMergerDesc;
+        graphicsPipelineDesc.shaders = shaderStages;
+        graphicsPipelineDesc.shaderNum = helper::GetCountOf(shaderStages);
+        NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_CompositePipeline));
+    }
+
     { // Storage texture
         nri::TextureDesc textureDesc = nri::Texture2D(swapChainFormat, (uint16_t)GetWindowResolution().x / 2, (uint16_t)GetWindowResolution().y, 1, 1,
-            nri::TextureUsageBits::SHADER_RESOURCE_STORAGE);
+            nri::TextureUsageBits::SHADER_RESOURCE | nri::TextureUsageBits::SHADER_RESOURCE_STORAGE);
         NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, textureDesc, m_Texture));
     }
 
@@ -276,29 +317,30 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     resourceGroupDesc.textureNum = 1;
     resourceGroupDesc.textures = &m_Texture;
 
-    m_MemoryAllocations.resize(NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data()))
-
-    { // Descriptor pool
-        nri::DescriptorPoolDesc descriptorPoolDesc = {};
-        descriptorPoolDesc.descriptorSetMaxNum = 1;
-        descriptorPoolDesc.storageTextureMaxNum = 1;
-
-        NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
-    }
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     { // Storage descriptor
         nri::Texture2DViewDesc texture2DViewDesc = {m_Texture, nri::Texture2DViewType::SHADER_RESOURCE_STORAGE_2D, swapChainFormat};
 
         NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, m_Descriptor));
+
+        texture2DViewDesc.viewType = nri::Texture2DViewType::SHADER_RESOURCE_2D;
+        NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, m_TextureView));
     }
 
-    { // Descriptor set
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_ComputePipelineLayout, 0, &m_DescriptorSet, 1,
-            0));
+    { // Descriptor sets
+        m_DescriptorAllocator.Reserve(*m_ComputePipelineLayout, 0, 1);
+        m_DescriptorAllocator.Reserve(*m_CompositePipelineLayout, 0, 1);
+
+        m_DescriptorAllocator.Allocate(*m_ComputePipelineLayout, 0, &m_DescriptorSet, 1);
 
         nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDesc = {&m_Descriptor, 1, 0};
         NRI.UpdateDescriptorRanges(*m_DescriptorSet, 0, 1, &descriptorRangeUpdateDesc);
+
+        m_DescriptorAllocator.Allocate(*m_CompositePipelineLayout, 0, &m_CompositeDescriptorSet, 1);
+
+        descriptorRangeUpdateDesc = {&m_TextureView, 1, 0};
+        NRI.UpdateDescriptorRanges(*m_CompositeDescriptorSet, 0, 1, &descriptorRangeUpdateDesc);
     }
 
     Rng::Hash::Initialize(m_RngState, 567, 57);
@@ -348,195 +390,197 @@ void Sample::PrepareFrame(uint32_t) {
     {
         ImGui::Text("Left - graphics, Right - compute");
         ImGui::Checkbox("Use ASYNC compute", &m_IsAsyncMode);
+        ImGui::Checkbox("Cache compute output", &m_IsCacheEnabled);
+        ImGui::Checkbox("Composite with a draw", &m_IsDrawComposition);
+
+        const FrameGraph::Stats& stats = m_FrameGraph.GetStats();
+        ImGui::Text("Submits: %u, waits: %u, barriers: %u, skipped: %u", stats.submitNum, stats.waitNum, stats.barrierNum, stats.skippedPassNum);
+
+        // GPU timeline, a row per queue
+        const FrameGraph::Timeline& timeline = m_FrameGraph.GetTimeline();
+        ImGui::Separator();
+        if (!timeline.passes.empty()) {
+            double& gpuTime = m_GpuTimes[m_IsCacheEnabled ? 1 : 0];
+            gpuTime = gpuTime == 0.0 ? timeline.duration : gpuTime * 0.9 + timeline.duration * 0.1;
+        }
+
+        ImGui::Text("GPU time: %.2f ms (cache off), %.2f ms (cache on)", m_GpuTimes[0], m_GpuTimes[1]);
+        ImGui::Text("GPU timeline: %.2f ms", timeline.duration);
+        {
+            static const ImU32 colors[] = {IM_COL32(70, 130, 180, 255), IM_COL32(200, 120, 50, 255), IM_COL32(90, 160, 90, 255), IM_COL32(160, 90, 160, 255)};
+
+            const float rowHeight = ImGui::GetTextLineHeight() + 2.0f;
+            const float scale = TIMELINE_WIDTH / float(std::max(timeline.duration, 0.001));
+            const ImVec2 p = ImGui::GetCursorScreenPos();
+
+            ImDrawList* drawList = ImGui::GetWindowDrawList();
+            drawList->AddRectFilled(p, ImVec2(p.x + TIMELINE_WIDTH, p.y + rowHeight * 2.0f), IM_COL32(40, 40, 40, 255));
+
+            for (size_t i = 0; i < timeline.passes.size(); i++) {
+                const FrameGraph::PassTiming& pass = timeline.passes[i];
+                const float y = p.y + (pass.queue == nri::CommandQueueType::COMPUTE ? rowHeight : 0.0f);
+                const ImVec2 min = ImVec2(p.x + float(pass.begin) * scale, y);
+                const ImVec2 max = ImVec2(std::max(p.x + float(pass.end) * scale, min.x + 1.0f), y + rowHeight - 1.0f);
+
+                drawList->AddRectFilled(min, max, colors[i % helper::GetCountOf(colors)]);
+                if (ImGui::CalcTextSize(pass.name).x < max.x - min.x)
+                    drawList->AddText(ImVec2(min.x + 1.0f, min.y), IM_COL32_WHITE, pass.name);
+            }
+
+            ImGui::Dummy(ImVec2(TIMELINE_WIDTH, rowHeight * 2.0f));
+        }
+
+        // How much of the compute time is hidden behind graphics work
+        const double computeTime = timeline.busyTime[1];
+        const double efficiency = computeTime > 0.0 ? timeline.overlapTime / computeTime : 0.0;
+        m_OverlapEfficiency = m_OverlapEfficiency * 0.9 + efficiency * 0.1;
+
+        ImGui::Text("Graphics busy : %.2f ms", timeline.busyTime[0]);
+        ImGui::Text("Compute busy  : %.2f ms", computeTime);
+        ImGui::Text("Overlap       : %.2f ms (%.0f%% of compute hidden)", timeline.overlapTime, m_OverlapEfficiency * 100.0);
+        ImGui::TextDisabled("Overlap assumes both queues share the GPU clock (not calibrated)");
     }
     ImGui::End();
 
     EndUI(NRI, *m_Streamer);
     NRI.CopyStreamerUpdateRequests(*m_Streamer);
 
-    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
-    if (!deviceDesc.isComputeQueueSupported)
+    if (!m_FrameGraph.IsAsyncComputeAvailable())
         m_IsAsyncMode = false;
 }
 
 void Sample::RenderFrame(uint32_t frameIndex) {
     const uint32_t windowWidth = GetWindowResolution().x;
     const uint32_t windowHeight = GetWindowResolution().y;
-    const uint32_t bufferedFrameIndex = frameIndex % BUFFERED_FRAME_MAX_NUM;
-    const Frame& frame = m_Frames[bufferedFrameIndex];
-    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
-
-    nri::CommandAllocator& commandAllocatorGraphics = *frame.commandAllocatorGraphics;
-    nri::CommandAllocator& commandAllocatorCompute = *frame.commandAllocatorCompute;
 
-    if (frameIndex >= BUFFERED_FRAME_MAX_NUM) {
+    if (frameIndex >= BUFFERED_FRAME_MAX_NUM)
         NRI.Wait(*m_FrameFence, 1 + frameIndex - BUFFERED_FRAME_MAX_NUM);
-        NRI.ResetCommandAllocator(commandAllocatorGraphics);
 
-        if (deviceDesc.isComputeQueueSupported)
-            NRI.ResetCommandAllocator(commandAllocatorCompute);
-    }
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+    m_FrameGraph.BeginFrame(frameIndex);
 
     const uint32_t backBufferIndex = NRI.AcquireNextSwapChainTexture(*m_SwapChain);
     const BackBuffer& backBuffer = m_SwapChainBuffers[backBufferIndex];
 
-    nri::TextureBarrierDesc textureBarrierDescs[2] = {};
-
-    textureBarrierDescs[0].texture = backBuffer.texture;
-    textureBarrierDescs[0].after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
-    textureBarrierDescs[0].layerNum = 1;
-    textureBarrierDescs[0].mipNum = 1;
-
-    textureBarrierDescs[1].texture = m_Texture;
-    textureBarrierDescs[1].layerNum = 1;
-    textureBarrierDescs[1].mipNum = 1;
-
-    nri::BarrierGroupDesc barrierGroupDesc = {};
-    barrierGroupDesc.textures = textureBarrierDescs;
-
-    // Fill command buffer #0 (graphics or compute)
-    nri::CommandBuffer& commandBuffer0 = m_IsAsyncMode ? *frame.commandBufferCompute : *frame.commandBufferGraphics[0];
-    NRI.BeginCommandBuffer(commandBuffer0, m_DescriptorPool);
-    {
-        helper::Annotation annotation(NRI, commandBuffer0, "Compute");
-
-        const uint32_t nx = ((windowWidth / 2) + 15) / 16;
-        const uint32_t ny = (windowHeight + 15) / 16;
-
-        NRI.CmdSetPipelineLayout(commandBuffer0, *m_ComputePipelineLayout);
-        NRI.CmdSetPipeline(commandBuffer0, *m_ComputePipeline);
-        NRI.CmdSetDescriptorSet(commandBuffer0, 0, *m_DescriptorSet, nullptr);
-        NRI.CmdDispatch(commandBuffer0, {nx, ny, 1});
-    }
-    NRI.EndCommandBuffer(commandBuffer0);
-
-    // Fill command buffer #1 (graphics)
-    nri::CommandBuffer& commandBuffer1 = *frame.commandBufferGraphics[1];
-    NRI.BeginCommandBuffer(commandBuffer1, nullptr);
-    {
-        helper::Annotation annotation(NRI, commandBuffer1, "Graphics");
+    // Resources
+    const FrameGraph::Resource backBufferResource = m_FrameGraph.ImportTransientTexture(*backBuffer.texture, {nri::AccessBits::UNKNOWN, nri::Layout::PRESENT});
+    const FrameGraph::Resource textureResource = m_FrameGraph.ImportTexture(*m_Texture, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE});
 
-        barrierGroupDesc.textureNum = 1;
-        NRI.CmdBarrier(commandBuffer1, barrierGroupDesc);
+    // The surface depends only on pixel coordinates, it's recomputed only if the size changes
+    const uint32_t surfaceInputs[] = {windowWidth / 2, windowHeight};
+    const uint64_t surfaceCacheKey = m_IsCacheEnabled ? FrameGraph::Hash(surfaceInputs, sizeof(surfaceInputs)) : 0;
 
+    // Passes, the compute one goes to the COMPUTE queue in async mode
+    m_FrameGraph.AddPass("Compute", nri::CommandQueueType::COMPUTE,
+        {
+            FrameGraph::Write(textureResource, {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER}),
+        },
+        [&](nri::CommandBuffer& commandBuffer) {
+            const uint32_t nx = ((windowWidth / 2) + 15) / 16;
+            const uint32_t ny = (windowHeight + 15) / 16;
+
+            NRI.CmdSetPipelineLayout(commandBuffer, *m_ComputePipelineLayout);
+            NRI.CmdSetPipeline(commandBuffer, *m_ComputePipeline);
+            NRI.CmdSetDescriptorSet(commandBuffer, 0, *m_DescriptorSet, nullptr);
+            NRI.CmdDispatch(commandBuffer, {nx, ny, 1});
+        },
+        surfaceCacheKey);
+
+    // Graphics: triangles on the whole screen, the compute output on top of the right half, UI on top of everything
+    const auto render = [&](nri::CommandBuffer& commandBuffer, bool drawTriangles, bool drawComposite, bool drawUI) {
         nri::AttachmentsDesc attachmentsDesc = {};
         attachmentsDesc.colorNum = 1;
         attachmentsDesc.colors = &backBuffer.colorAttachment;
 
-        NRI.CmdBeginRendering(commandBuffer1, attachmentsDesc);
+        NRI.CmdBeginRendering(commandBuffer, attachmentsDesc);
         {
             const nri::Viewport viewport = {0.0f, 0.0f, (float)windowWidth, (float)windowHeight, 0.0f, 1.0f};
             const nri::Rect scissorRect = {0, 0, (nri::Dim_t)windowWidth, (nri::Dim_t)windowHeight};
-            NRI.CmdSetViewports(commandBuffer1, &viewport, 1);
-            NRI.CmdSetScissors(commandBuffer1, &scissorRect, 1);
-
-            nri::ClearDesc clearDesc = {};
-            clearDesc.colorAttachmentIndex = 0;
-            clearDesc.planes = nri::PlaneBits::COLOR;
-            NRI.CmdClearAttachments(commandBuffer1, &clearDesc, 1, nullptr, 0);
-
-            const uint64_t offset = 0;
-            NRI.CmdSetPipelineLayout(commandBuffer1, *m_GraphicsPipelineLayout);
-            NRI.CmdSetPipeline(commandBuffer1, *m_GraphicsPipeline);
-            NRI.CmdSetIndexBuffer(commandBuffer1, *m_GeometryBuffer, 0, nri::IndexType::UINT16);
-            NRI.CmdSetVertexBuffers(commandBuffer1, 0, 1, &m_GeometryBuffer, &offset);
-            NRI.CmdDraw(commandBuffer1, {VERTEX_NUM, 1, 0, 0});
-
-            RenderUI(NRI, NRI, *m_Streamer, commandBuffer1, 1.0f, true);
-        }
-        NRI.CmdEndRendering(commandBuffer1);
-    }
-    NRI.EndCommandBuffer(commandBuffer1);
-
-    // Fill command buffer #2 (graphics)
-    nri::CommandBuffer& commandBuffer2 = *frame.commandBufferGraphics[2];
-    NRI.BeginCommandBuffer(commandBuffer2, nullptr);
-    {
-        helper::Annotation annotation(NRI, commandBuffer2, "Composition");
-
-        // Resource transitions
-        textureBarrierDescs[0].before = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT};
-        textureBarrierDescs[0].after = {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY};
-
-        textureBarrierDescs[1].before = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER};
-        textureBarrierDescs[1].after = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY};
-
-        barrierGroupDesc.textureNum = 2;
-        NRI.CmdBarrier(commandBuffer2, barrierGroupDesc);
-
-        // Copy texture produced by compute to back buffer
-        nri::TextureRegionDesc dstRegion = {};
-        dstRegion.x = (uint16_t)windowWidth / 2;
-
-        nri::TextureRegionDesc srcRegion = {};
-        srcRegion.width = (uint16_t)windowWidth / 2;
-        srcRegion.height = (uint16_t)windowHeight;
-        srcRegion.depth = 1;
-
-        NRI.CmdCopyTexture(commandBuffer2, *backBuffer.texture, &dstRegion, *m_Texture, &srcRegion);
-
-        // Resource transitions
-        textureBarrierDescs[0].before = {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY};
-        textureBarrierDescs[0].after = {nri::AccessBits::UNKNOWN, nri::Layout::PRESENT};
-
-        textureBarrierDescs[1].before = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY};
-        textureBarrierDescs[1].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER};
 
-        barrierGroupDesc.textureNum = 2;
-        NRI.CmdBarrier(commandBuffer2, barrierGroupDesc);
-    }
-    NRI.EndCommandBuffer(commandBuffer2);
-
-    nri::CommandBuffer* commandBufferArray[3] = {&commandBuffer0, &commandBuffer1, &commandBuffer2};
-
-    // Submit work
-    if (m_IsAsyncMode) {
-        nri::FenceSubmitDesc computeFinishedFence = {};
-        computeFinishedFence.fence = m_ComputeFence;
-        computeFinishedFence.value = 1 + frameIndex;
-
-        { // Submit the Compute task into the COMPUTE queue
-            nri::FenceSubmitDesc waitFence = {};
-            waitFence.fence = m_FrameFence;
-            waitFence.value = frameIndex;
-
-            nri::QueueSubmitDesc computeTask = {};
-            computeTask.waitFences = &waitFence; // Wait for the previous frame completion before execution
-            computeTask.waitFenceNum = 1;
-            computeTask.commandBuffers = &commandBufferArray[0];
-            computeTask.commandBufferNum = 1;
-            computeTask.signalFences = &computeFinishedFence;
-            computeTask.signalFenceNum = 1;
-
-            NRI.QueueSubmit(*m_ComputeQueue, computeTask);
-        }
-
-        { // Submit the Graphics task into the GRAPHICS queue
-            nri::QueueSubmitDesc graphicsTask = {};
-            graphicsTask.commandBuffers = &commandBufferArray[1];
-            graphicsTask.commandBufferNum = 1;
-
-            NRI.QueueSubmit(*m_GraphicsQueue, graphicsTask);
-        }
-
-        { // Submit the Composition task into the GRAPHICS queue
-            nri::QueueSubmitDesc compositionTask = {};
-            compositionTask.waitFences = &computeFinishedFence; // Wait for the Compute task completion before execution
-            compositionTask.waitFenceNum = 1;
-            compositionTask.commandBuffers = &commandBufferArray[2];
-            compositionTask.commandBufferNum = 1;
-
-            NRI.QueueSubmit(*m_GraphicsQueue, compositionTask);
+            if (drawTriangles) {
+                NRI.CmdSetViewports(commandBuffer, &viewport, 1);
+                NRI.CmdSetScissors(commandBuffer, &scissorRect, 1);
+
+                nri::ClearDesc clearDesc = {};
+                clearDesc.colorAttachmentIndex = 0;
+                clearDesc.planes = nri::PlaneBits::COLOR;
+                NRI.CmdClearAttachments(commandBuffer, &clearDesc, 1, nullptr, 0);
+
+                const uint64_t offset = 0;
+                NRI.CmdSetPipelineLayout(commandBuffer, *m_GraphicsPipelineLayout);
+                NRI.CmdSetPipeline(commandBuffer, *m_GraphicsPipeline);
+                NRI.CmdSetIndexBuffer(commandBuffer, *m_GeometryBuffer, 0, nri::IndexType::UINT16);
+                NRI.CmdSetVertexBuffers(commandBuffer, 0, 1, &m_GeometryBuffer, &offset);
+                NRI.CmdDraw(commandBuffer, {VERTEX_NUM, 1, 0, 0});
+            }
+
+            // A texel per pixel, replaces the copy
+            if (drawComposite) {
+                const nri::Viewport compositeViewport = {float(windowWidth / 2), 0.0f, float(windowWidth / 2), (float)windowHeight, 0.0f, 1.0f};
+                const nri::Rect compositeRect = {(int16_t)(windowWidth / 2), 0, (nri::Dim_t)(windowWidth / 2), (nri::Dim_t)windowHeight};
+                NRI.CmdSetViewports(commandBuffer, &compositeViewport, 1);
+                NRI.CmdSetScissors(commandBuffer, &compositeRect, 1);
+
+                NRI.CmdSetPipelineLayout(commandBuffer, *m_CompositePipelineLayout);
+                NRI.CmdSetPipeline(commandBuffer, *m_CompositePipeline);
+                NRI.CmdSetDescriptorSet(commandBuffer, 0, *m_CompositeDescriptorSet, nullptr);
+                NRI.CmdDraw(commandBuffer, {3, 1, 0, 0});
+
+                NRI.CmdSetViewports(commandBuffer, &viewport, 1);
+                NRI.CmdSetScissors(commandBuffer, &scissorRect, 1);
+            }
+
+            if (drawUI)
+                RenderUI(NRI, NRI, *m_Streamer, commandBuffer, 1.0f, true);
         }
+        NRI.CmdEndRendering(commandBuffer);
+    };
+
+    const FrameGraph::Usage backBufferWrite = FrameGraph::Write(backBufferResource, {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT});
+    const FrameGraph::Usage textureRead = FrameGraph::Read(textureResource, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE, nri::StageBits::FRAGMENT_SHADER});
+
+    if (!m_IsDrawComposition) {
+        m_FrameGraph.AddPass("Graphics", nri::CommandQueueType::GRAPHICS, {backBufferWrite}, [&](nri::CommandBuffer& commandBuffer) {
+            render(commandBuffer, true, false, true);
+        });
+
+        m_FrameGraph.AddPass("Composition", nri::CommandQueueType::GRAPHICS,
+            {
+                FrameGraph::Read(textureResource, {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY}),
+                FrameGraph::Write(backBufferResource, {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY}),
+            },
+            [&](nri::CommandBuffer& commandBuffer) {
+                // Copy texture produced by compute to back buffer
+                nri::TextureRegionDesc dstRegion = {};
+                dstRegion.x = (uint16_t)windowWidth / 2;
+
+                nri::TextureRegionDesc srcRegion = {};
+                srcRegion.width = (uint16_t)windowWidth / 2;
+                srcRegion.height = (uint16_t)windowHeight;
+                srcRegion.depth = 1;
+
+                NRI.CmdCopyTexture(commandBuffer, *backBuffer.texture, &dstRegion, *m_Texture, &srcRegion);
+            });
+    } else if (m_IsAsyncMode) {
+        // Triangles don't wait for compute, the composite draw does. UI goes after it, so it's not covered
+        m_FrameGraph.AddPass("Graphics", nri::CommandQueueType::GRAPHICS, {backBufferWrite}, [&](nri::CommandBuffer& commandBuffer) {
+            render(commandBuffer, true, false, false);
+        });
+
+        m_FrameGraph.AddPass("Composition", nri::CommandQueueType::GRAPHICS, {textureRead, backBufferWrite}, [&](nri::CommandBuffer& commandBuffer) {
+            render(commandBuffer, false, true, true);
+        });
     } else {
-        // Submit all tasks to the GRAPHICS queue
-        nri::QueueSubmitDesc allTasks = {};
-        allTasks.commandBuffers = commandBufferArray;
-        allTasks.commandBufferNum = helper::GetCountOf(commandBufferArray);
-
-        NRI.QueueSubmit(*m_GraphicsQueue, allTasks);
+        // Same render pass
+        m_FrameGraph.AddPass("Graphics", nri::CommandQueueType::GRAPHICS, {textureRead, backBufferWrite}, [&](nri::CommandBuffer& commandBuffer) {
+            render(commandBuffer, true, true, true);
+        });
     }
 
+    // Submit work
+    const FrameGraph::Policy policy = m_IsAsyncMode ? FrameGraph::Policy::ASYNC_COMPUTE : FrameGraph::Policy::GRAPHICS_ONLY;
+    m_FrameGraph.Execute(policy, m_DescriptorAllocator.GetDescriptorPool());
+
     // Present
     NRI.QueuePresent(*m_SwapChain);
 
@@ -4,19 +4,20 @@
 #include "NRIFramework.h"
 
 #include "../Shaders/SceneViewerBindlessStructs.h"
+#include "ConstantAllocator.h"
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
 
 #include <array>
 
 constexpr uint32_t GLOBAL_DESCRIPTOR_SET = 0;
 constexpr uint32_t MATERIAL_DESCRIPTOR_SET = 1;
 constexpr float CLEAR_DEPTH = 0.0f;
-constexpr uint32_t TEXTURES_PER_MATERIAL = 4;
 constexpr uint32_t BUFFER_COUNT = 3;
+constexpr uint32_t CONSTANT_FRAME_SIZE = 64 * 1024;
 
 enum SceneBuffers {
-    // HOST_UPLOAD
-    CONSTANT_BUFFER,
-
     // READBACK
     READBACK_BUFFER,
 
@@ -41,7 +42,6 @@ struct NRIInterface
 struct Frame {
     nri::CommandAllocator* commandAllocator;
     nri::CommandBuffer* commandBuffer;
-    uint32_t globalConstantBufferViewOffsets;
 };
 
 class Sample : public SampleBase {
@@ -66,7 +66,6 @@ private:
     nri::SwapChain* m_SwapChain = nullptr;
     nri::CommandQueue* m_CommandQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     nri::PipelineLayout* m_ComputePipelineLayout = nullptr;
     nri::Descriptor* m_DepthAttachment = nullptr;
@@ -76,15 +75,20 @@ private:
     nri::Pipeline* m_Pipeline = nullptr;
     nri::Pipeline* m_ComputePipeline = nullptr;
 
+    ConstantAllocator m_ConstantAllocator;
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
     std::array<Frame, BUFFERED_FRAME_MAX_NUM> m_Frames = {};
     std::vector<BackBuffer> m_SwapChainBuffers;
     std::vector<nri::DescriptorSet*> m_DescriptorSets;
     std::vector<nri::Texture*> m_Textures;
     std::vector<nri::Buffer*> m_Buffers;
-    std::vector<nri::Memory*> m_MemoryAllocations;
     std::vector<nri::Descriptor*> m_Descriptors;
 
     bool m_UseGPUDrawGeneration = true;
+    UploadManager::Stats m_UploadStats = {};
+    uint64_t m_UploadRingSize = 0;
+    double m_UploadTime = 0.0;
     nri::Format m_DepthFormat = nri::Format::UNKNOWN;
 
     utils::Scene m_Scene;
@@ -113,16 +117,17 @@ Sample::~Sample() {
     for (size_t i = 0; i < m_Buffers.size(); i++)
         NRI.DestroyBuffer(*m_Buffers[i]);
 
-    for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
-        NRI.FreeMemory(*m_MemoryAllocations[i]);
+    m_MemoryAllocator.Destroy();
 
     NRI.DestroyPipeline(*m_Pipeline);
     NRI.DestroyPipeline(*m_ComputePipeline);
 
+    m_ConstantAllocator.Destroy();
+
     NRI.DestroyQueryPool(*m_QueryPool);
     NRI.DestroyPipelineLayout(*m_PipelineLayout);
     NRI.DestroyPipelineLayout(*m_ComputePipelineLayout);
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
+    m_DescriptorAllocator.Destroy();
     NRI.DestroyFence(*m_FrameFence);
     NRI.DestroySwapChain(*m_SwapChain);
     NRI.DestroyStreamer(*m_Streamer);
@@ -168,6 +173,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     streamerDesc.frameInFlightNum = BUFFERED_FRAME_MAX_NUM;
     NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
+    // Memory allocator
+    m_MemoryAllocator.Create(NRI, *m_Device);
+
+    // Descriptor allocator
+    m_DescriptorAllocator.Create(NRI, *m_Device);
+
     // Command queue
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_CommandQueue));
 
@@ -203,17 +214,18 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     utils::ShaderCodeStorage shaderCodeStorage;
     {
         {
-            nri::DescriptorRangeDesc globalDescriptorRange[3] = {};
-            globalDescriptorRange[0] = {0, 1, nri::DescriptorType::CONSTANT_BUFFER, nri::StageBits::ALL};
-            globalDescriptorRange[1] = {0, 1, nri::DescriptorType::SAMPLER, nri::StageBits::FRAGMENT_SHADER};
-            globalDescriptorRange[2] = {0, BUFFER_COUNT, nri::DescriptorType::STRUCTURED_BUFFER, nri::StageBits::ALL};
+            nri::DescriptorRangeDesc globalDescriptorRange[2] = {};
+            globalDescriptorRange[0] = {0, 1, nri::DescriptorType::SAMPLER, nri::StageBits::FRAGMENT_SHADER};
+            globalDescriptorRange[1] = {0, BUFFER_COUNT, nri::DescriptorType::STRUCTURED_BUFFER, nri::StageBits::ALL};
+
+            nri::DynamicConstantBufferDesc globalDynamicConstantBuffer = {0, nri::StageBits::ALL};
 
             // Bindless descriptors
             nri::DescriptorRangeDesc textureDescriptorRange[1] = {};
             textureDescriptorRange[0] = {0, 512, nri::DescriptorType::TEXTURE, nri::StageBits::FRAGMENT_SHADER, nri::DescriptorRangeBits::VARIABLE_SIZED_ARRAY | nri::DescriptorRangeBits::PARTIALLY_BOUND};
 
             nri::DescriptorSetDesc descriptorSetDescs[] = {
-                {0, globalDescriptorRange, helper::GetCountOf(globalDescriptorRange)},
+                {0, globalDescriptorRange, helper::GetCountOf(globalDescriptorRange), &globalDynamicConstantBuffer, 1},
                 {1, textureDescriptorRange, helper::GetCountOf(textureDescriptorRange), nullptr, 0},
             };
 
@@ -224,6 +236,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
             pipelineLayoutDesc.enableD3D12DrawParametersEmulation = true;
 
             NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+            m_DescriptorAllocator.AddPipelineLayout(*m_PipelineLayout, pipelineLayoutDesc);
         }
 
         {
@@ -248,6 +261,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
             pipelineLayoutDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
 
             NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_ComputePipelineLayout));
+            m_DescriptorAllocator.AddPipelineLayout(*m_ComputePipelineLayout, pipelineLayoutDesc);
         }
 
         nri::VertexStreamDesc vertexStreamDesc = {};
@@ -339,7 +353,6 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     m_Camera.Initialize(m_Scene.aabb.GetCenter(), m_Scene.aabb.vMin, false);
 
     const uint32_t textureNum = (uint32_t)m_Scene.textures.size();
-    const uint32_t materialNum = (uint32_t)m_Scene.materials.size();
 
     // Textures
     for (const utils::Texture* textureData : m_Scene.textures) {
@@ -359,20 +372,14 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         m_Textures.push_back(depthTexture);
     }
 
-    const uint32_t constantBufferSize = helper::Align((uint32_t)sizeof(GlobalConstants), deviceDesc.constantBufferOffsetAlignment);
+    m_ConstantAllocator.Create(NRI, *m_Device, CONSTANT_FRAME_SIZE, BUFFERED_FRAME_MAX_NUM, sizeof(GlobalConstants));
 
     { // Buffers
-        // CONSTANT_BUFFER
-        nri::BufferDesc bufferDesc = {};
-        bufferDesc.size = constantBufferSize * BUFFERED_FRAME_MAX_NUM;
-        bufferDesc.usageMask = nri::BufferUsageBits::CONSTANT_BUFFER;
-        nri::Buffer* buffer;
-        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
-        m_Buffers.push_back(buffer);
-
         // READBACK_BUFFER
+        nri::BufferDesc bufferDesc = {};
         bufferDesc.size = sizeof(nri::PipelineStatisticsDesc) * BUFFERED_FRAME_MAX_NUM;
         bufferDesc.usageMask = nri::BufferUsageBits::NONE;
+        nri::Buffer* buffer;
         NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
         m_Buffers.push_back(buffer);
 
@@ -425,37 +432,23 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
 
     { // Memory
         nri::ResourceGroupDesc resourceGroupDesc = {};
-        resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
-        resourceGroupDesc.bufferNum = 1;
-        resourceGroupDesc.buffers = &m_Buffers[CONSTANT_BUFFER];
-
-        size_t baseAllocation = m_MemoryAllocations.size();
-        m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
-
         resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_READBACK;
         resourceGroupDesc.bufferNum = 1;
         resourceGroupDesc.buffers = &m_Buffers[READBACK_BUFFER];
 
-        baseAllocation = m_MemoryAllocations.size();
-        m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+        m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
         resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
-        resourceGroupDesc.bufferNum = (uint32_t)SceneBuffers::MAX_NUM - 2;
+        resourceGroupDesc.bufferNum = (uint32_t)SceneBuffers::MAX_NUM - INDEX_BUFFER;
         resourceGroupDesc.buffers = &m_Buffers[INDEX_BUFFER];
         resourceGroupDesc.textureNum = (uint32_t)m_Textures.size();
         resourceGroupDesc.textures = m_Textures.data();
 
-        baseAllocation = m_MemoryAllocations.size();
-        uint32_t allocationNum = NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc);
-        m_MemoryAllocations.resize(baseAllocation + allocationNum, nullptr);
-        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+        m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
     }
 
     // Create descriptors
     nri::Descriptor* anisotropicSampler = nullptr;
-    nri::Descriptor* constantBufferViews[BUFFERED_FRAME_MAX_NUM] = {};
     nri::Descriptor* resourceViews[BUFFER_COUNT] = {};
     {
         // Material textures
@@ -515,17 +508,6 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
 
         bufferViewDesc.format = nri::Format::UNKNOWN;
 
-        // Constant buffer
-        for (uint32_t i = 0; i < BUFFERED_FRAME_MAX_NUM; i++) {
-            m_Frames[i].globalConstantBufferViewOffsets = i * constantBufferSize;
-            bufferViewDesc.buffer = m_Buffers[CONSTANT_BUFFER];
-            bufferViewDesc.viewType = nri::BufferViewType::CONSTANT;
-            bufferViewDesc.offset = i * constantBufferSize;
-            bufferViewDesc.size = constantBufferSize;
-            NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, constantBufferViews[i]));
-            m_Descriptors.push_back(constantBufferViews[i]);
-        }
-
         // Depth buffer
         nri::Texture2DViewDesc texture2DViewDesc = {depthTexture, nri::Texture2DViewType::DEPTH_STENCIL_ATTACHMENT, m_DepthFormat};
 
@@ -544,62 +526,48 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         }
     }
 
-#define TEST 100
+    { // Descriptor sets
+        m_DescriptorAllocator.Reserve(*m_PipelineLayout, GLOBAL_DESCRIPTOR_SET, 1);
+        m_DescriptorAllocator.Reserve(*m_PipelineLayout, MATERIAL_DESCRIPTOR_SET, 1, textureNum);
+        m_DescriptorAllocator.Reserve(*m_ComputePipelineLayout, 0, 1);
+
+        m_DescriptorSets.resize(3);
 
-    { // Descriptor pool
-        nri::DescriptorPoolDesc descriptorPoolDesc = {};
-        descriptorPoolDesc.descriptorSetMaxNum = materialNum + BUFFERED_FRAME_MAX_NUM + 2;
-        descriptorPoolDesc.textureMaxNum = materialNum * TEXTURES_PER_MATERIAL;
-        descriptorPoolDesc.samplerMaxNum = BUFFERED_FRAME_MAX_NUM;
-        descriptorPoolDesc.storageStructuredBufferMaxNum = 1 * 2 * TEST;
-        descriptorPoolDesc.storageBufferMaxNum = 1 * 2 * TEST;
-        descriptorPoolDesc.bufferMaxNum = 3 * 2 * TEST;
-        descriptorPoolDesc.structuredBufferMaxNum = 4 * 2 * TEST;
-        descriptorPoolDesc.constantBufferMaxNum = BUFFERED_FRAME_MAX_NUM;
+        // Global (constants are bound with a dynamic offset, so one set serves all frames)
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, GLOBAL_DESCRIPTOR_SET, &m_DescriptorSets[0], 1);
 
-        NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
-    }
+        nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs[2] = {};
+        descriptorRangeUpdateDescs[0].descriptorNum = 1;
+        descriptorRangeUpdateDescs[0].descriptors = &anisotropicSampler;
+        descriptorRangeUpdateDescs[1].descriptorNum = BUFFER_COUNT;
+        descriptorRangeUpdateDescs[1].descriptors = resourceViews;
 
-    { // Descriptor sets
-        m_DescriptorSets.resize(BUFFERED_FRAME_MAX_NUM + 2);
-
-        // Global
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, GLOBAL_DESCRIPTOR_SET,
-            &m_DescriptorSets[0], BUFFERED_FRAME_MAX_NUM, 0));
-
-        for (uint32_t i = 0; i < BUFFERED_FRAME_MAX_NUM; i++) {
-            nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs[3] = {};
-            descriptorRangeUpdateDescs[0].descriptorNum = 1;
-            descriptorRangeUpdateDescs[0].descriptors = &constantBufferViews[i];
-            descriptorRangeUpdateDescs[1].descriptorNum = 1;
-            descriptorRangeUpdateDescs[1].descriptors = &anisotropicSampler;
-            descriptorRangeUpdateDescs[2].descriptorNum = BUFFER_COUNT;
-            descriptorRangeUpdateDescs[2].descriptors = resourceViews;
-
-            NRI.UpdateDescriptorRanges(*m_DescriptorSets[i], 0, helper::GetCountOf(descriptorRangeUpdateDescs), descriptorRangeUpdateDescs);
-        }
+        NRI.UpdateDescriptorRanges(*m_DescriptorSets[0], 0, helper::GetCountOf(descriptorRangeUpdateDescs), descriptorRangeUpdateDescs);
+
+        const nri::Descriptor* globalConstantBuffer = &m_ConstantAllocator.GetView();
+        NRI.UpdateDynamicConstantBuffers(*m_DescriptorSets[0], 0, 1, &globalConstantBuffer);
 
         // Material
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, MATERIAL_DESCRIPTOR_SET,
-            &m_DescriptorSets[BUFFERED_FRAME_MAX_NUM], 1, textureNum));
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, MATERIAL_DESCRIPTOR_SET, &m_DescriptorSets[1], 1, textureNum);
         nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDesc = {};
         descriptorRangeUpdateDesc.descriptorNum = textureNum;
         descriptorRangeUpdateDesc.descriptors = m_Descriptors.data();
-        NRI.UpdateDescriptorRanges(*m_DescriptorSets[BUFFERED_FRAME_MAX_NUM], 0, 1, &descriptorRangeUpdateDesc);
+        NRI.UpdateDescriptorRanges(*m_DescriptorSets[1], 0, 1, &descriptorRangeUpdateDesc);
 
         // Culling
         nri::Descriptor* storageDescriptors[2] = {m_IndirectBufferCountStorageAttachement, m_IndirectBufferStorageAttachement};
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_ComputePipelineLayout, 0, &m_DescriptorSets[BUFFERED_FRAME_MAX_NUM + 1], 1, 0));
+        m_DescriptorAllocator.Allocate(*m_ComputePipelineLayout, 0, &m_DescriptorSets[2], 1);
         nri::DescriptorRangeUpdateDesc rangeUpdateDescs[2] = {};
         rangeUpdateDescs[0].descriptorNum = helper::GetCountOf(rangeUpdateDescs);
         rangeUpdateDescs[0].descriptors = storageDescriptors;
         rangeUpdateDescs[1].descriptorNum = BUFFER_COUNT;
         rangeUpdateDescs[1].descriptors = resourceViews;
-        NRI.UpdateDescriptorRanges(*m_DescriptorSets[BUFFERED_FRAME_MAX_NUM + 1], 0, 2, rangeUpdateDescs);
+        NRI.UpdateDescriptorRanges(*m_DescriptorSets[2], 0, 2, rangeUpdateDescs);
     }
 
     { // Upload data
-        std::vector<nri::TextureUploadDesc> textureData(1 + textureNum);
+        const double uploadBegin = m_Timer.GetTimeStamp();
+
         std::vector<MaterialData> materialData(m_Scene.materials.size());
         std::vector<InstanceData> instanceData(m_Scene.instances.size());
         std::vector<MeshData> meshData(m_Scene.meshes.size());
@@ -636,48 +604,37 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
             data.vtxOffset = mesh.vertexOffset;
         }
 
-        uint32_t subresourceNum = 0;
-        for (uint32_t i = 0; i < textureNum; i++) {
-            const utils::Texture& texture = *m_Scene.textures[i];
-            subresourceNum += texture.GetArraySize() * texture.GetMipNum();
-        }
-
-        std::vector<nri::TextureSubresourceUploadDesc> subresources(subresourceNum);
-        ;
-        nri::TextureSubresourceUploadDesc* subresourceBegin = subresources.data();
+        UploadManager uploadManager;
+        uploadManager.Create(NRI, *m_Device, *m_CommandQueue);
 
-        textureData[0] = {};
-        textureData[0].subresources = nullptr;
-        textureData[0].texture = depthTexture;
-        textureData[0].after = {nri::AccessBits::DEPTH_STENCIL_ATTACHMENT_WRITE, nri::Layout::DEPTH_STENCIL_ATTACHMENT};
+        uploadManager.UploadTexture(*depthTexture, nullptr, {nri::AccessBits::DEPTH_STENCIL_ATTACHMENT_WRITE, nri::Layout::DEPTH_STENCIL_ATTACHMENT});
 
+        std::vector<nri::TextureSubresourceUploadDesc> subresources;
         for (uint32_t i = 0; i < textureNum; i++) {
             const utils::Texture& texture = *m_Scene.textures[i];
 
+            subresources.resize(texture.GetArraySize() * texture.GetMipNum());
             for (uint32_t slice = 0; slice < texture.GetArraySize(); slice++) {
                 for (uint32_t mip = 0; mip < texture.GetMipNum(); mip++)
-                    texture.GetSubresource(subresourceBegin[slice * texture.GetMipNum() + mip], mip, slice);
+                    texture.GetSubresource(subresources[slice * texture.GetMipNum() + mip], mip, slice);
             }
 
-            const uint32_t j = i + 1;
-            textureData[j] = {};
-            textureData[j].subresources = subresourceBegin;
-            textureData[j].texture = m_Textures[i];
-            textureData[j].after = {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE};
-
-            subresourceBegin += texture.GetArraySize() * texture.GetMipNum();
+            uploadManager.UploadTexture(*m_Textures[i], subresources.data(), {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE});
         }
 
-        nri::BufferUploadDesc bufferData[] = {
-            {nullptr, 0, m_Buffers[INDIRECT_BUFFER], 0, {nri::AccessBits::ARGUMENT_BUFFER, nri::StageBits::INDIRECT}},
-            {meshData.data(), meshData.size() * sizeof(MeshData), m_Buffers[MESH_BUFFER], 0, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::FRAGMENT_SHADER | nri::StageBits::COMPUTE_SHADER}},
-            {materialData.data(), materialData.size() * sizeof(MaterialData), m_Buffers[MATERIAL_BUFFER], 0, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::FRAGMENT_SHADER | nri::StageBits::COMPUTE_SHADER}},
-            {instanceData.data(), instanceData.size() * sizeof(InstanceData), m_Buffers[INSTANCE_BUFFER], 0, {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::FRAGMENT_SHADER | nri::StageBits::COMPUTE_SHADER}},
-            {m_Scene.vertices.data(), helper::GetByteSizeOf(m_Scene.vertices), m_Buffers[VERTEX_BUFFER], 0, {nri::AccessBits::VERTEX_BUFFER}},
-            {m_Scene.indices.data(), helper::GetByteSizeOf(m_Scene.indices), m_Buffers[INDEX_BUFFER], 0, {nri::AccessBits::INDEX_BUFFER}},
-        };
+        const nri::AccessStage shaderResource = {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::FRAGMENT_SHADER | nri::StageBits::COMPUTE_SHADER};
+        uploadManager.UploadBuffer(*m_Buffers[INDIRECT_BUFFER], 0, nullptr, 0, {nri::AccessBits::ARGUMENT_BUFFER, nri::StageBits::INDIRECT});
+        uploadManager.UploadBuffer(*m_Buffers[MESH_BUFFER], 0, meshData.data(), meshData.size() * sizeof(MeshData), shaderResource);
+        uploadManager.UploadBuffer(*m_Buffers[MATERIAL_BUFFER], 0, materialData.data(), materialData.size() * sizeof(MaterialData), shaderResource);
+        uploadManager.UploadBuffer(*m_Buffers[INSTANCE_BUFFER], 0, instanceData.data(), instanceData.size() * sizeof(InstanceData), shaderResource);
+        uploadManager.UploadBuffer(*m_Buffers[VERTEX_BUFFER], 0, m_Scene.vertices.data(), helper::GetByteSizeOf(m_Scene.vertices), {nri::AccessBits::VERTEX_BUFFER});
+        uploadManager.UploadBuffer(*m_Buffers[INDEX_BUFFER], 0, m_Scene.indices.data(), helper::GetByteSizeOf(m_Scene.indices), {nri::AccessBits::INDEX_BUFFER});
 
-        NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_CommandQueue, textureData.data(), (uint32_t)textureData.size(), bufferData, helper::GetCountOf(bufferData)));
+        uploadManager.Flush();
+
+        m_UploadStats = uploadManager.GetStats();
+        m_UploadRingSize = uploadManager.GetRingSize();
+        m_UploadTime = m_Timer.GetTimeStamp() - uploadBegin;
     }
 
     { // Pipeline statistics
@@ -711,6 +668,16 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
             ImGui::Text("Rasterizer output primitives : %llu", pipelineStats->rasterizerOutPrimitiveNum);
             ImGui::Text("Fragment shader invocations  : %llu", pipelineStats->fragmentShaderInvocationNum);
             ImGui::Checkbox("GPU draw call generation", &m_UseGPUDrawGeneration);
+
+            ImGui::Separator();
+            ImGui::Text("Upload                       : %.1f Mb in %.1f ms", m_UploadStats.uploadedBytes / (1024.0 * 1024.0), m_UploadTime);
+            ImGui::Text("Upload ring                  : %.1f Mb, %u submits, %u stalls", m_UploadRingSize / (1024.0 * 1024.0), m_UploadStats.submitNum, m_UploadStats.stallNum);
+
+            const MemoryAllocator::Stats memoryStats = m_MemoryAllocator.GetStats();
+            ImGui::Separator();
+            ImGui::Text("GPU memory                   : %.1f / %.1f Mb, %u allocations", memoryStats.usedBytes / (1024.0 * 1024.0), memoryStats.blockBytes / (1024.0 * 1024.0), memoryStats.allocationNum);
+            ImGui::Text("Memory blocks                : %u (+%u dedicated)", memoryStats.blockNum, memoryStats.dedicatedNum);
+            ImGui::Text("Fragmentation                : %.1f%%, %.1f Kb wasted", memoryStats.fragmentation * 100.0f, memoryStats.wastedBytes / 1024.0);
         }
         ImGui::End();
     }
@@ -740,22 +707,22 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.ResetCommandAllocator(*frame.commandAllocator);
     }
 
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+
     const uint32_t currentTextureIndex = NRI.AcquireNextSwapChainTexture(*m_SwapChain);
     BackBuffer& currentBackBuffer = m_SwapChainBuffers[currentTextureIndex];
 
     // Update constants
-    const uint64_t rangeOffset = m_Frames[bufferedFrameIndex].globalConstantBufferViewOffsets;
-    auto constants = (GlobalConstants*)NRI.MapBuffer(*m_Buffers[CONSTANT_BUFFER], rangeOffset, sizeof(GlobalConstants));
-    if (constants) {
-        constants->gWorldToClip = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
-        constants->gCameraPos = m_Camera.state.position;
+    m_ConstantAllocator.BeginFrame(bufferedFrameIndex);
 
-        NRI.UnmapBuffer(*m_Buffers[CONSTANT_BUFFER]);
-    }
+    uint32_t globalConstantsOffset = 0;
+    GlobalConstants* constants = m_ConstantAllocator.Allocate<GlobalConstants>(globalConstantsOffset);
+    constants->gWorldToClip = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
+    constants->gCameraPos = m_Camera.state.position;
 
     // Record
     nri::CommandBuffer& commandBuffer = *frame.commandBuffer;
-    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
     {
         helper::Annotation annotation(NRI, commandBuffer, "Scene");
 
@@ -790,7 +757,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
         if (m_UseGPUDrawGeneration) {
             NRI.CmdSetPipelineLayout(commandBuffer, *m_ComputePipelineLayout);
-            NRI.CmdSetDescriptorSet(commandBuffer, 0, *m_DescriptorSets[BUFFERED_FRAME_MAX_NUM + 1], nullptr);
+            NRI.CmdSetDescriptorSet(commandBuffer, 0, *m_DescriptorSets[2], nullptr);
 
             // Culling
             CullingConstants cullingConstants = {};
@@ -828,8 +795,8 @@ void Sample::RenderFrame(uint32_t frameIndex) {
                 NRI.CmdSetIndexBuffer(commandBuffer, *m_Buffers[INDEX_BUFFER], 0, sizeof(utils::Index) == 2 ? nri::IndexType::UINT16 : nri::IndexType::UINT32);
 
                 NRI.CmdSetPipelineLayout(commandBuffer, *m_PipelineLayout);
-                NRI.CmdSetDescriptorSet(commandBuffer, GLOBAL_DESCRIPTOR_SET, *m_DescriptorSets[bufferedFrameIndex], nullptr);
-                NRI.CmdSetDescriptorSet(commandBuffer, MATERIAL_DESCRIPTOR_SET, *m_DescriptorSets[BUFFERED_FRAME_MAX_NUM], nullptr);
+                NRI.CmdSetDescriptorSet(commandBuffer, GLOBAL_DESCRIPTOR_SET, *m_DescriptorSets[0], &globalConstantsOffset);
+                NRI.CmdSetDescriptorSet(commandBuffer, MATERIAL_DESCRIPTOR_SET, *m_DescriptorSets[1], nullptr);
                 NRI.CmdSetPipeline(commandBuffer, *m_Pipeline);
 
                 constexpr uint64_t offset = 0;
@@ -866,6 +833,8 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     }
     NRI.EndCommandBuffer(commandBuffer);
 
+    m_ConstantAllocator.EndFrame();
+
     { // Submit
         nri::QueueSubmitDesc queueSubmitDesc = {};
         queueSubmitDesc.commandBuffers = &frame.commandBuffer;
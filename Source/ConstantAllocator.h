@@ -0,0 +1,123 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+// Per-frame linear allocator for constants. The buffer is split into "frameNum" slots, each frame bump-allocates from
+// its own slot, which is safe to overwrite once the frame fence for this slot is reached. Constants are bound via a
+// dynamic constant buffer using the offset returned by "Allocate". D3D12 and Vulkan keep the buffer mapped for the whole
+// lifetime. D3D11 doesn't allow the GPU to use a mapped buffer, so there the slot is mapped in "BeginFrame" and unmapped
+// in "EndFrame"
+class ConstantAllocator {
+public:
+    ~ConstantAllocator() {
+        Destroy();
+    }
+
+    // Use with "UpdateDynamicConstantBuffers", the view covers "maxConstantSize" bytes at any returned offset
+    inline nri::Descriptor& GetView() const {
+        return *m_View;
+    }
+
+    inline uint64_t GetFrameUsage() const {
+        return m_Offset - m_FrameBegin;
+    }
+
+    void Create(const nri::CoreInterface& NRI, nri::Device& device, uint32_t frameSize, uint32_t frameNum, uint32_t maxConstantSize) {
+        m_NRI = &NRI;
+
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(device);
+        m_IsPersistentlyMapped = deviceDesc.graphicsAPI != nri::GraphicsAPI::D3D11;
+        m_Alignment = deviceDesc.constantBufferOffsetAlignment;
+        m_MaxConstantSize = helper::Align(maxConstantSize, m_Alignment);
+        m_FrameSize = helper::Align(std::max(frameSize, m_MaxConstantSize), m_Alignment);
+
+        nri::BufferDesc bufferDesc = {};
+        bufferDesc.size = uint64_t(m_FrameSize) * frameNum;
+        bufferDesc.usageMask = nri::BufferUsageBits::CONSTANT_BUFFER;
+        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(device, bufferDesc, m_Buffer));
+
+        nri::ResourceGroupDesc resourceGroupDesc = {};
+        resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+        resourceGroupDesc.bufferNum = 1;
+        resourceGroupDesc.buffers = &m_Buffer;
+
+        m_MemoryAllocations.resize(NRI.CalculateAllocationNumber(device, resourceGroupDesc), nullptr);
+        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(device, resourceGroupDesc, m_MemoryAllocations.data()));
+
+        nri::BufferViewDesc bufferViewDesc = {};
+        bufferViewDesc.buffer = m_Buffer;
+        bufferViewDesc.viewType = nri::BufferViewType::CONSTANT;
+        bufferViewDesc.size = m_MaxConstantSize;
+        NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, m_View));
+
+        if (m_IsPersistentlyMapped)
+            m_MappedBuffer = (uint8_t*)NRI.MapBuffer(*m_Buffer, 0, nri::WHOLE_SIZE);
+    }
+
+    void Destroy() {
+        if (!m_NRI)
+            return;
+
+        if (m_IsPersistentlyMapped)
+            m_NRI->UnmapBuffer(*m_Buffer);
+
+        m_NRI->DestroyDescriptor(*m_View);
+        m_NRI->DestroyBuffer(*m_Buffer);
+
+        for (nri::Memory* memory : m_MemoryAllocations)
+            m_NRI->FreeMemory(*memory);
+
+        m_MemoryAllocations.clear();
+        m_NRI = nullptr;
+    }
+
+    // The caller must have waited for the frame which used this slot last time
+    void BeginFrame(uint32_t bufferedFrameIndex) {
+        m_FrameBegin = uint64_t(bufferedFrameIndex) * m_FrameSize;
+        m_Offset = m_FrameBegin;
+
+        if (m_IsPersistentlyMapped)
+            m_Data = m_MappedBuffer + m_FrameBegin;
+        else
+            m_Data = (uint8_t*)m_NRI->MapBuffer(*m_Buffer, m_FrameBegin, m_FrameSize);
+    }
+
+    // Call after the last "Allocate" of the frame and before submitting
+    void EndFrame() {
+        if (!m_IsPersistentlyMapped)
+            m_NRI->UnmapBuffer(*m_Buffer);
+
+        m_Data = nullptr;
+    }
+
+    template <typename T>
+    inline T* Allocate(uint32_t& dynamicOffset) {
+        return (T*)Allocate(sizeof(T), dynamicOffset);
+    }
+
+    void* Allocate(uint32_t size, uint32_t& dynamicOffset) {
+        NRI_ABORT_ON_FALSE(size <= m_MaxConstantSize);
+        NRI_ABORT_ON_FALSE(m_Offset + m_MaxConstantSize <= m_FrameBegin + m_FrameSize); // the view must fit, not only the data
+
+        dynamicOffset = (uint32_t)m_Offset;
+        m_Offset += helper::Align(size, m_Alignment);
+
+        return m_Data + (dynamicOffset - m_FrameBegin);
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Buffer* m_Buffer = nullptr;
+    nri::Descriptor* m_View = nullptr;
+    uint8_t* m_MappedBuffer = nullptr;
+    uint8_t* m_Data = nullptr; // the current slot
+    std::vector<nri::Memory*> m_MemoryAllocations;
+    uint64_t m_FrameBegin = 0;
+    uint64_t m_Offset = 0;
+    uint32_t m_FrameSize = 0;
+    uint32_t m_MaxConstantSize = 0;
+    uint32_t m_Alignment = 1;
+    bool m_IsPersistentlyMapped = true;
+};
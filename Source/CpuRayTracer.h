@@ -0,0 +1,628 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include <smmintrin.h>
+
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+// CPU reference for the ray tracing samples, for machines without ray tracing hardware and for checking GPU output.
+// Every geometry gets a SAH BVH over its triangles, instances get another one over their world-space bounds. Instances
+// are the same "GeometryObjectInstance" entries the TLAS is built from, "instanceId" selects the geometry. Rays are
+// generated as in the samples' raygen shaders and traced as 2x2 packets, a ray per SSE lane. The image is split into
+// tiles, which are picked up by worker threads
+class CpuRayTracer {
+public:
+    static constexpr uint32_t INVALID_INDEX = uint32_t(-1);
+
+    struct Geometry {
+        const float* positions; // float3
+        const uint16_t* indices;
+        uint32_t triangleNum;
+    };
+
+    // What "closesthit" shaders get
+    struct Hit {
+        float t;
+        float barycentrics[2];
+        uint32_t instanceIndex; // "INVALID_INDEX" on miss
+        uint32_t instanceId;
+        uint32_t primitiveIndex;
+    };
+
+    // Returns a packed output pixel, called from worker threads
+    typedef std::function<uint32_t(const Hit& hit)> Shader;
+
+    struct View {
+        float origin[3];
+        float tMin;
+        float tMax;
+    };
+
+    struct Stats {
+        uint64_t rayNum;
+        double geometryBuildTime; // ms
+        double instanceBuildTime; // ms
+        double renderTime;        // ms
+        uint32_t threadNum;
+        uint32_t instanceNodeNum;
+    };
+
+    inline const Stats& GetStats() const {
+        return m_Stats;
+    }
+
+    // Rays per second per thread of the last "Render"
+    inline double GetRaysPerSecondPerCore() const {
+        return m_Stats.renderTime == 0.0 ? 0.0 : m_Stats.rayNum * 1000.0 / (m_Stats.renderTime * m_Stats.threadNum);
+    }
+
+    void SetGeometries(const Geometry* geometries, uint32_t geometryNum) {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        m_Geometries.resize(geometryNum);
+        for (uint32_t i = 0; i < geometryNum; i++) {
+            const Geometry& geometry = geometries[i];
+            GeometryData& geometryData = m_Geometries[i];
+
+            std::vector<Aabb> primBounds(geometry.triangleNum);
+            geometryData.triangles.resize(geometry.triangleNum);
+
+            for (uint32_t j = 0; j < geometry.triangleNum; j++) {
+                const float* v0 = geometry.positions + geometry.indices[j * 3] * 3;
+                const float* v1 = geometry.positions + geometry.indices[j * 3 + 1] * 3;
+                const float* v2 = geometry.positions + geometry.indices[j * 3 + 2] * 3;
+
+                Triangle& triangle = geometryData.triangles[j];
+                Aabb& bounds = primBounds[j];
+                bounds = EMPTY_AABB;
+
+                for (uint32_t k = 0; k < 3; k++) {
+                    triangle.v0[k] = v0[k];
+                    triangle.e1[k] = v1[k] - v0[k];
+                    triangle.e2[k] = v2[k] - v0[k];
+
+                    bounds.min[k] = std::min(std::min(v0[k], v1[k]), v2[k]);
+                    bounds.max[k] = std::max(std::max(v0[k], v1[k]), v2[k]);
+                }
+            }
+
+            BuildBvh(geometryData.bvh, primBounds);
+        }
+
+        m_Stats.geometryBuildTime = GetElapsedTime(start);
+    }
+
+    // Needs to be called again if instances move
+    void SetInstances(const nri::GeometryObjectInstance* instances, uint32_t instanceNum) {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<Aabb> primBounds(instanceNum);
+        m_Instances.resize(instanceNum);
+
+        for (uint32_t i = 0; i < instanceNum; i++) {
+            const nri::GeometryObjectInstance& instance = instances[i];
+            InstanceData& instanceData = m_Instances[i];
+
+            instanceData.instanceId = instance.instanceId;
+            instanceData.geometryIndex = instance.instanceId;
+            NRI_ABORT_ON_FALSE(instanceData.geometryIndex < m_Geometries.size());
+
+            Invert(instance.transform, instanceData.worldToObject);
+
+            // World bounds of the transformed corners of the geometry bounds
+            const Node& root = m_Geometries[instanceData.geometryIndex].bvh.nodes[0];
+            Aabb& bounds = primBounds[i];
+            bounds = EMPTY_AABB;
+
+            for (uint32_t corner = 0; corner < 8; corner++) {
+                const float p[3] = {
+                    (corner & 1) ? root.boundsMax[0] : root.boundsMin[0],
+                    (corner & 2) ? root.boundsMax[1] : root.boundsMin[1],
+                    (corner & 4) ? root.boundsMax[2] : root.boundsMin[2],
+                };
+
+                for (uint32_t k = 0; k < 3; k++) {
+                    const float w = instance.transform[k][0] * p[0] + instance.transform[k][1] * p[1] + instance.transform[k][2] * p[2] + instance.transform[k][3];
+                    bounds.min[k] = std::min(bounds.min[k], w);
+                    bounds.max[k] = std::max(bounds.max[k], w);
+                }
+            }
+        }
+
+        BuildBvh(m_InstanceBvh, primBounds);
+
+        m_Stats.instanceBuildTime = GetElapsedTime(start);
+        m_Stats.instanceNodeNum = (uint32_t)m_InstanceBvh.nodes.size();
+    }
+
+    // "threadNum = 0" means all cores
+    void Render(uint32_t* pixels, uint32_t width, uint32_t height, const View& view, const Shader& shader, uint32_t threadNum = 0) {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        if (threadNum == 0)
+            threadNum = std::max(std::thread::hardware_concurrency(), 1u);
+
+        const uint32_t tileNumX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        const uint32_t tileNumY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        const uint32_t tileNum = tileNumX * tileNumY;
+        threadNum = std::min(threadNum, tileNum);
+
+        std::atomic_uint32_t nextTile = 0;
+        auto worker = [&]() {
+            for (uint32_t tile = nextTile++; tile < tileNum; tile = nextTile++)
+                RenderTile(pixels, width, height, (tile % tileNumX) * TILE_SIZE, (tile / tileNumX) * TILE_SIZE, view, shader);
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < threadNum; i++)
+            threads.emplace_back(worker);
+
+        worker();
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        m_Stats.rayNum = uint64_t(width) * height;
+        m_Stats.renderTime = GetElapsedTime(start);
+        m_Stats.threadNum = threadNum;
+    }
+
+private:
+    static constexpr uint32_t TILE_SIZE = 16;
+    static constexpr uint32_t BIN_NUM = 16;
+    static constexpr uint32_t LEAF_SIZE_MAX = 8;
+    static constexpr uint32_t STACK_SIZE = 64;
+    static constexpr float TRAVERSAL_COST = 1.0f; // relative to a primitive test
+
+    struct Aabb {
+        float min[3];
+        float max[3];
+    };
+
+    static constexpr Aabb EMPTY_AABB = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+
+    struct Node {
+        float boundsMin[3];
+        uint32_t first; // left child (the right one follows it) or first primitive
+        float boundsMax[3];
+        uint16_t primNum; // 0 for inner nodes
+        uint16_t axis;
+    };
+
+    struct Bvh {
+        std::vector<Node> nodes;
+        std::vector<uint32_t> primIndices;
+    };
+
+    struct Triangle {
+        float v0[3];
+        float e1[3];
+        float e2[3];
+    };
+
+    struct GeometryData {
+        Bvh bvh;
+        std::vector<Triangle> triangles;
+    };
+
+    struct InstanceData {
+        float worldToObject[3][4];
+        uint32_t geometryIndex;
+        uint32_t instanceId;
+    };
+
+    struct Packet {
+        __m128 origin[3];
+        __m128 direction[3];
+        __m128 invDirection[3];
+        __m128 tMin;
+        uint32_t isNegative[3]; // direction signs of the first ray, for front-to-back traversal
+    };
+
+    struct PacketHit {
+        __m128 t;
+        __m128 u;
+        __m128 v;
+        __m128i instanceIndex;
+        __m128i primitiveIndex;
+    };
+
+    static double GetElapsedTime(std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    static float GetArea(const Aabb& aabb) {
+        const float dx = aabb.max[0] - aabb.min[0];
+        const float dy = aabb.max[1] - aabb.min[1];
+        const float dz = aabb.max[2] - aabb.min[2];
+
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    static void Grow(Aabb& dst, const Aabb& src) {
+        for (uint32_t k = 0; k < 3; k++) {
+            dst.min[k] = std::min(dst.min[k], src.min[k]);
+            dst.max[k] = std::max(dst.max[k], src.max[k]);
+        }
+    }
+
+    static void Invert(const float m[3][4], float r[3][4]) {
+        const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        const float invDet = 1.0f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+
+        r[0][0] = c00 * invDet;
+        r[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+        r[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+        r[1][0] = c01 * invDet;
+        r[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+        r[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+        r[2][0] = c02 * invDet;
+        r[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+        r[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+
+        for (uint32_t k = 0; k < 3; k++)
+            r[k][3] = -(r[k][0] * m[0][3] + r[k][1] * m[1][3] + r[k][2] * m[2][3]);
+    }
+
+    // Binned SAH, split along the centroid bounds
+    static void BuildBvh(Bvh& bvh, const std::vector<Aabb>& primBounds) {
+        const uint32_t primNum = (uint32_t)primBounds.size();
+
+        std::vector<float> centroids(primNum * 3);
+        for (uint32_t i = 0; i < primNum; i++) {
+            for (uint32_t k = 0; k < 3; k++)
+                centroids[i * 3 + k] = (primBounds[i].min[k] + primBounds[i].max[k]) * 0.5f;
+        }
+
+        bvh.primIndices.resize(primNum);
+        for (uint32_t i = 0; i < primNum; i++)
+            bvh.primIndices[i] = i;
+
+        bvh.nodes.clear();
+        bvh.nodes.reserve(std::max(primNum * 2, 1u));
+        bvh.nodes.push_back({{}, 0, {}, 0, 0});
+
+        struct Task {
+            uint32_t nodeIndex;
+            uint32_t first;
+            uint32_t num;
+        };
+
+        std::vector<Task> tasks = {{0, 0, primNum}};
+        while (!tasks.empty()) {
+            const Task task = tasks.back();
+            tasks.pop_back();
+
+            Aabb bounds = EMPTY_AABB;
+            Aabb centroidBounds = EMPTY_AABB;
+            for (uint32_t i = task.first; i < task.first + task.num; i++) {
+                const uint32_t prim = bvh.primIndices[i];
+                Grow(bounds, primBounds[prim]);
+
+                const float* c = &centroids[prim * 3];
+                Grow(centroidBounds, {{c[0], c[1], c[2]}, {c[0], c[1], c[2]}});
+            }
+
+            Node& node = bvh.nodes[task.nodeIndex];
+            memcpy(node.boundsMin, bounds.min, sizeof(node.boundsMin));
+            memcpy(node.boundsMax, bounds.max, sizeof(node.boundsMax));
+            node.first = task.first;
+            node.primNum = (uint16_t)task.num;
+            node.axis = 0;
+
+            if (task.num <= 1)
+                continue;
+
+            // Find the cheapest split
+            float bestCost = FLT_MAX;
+            uint32_t bestAxis = 0;
+            uint32_t bestBin = 0;
+
+            for (uint32_t axis = 0; axis < 3; axis++) {
+                const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                if (extent <= 0.0f)
+                    continue;
+
+                Aabb binBounds[BIN_NUM];
+                uint32_t binPrimNum[BIN_NUM] = {};
+                for (Aabb& binBound : binBounds)
+                    binBound = EMPTY_AABB;
+
+                const float scale = BIN_NUM / extent;
+                for (uint32_t i = task.first; i < task.first + task.num; i++) {
+                    const uint32_t prim = bvh.primIndices[i];
+                    const uint32_t bin = std::min(uint32_t((centroids[prim * 3 + axis] - centroidBounds.min[axis]) * scale), BIN_NUM - 1);
+
+                    Grow(binBounds[bin], primBounds[prim]);
+                    binPrimNum[bin]++;
+                }
+
+                // "rightCosts[i]" is for bins after "i"
+                float rightCosts[BIN_NUM] = {};
+                Aabb rightBounds = EMPTY_AABB;
+                uint32_t rightPrimNum = 0;
+                for (uint32_t bin = BIN_NUM - 1; bin > 0; bin--) {
+                    Grow(rightBounds, binBounds[bin]);
+                    rightPrimNum += binPrimNum[bin];
+                    rightCosts[bin - 1] = rightPrimNum ? GetArea(rightBounds) * rightPrimNum : 0.0f;
+                }
+
+                Aabb leftBounds = EMPTY_AABB;
+                uint32_t leftPrimNum = 0;
+                for (uint32_t bin = 0; bin < BIN_NUM - 1; bin++) {
+                    Grow(leftBounds, binBounds[bin]);
+                    leftPrimNum += binPrimNum[bin];
+
+                    if (leftPrimNum == 0 || leftPrimNum == task.num)
+                        continue;
+
+                    const float cost = GetArea(leftBounds) * leftPrimNum + rightCosts[bin];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = bin;
+                    }
+                }
+            }
+
+            const float area = GetArea(bounds);
+            const float leafCost = float(task.num);
+            const float splitCost = area > 0.0f ? TRAVERSAL_COST + bestCost / area : FLT_MAX;
+
+            uint32_t leftNum = 0;
+            if (bestCost != FLT_MAX && (splitCost < leafCost || task.num > LEAF_SIZE_MAX)) {
+                const float extent = centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis];
+                const float scale = BIN_NUM / extent;
+                const float minCentroid = centroidBounds.min[bestAxis];
+
+                uint32_t* begin = bvh.primIndices.data() + task.first;
+                uint32_t* middle = std::partition(begin, begin + task.num, [&](uint32_t prim) {
+                    return std::min(uint32_t((centroids[prim * 3 + bestAxis] - minCentroid) * scale), BIN_NUM - 1) <= bestBin;
+                });
+
+                leftNum = uint32_t(middle - begin);
+            } else if (task.num > LEAF_SIZE_MAX)
+                leftNum = task.num / 2; // coincident centroids, any split will do
+            else
+                continue;
+
+            const uint32_t leftIndex = (uint32_t)bvh.nodes.size();
+            bvh.nodes.push_back({});
+            bvh.nodes.push_back({});
+
+            Node& parent = bvh.nodes[task.nodeIndex];
+            parent.first = leftIndex;
+            parent.primNum = 0;
+            parent.axis = (uint16_t)bestAxis;
+
+            tasks.push_back({leftIndex, task.first, leftNum});
+            tasks.push_back({leftIndex + 1, task.first + leftNum, task.num - leftNum});
+        }
+    }
+
+    static void SetDirection(Packet& packet) {
+        // A tiny component instead of zero keeps slab distances finite
+        const __m128 epsilon = _mm_set1_ps(1e-20f);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+
+        for (uint32_t k = 0; k < 3; k++) {
+            __m128 d = packet.direction[k];
+            __m128 isTiny = _mm_cmplt_ps(_mm_andnot_ps(signMask, d), epsilon);
+            d = _mm_blendv_ps(d, _mm_or_ps(epsilon, _mm_and_ps(signMask, d)), isTiny);
+
+            packet.invDirection[k] = _mm_div_ps(_mm_set1_ps(1.0f), d);
+            packet.isNegative[k] = _mm_cvtss_f32(d) < 0.0f ? 1 : 0;
+        }
+    }
+
+    static int IntersectNode(const Node& node, const Packet& packet, __m128 tMax) {
+        __m128 tNear = packet.tMin;
+        __m128 tFar = tMax;
+
+        for (uint32_t k = 0; k < 3; k++) {
+            const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[k]), packet.origin[k]), packet.invDirection[k]);
+            const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[k]), packet.origin[k]), packet.invDirection[k]);
+
+            tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+            tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+        }
+
+        return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    }
+
+    // "leaf" is called for primitives of leaves hit by any ray, "hit.t" can shrink in between
+    template <typename Leaf>
+    static void Traverse(const Bvh& bvh, const Packet& packet, const PacketHit& hit, Leaf&& leaf) {
+        uint32_t stack[STACK_SIZE];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize) {
+            const Node& node = bvh.nodes[stack[--stackSize]];
+            if (!IntersectNode(node, packet, hit.t))
+                continue;
+
+            if (node.primNum) {
+                for (uint32_t i = node.first; i < node.first + node.primNum; i++)
+                    leaf(bvh.primIndices[i]);
+            } else {
+                NRI_ABORT_ON_FALSE(stackSize + 2 <= STACK_SIZE);
+
+                // Far child first, so the near one is popped next
+                const uint32_t isNegative = packet.isNegative[node.axis];
+                stack[stackSize++] = node.first + 1 - isNegative;
+                stack[stackSize++] = node.first + isNegative;
+            }
+        }
+    }
+
+    // Moller-Trumbore, "u" and "v" are weights of the 2nd and 3rd vertices as DXR barycentrics
+    static void IntersectTriangle(const Triangle& triangle, const Packet& packet, uint32_t instanceIndex, uint32_t primitiveIndex, PacketHit& hit) {
+        const __m128 e1[3] = {_mm_set1_ps(triangle.e1[0]), _mm_set1_ps(triangle.e1[1]), _mm_set1_ps(triangle.e1[2])};
+        const __m128 e2[3] = {_mm_set1_ps(triangle.e2[0]), _mm_set1_ps(triangle.e2[1]), _mm_set1_ps(triangle.e2[2])};
+        const __m128* d = packet.direction;
+
+        __m128 p[3];
+        Cross(d, e2, p);
+
+        const __m128 det = Dot(e1, p);
+        const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+        const __m128 s[3] = {
+            _mm_sub_ps(packet.origin[0], _mm_set1_ps(triangle.v0[0])),
+            _mm_sub_ps(packet.origin[1], _mm_set1_ps(triangle.v0[1])),
+            _mm_sub_ps(packet.origin[2], _mm_set1_ps(triangle.v0[2])),
+        };
+
+        const __m128 u = _mm_mul_ps(Dot(s, p), invDet);
+
+        __m128 q[3];
+        Cross(s, e1, q);
+
+        const __m128 v = _mm_mul_ps(Dot(d, q), invDet);
+        const __m128 t = _mm_mul_ps(Dot(e2, q), invDet);
+
+        const __m128 zero = _mm_setzero_ps();
+        __m128 mask = _mm_cmpneq_ps(det, zero);
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(t, packet.tMin));
+        mask = _mm_and_ps(mask, _mm_cmplt_ps(t, hit.t));
+
+        if (!_mm_movemask_ps(mask))
+            return;
+
+        const __m128i maski = _mm_castps_si128(mask);
+        hit.t = _mm_blendv_ps(hit.t, t, mask);
+        hit.u = _mm_blendv_ps(hit.u, u, mask);
+        hit.v = _mm_blendv_ps(hit.v, v, mask);
+        hit.instanceIndex = _mm_blendv_epi8(hit.instanceIndex, _mm_set1_epi32((int32_t)instanceIndex), maski);
+        hit.primitiveIndex = _mm_blendv_epi8(hit.primitiveIndex, _mm_set1_epi32((int32_t)primitiveIndex), maski);
+    }
+
+    static inline __m128 Dot(const __m128* a, const __m128* b) {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+    }
+
+    static inline void Cross(const __m128* a, const __m128* b, __m128* r) {
+        r[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+        r[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+        r[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+    }
+
+    void TracePacket(const Packet& packet, PacketHit& hit) const {
+        Traverse(m_InstanceBvh, packet, hit, [&](uint32_t instanceIndex) {
+            const InstanceData& instance = m_Instances[instanceIndex];
+            const GeometryData& geometry = m_Geometries[instance.geometryIndex];
+
+            // Object space rays keep the world space "t"
+            const float(*m)[4] = instance.worldToObject;
+
+            Packet local;
+            for (uint32_t k = 0; k < 3; k++) {
+                const __m128 m0 = _mm_set1_ps(m[k][0]);
+                const __m128 m1 = _mm_set1_ps(m[k][1]);
+                const __m128 m2 = _mm_set1_ps(m[k][2]);
+
+                local.origin[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, packet.origin[0]), _mm_mul_ps(m1, packet.origin[1])), _mm_add_ps(_mm_mul_ps(m2, packet.origin[2]), _mm_set1_ps(m[k][3])));
+                local.direction[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, packet.direction[0]), _mm_mul_ps(m1, packet.direction[1])), _mm_mul_ps(m2, packet.direction[2]));
+            }
+
+            local.tMin = packet.tMin;
+            SetDirection(local);
+
+            Traverse(geometry.bvh, local, hit, [&](uint32_t primitiveIndex) {
+                IntersectTriangle(geometry.triangles[primitiveIndex], local, instanceIndex, primitiveIndex, hit);
+            });
+        });
+    }
+
+    void RenderTile(uint32_t* pixels, uint32_t width, uint32_t height, uint32_t tileX, uint32_t tileY, const View& view, const Shader& shader) const {
+        const float aspectRatio = float(width) / float(height);
+        const uint32_t tileMaxX = std::min(tileX + TILE_SIZE, width);
+        const uint32_t tileMaxY = std::min(tileY + TILE_SIZE, height);
+
+        for (uint32_t y = tileY; y < tileMaxY; y += 2) {
+            for (uint32_t x = tileX; x < tileMaxX; x += 2) {
+                // Lanes: (x, y), (x + 1, y), (x, y + 1), (x + 1, y + 1). Rays outside of the image get "tMin = inf"
+                alignas(16) float dx[4], dy[4], dz[4], tMin[4];
+                for (uint32_t lane = 0; lane < 4; lane++) {
+                    const uint32_t px = x + (lane & 1);
+                    const uint32_t py = y + (lane >> 1);
+
+                    // As in raygen shaders
+                    const float ndcX = (float(px) + 0.5f) / float(width) * 2.0f - 1.0f;
+                    const float ndcY = (float(py) + 0.5f) / float(height) * 2.0f - 1.0f;
+                    const float invLength = 1.0f / sqrtf(ndcX * ndcX * aspectRatio * aspectRatio + ndcY * ndcY + 1.0f);
+
+                    dx[lane] = ndcX * aspectRatio * invLength;
+                    dy[lane] = -ndcY * invLength;
+                    dz[lane] = invLength;
+                    tMin[lane] = (px < width && py < height) ? view.tMin : INFINITY;
+                }
+
+                Packet packet;
+                packet.origin[0] = _mm_set1_ps(view.origin[0]);
+                packet.origin[1] = _mm_set1_ps(view.origin[1]);
+                packet.origin[2] = _mm_set1_ps(view.origin[2]);
+                packet.direction[0] = _mm_load_ps(dx);
+                packet.direction[1] = _mm_load_ps(dy);
+                packet.direction[2] = _mm_load_ps(dz);
+                packet.tMin = _mm_load_ps(tMin);
+                SetDirection(packet);
+
+                PacketHit hit;
+                hit.t = _mm_set1_ps(view.tMax);
+                hit.u = _mm_setzero_ps();
+                hit.v = _mm_setzero_ps();
+                hit.instanceIndex = _mm_set1_epi32((int32_t)INVALID_INDEX);
+                hit.primitiveIndex = _mm_set1_epi32((int32_t)INVALID_INDEX);
+
+                TracePacket(packet, hit);
+
+                alignas(16) float t[4], u[4], v[4];
+                alignas(16) uint32_t instanceIndices[4], primitiveIndices[4];
+                _mm_store_ps(t, hit.t);
+                _mm_store_ps(u, hit.u);
+                _mm_store_ps(v, hit.v);
+                _mm_store_si128((__m128i*)instanceIndices, hit.instanceIndex);
+                _mm_store_si128((__m128i*)primitiveIndices, hit.primitiveIndex);
+
+                for (uint32_t lane = 0; lane < 4; lane++) {
+                    const uint32_t px = x + (lane & 1);
+                    const uint32_t py = y + (lane >> 1);
+                    if (px >= width || py >= height)
+                        continue;
+
+                    const uint32_t instanceIndex = instanceIndices[lane];
+
+                    Hit laneHit = {};
+                    laneHit.t = t[lane];
+                    laneHit.barycentrics[0] = u[lane];
+                    laneHit.barycentrics[1] = v[lane];
+                    laneHit.instanceIndex = instanceIndex;
+                    laneHit.instanceId = instanceIndex == INVALID_INDEX ? 0 : m_Instances[instanceIndex].instanceId;
+                    laneHit.primitiveIndex = primitiveIndices[lane];
+
+                    pixels[py * width + px] = shader(laneHit);
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<GeometryData> m_Geometries;
+    std::vector<InstanceData> m_Instances;
+    Bvh m_InstanceBvh;
+    Stats m_Stats = {};
+};
@@ -0,0 +1,91 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include <deque>
+#include <functional>
+
+// Deferred destruction of GPU objects. A retired object is tagged with the fence value of the frame being recorded and
+// gets destroyed in "Update" once the fence passes this value, so replacing resources doesn't need "WaitForIdle"
+class DeletionQueue {
+public:
+    ~DeletionQueue() {
+        Destroy();
+    }
+
+    inline size_t GetPendingNum() const {
+        return m_Entries.size();
+    }
+
+    void Create(const nri::CoreInterface& NRI, nri::Fence& fence) {
+        m_NRI = &NRI;
+        m_Fence = &fence;
+        m_FenceValue = 1;
+    }
+
+    // The GPU must be idle
+    void Destroy() {
+        if (!m_NRI)
+            return;
+
+        for (Entry& entry : m_Entries)
+            entry.destroy();
+
+        m_Entries.clear();
+        m_NRI = nullptr;
+    }
+
+    // The value the fence gets signaled with at the end of the frame being recorded. Anything submitted before also
+    // completes by then, including one-time submits made outside of frames
+    inline void SetFenceValue(uint64_t fenceValue) {
+        m_FenceValue = fenceValue;
+    }
+
+    // Releases everything the GPU is done with
+    void Update() {
+        const uint64_t completedValue = m_NRI->GetFenceValue(*m_Fence);
+
+        while (!m_Entries.empty() && m_Entries.front().fenceValue <= completedValue) {
+            m_Entries.front().destroy();
+            m_Entries.pop_front();
+        }
+    }
+
+    // Objects pushed together are destroyed in the same order
+    void Push(std::function<void()>&& destroy) {
+        m_Entries.push_back({std::move(destroy), m_FenceValue});
+    }
+
+    void Push(nri::Descriptor& descriptor) {
+        Push([this, &descriptor]() { m_NRI->DestroyDescriptor(descriptor); });
+    }
+
+    void Push(nri::Buffer& buffer) {
+        Push([this, &buffer]() { m_NRI->DestroyBuffer(buffer); });
+    }
+
+    void Push(nri::Texture& texture) {
+        Push([this, &texture]() { m_NRI->DestroyTexture(texture); });
+    }
+
+    void Push(nri::CommandBuffer& commandBuffer) {
+        Push([this, &commandBuffer]() { m_NRI->DestroyCommandBuffer(commandBuffer); });
+    }
+
+    void Push(nri::CommandAllocator& commandAllocator) {
+        Push([this, &commandAllocator]() { m_NRI->DestroyCommandAllocator(commandAllocator); });
+    }
+
+private:
+    struct Entry {
+        std::function<void()> destroy;
+        uint64_t fenceValue;
+    };
+
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Fence* m_Fence = nullptr;
+    std::deque<Entry> m_Entries;
+    uint64_t m_FenceValue = 1;
+};
@@ -0,0 +1,334 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include <vector>
+
+// Descriptor set allocator sized from pipeline layouts. Register layouts with "AddPipelineLayout", declare what will be
+// allocated with "Reserve", and the first pool is created with exactly the reserved capacity on the first allocation.
+// Running out of space chains a new pool. Vulkan and D3D11 use sets from any pool, but D3D12 binds one pool at a time
+// ("BeginCommandBuffer" or "CmdSetDescriptorPool"). There "BeginFrame" replaces a chained persistent pool with a single
+// larger one and copies the live sets into it, rewriting the pointers filled by "Allocate": they must stay where they
+// are and must not be copied. Replaced pools are destroyed once no queued frame can use them. Transient sets come from
+// a per-frame pool ring, which gets reset in "BeginFrame". An overflowing ring slot chains too and gets merged into a
+// single larger pool the next time it's used, so it settles after a few frames
+class DescriptorAllocator {
+public:
+    ~DescriptorAllocator() {
+        Destroy();
+    }
+
+    // For "BeginCommandBuffer", the persistent pool or "nullptr" if nothing is allocated yet
+    inline nri::DescriptorPool* GetDescriptorPool() const {
+        NRI_ABORT_ON_FALSE(!m_IsSinglePoolBound || m_Persistent.pools.size() <= 1); // D3D12: allocated after "BeginFrame"
+
+        return m_Persistent.pools.empty() ? nullptr : m_Persistent.pools.front().pool;
+    }
+
+    // The pool of the latest transient set, on D3D12 bind it with "CmdSetDescriptorPool" before using the set
+    inline nri::DescriptorPool* GetTransientDescriptorPool() const {
+        const PoolChain& chain = m_Transient[m_FrameSlot];
+        return chain.pools.empty() ? nullptr : chain.pools.back().pool;
+    }
+
+    inline uint32_t GetPoolNum() const {
+        uint32_t poolNum = (uint32_t)m_Persistent.pools.size();
+        for (const PoolChain& chain : m_Transient)
+            poolNum += (uint32_t)chain.pools.size();
+
+        return poolNum;
+    }
+
+    // "queuedFrameNum" - the most frames in flight, "BeginFrame" relies on it
+    void Create(const nri::CoreInterface& NRI, nri::Device& device, uint32_t queuedFrameNum = BUFFERED_FRAME_MAX_NUM) {
+        m_NRI = &NRI;
+        m_Device = &device;
+        m_IsSinglePoolBound = NRI.GetDeviceDesc(device).graphicsAPI == nri::GraphicsAPI::D3D12;
+        m_Transient.resize(queuedFrameNum);
+    }
+
+    void Destroy() {
+        if (!m_NRI)
+            return;
+
+        DestroyPools(m_Persistent);
+        for (PoolChain& chain : m_Transient)
+            DestroyPools(chain);
+
+        for (const RetiredPool& retiredPool : m_RetiredPools)
+            m_NRI->DestroyDescriptorPool(*retiredPool.pool);
+
+        m_Transient.clear();
+        m_RetiredPools.clear();
+        m_LiveSets.clear();
+        m_SetLayouts.clear();
+        m_NRI = nullptr;
+    }
+
+    // Copies what is needed from "pipelineLayoutDesc", which doesn't need to outlive the call
+    void AddPipelineLayout(const nri::PipelineLayout& pipelineLayout, const nri::PipelineLayoutDesc& pipelineLayoutDesc) {
+        for (uint32_t i = 0; i < pipelineLayoutDesc.descriptorSetNum; i++) {
+            const nri::DescriptorSetDesc& descriptorSetDesc = pipelineLayoutDesc.descriptorSets[i];
+
+            SetLayout setLayout = {};
+            setLayout.pipelineLayout = &pipelineLayout;
+            setLayout.setIndex = i;
+            setLayout.rangeNum = descriptorSetDesc.rangeNum;
+            setLayout.fixed.descriptorSetMaxNum = 1;
+            setLayout.fixed.dynamicConstantBufferMaxNum = descriptorSetDesc.dynamicConstantBufferNum;
+
+            for (uint32_t j = 0; j < descriptorSetDesc.rangeNum; j++) {
+                const nri::DescriptorRangeDesc& range = descriptorSetDesc.ranges[j];
+
+                if ((uint32_t)range.flags & (uint32_t)nri::DescriptorRangeBits::VARIABLE_SIZED_ARRAY) {
+                    setLayout.variableType = range.descriptorType;
+                    setLayout.hasVariableRange = true;
+                } else
+                    GetField(setLayout.fixed, range.descriptorType) += range.descriptorNum;
+            }
+
+            m_SetLayouts.push_back(setLayout);
+        }
+    }
+
+    void Reserve(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, uint32_t setNum, uint32_t variableDescriptorNum = 0) {
+        Add(m_Persistent.reserved, GetRequirements(FindSetLayout(pipelineLayout, setIndex), setNum, variableDescriptorNum));
+    }
+
+    // Per frame
+    void ReserveTransient(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, uint32_t setNum, uint32_t variableDescriptorNum = 0) {
+        const nri::DescriptorPoolDesc requirements = GetRequirements(FindSetLayout(pipelineLayout, setIndex), setNum, variableDescriptorNum);
+        for (PoolChain& chain : m_Transient)
+            Add(chain.reserved, requirements);
+    }
+
+    // On D3D12 "descriptorSets" get rewritten if the sets move to a larger pool
+    void Allocate(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, nri::DescriptorSet** descriptorSets, uint32_t setNum, uint32_t variableDescriptorNum = 0) {
+        const SetLayout& setLayout = FindSetLayout(pipelineLayout, setIndex);
+        AllocateFromChain(m_Persistent, setLayout, descriptorSets, setNum, variableDescriptorNum);
+
+        if (m_IsSinglePoolBound) {
+            for (uint32_t i = 0; i < setNum; i++)
+                m_LiveSets.push_back({descriptorSets + i, (uint32_t)(&setLayout - m_SetLayouts.data()), variableDescriptorNum});
+        }
+    }
+
+    // Valid until "BeginFrame" is called for the same frame slot
+    nri::DescriptorSet* AllocateTransient(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex, uint32_t variableDescriptorNum = 0) {
+        nri::DescriptorSet* descriptorSet = nullptr;
+        AllocateFromChain(m_Transient[m_FrameSlot], FindSetLayout(pipelineLayout, setIndex), &descriptorSet, 1, variableDescriptorNum);
+
+        return descriptorSet;
+    }
+
+    // Call once per frame before recording, after waiting for the frame "queuedFrameNum" frames back
+    void BeginFrame(uint32_t frameIndex) {
+        // Replaced pools are no longer used by any frame in flight
+        size_t n = 0;
+        for (size_t i = 0; i < m_RetiredPools.size(); i++) {
+            if (frameIndex >= m_RetiredPools[i].frameIndex + m_Transient.size())
+                m_NRI->DestroyDescriptorPool(*m_RetiredPools[i].pool);
+            else
+                m_RetiredPools[n++] = m_RetiredPools[i];
+        }
+        m_RetiredPools.resize(n);
+
+        if (m_IsSinglePoolBound && m_Persistent.pools.size() > 1)
+            MergePersistentPools(frameIndex);
+
+        // A chained ring slot gets merged into a single pool, its sets are not used anymore
+        m_FrameSlot = frameIndex % (uint32_t)m_Transient.size();
+        PoolChain& chain = m_Transient[m_FrameSlot];
+
+        if (chain.pools.size() > 1) {
+            nri::DescriptorPoolDesc capacity = {};
+            for (const Pool& pool : chain.pools)
+                Add(capacity, pool.capacity);
+
+            DestroyPools(chain);
+            chain.reserved = Max(chain.reserved, capacity);
+        } else if (!chain.pools.empty()) {
+            m_NRI->ResetDescriptorPool(*chain.pools.front().pool);
+            chain.pools.front().used = {};
+        }
+    }
+
+private:
+    struct SetLayout {
+        const nri::PipelineLayout* pipelineLayout;
+        nri::DescriptorPoolDesc fixed;
+        uint32_t setIndex;
+        uint32_t rangeNum;
+        nri::DescriptorType variableType;
+        bool hasVariableRange;
+    };
+
+    struct Pool {
+        nri::DescriptorPool* pool;
+        nri::DescriptorPoolDesc capacity;
+        nri::DescriptorPoolDesc used;
+    };
+
+    struct PoolChain {
+        std::vector<Pool> pools;
+        nri::DescriptorPoolDesc reserved = {};
+    };
+
+    struct LiveSet {
+        nri::DescriptorSet** descriptorSet; // owned by the caller
+        uint32_t setLayoutIndex;
+        uint32_t variableDescriptorNum;
+    };
+
+    struct RetiredPool {
+        nri::DescriptorPool* pool;
+        uint32_t frameIndex;
+    };
+
+    static constexpr uint32_t nri::DescriptorPoolDesc::*FIELDS[] = {
+        &nri::DescriptorPoolDesc::descriptorSetMaxNum,
+        &nri::DescriptorPoolDesc::samplerMaxNum,
+        &nri::DescriptorPoolDesc::constantBufferMaxNum,
+        &nri::DescriptorPoolDesc::dynamicConstantBufferMaxNum,
+        &nri::DescriptorPoolDesc::textureMaxNum,
+        &nri::DescriptorPoolDesc::storageTextureMaxNum,
+        &nri::DescriptorPoolDesc::bufferMaxNum,
+        &nri::DescriptorPoolDesc::storageBufferMaxNum,
+        &nri::DescriptorPoolDesc::structuredBufferMaxNum,
+        &nri::DescriptorPoolDesc::storageStructuredBufferMaxNum,
+        &nri::DescriptorPoolDesc::accelerationStructureMaxNum,
+    };
+
+    static uint32_t& GetField(nri::DescriptorPoolDesc& desc, nri::DescriptorType descriptorType) {
+        switch (descriptorType) {
+            case nri::DescriptorType::SAMPLER:
+                return desc.samplerMaxNum;
+            case nri::DescriptorType::CONSTANT_BUFFER:
+                return desc.constantBufferMaxNum;
+            case nri::DescriptorType::TEXTURE:
+                return desc.textureMaxNum;
+            case nri::DescriptorType::STORAGE_TEXTURE:
+                return desc.storageTextureMaxNum;
+            case nri::DescriptorType::BUFFER:
+                return desc.bufferMaxNum;
+            case nri::DescriptorType::STORAGE_BUFFER:
+                return desc.storageBufferMaxNum;
+            case nri::DescriptorType::STRUCTURED_BUFFER:
+                return desc.structuredBufferMaxNum;
+            case nri::DescriptorType::STORAGE_STRUCTURED_BUFFER:
+                return desc.storageStructuredBufferMaxNum;
+            default:
+                return desc.accelerationStructureMaxNum;
+        }
+    }
+
+    static void Add(nri::DescriptorPoolDesc& dst, const nri::DescriptorPoolDesc& src) {
+        for (uint32_t nri::DescriptorPoolDesc::*field : FIELDS)
+            dst.*field += src.*field;
+    }
+
+    static nri::DescriptorPoolDesc Max(const nri::DescriptorPoolDesc& a, const nri::DescriptorPoolDesc& b) {
+        nri::DescriptorPoolDesc result = {};
+        for (uint32_t nri::DescriptorPoolDesc::*field : FIELDS)
+            result.*field = std::max(a.*field, b.*field);
+
+        return result;
+    }
+
+    static bool Fits(const Pool& pool, const nri::DescriptorPoolDesc& requirements) {
+        for (uint32_t nri::DescriptorPoolDesc::*field : FIELDS) {
+            if (pool.used.*field + requirements.*field > pool.capacity.*field)
+                return false;
+        }
+
+        return true;
+    }
+
+    const SetLayout& FindSetLayout(const nri::PipelineLayout& pipelineLayout, uint32_t setIndex) const {
+        for (const SetLayout& setLayout : m_SetLayouts) {
+            if (setLayout.pipelineLayout == &pipelineLayout && setLayout.setIndex == setIndex)
+                return setLayout;
+        }
+
+        NRI_ABORT_ON_FALSE(false); // not registered with "AddPipelineLayout"
+        return m_SetLayouts.front();
+    }
+
+    static nri::DescriptorPoolDesc GetRequirements(const SetLayout& setLayout, uint32_t setNum, uint32_t variableDescriptorNum) {
+        nri::DescriptorPoolDesc requirements = setLayout.fixed;
+        if (setLayout.hasVariableRange)
+            GetField(requirements, setLayout.variableType) += variableDescriptorNum;
+
+        for (uint32_t nri::DescriptorPoolDesc::*field : FIELDS)
+            requirements.*field *= setNum;
+
+        return requirements;
+    }
+
+    void AllocateFromChain(PoolChain& chain, const SetLayout& setLayout, nri::DescriptorSet** descriptorSets, uint32_t setNum, uint32_t variableDescriptorNum) {
+        const nri::DescriptorPoolDesc requirements = GetRequirements(setLayout, setNum, variableDescriptorNum);
+
+        if (chain.pools.empty() || !Fits(chain.pools.back(), requirements)) {
+            // The first pool gets the reservation, chained ones repeat the previous capacity
+            nri::DescriptorPoolDesc capacity = Max(chain.pools.empty() ? chain.reserved : chain.pools.back().capacity, requirements);
+
+            Pool pool = {};
+            pool.capacity = capacity;
+            NRI_ABORT_ON_FAILURE(m_NRI->CreateDescriptorPool(*m_Device, capacity, pool.pool));
+
+            chain.pools.push_back(pool);
+        }
+
+        Pool& pool = chain.pools.back();
+        NRI_ABORT_ON_FAILURE(m_NRI->AllocateDescriptorSets(*pool.pool, *setLayout.pipelineLayout, setLayout.setIndex, descriptorSets, setNum, variableDescriptorNum));
+        Add(pool.used, requirements);
+    }
+
+    // D3D12: the live sets are copied into a single pool, which can hold all chained pools
+    void MergePersistentPools(uint32_t frameIndex) {
+        Pool merged = {};
+        for (const Pool& pool : m_Persistent.pools)
+            Add(merged.capacity, pool.capacity);
+
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateDescriptorPool(*m_Device, merged.capacity, merged.pool));
+
+        for (const LiveSet& liveSet : m_LiveSets) {
+            const SetLayout& setLayout = m_SetLayouts[liveSet.setLayoutIndex];
+
+            nri::DescriptorSet* descriptorSet = nullptr;
+            NRI_ABORT_ON_FAILURE(m_NRI->AllocateDescriptorSets(*merged.pool, *setLayout.pipelineLayout, setLayout.setIndex, &descriptorSet, 1, liveSet.variableDescriptorNum));
+
+            const nri::DescriptorSetCopyDesc descriptorSetCopyDesc = {*liveSet.descriptorSet, 0, 0, setLayout.rangeNum, 0, 0, setLayout.fixed.dynamicConstantBufferMaxNum};
+            m_NRI->CopyDescriptorSet(*descriptorSet, descriptorSetCopyDesc);
+
+            *liveSet.descriptorSet = descriptorSet;
+            Add(merged.used, GetRequirements(setLayout, 1, liveSet.variableDescriptorNum));
+        }
+
+        for (const Pool& pool : m_Persistent.pools)
+            m_RetiredPools.push_back({pool.pool, frameIndex});
+
+        m_Persistent.pools.clear();
+        m_Persistent.pools.push_back(merged);
+    }
+
+    void DestroyPools(PoolChain& chain) {
+        for (const Pool& pool : chain.pools)
+            m_NRI->DestroyDescriptorPool(*pool.pool);
+
+        chain.pools.clear();
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Device* m_Device = nullptr;
+    std::vector<SetLayout> m_SetLayouts;
+    std::vector<LiveSet> m_LiveSets;
+    std::vector<RetiredPool> m_RetiredPools;
+    std::vector<PoolChain> m_Transient; // a slot per queued frame
+    PoolChain m_Persistent;
+    uint32_t m_FrameSlot = 0;
+    bool m_IsSinglePoolBound = false;
+};
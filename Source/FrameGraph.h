@@ -0,0 +1,753 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include "MemoryAllocator.h"
+
+#include <array>
+#include <functional>
+
+// Schedules a frame of passes onto the graphics and compute queues. Passes declare the resources they read and write
+// (with the state they need) and a preferred queue, the scheduling policy decides whether the compute queue is used.
+// "Execute" splits the frame into per-queue submissions, a submission signals its queue fence only if another queue
+// waits for it (or for the frame slot reuse), and barriers are placed where the state changes. Resources are accessible
+// from all queues in NRI, so a queue ownership transfer is the fence wait plus a transition recorded on a queue able to
+// handle both states: the compute queue can't touch attachment layouts, the graphics queue does it instead. A pass can
+// be cached: it's skipped (with its barriers and waits) if its outputs still hold the result for the same "cacheKey"
+class FrameGraph {
+public:
+    enum class Policy : uint8_t {
+        GRAPHICS_ONLY,
+        ASYNC_COMPUTE
+    };
+
+    typedef uint32_t Resource; // valid for the current frame
+    typedef std::function<void(nri::CommandBuffer& commandBuffer)> Callback;
+
+    struct Usage {
+        Resource resource;
+        nri::AccessLayoutStage state; // "layout" is ignored for buffers
+        bool isWrite;
+    };
+
+    struct Stats {
+        uint32_t submitNum;
+        uint32_t waitNum; // cross-queue
+        uint32_t barrierNum;
+        uint32_t skippedPassNum; // cached
+    };
+
+    // Times are in ms from the first timestamp of the frame, both queues are assumed to share the clock
+    struct PassTiming {
+        const char* name;
+        nri::CommandQueueType queue;
+        double begin;
+        double end;
+    };
+
+    struct Timeline {
+        std::vector<PassTiming> passes;
+        std::array<double, 2> busyTime; // graphics, compute
+        double overlapTime;             // both queues are busy
+        double duration;
+    };
+
+    static inline Usage Read(Resource resource, const nri::AccessLayoutStage& state) {
+        return {resource, state, false};
+    }
+
+    static inline Usage Write(Resource resource, const nri::AccessLayoutStage& state) {
+        return {resource, state, true};
+    }
+
+    // A cache key for pass inputs (FNV-1a), never "0"
+    static uint64_t Hash(const void* data, size_t size) {
+        const uint8_t* bytes = (const uint8_t*)data;
+
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+        return hash ? hash : 1;
+    }
+
+    ~FrameGraph() {
+        Destroy();
+    }
+
+    inline const Stats& GetStats() const {
+        return m_Stats;
+    }
+
+    inline bool IsAsyncComputeAvailable() const {
+        return m_Queues[COMPUTE] != nullptr;
+    }
+
+    // The frame which used the current frame slot last time, if timestamps are enabled
+    inline const Timeline& GetTimeline() const {
+        return m_Timeline;
+    }
+
+    // "computeQueue" is optional
+    void Create(const nri::CoreInterface& NRI, nri::Device& device, nri::CommandQueue& graphicsQueue, nri::CommandQueue* computeQueue) {
+        m_NRI = &NRI;
+        m_Queues = {&graphicsQueue, computeQueue};
+
+        for (uint32_t i = 0; i < QUEUE_NUM; i++) {
+            if (!m_Queues[i])
+                continue;
+
+            NRI_ABORT_ON_FAILURE(NRI.CreateFence(device, 0, m_Fences[i]));
+
+            for (FrameSlot& frameSlot : m_FrameSlots)
+                NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(*m_Queues[i], frameSlot.commandAllocators[i]));
+        }
+    }
+
+    // Timestamps around every pass, on both queues. NRI exposes no clock calibration, so the queues are assumed to tick
+    // the same GPU clock and timestamps are placed on a common timeline as is. Cross-queue placement and the overlap
+    // depend on this assumption, per-queue busy times don't
+    void EnableTimestamps(nri::Device& device, MemoryAllocator& memoryAllocator, uint32_t passNumMax) {
+        const nri::DeviceDesc& deviceDesc = m_NRI->GetDeviceDesc(device);
+        m_TimestampPeriod = 1000.0 / double(deviceDesc.timestampFrequencyHz);
+        m_QueryNumPerFrame = passNumMax * 2;
+
+        nri::QueryPoolDesc queryPoolDesc = {};
+        queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+        queryPoolDesc.capacity = m_QueryNumPerFrame * BUFFERED_FRAME_MAX_NUM;
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateQueryPool(device, queryPoolDesc, m_QueryPool));
+
+        const nri::BufferDesc bufferDesc = {queryPoolDesc.capacity * sizeof(uint64_t), 0, nri::BufferUsageBits::NONE};
+        NRI_ABORT_ON_FAILURE(m_NRI->CreateBuffer(device, bufferDesc, m_QueryBuffer));
+
+        nri::ResourceGroupDesc resourceGroupDesc = {};
+        resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_READBACK;
+        resourceGroupDesc.bufferNum = 1;
+        resourceGroupDesc.buffers = &m_QueryBuffer;
+
+        memoryAllocator.AllocateAndBind(resourceGroupDesc);
+    }
+
+    void Destroy() {
+        if (!m_NRI)
+            return;
+
+        for (uint32_t i = 0; i < QUEUE_NUM; i++) {
+            if (!m_Queues[i])
+                continue;
+
+            m_NRI->Wait(*m_Fences[i], m_FenceValues[i]);
+
+            for (FrameSlot& frameSlot : m_FrameSlots) {
+                for (nri::CommandBuffer* commandBuffer : frameSlot.commandBuffers[i])
+                    m_NRI->DestroyCommandBuffer(*commandBuffer);
+
+                m_NRI->DestroyCommandAllocator(*frameSlot.commandAllocators[i]);
+            }
+
+            m_NRI->DestroyFence(*m_Fences[i]);
+        }
+
+        if (m_QueryPool) {
+            m_NRI->DestroyQueryPool(*m_QueryPool);
+            m_NRI->DestroyBuffer(*m_QueryBuffer);
+            m_QueryPool = nullptr;
+        }
+
+        m_FrameSlots = {};
+        m_Resources.clear();
+        m_NRI = nullptr;
+    }
+
+    // Waits for the frame which used this slot last time
+    void BeginFrame(uint32_t frameIndex) {
+        m_FrameSlot = &m_FrameSlots[frameIndex % BUFFERED_FRAME_MAX_NUM];
+
+        for (uint32_t i = 0; i < QUEUE_NUM; i++) {
+            if (!m_Queues[i])
+                continue;
+
+            m_NRI->Wait(*m_Fences[i], m_FrameSlot->fenceValues[i]);
+            m_NRI->ResetCommandAllocator(*m_FrameSlot->commandAllocators[i]);
+            m_FrameSlot->commandBufferNum[i] = 0;
+        }
+
+        if (m_QueryPool)
+            ReadTimestamps(frameIndex % BUFFERED_FRAME_MAX_NUM);
+
+        // Persistent resources keep their state, the rest is imported every frame
+        size_t n = 0;
+        for (size_t i = 0; i < m_Resources.size(); i++) {
+            if (m_Resources[i].isPersistent) {
+                m_Resources[i].lastPass = NONE;
+                m_Resources[n++] = m_Resources[i];
+            }
+        }
+        m_Resources.resize(n);
+
+        m_Passes.clear();
+        m_Batches.clear();
+    }
+
+    // The state is tracked across frames, "initial" is used only the first time
+    Resource ImportTexture(nri::Texture& texture, const nri::AccessLayoutStage& initial) {
+        return Import(&texture, nullptr, initial, nullptr);
+    }
+
+    Resource ImportBuffer(nri::Buffer& buffer, const nri::AccessStage& initial) {
+        return Import(nullptr, &buffer, {initial.access, nri::Layout::UNKNOWN, initial.stages}, nullptr);
+    }
+
+    // The content is undefined at the beginning of the frame, at the end the texture gets transitioned to "final" (a swap chain texture)
+    Resource ImportTransientTexture(nri::Texture& texture, const nri::AccessLayoutStage& final) {
+        return Import(&texture, nullptr, {nri::AccessBits::UNKNOWN, nri::Layout::UNKNOWN}, &final);
+    }
+
+    // Drops the tracked state of a persistent resource, call between frames before destroying it or reusing its address
+    void Release(nri::Texture& texture) {
+        Release(&texture, nullptr);
+    }
+
+    void Release(nri::Buffer& buffer) {
+        Release(nullptr, &buffer);
+    }
+
+    // Passes run in declaration order within a queue. "cacheKey" identifies the inputs of a pass whose outputs are
+    // persistent resources, "0" means "not cached". Any other write to an output drops the cached result
+    void AddPass(const char* name, nri::CommandQueueType queue, std::initializer_list<Usage> usages, Callback&& callback, uint64_t cacheKey = 0) {
+        NRI_ABORT_ON_FALSE(queue == nri::CommandQueueType::GRAPHICS || queue == nri::CommandQueueType::COMPUTE);
+
+        Pass& pass = m_Passes.emplace_back();
+        pass.name = name;
+        pass.preferredQueue = queue == nri::CommandQueueType::COMPUTE ? COMPUTE : GRAPHICS;
+        pass.usages = usages;
+        pass.callback = std::move(callback);
+        pass.cacheKey = cacheKey;
+    }
+
+    // Records and submits the frame
+    void Execute(Policy policy, nri::DescriptorPool* descriptorPool) {
+        m_Stats = {};
+        Compile(policy);
+
+        m_Stats.submitNum = (uint32_t)m_Batches.size();
+
+        const uint32_t queryOffset = uint32_t(m_FrameSlot - m_FrameSlots.data()) * m_QueryNumPerFrame;
+        m_FrameSlot->timedPasses.clear();
+
+        for (Batch& batch : m_Batches) {
+            nri::CommandBuffer& commandBuffer = GetCommandBuffer(batch.queue);
+            m_NRI->BeginCommandBuffer(commandBuffer, descriptorPool);
+            {
+                const uint32_t batchQueryBegin = queryOffset + (uint32_t)m_FrameSlot->timedPasses.size() * 2;
+
+                for (uint32_t passIndex : batch.passes) {
+                    Pass& pass = m_Passes[passIndex];
+
+                    // Barriers are a part of the pass time
+                    const uint32_t queryIndex = queryOffset + (uint32_t)m_FrameSlot->timedPasses.size() * 2;
+                    const bool isTimed = m_QueryPool && pass.callback && queryIndex + 2 <= queryOffset + m_QueryNumPerFrame;
+                    if (isTimed) {
+                        m_NRI->CmdResetQueries(commandBuffer, *m_QueryPool, queryIndex, 2);
+                        m_NRI->CmdEndQuery(commandBuffer, *m_QueryPool, queryIndex);
+                    }
+
+                    RecordBarriers(commandBuffer, pass.barriers);
+
+                    if (pass.callback) {
+                        helper::Annotation annotation(*m_NRI, commandBuffer, pass.name);
+                        pass.callback(commandBuffer);
+                    }
+
+                    RecordBarriers(commandBuffer, pass.postBarriers);
+
+                    if (isTimed) {
+                        m_NRI->CmdEndQuery(commandBuffer, *m_QueryPool, queryIndex + 1);
+                        m_FrameSlot->timedPasses.push_back({pass.name, batch.queue});
+                    }
+                }
+
+                const uint32_t batchQueryEnd = queryOffset + (uint32_t)m_FrameSlot->timedPasses.size() * 2;
+                if (batchQueryEnd != batchQueryBegin)
+                    m_NRI->CmdCopyQueries(commandBuffer, *m_QueryPool, batchQueryBegin, batchQueryEnd - batchQueryBegin, *m_QueryBuffer, batchQueryBegin * sizeof(uint64_t));
+            }
+            m_NRI->EndCommandBuffer(commandBuffer);
+
+            std::array<nri::FenceSubmitDesc, QUEUE_NUM> waitFences = {};
+            uint32_t waitFenceNum = 0;
+            for (uint32_t i = 0; i < QUEUE_NUM; i++) {
+                uint64_t value = batch.waitValues[i];
+                if (batch.waitBatches[i] != NONE)
+                    value = std::max(value, m_Batches[batch.waitBatches[i]].signalValue);
+
+                if (value) {
+                    nri::FenceSubmitDesc& waitFence = waitFences[waitFenceNum++];
+                    waitFence.fence = m_Fences[i];
+                    waitFence.value = value;
+                }
+            }
+
+            nri::FenceSubmitDesc signalFence = {};
+            if (batch.isSignaled) {
+                batch.signalValue = ++m_FenceValues[batch.queue];
+                signalFence.fence = m_Fences[batch.queue];
+                signalFence.value = batch.signalValue;
+            }
+
+            nri::CommandBuffer* commandBuffers[] = {&commandBuffer};
+
+            nri::QueueSubmitDesc queueSubmitDesc = {};
+            queueSubmitDesc.waitFences = waitFences.data();
+            queueSubmitDesc.waitFenceNum = waitFenceNum;
+            queueSubmitDesc.commandBuffers = commandBuffers;
+            queueSubmitDesc.commandBufferNum = 1;
+            queueSubmitDesc.signalFences = &signalFence;
+            queueSubmitDesc.signalFenceNum = batch.isSignaled ? 1 : 0;
+
+            m_NRI->QueueSubmit(*m_Queues[batch.queue], queueSubmitDesc);
+
+            m_Stats.waitNum += waitFenceNum;
+        }
+
+        // Fence values to wait for before the frame slot gets reused, and for cross-frame dependencies
+        for (uint32_t i = 0; i < QUEUE_NUM; i++)
+            m_FrameSlot->fenceValues[i] = m_FenceValues[i];
+
+        for (ResourceState& resource : m_Resources) {
+            if (resource.lastPass != NONE) {
+                const Batch& batch = m_Batches[m_Passes[resource.lastPass].batch];
+                resource.lastQueue = batch.queue;
+                resource.lastFenceValue = batch.signalValue;
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t GRAPHICS = 0;
+    static constexpr uint32_t COMPUTE = 1;
+    static constexpr uint32_t QUEUE_NUM = 2;
+    static constexpr uint32_t NONE = uint32_t(-1);
+
+    struct ResourceState {
+        nri::Texture* texture;
+        nri::Buffer* buffer;
+        nri::AccessLayoutStage state;
+        nri::AccessLayoutStage final;
+        uint64_t lastFenceValue; // previous frames
+        uint64_t cacheKey;       // of the pass whose result the resource holds
+        uint32_t lastQueue;
+        uint32_t lastPass; // this frame
+        nri::Dim_t layerNum;
+        nri::Mip_t mipNum;
+        bool lastIsWrite;
+        bool isPersistent;
+    };
+
+    struct Barrier {
+        Resource resource;
+        nri::AccessLayoutStage before;
+        nri::AccessLayoutStage after;
+    };
+
+    struct Pass {
+        const char* name;
+        std::vector<Usage> usages;
+        std::vector<Barrier> barriers;
+        std::vector<Barrier> postBarriers;
+        Callback callback;
+        std::array<uint32_t, QUEUE_NUM> waitBatches = {NONE, NONE};
+        std::array<uint64_t, QUEUE_NUM> waitValues = {};
+        uint64_t cacheKey = 0;
+        uint32_t preferredQueue = GRAPHICS;
+        uint32_t queue = GRAPHICS;
+        uint32_t batch = NONE;
+    };
+
+    // A submission
+    struct Batch {
+        std::vector<uint32_t> passes;
+        std::array<uint32_t, QUEUE_NUM> waitBatches;
+        std::array<uint64_t, QUEUE_NUM> waitValues;
+        uint64_t signalValue;
+        uint32_t queue;
+        bool isSignaled;
+    };
+
+    struct TimedPass {
+        const char* name;
+        uint32_t queue;
+    };
+
+    struct FrameSlot {
+        std::vector<TimedPass> timedPasses; // query pairs in submission order
+        std::array<nri::CommandAllocator*, QUEUE_NUM> commandAllocators;
+        std::array<std::vector<nri::CommandBuffer*>, QUEUE_NUM> commandBuffers;
+        std::array<uint32_t, QUEUE_NUM> commandBufferNum;
+        std::array<uint64_t, QUEUE_NUM> fenceValues;
+    };
+
+    static inline bool IsSameState(const nri::AccessLayoutStage& a, const nri::AccessLayoutStage& b) {
+        return a.access == b.access && a.layout == b.layout && a.stages == b.stages;
+    }
+
+    // States the compute queue can transition from and to
+    static bool IsComputeCompatible(const nri::AccessLayoutStage& state) {
+        constexpr nri::AccessBits graphicsAccess = nri::AccessBits::COLOR_ATTACHMENT | nri::AccessBits::DEPTH_STENCIL_ATTACHMENT_WRITE | nri::AccessBits::VERTEX_BUFFER
+            | nri::AccessBits::INDEX_BUFFER | nri::AccessBits::SHADING_RATE_ATTACHMENT;
+        constexpr nri::StageBits graphicsStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::MESH_SHADERS | nri::StageBits::FRAGMENT_SHADER
+            | nri::StageBits::DEPTH_STENCIL_ATTACHMENT | nri::StageBits::COLOR_ATTACHMENT;
+
+        if (state.access & graphicsAccess)
+            return false;
+
+        if (state.stages != nri::StageBits::ALL && (state.stages & graphicsStages))
+            return false;
+
+        return state.layout == nri::Layout::UNKNOWN || state.layout == nri::Layout::SHADER_RESOURCE || state.layout == nri::Layout::SHADER_RESOURCE_STORAGE
+            || state.layout == nri::Layout::COPY_SOURCE || state.layout == nri::Layout::COPY_DESTINATION;
+    }
+
+    Resource Import(nri::Texture* texture, nri::Buffer* buffer, const nri::AccessLayoutStage& initial, const nri::AccessLayoutStage* final) {
+        const bool isPersistent = final == nullptr;
+
+        for (size_t i = 0; i < m_Resources.size(); i++) {
+            if (m_Resources[i].texture == texture && m_Resources[i].buffer == buffer)
+                return (Resource)i;
+        }
+
+        ResourceState& resource = m_Resources.emplace_back();
+        resource.texture = texture;
+        resource.buffer = buffer;
+        resource.state = initial;
+        resource.final = isPersistent ? initial : *final;
+        resource.lastFenceValue = 0;
+        resource.cacheKey = 0;
+        resource.lastQueue = GRAPHICS;
+        resource.lastPass = NONE;
+        resource.layerNum = texture ? m_NRI->GetTextureDesc(*texture).layerNum : 0;
+        resource.mipNum = texture ? m_NRI->GetTextureDesc(*texture).mipNum : 0;
+        resource.lastIsWrite = false;
+        resource.isPersistent = isPersistent;
+
+        return Resource(m_Resources.size() - 1);
+    }
+
+    void Release(nri::Texture* texture, nri::Buffer* buffer) {
+        for (size_t i = 0; i < m_Resources.size(); i++) {
+            if (m_Resources[i].texture == texture && m_Resources[i].buffer == buffer) {
+                m_Resources.erase(m_Resources.begin() + i);
+                return;
+            }
+        }
+    }
+
+    void Compile(Policy policy) {
+        std::array<uint32_t, QUEUE_NUM> openBatches = {NONE, NONE};
+
+        // Transition passes get appended, so passes are accessed by index
+        const uint32_t passNum = (uint32_t)m_Passes.size();
+        for (uint32_t i = 0; i < passNum; i++) {
+            if (IsCached(m_Passes[i])) {
+                m_Stats.skippedPassNum++;
+                continue;
+            }
+
+            m_Passes[i].queue = policy == Policy::ASYNC_COMPUTE && IsAsyncComputeAvailable() ? m_Passes[i].preferredQueue : GRAPHICS;
+
+            for (size_t j = 0; j < m_Passes[i].usages.size(); j++) {
+                const Usage usage = m_Passes[i].usages[j];
+                AddUsage(i, usage, openBatches);
+
+                if (usage.isWrite)
+                    m_Resources[usage.resource].cacheKey = m_Passes[i].cacheKey;
+            }
+
+            AddToBatch(i, openBatches);
+        }
+
+        // Final transitions
+        for (Resource r = 0; r < (Resource)m_Resources.size(); r++) {
+            ResourceState& resource = m_Resources[r];
+            if (resource.isPersistent || resource.lastPass == NONE || IsSameState(resource.state, resource.final))
+                continue;
+
+            if (m_Passes[resource.lastPass].queue == GRAPHICS || IsComputeCompatible(resource.final))
+                m_Passes[resource.lastPass].postBarriers.push_back({r, resource.state, resource.final});
+            else {
+                const uint32_t passIndex = AddTransitionPass(r, resource.final, openBatches);
+                AddToBatch(passIndex, openBatches);
+            }
+        }
+
+        // The last submission of each queue signals for the frame slot reuse
+        for (uint32_t batchIndex : openBatches) {
+            if (batchIndex != NONE)
+                m_Batches[batchIndex].isSignaled = true;
+        }
+
+        // And submissions holding the last access to a persistent resource, for the next frame
+        for (const ResourceState& resource : m_Resources) {
+            if (resource.isPersistent && resource.lastPass != NONE)
+                m_Batches[m_Passes[resource.lastPass].batch].isSignaled = true;
+        }
+    }
+
+    bool IsCached(const Pass& pass) const {
+        if (!pass.cacheKey)
+            return false;
+
+        bool hasOutputs = false;
+        for (const Usage& usage : pass.usages) {
+            if (usage.isWrite) {
+                const ResourceState& resource = m_Resources[usage.resource];
+                if (!resource.isPersistent || resource.cacheKey != pass.cacheKey)
+                    return false;
+
+                hasOutputs = true;
+            }
+        }
+
+        return hasOutputs;
+    }
+
+    void AddUsage(uint32_t passIndex, const Usage& usage, std::array<uint32_t, QUEUE_NUM>& openBatches) {
+        ResourceState& resource = m_Resources[usage.resource];
+        const uint32_t queue = m_Passes[passIndex].queue;
+        const uint32_t prevQueue = resource.lastPass == NONE ? resource.lastQueue : m_Passes[resource.lastPass].queue;
+        const bool isCrossQueue = prevQueue != queue;
+
+        // Reads in the same state on the same queue don't need anything
+        if (!usage.isWrite && !resource.lastIsWrite && IsSameState(resource.state, usage.state) && !isCrossQueue)
+            return;
+
+        if (isCrossQueue) {
+            // The compute queue can't do this transition, the graphics queue does it before the hand-off
+            if (queue == COMPUTE && !IsSameState(resource.state, usage.state) && (!IsComputeCompatible(resource.state) || !IsComputeCompatible(usage.state))) {
+                if (resource.lastPass != NONE)
+                    m_Passes[resource.lastPass].postBarriers.push_back({usage.resource, resource.state, usage.state});
+                else
+                    AddToBatch(AddTransitionPass(usage.resource, usage.state, openBatches), openBatches);
+
+                resource.state = usage.state;
+            }
+
+            AddWait(passIndex, resource, openBatches);
+        }
+
+        // The fence wait covers memory dependencies between queues
+        if (!isCrossQueue || !IsSameState(resource.state, usage.state))
+            m_Passes[passIndex].barriers.push_back({usage.resource, resource.state, usage.state});
+
+        resource.state = usage.state;
+        resource.lastPass = passIndex;
+        resource.lastIsWrite = usage.isWrite;
+    }
+
+    // A barrier-only pass on the graphics queue
+    uint32_t AddTransitionPass(Resource r, const nri::AccessLayoutStage& after, std::array<uint32_t, QUEUE_NUM>& openBatches) {
+        ResourceState& resource = m_Resources[r];
+
+        const uint32_t passIndex = (uint32_t)m_Passes.size();
+        Pass& pass = m_Passes.emplace_back();
+        pass.name = "Transition";
+        pass.preferredQueue = GRAPHICS;
+        pass.queue = GRAPHICS;
+
+        if (resource.lastPass != NONE ? m_Passes[resource.lastPass].queue != GRAPHICS : resource.lastQueue != GRAPHICS)
+            AddWait(passIndex, resource, openBatches);
+
+        pass.barriers.push_back({r, resource.state, after});
+
+        resource.state = after;
+        resource.lastPass = passIndex;
+        resource.lastIsWrite = true;
+
+        return passIndex;
+    }
+
+    // The pass waits for the last access to the resource on another queue
+    void AddWait(uint32_t passIndex, const ResourceState& resource, std::array<uint32_t, QUEUE_NUM>& openBatches) {
+        Pass& pass = m_Passes[passIndex];
+
+        if (resource.lastPass == NONE) {
+            pass.waitValues[resource.lastQueue] = std::max(pass.waitValues[resource.lastQueue], resource.lastFenceValue);
+            return;
+        }
+
+        const Pass& prevPass = m_Passes[resource.lastPass];
+        uint32_t& waitBatch = pass.waitBatches[prevPass.queue];
+        waitBatch = waitBatch == NONE ? prevPass.batch : std::max(waitBatch, prevPass.batch);
+
+        // Later passes of that queue go into a new submission
+        Batch& batch = m_Batches[prevPass.batch];
+        batch.isSignaled = true;
+        if (openBatches[prevPass.queue] == prevPass.batch)
+            openBatches[prevPass.queue] = NONE;
+    }
+
+    void AddToBatch(uint32_t passIndex, std::array<uint32_t, QUEUE_NUM>& openBatches) {
+        Pass& pass = m_Passes[passIndex];
+
+        bool hasWaits = false;
+        for (uint32_t i = 0; i < QUEUE_NUM; i++)
+            hasWaits = hasWaits || pass.waitBatches[i] != NONE || pass.waitValues[i] != 0;
+
+        // Waits happen at the beginning of a submission
+        uint32_t& openBatch = openBatches[pass.queue];
+        if (hasWaits || openBatch == NONE) {
+            openBatch = (uint32_t)m_Batches.size();
+
+            Batch& batch = m_Batches.emplace_back();
+            batch.waitBatches = pass.waitBatches;
+            batch.waitValues = pass.waitValues;
+            batch.signalValue = 0;
+            batch.queue = pass.queue;
+            batch.isSignaled = false;
+        }
+
+        pass.batch = openBatch;
+        m_Batches[openBatch].passes.push_back(passIndex);
+    }
+
+    void ReadTimestamps(uint32_t frameSlotIndex) {
+        m_Timeline.passes.clear();
+        m_Timeline.busyTime = {};
+        m_Timeline.overlapTime = 0.0;
+        m_Timeline.duration = 0.0;
+
+        const std::vector<TimedPass>& timedPasses = m_FrameSlot->timedPasses;
+        if (timedPasses.empty())
+            return;
+
+        const uint64_t offset = frameSlotIndex * m_QueryNumPerFrame * sizeof(uint64_t);
+        const uint64_t* timestamps = (uint64_t*)m_NRI->MapBuffer(*m_QueryBuffer, offset, timedPasses.size() * 2 * sizeof(uint64_t));
+        {
+            uint64_t first = UINT64_MAX;
+            for (size_t i = 0; i < timedPasses.size() * 2; i++)
+                first = std::min(first, timestamps[i]);
+
+            for (size_t i = 0; i < timedPasses.size(); i++) {
+                const uint64_t begin = timestamps[i * 2];
+                const uint64_t end = std::max(begin, timestamps[i * 2 + 1]);
+
+                PassTiming& passTiming = m_Timeline.passes.emplace_back();
+                passTiming.name = timedPasses[i].name;
+                passTiming.queue = timedPasses[i].queue == COMPUTE ? nri::CommandQueueType::COMPUTE : nri::CommandQueueType::GRAPHICS;
+                passTiming.begin = double(begin - first) * m_TimestampPeriod;
+                passTiming.end = double(end - first) * m_TimestampPeriod;
+
+                m_Timeline.duration = std::max(m_Timeline.duration, passTiming.end);
+            }
+        }
+        m_NRI->UnmapBuffer(*m_QueryBuffer);
+
+        // Busy intervals of each queue, merged
+        std::array<std::vector<std::pair<double, double>>, QUEUE_NUM> intervals;
+        for (size_t i = 0; i < timedPasses.size(); i++)
+            intervals[timedPasses[i].queue].push_back({m_Timeline.passes[i].begin, m_Timeline.passes[i].end});
+
+        for (uint32_t i = 0; i < QUEUE_NUM; i++) {
+            std::vector<std::pair<double, double>>& queueIntervals = intervals[i];
+            std::sort(queueIntervals.begin(), queueIntervals.end());
+
+            size_t n = 0;
+            for (size_t j = 0; j < queueIntervals.size(); j++) {
+                if (n && queueIntervals[j].first <= queueIntervals[n - 1].second)
+                    queueIntervals[n - 1].second = std::max(queueIntervals[n - 1].second, queueIntervals[j].second);
+                else
+                    queueIntervals[n++] = queueIntervals[j];
+            }
+            queueIntervals.resize(n);
+
+            for (const auto& interval : queueIntervals)
+                m_Timeline.busyTime[i] += interval.second - interval.first;
+        }
+
+        // Intersection
+        size_t g = 0;
+        size_t c = 0;
+        while (g < intervals[GRAPHICS].size() && c < intervals[COMPUTE].size()) {
+            const auto& a = intervals[GRAPHICS][g];
+            const auto& b = intervals[COMPUTE][c];
+
+            m_Timeline.overlapTime += std::max(0.0, std::min(a.second, b.second) - std::max(a.first, b.first));
+
+            if (a.second < b.second)
+                g++;
+            else
+                c++;
+        }
+    }
+
+    nri::CommandBuffer& GetCommandBuffer(uint32_t queue) {
+        std::vector<nri::CommandBuffer*>& commandBuffers = m_FrameSlot->commandBuffers[queue];
+        uint32_t& commandBufferNum = m_FrameSlot->commandBufferNum[queue];
+
+        if (commandBufferNum == commandBuffers.size()) {
+            nri::CommandBuffer* commandBuffer = nullptr;
+            NRI_ABORT_ON_FAILURE(m_NRI->CreateCommandBuffer(*m_FrameSlot->commandAllocators[queue], commandBuffer));
+            commandBuffers.push_back(commandBuffer);
+        }
+
+        return *commandBuffers[commandBufferNum++];
+    }
+
+    void RecordBarriers(nri::CommandBuffer& commandBuffer, const std::vector<Barrier>& barriers) {
+        if (barriers.empty())
+            return;
+
+        m_TextureBarriers.clear();
+        m_BufferBarriers.clear();
+
+        for (const Barrier& barrier : barriers) {
+            const ResourceState& resource = m_Resources[barrier.resource];
+
+            if (resource.texture) {
+                nri::TextureBarrierDesc& textureBarrier = m_TextureBarriers.emplace_back();
+                textureBarrier = {};
+                textureBarrier.texture = resource.texture;
+                textureBarrier.before = barrier.before;
+                textureBarrier.after = barrier.after;
+                textureBarrier.layerNum = resource.layerNum;
+                textureBarrier.mipNum = resource.mipNum;
+            } else {
+                nri::BufferBarrierDesc& bufferBarrier = m_BufferBarriers.emplace_back();
+                bufferBarrier = {};
+                bufferBarrier.buffer = resource.buffer;
+                bufferBarrier.before = {barrier.before.access, barrier.before.stages};
+                bufferBarrier.after = {barrier.after.access, barrier.after.stages};
+            }
+        }
+
+        nri::BarrierGroupDesc barrierGroupDesc = {};
+        barrierGroupDesc.textures = m_TextureBarriers.data();
+        barrierGroupDesc.textureNum = (uint16_t)m_TextureBarriers.size();
+        barrierGroupDesc.buffers = m_BufferBarriers.data();
+        barrierGroupDesc.bufferNum = (uint16_t)m_BufferBarriers.size();
+
+        m_NRI->CmdBarrier(commandBuffer, barrierGroupDesc);
+
+        m_Stats.barrierNum += (uint32_t)barriers.size();
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    FrameSlot* m_FrameSlot = nullptr;
+    nri::QueryPool* m_QueryPool = nullptr;
+    nri::Buffer* m_QueryBuffer = nullptr;
+    std::array<nri::CommandQueue*, QUEUE_NUM> m_Queues = {};
+    std::array<nri::Fence*, QUEUE_NUM> m_Fences = {};
+    std::array<uint64_t, QUEUE_NUM> m_FenceValues = {};
+    std::array<FrameSlot, BUFFERED_FRAME_MAX_NUM> m_FrameSlots = {};
+    std::vector<ResourceState> m_Resources;
+    std::vector<Pass> m_Passes;
+    std::vector<Batch> m_Batches;
+    std::vector<nri::TextureBarrierDesc> m_TextureBarriers;
+    std::vector<nri::BufferBarrierDesc> m_BufferBarriers;
+    Timeline m_Timeline = {};
+    Stats m_Stats = {};
+    double m_TimestampPeriod = 0.0; // ms
+    uint32_t m_QueryNumPerFrame = 0;
+};
@@ -0,0 +1,429 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Host allocator for "nri::AllocationCallbacks". Small allocations are served from per-thread size-class pools without
+// locks, a block freed on a foreign thread is pushed to the lock-free list of the owning thread and reclaimed there on
+// the next pool miss. Big or over-aligned allocations go to the system heap. In "SYSTEM" mode everything goes to the
+// system heap, but the counters still work, which is handy for comparison. Destroy after the NRI device.
+// "AllocateTransient" is a separate frame-scoped linear arena for the application, memory is valid until the next "BeginFrame"
+class HostAllocator {
+public:
+    enum class Mode : uint8_t {
+        SYSTEM,
+        POOL
+    };
+
+    struct Stats {
+        uint64_t allocationNum;
+        uint64_t freeNum;
+        uint64_t allocatedBytes;
+        uint64_t liveBytes;
+        uint64_t peakBytes;
+        uint64_t transientBytes;
+    };
+
+    ~HostAllocator() {
+        Destroy();
+    }
+
+    inline Mode GetMode() const {
+        return m_Mode;
+    }
+
+    // Stats of the frame finished by the last "BeginFrame"
+    inline const Stats& GetFrameStats() const {
+        return m_FrameStats;
+    }
+
+    void Create(Mode mode, size_t transientArenaSize = 1024 * 1024) {
+        Destroy();
+
+        m_Mode = mode;
+        m_Arena.reset(new uint8_t[transientArenaSize]);
+        m_ArenaSize = transientArenaSize;
+        m_ArenaOffset.store(0, std::memory_order_relaxed);
+        m_FrameStats = {};
+        m_PrevTotals = {};
+
+        std::lock_guard<std::mutex> lock(GetRegistryLock());
+        static uint64_t s_NextId = 1;
+        m_Id = s_NextId++;
+        GetRegistry().push_back(m_Id);
+    }
+
+    // Outstanding allocations become invalid
+    void Destroy() {
+        if (!m_Id)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(GetRegistryLock());
+            std::vector<uint64_t>& registry = GetRegistry();
+            registry.erase(std::find(registry.begin(), registry.end(), m_Id));
+        }
+
+        for (void* page : m_Pages)
+            free(page);
+
+        for (void* chunk : m_ArenaOverflow)
+            free(chunk);
+
+        m_Pages.clear();
+        m_ArenaOverflow.clear();
+        m_Caches.clear();
+        m_Arena.reset();
+        m_Id = 0;
+    }
+
+    nri::AllocationCallbacks GetAllocationCallbacks() {
+        nri::AllocationCallbacks allocationCallbacks = {};
+        allocationCallbacks.Allocate = AllocateCallback;
+        allocationCallbacks.Reallocate = ReallocateCallback;
+        allocationCallbacks.Free = FreeCallback;
+        allocationCallbacks.userArg = this;
+
+        return allocationCallbacks;
+    }
+
+    // Finishes frame stats and resets the transient arena. Transient memory must not be used by other threads at this point
+    void BeginFrame() {
+        Stats totals = GetTotals();
+
+        m_FrameStats = totals;
+        m_FrameStats.allocationNum -= m_PrevTotals.allocationNum;
+        m_FrameStats.freeNum -= m_PrevTotals.freeNum;
+        m_FrameStats.allocatedBytes -= m_PrevTotals.allocatedBytes;
+        m_PrevTotals = totals;
+
+        m_PeakBytes.store(totals.liveBytes, std::memory_order_relaxed);
+
+        // The arena grows to the high watermark if it has overflowed
+        size_t transientBytes = m_ArenaOffset.exchange(0, std::memory_order_relaxed);
+        if (transientBytes > m_ArenaSize) {
+            m_ArenaSize = helper::Align(transientBytes, (size_t)64 * 1024);
+            m_Arena.reset(new uint8_t[m_ArenaSize]);
+        }
+
+        for (void* chunk : m_ArenaOverflow)
+            free(chunk);
+
+        m_ArenaOverflow.clear();
+    }
+
+    // Cumulative counters, "peakBytes" and "transientBytes" are for the current frame
+    Stats GetTotals() {
+        Stats totals = {};
+
+        std::lock_guard<std::mutex> lock(m_CacheLock);
+        for (const std::unique_ptr<ThreadCache>& cache : m_Caches) {
+            totals.allocationNum += cache->allocationNum.load(std::memory_order_relaxed);
+            totals.freeNum += cache->freeNum.load(std::memory_order_relaxed);
+            totals.allocatedBytes += cache->allocatedBytes.load(std::memory_order_relaxed);
+        }
+
+        totals.liveBytes = m_LiveBytes.load(std::memory_order_relaxed);
+        totals.peakBytes = m_PeakBytes.load(std::memory_order_relaxed);
+        totals.transientBytes = m_ArenaOffset.load(std::memory_order_relaxed);
+
+        return totals;
+    }
+
+    template <typename T>
+    inline T* AllocateTransient(size_t num) {
+        return (T*)AllocateTransient(sizeof(T) * num, alignof(T));
+    }
+
+    // Lock-free bump allocation, safe to call from any thread
+    void* AllocateTransient(size_t size, size_t alignment = 16) {
+        size_t offset = m_ArenaOffset.fetch_add(size + alignment - 1, std::memory_order_relaxed);
+        if (offset + size + alignment - 1 <= m_ArenaSize)
+            return (void*)helper::Align((uintptr_t)(m_Arena.get() + offset), alignment);
+
+        // Rare, the arena gets bigger on the next "BeginFrame"
+        uint8_t* chunk = (uint8_t*)malloc(size + alignment - 1);
+        NRI_ABORT_ON_FALSE(chunk);
+
+        std::lock_guard<std::mutex> lock(m_CacheLock);
+        m_ArenaOverflow.push_back(chunk);
+
+        return (void*)helper::Align((uintptr_t)chunk, alignment);
+    }
+
+    void* Allocate(size_t size, size_t alignment) {
+        ThreadCache& cache = GetThreadCache();
+
+        uint8_t* memory = nullptr;
+        uint64_t blockSize = size;
+        if (m_Mode == Mode::POOL && size <= MAX_POOLED_SIZE && alignment <= sizeof(Header)) {
+            uint32_t sizeClass = GetSizeClass(size);
+            blockSize = GetClassSize(sizeClass);
+
+            FreeBlock* block = cache.freeLists[sizeClass];
+            if (!block) {
+                ReclaimRemoteFrees(cache);
+                block = cache.freeLists[sizeClass];
+            }
+
+            if (block) {
+                cache.freeLists[sizeClass] = block->next;
+                memory = (uint8_t*)block;
+            } else
+                memory = CarveBlock(cache, sizeClass);
+        } else {
+            alignment = std::max(alignment, sizeof(Header));
+
+            uint8_t* base = (uint8_t*)malloc(size + sizeof(Header) + alignment - 1);
+            if (!base)
+                return nullptr;
+
+            memory = (uint8_t*)helper::Align((uintptr_t)(base + sizeof(Header)), alignment);
+
+            Header* header = (Header*)memory - 1;
+            header->ownerOrSize = size;
+            header->sizeClass = SYSTEM_CLASS;
+            header->offset = uint32_t(memory - base);
+        }
+
+        cache.allocationNum.fetch_add(1, std::memory_order_relaxed);
+        cache.allocatedBytes.fetch_add(blockSize, std::memory_order_relaxed);
+
+        uint64_t liveBytes = m_LiveBytes.fetch_add(blockSize, std::memory_order_relaxed) + blockSize;
+        uint64_t peakBytes = m_PeakBytes.load(std::memory_order_relaxed);
+        while (liveBytes > peakBytes && !m_PeakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed))
+            ;
+
+        return memory;
+    }
+
+    void Free(void* memory) {
+        if (!memory)
+            return;
+
+        ThreadCache& cache = GetThreadCache();
+        Header* header = (Header*)memory - 1;
+
+        uint64_t blockSize;
+        if (header->sizeClass == SYSTEM_CLASS) {
+            blockSize = header->ownerOrSize;
+            free((uint8_t*)memory - header->offset);
+        } else {
+            blockSize = GetClassSize(header->sizeClass);
+
+            FreeBlock* block = (FreeBlock*)memory;
+            ThreadCache* owner = (ThreadCache*)header->ownerOrSize;
+            if (owner == &cache) {
+                block->next = cache.freeLists[header->sizeClass];
+                cache.freeLists[header->sizeClass] = block;
+            } else {
+                block->next = owner->remoteFrees.load(std::memory_order_relaxed);
+                while (!owner->remoteFrees.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed))
+                    ;
+            }
+        }
+
+        cache.freeNum.fetch_add(1, std::memory_order_relaxed);
+        m_LiveBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+    }
+
+    void* Reallocate(void* memory, size_t size, size_t alignment) {
+        if (!memory)
+            return Allocate(size, alignment);
+
+        Header* header = (Header*)memory - 1;
+        size_t oldSize = header->sizeClass == SYSTEM_CLASS ? (size_t)header->ownerOrSize : GetClassSize(header->sizeClass) - sizeof(Header);
+
+        // Still fits and alignment is satisfied
+        if (header->sizeClass != SYSTEM_CLASS && size <= oldSize && alignment <= sizeof(Header))
+            return memory;
+
+        void* newMemory = Allocate(size, alignment);
+        if (newMemory) {
+            memcpy(newMemory, memory, std::min(oldSize, size));
+            Free(memory);
+        }
+
+        return newMemory;
+    }
+
+private:
+    // Sizes include the header: 32, 64 ... 4096
+    static constexpr uint32_t CLASS_MIN_LOG2 = 5;
+    static constexpr uint32_t CLASS_NUM = 8;
+    static constexpr uint32_t SYSTEM_CLASS = uint32_t(-1);
+    static constexpr size_t PAGE_SIZE = 64 * 1024;
+
+    struct Header {
+        uint64_t ownerOrSize; // owning "ThreadCache" for pooled blocks, requested size for system blocks
+        uint32_t sizeClass;
+        uint32_t offset; // from the system allocation
+    };
+
+    static constexpr size_t MAX_POOLED_SIZE = (size_t(1) << (CLASS_MIN_LOG2 + CLASS_NUM - 1)) - sizeof(Header);
+
+    // Overlaps user memory, the header stays intact
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct ThreadCache {
+        FreeBlock* freeLists[CLASS_NUM] = {};
+        uint8_t* pageCur = nullptr;
+        uint8_t* pageEnd = nullptr;
+        std::atomic<FreeBlock*> remoteFrees = nullptr;
+        std::atomic_uint64_t allocationNum = 0;
+        std::atomic_uint64_t freeNum = 0;
+        std::atomic_uint64_t allocatedBytes = 0;
+        std::atomic_bool isOrphaned = false;
+    };
+
+    // A cache outlives its thread, it gets orphaned on thread exit and adopted by the next new thread
+    struct ThreadBinding {
+        ThreadCache* cache = nullptr;
+        uint64_t allocatorId = 0;
+
+        ~ThreadBinding() {
+            Release();
+        }
+
+        void Release() {
+            std::lock_guard<std::mutex> lock(GetRegistryLock());
+            std::vector<uint64_t>& registry = GetRegistry();
+            if (allocatorId && std::find(registry.begin(), registry.end(), allocatorId) != registry.end())
+                cache->isOrphaned.store(true, std::memory_order_release);
+
+            cache = nullptr;
+            allocatorId = 0;
+        }
+    };
+
+    static inline std::mutex& GetRegistryLock() {
+        static std::mutex registryLock;
+        return registryLock;
+    }
+
+    // IDs of live allocators
+    static inline std::vector<uint64_t>& GetRegistry() {
+        static std::vector<uint64_t> registry;
+        return registry;
+    }
+
+    static inline uint32_t GetSizeClass(size_t size) {
+        size += sizeof(Header) - 1;
+
+        uint32_t sizeClass = 0;
+        while ((size >> (CLASS_MIN_LOG2 + sizeClass)) != 0)
+            sizeClass++;
+
+        return sizeClass;
+    }
+
+    static inline size_t GetClassSize(uint32_t sizeClass) {
+        return size_t(1) << (CLASS_MIN_LOG2 + sizeClass);
+    }
+
+    ThreadCache& GetThreadCache() {
+        static thread_local ThreadBinding binding;
+        if (binding.allocatorId == m_Id)
+            return *binding.cache;
+
+        if (binding.allocatorId)
+            binding.Release();
+
+        std::lock_guard<std::mutex> lock(m_CacheLock);
+
+        ThreadCache* cache = nullptr;
+        for (const std::unique_ptr<ThreadCache>& candidate : m_Caches) {
+            bool isOrphaned = true;
+            if (candidate->isOrphaned.compare_exchange_strong(isOrphaned, false, std::memory_order_acquire)) {
+                cache = candidate.get();
+                break;
+            }
+        }
+
+        if (!cache) {
+            m_Caches.emplace_back(new ThreadCache);
+            cache = m_Caches.back().get();
+        }
+
+        binding.cache = cache;
+        binding.allocatorId = m_Id;
+
+        return *cache;
+    }
+
+    void ReclaimRemoteFrees(ThreadCache& cache) {
+        FreeBlock* block = cache.remoteFrees.exchange(nullptr, std::memory_order_acquire);
+        while (block) {
+            FreeBlock* next = block->next;
+
+            uint32_t sizeClass = ((Header*)block - 1)->sizeClass;
+            block->next = cache.freeLists[sizeClass];
+            cache.freeLists[sizeClass] = block;
+
+            block = next;
+        }
+    }
+
+    uint8_t* CarveBlock(ThreadCache& cache, uint32_t sizeClass) {
+        size_t blockSize = GetClassSize(sizeClass);
+
+        // The tail of the previous page is abandoned
+        if (cache.pageCur + blockSize > cache.pageEnd) {
+            uint8_t* page = (uint8_t*)malloc(PAGE_SIZE);
+            NRI_ABORT_ON_FALSE(page);
+
+            cache.pageCur = page;
+            cache.pageEnd = page + PAGE_SIZE;
+
+            std::lock_guard<std::mutex> lock(m_CacheLock);
+            m_Pages.push_back(page);
+        }
+
+        Header* header = (Header*)cache.pageCur;
+        header->ownerOrSize = (uint64_t)&cache;
+        header->sizeClass = sizeClass;
+        header->offset = 0;
+
+        cache.pageCur += blockSize;
+
+        return (uint8_t*)(header + 1);
+    }
+
+    static void* AllocateCallback(void* userArg, size_t size, size_t alignment) {
+        return ((HostAllocator*)userArg)->Allocate(size, alignment);
+    }
+
+    static void* ReallocateCallback(void* userArg, void* memory, size_t size, size_t alignment) {
+        return ((HostAllocator*)userArg)->Reallocate(memory, size, alignment);
+    }
+
+    static void FreeCallback(void* userArg, void* memory) {
+        ((HostAllocator*)userArg)->Free(memory);
+    }
+
+private:
+    std::vector<std::unique_ptr<ThreadCache>> m_Caches;
+    std::vector<void*> m_Pages;
+    std::vector<void*> m_ArenaOverflow;
+    std::unique_ptr<uint8_t[]> m_Arena;
+    std::mutex m_CacheLock;
+    std::atomic_uint64_t m_LiveBytes = 0;
+    std::atomic_uint64_t m_PeakBytes = 0;
+    std::atomic<size_t> m_ArenaOffset = 0;
+    Stats m_FrameStats = {};
+    Stats m_PrevTotals = {};
+    size_t m_ArenaSize = 0;
+    uint64_t m_Id = 0;
+    Mode m_Mode = Mode::POOL;
+};
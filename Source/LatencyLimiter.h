@@ -0,0 +1,184 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <thread>
+
+// Software latency limiter for devices without "LowLatencyInterface". Completion of every frame is observed by polling
+// the frame fence (frame "N" must signal "1 + N"). The GPU time of a frame is the time from its start (the later of its
+// submission and the completion of the previous frame) to its completion. "Sleep" predicts when the GPU drains the
+// already submitted frames and delays the CPU, so the next submission arrives just in time and input is sampled as late
+// as possible. A completion is seen at the next poll, so samples are noisy, medians are used for the prediction.
+// Input-to-present latency is estimated as input-to-GPU-completion, which holds for immediate presentation
+class LatencyLimiter {
+public:
+    enum Mode : uint32_t {
+        QUEUING,
+        LIMITER,
+
+        MAX_NUM
+    };
+
+    static constexpr double SLEEP_MARGIN = 0.5; // ms
+    static constexpr double POLL_PERIOD = 0.25; // ms
+
+    inline double GetGpuTime() const {
+        return Median(m_GpuTimes);
+    }
+
+    // From input sampling to submission, waits excluded
+    inline double GetCpuTime() const {
+        return Median(m_CpuTimes);
+    }
+
+    inline double GetSleepTime() const {
+        return m_SleepTime;
+    }
+
+    inline uint64_t GetCompletedFrameNum() const {
+        return m_CompletedFrameNum;
+    }
+
+    // Valid for a few recently completed frames
+    inline double GetCompletionTime(uint32_t frameIndex) const {
+        return m_Frames[frameIndex % m_Frames.size()].completionTime;
+    }
+
+    // Smoothed, 0 if not measured yet
+    inline double GetLatency(Mode mode) const {
+        return m_Latency[mode];
+    }
+
+    void Create(const nri::CoreInterface& NRI, nri::Fence& frameFence) {
+        m_NRI = &NRI;
+        m_FrameFence = &frameFence;
+        m_CompletedFrameNum = NRI.GetFenceValue(frameFence);
+        m_LastCompletionTime = Now();
+    }
+
+    // Records completion times of finished frames
+    void Poll() {
+        const uint64_t completedFrameNum = m_NRI->GetFenceValue(*m_FrameFence);
+        if (completedFrameNum == m_CompletedFrameNum)
+            return;
+
+        // Several frames completed since the last poll share one time, only the first one is worth a GPU time sample
+        const double now = Now();
+        const bool isPrecise = completedFrameNum == m_CompletedFrameNum + 1;
+
+        for (; m_CompletedFrameNum < completedFrameNum; m_CompletedFrameNum++) {
+            FrameTimes& frame = m_Frames[m_CompletedFrameNum % m_Frames.size()];
+            frame.completionTime = now;
+
+            if (isPrecise)
+                Push(m_GpuTimes, m_GpuTimeIndex, now - std::max(frame.submitTime, m_LastCompletionTime));
+
+            const double latency = now - frame.inputTime;
+            double& smoothedLatency = m_Latency[frame.mode];
+            smoothedLatency = smoothedLatency == 0.0 ? latency : smoothedLatency * 0.95 + latency * 0.05;
+
+            m_LastCompletionTime = now;
+        }
+    }
+
+    // Waits for the completion of the frame. The wait is not counted as CPU time and the completion time is precise
+    void Wait(uint32_t frameIndex) {
+        const double begin = Now();
+        m_NRI->Wait(*m_FrameFence, 1 + (uint64_t)frameIndex);
+        m_WaitTime += Now() - begin;
+
+        Poll();
+    }
+
+    // Call just before sampling input. Without "isEnabled" only timings are recorded
+    void Sleep(uint32_t frameIndex, bool isEnabled) {
+        Poll();
+
+        const double begin = Now();
+        if (isEnabled) {
+            // The prediction is refined while sleeping, since polling observes new completions
+            for (;;) {
+                const double wakeTime = PredictGpuIdleTime(frameIndex) - GetCpuTime() - SLEEP_MARGIN;
+                const double now = Now();
+                if (now >= wakeTime)
+                    break;
+
+                std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(std::min(wakeTime - now, POLL_PERIOD)));
+                Poll();
+            }
+        }
+
+        FrameTimes& frame = m_Frames[frameIndex % m_Frames.size()];
+        frame.inputTime = Now();
+        frame.mode = isEnabled ? LIMITER : QUEUING;
+        m_WaitTime = 0.0;
+
+        m_SleepTime = m_SleepTime * 0.95 + (frame.inputTime - begin) * 0.05;
+    }
+
+    // Call right after the frame is submitted
+    void Submit(uint32_t frameIndex) {
+        FrameTimes& frame = m_Frames[frameIndex % m_Frames.size()];
+        frame.submitTime = Now();
+
+        Push(m_CpuTimes, m_CpuTimeIndex, frame.submitTime - frame.inputTime - m_WaitTime);
+        Poll();
+    }
+
+private:
+    static constexpr uint32_t WINDOW_SIZE = 15;
+
+    using Window = std::array<double, WINDOW_SIZE>;
+
+    struct FrameTimes {
+        double inputTime;
+        double submitTime;
+        double completionTime;
+        Mode mode;
+    };
+
+    static double Now() {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    static void Push(Window& window, uint32_t& index, double value) {
+        window[index] = value;
+        index = (index + 1) % WINDOW_SIZE;
+    }
+
+    static double Median(const Window& window) {
+        Window sorted = window;
+        std::nth_element(sorted.begin(), sorted.begin() + WINDOW_SIZE / 2, sorted.end());
+
+        return sorted[WINDOW_SIZE / 2];
+    }
+
+    // Submitted but not completed frames are executed back to back
+    double PredictGpuIdleTime(uint32_t frameIndex) const {
+        const double gpuTime = GetGpuTime();
+
+        double idleTime = m_LastCompletionTime;
+        for (uint64_t i = m_CompletedFrameNum; i < frameIndex; i++)
+            idleTime = std::max(idleTime, m_Frames[i % m_Frames.size()].submitTime) + gpuTime;
+
+        return idleTime;
+    }
+
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Fence* m_FrameFence = nullptr;
+    std::array<FrameTimes, 8> m_Frames = {}; // more than queued frames
+    std::array<double, MAX_NUM> m_Latency = {};
+    Window m_GpuTimes = {};
+    Window m_CpuTimes = {};
+    uint64_t m_CompletedFrameNum = 0;
+    double m_LastCompletionTime = 0.0;
+    double m_SleepTime = 0.0;
+    double m_WaitTime = 0.0; // since input sampling
+    uint32_t m_GpuTimeIndex = 0;
+    uint32_t m_CpuTimeIndex = 0;
+};
@@ -0,0 +1,244 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Records latency markers with CPU timestamps, independently of "LowLatencyInterface". "Record" is lock-free and can be
+// called from any thread: a slot of the ring is claimed by an atomic increment and guarded by a seqlock, its sequence
+// number is odd while the payload is written and even once it's published. The payload is atomic (relaxed), so a reader
+// racing with a writer that has lapped the ring sees a changed sequence and drops the event instead of tearing it.
+// "Resolve" is called by one thread once per frame. It drains the ring, assembles frames and turns complete frames into
+// stage durations, which feed the percentiles and, if a file is given, a per-frame CSV. "GPU_END" is an observation of
+// the frame completion (for example, via a frame fence). The GPU is assumed to execute frames back to back, a frame
+// starts after its submission and the completion of the previous frame, the time before the start is "QUEUE"
+class LatencyRecorder {
+public:
+    enum Marker : uint32_t {
+        SIMULATION_START,
+        INPUT_SAMPLE,
+        SIMULATION_END,
+        RENDER_SUBMIT_START,
+        RENDER_SUBMIT_END,
+        PRESENT_START,
+        PRESENT_END,
+        GPU_END,
+
+        MARKER_NUM
+    };
+
+    enum Stage : uint32_t {
+        SLEEP,         // simulation start - input
+        SIMULATION,    // input - simulation end
+        RENDER_SUBMIT, // simulation end - render submit end
+        PRESENT,       // present call
+        QUEUE,         // render submit end - GPU start
+        GPU,           // GPU start - GPU end
+        TOTAL,         // input - GPU end
+
+        STAGE_NUM
+    };
+
+    enum Percentile : uint32_t {
+        P50,
+        P95,
+        P99,
+
+        PERCENTILE_NUM
+    };
+
+    using Breakdown = std::array<std::array<double, PERCENTILE_NUM>, STAGE_NUM>; // ms
+
+    static constexpr uint32_t RING_SIZE = 1024;
+    static constexpr uint32_t FRAME_WINDOW = 16;     // frames being assembled
+    static constexpr uint32_t RECENT_FRAME_NUM = 256; // for "GetRecentBreakdown"
+
+    static double Now() {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    static const char* GetStageName(Stage stage) {
+        static const char* names[] = {"sleep", "simulation", "render_submit", "present", "queue", "gpu", "total"};
+        static_assert(sizeof(names) / sizeof(names[0]) == STAGE_NUM, "Unexpected");
+
+        return names[stage];
+    }
+
+    ~LatencyRecorder() {
+        Destroy();
+    }
+
+    inline uint32_t GetFrameNum() const {
+        return (uint32_t)m_RunStages[TOTAL].size();
+    }
+
+    inline uint64_t GetDroppedEventNum() const {
+        return m_DroppedEventNum;
+    }
+
+    // "csvFileName" can be empty
+    void Create(const std::string& csvFileName) {
+        if (csvFileName.empty())
+            return;
+
+        m_File = fopen(csvFileName.c_str(), "w");
+        NRI_ABORT_ON_FALSE(m_File);
+
+        fprintf(m_File, "frame");
+        for (uint32_t i = 0; i < STAGE_NUM; i++)
+            fprintf(m_File, ",%s", GetStageName((Stage)i));
+        fprintf(m_File, "\n");
+    }
+
+    // Prints the breakdown of the whole run if a CSV file is written (the CSV itself keeps one row per frame)
+    void Destroy() {
+        if (m_File && GetFrameNum()) {
+            Breakdown breakdown;
+            GetRunBreakdown(breakdown);
+
+            printf("Latency breakdown over %u frames (ms):\nstage,p50,p95,p99\n", GetFrameNum());
+            for (uint32_t i = 0; i < STAGE_NUM; i++)
+                printf("%s,%.3f,%.3f,%.3f\n", GetStageName((Stage)i), breakdown[i][P50], breakdown[i][P95], breakdown[i][P99]);
+        }
+
+        for (std::vector<float>& durations : m_RunStages)
+            durations.clear();
+
+        if (m_File) {
+            fclose(m_File);
+            m_File = nullptr;
+        }
+    }
+
+    void Record(uint32_t frameIndex, Marker marker, double time = Now()) {
+        const uint64_t index = m_WriteIndex.fetch_add(1, std::memory_order_relaxed);
+
+        Event& event = m_Events[index % RING_SIZE];
+        event.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        event.time.store(time, std::memory_order_relaxed);
+        event.frameIndex.store(frameIndex, std::memory_order_relaxed);
+        event.marker.store(marker, std::memory_order_relaxed);
+        event.sequence.store(index * 2 + 2, std::memory_order_release);
+    }
+
+    void Resolve() {
+        const uint64_t writeIndex = m_WriteIndex.load(std::memory_order_acquire);
+
+        for (; m_ReadIndex < writeIndex; m_ReadIndex++) {
+            const Event& event = m_Events[m_ReadIndex % RING_SIZE];
+
+            // Not published yet, the rest is read next time
+            const uint64_t published = m_ReadIndex * 2 + 2;
+            const uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+            if (sequence < published)
+                break;
+
+            const double time = event.time.load(std::memory_order_relaxed);
+            const uint32_t frameIndex = event.frameIndex.load(std::memory_order_relaxed);
+            const Marker marker = event.marker.load(std::memory_order_relaxed);
+
+            // Overwritten or being overwritten, the ring has been lapped
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence != published || event.sequence.load(std::memory_order_relaxed) != sequence) {
+                m_DroppedEventNum++;
+                continue;
+            }
+
+            FrameMarkers& frame = m_Frames[frameIndex % FRAME_WINDOW];
+            if (frame.frameIndex != frameIndex) {
+                frame.frameIndex = frameIndex;
+                frame.markerMask = 0;
+            }
+
+            frame.times[marker] = time;
+            frame.markerMask |= 1u << marker;
+
+            if (frame.markerMask == (1u << MARKER_NUM) - 1) {
+                AddFrame(frame);
+                frame.markerMask = 0;
+            }
+        }
+    }
+
+    void GetRecentBreakdown(Breakdown& breakdown) const {
+        const size_t frameNum = std::min(m_RunStages[TOTAL].size(), (size_t)RECENT_FRAME_NUM);
+        for (uint32_t i = 0; i < STAGE_NUM; i++)
+            GetPercentiles(m_RunStages[i].data() + m_RunStages[i].size() - frameNum, frameNum, breakdown[i]);
+    }
+
+    void GetRunBreakdown(Breakdown& breakdown) const {
+        for (uint32_t i = 0; i < STAGE_NUM; i++)
+            GetPercentiles(m_RunStages[i].data(), m_RunStages[i].size(), breakdown[i]);
+    }
+
+private:
+    struct Event {
+        std::atomic<uint64_t> sequence; // "index * 2 + 1" while written, "index * 2 + 2" once published
+        std::atomic<double> time;
+        std::atomic<uint32_t> frameIndex;
+        std::atomic<Marker> marker;
+    };
+
+    struct FrameMarkers {
+        std::array<double, MARKER_NUM> times;
+        uint32_t frameIndex = UINT32_MAX;
+        uint32_t markerMask;
+    };
+
+    static void GetPercentiles(const float* durations, size_t num, std::array<double, PERCENTILE_NUM>& percentiles) {
+        percentiles = {};
+        if (!num)
+            return;
+
+        std::vector<float> sorted(durations, durations + num);
+        std::sort(sorted.begin(), sorted.end());
+
+        static const double ranks[] = {0.50, 0.95, 0.99};
+        for (uint32_t i = 0; i < PERCENTILE_NUM; i++)
+            percentiles[i] = sorted[std::min((size_t)(ranks[i] * (double)num), num - 1)];
+    }
+
+    void AddFrame(const FrameMarkers& frame) {
+        const std::array<double, MARKER_NUM>& t = frame.times;
+        const double gpuStart = std::max(t[RENDER_SUBMIT_END], m_PrevGpuEnd);
+        m_PrevGpuEnd = t[GPU_END];
+
+        std::array<double, STAGE_NUM> stages = {};
+        stages[SLEEP] = t[INPUT_SAMPLE] - t[SIMULATION_START];
+        stages[SIMULATION] = t[SIMULATION_END] - t[INPUT_SAMPLE];
+        stages[RENDER_SUBMIT] = t[RENDER_SUBMIT_END] - t[SIMULATION_END];
+        stages[PRESENT] = t[PRESENT_END] - t[PRESENT_START];
+        stages[QUEUE] = gpuStart - t[RENDER_SUBMIT_END];
+        stages[GPU] = t[GPU_END] - gpuStart;
+        stages[TOTAL] = t[GPU_END] - t[INPUT_SAMPLE];
+
+        for (uint32_t i = 0; i < STAGE_NUM; i++)
+            m_RunStages[i].push_back((float)stages[i]);
+
+        if (m_File) {
+            fprintf(m_File, "%u", frame.frameIndex);
+            for (double stage : stages)
+                fprintf(m_File, ",%.3f", stage);
+            fprintf(m_File, "\n");
+        }
+    }
+
+    std::array<Event, RING_SIZE> m_Events = {};
+    std::array<FrameMarkers, FRAME_WINDOW> m_Frames = {};
+    std::array<std::vector<float>, STAGE_NUM> m_RunStages; // per frame
+    std::atomic<uint64_t> m_WriteIndex = 0;
+    FILE* m_File = nullptr;
+    uint64_t m_ReadIndex = 0;
+    uint64_t m_DroppedEventNum = 0;
+    double m_PrevGpuEnd = 0.0;
+};
@@ -2,6 +2,12 @@
 
 #include "NRIFramework.h"
 
+#include "DescriptorAllocator.h"
+#include "LatencyLimiter.h"
+#include "LatencyRecorder.h"
+#include "MemoryAllocator.h"
+#include "QueuedFrameController.h"
+
 #include <array>
 
 // Tweakables, which must be set only once
@@ -32,12 +38,17 @@ public:
 
     ~Sample();
 
+    void InitCmdLine(cmdline::parser& cmdLine) override;
+    void ReadCmdLine(cmdline::parser& cmdLine) override;
     bool Initialize(nri::GraphicsAPI graphicsAPI) override;
     void LatencySleep(uint32_t) override;
     void PrepareFrame(uint32_t) override;
     void RenderFrame(uint32_t frameIndex) override;
 
 private:
+    void PreserveFrameQueue(uint32_t frameIndex);
+    void RecordGpuCompletions();
+
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
     nri::Streamer* m_Streamer = nullptr;
@@ -46,24 +57,37 @@ private:
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     nri::Pipeline* m_Pipeline = nullptr;
     nri::Fence* m_FrameFence = nullptr;
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::DescriptorSet* m_DescriptorSet = nullptr;
     nri::Buffer* m_Buffer = nullptr;
-    nri::Memory* m_Memory = nullptr;
     nri::Descriptor* m_BufferStorage = nullptr;
 
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
+    LatencyLimiter m_LatencyLimiter;
+    LatencyRecorder m_LatencyRecorder;
+    QueuedFrameController m_QueuedFrameController;
     std::array<Frame, QUEUED_FRAMES_MAX_NUM> m_Frames = {};
     std::vector<BackBuffer> m_SwapChainBuffers;
+    std::string m_LatencyCsvFileName;
+    uint64_t m_RecordedCompletionNum = 0;
     float m_CpuWorkload = 4.0f;                        // ms
     uint32_t m_GpuWorkload = 10;                       // in pigeons, current settings give ~10 ms on RTX 4080
     uint32_t m_QueuedFrameNum = QUEUED_FRAMES_MAX_NUM; // [1; QUEUED_FRAMES_MAX_NUM]
     bool m_AllowLowLatency = false;
     bool m_EnableLowLatency = false;
+    bool m_EnableLatencyLimiter = false;
+    bool m_EnableQueuedFrameController = true;
 };
 
 Sample::~Sample() {
     NRI.WaitForIdle(*m_CommandQueue);
 
+    // Flush the latency history
+    m_LatencyLimiter.Poll();
+    RecordGpuCompletions();
+    m_LatencyRecorder.Resolve();
+    m_LatencyRecorder.Destroy();
+
     for (Frame& frame : m_Frames) {
         NRI.DestroyCommandBuffer(*frame.commandBuffer);
         NRI.DestroyCommandAllocator(*frame.commandAllocator);
@@ -72,7 +96,7 @@ Sample::~Sample() {
     for (BackBuffer& backBuffer : m_SwapChainBuffers)
         NRI.DestroyDescriptor(*backBuffer.colorAttachment);
 
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
+    m_DescriptorAllocator.Destroy();
     NRI.DestroyDescriptor(*m_BufferStorage);
     NRI.DestroyBuffer(*m_Buffer);
     NRI.DestroyPipeline(*m_Pipeline);
@@ -81,13 +105,21 @@ Sample::~Sample() {
     NRI.DestroySwapChain(*m_SwapChain);
     NRI.DestroyStreamer(*m_Streamer);
 
-    NRI.FreeMemory(*m_Memory);
+    m_MemoryAllocator.Destroy();
 
     DestroyUI(NRI);
 
     nri::nriDestroyDevice(*m_Device);
 }
 
+void Sample::InitCmdLine(cmdline::parser& cmdLine) {
+    cmdLine.add<std::string>("latencyCsv", 0, "write per-frame latency breakdown to a CSV file", false, "");
+}
+
+void Sample::ReadCmdLine(cmdline::parser& cmdLine) {
+    m_LatencyCsvFileName = cmdLine.get<std::string>("latencyCsv");
+}
+
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     nri::AdapterDesc bestAdapterDesc = {};
     uint32_t adapterDescsNum = 1;
@@ -120,6 +152,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     streamerDesc.frameInFlightNum = QUEUED_FRAMES_MAX_NUM;
     NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
+    // Memory allocator
+    m_MemoryAllocator.Create(NRI, *m_Device);
+
+    // Descriptor allocator
+    m_DescriptorAllocator.Create(NRI, *m_Device, QUEUED_FRAMES_MAX_NUM);
+
     // Low latency
     m_AllowLowLatency = ALLOW_LOW_LATENCY && deviceDesc.isLowLatencySupported;
 
@@ -132,6 +170,16 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     // Fence
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
+    // Software latency limiter (a fallback if low latency is not supported)
+    m_LatencyLimiter.Create(NRI, *m_FrameFence);
+    m_EnableLatencyLimiter = !m_AllowLowLatency;
+
+    // Latency markers (recorded even without low latency support)
+    m_LatencyRecorder.Create(m_LatencyCsvFileName);
+
+    // Adaptive frame queue
+    m_QueuedFrameController.Create(QUEUED_FRAMES_MAX_NUM, m_QueuedFrameNum);
+
     // Swap chain
     nri::Format swapChainFormat;
     {
@@ -176,7 +224,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         resourceGroupDesc.bufferNum = 1;
         resourceGroupDesc.buffers = &m_Buffer;
 
-        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, &m_Memory));
+        m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
         nri::BufferViewDesc bufferViewDesc = {};
         bufferViewDesc.buffer = m_Buffer;
@@ -197,6 +245,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
         pipelineLayoutDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
         NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_PipelineLayout, pipelineLayoutDesc);
 
         nri::ComputePipelineDesc computePipelineDesc = {};
         computePipelineDesc.pipelineLayout = m_PipelineLayout;
@@ -204,13 +253,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_Pipeline));
     }
 
-    { // Descriptor pool
-        nri::DescriptorPoolDesc descriptorPoolDesc = {};
-        descriptorPoolDesc.descriptorSetMaxNum = 1;
-        descriptorPoolDesc.storageBufferMaxNum = 1;
-
-        NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 0, &m_DescriptorSet, 1, 0));
+    { // Descriptor set
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, 0, &m_DescriptorSet, 1);
 
         nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDesc = {&m_BufferStorage, 1, 0};
         NRI.UpdateDescriptorRanges(*m_DescriptorSet, 0, 1, &descriptorRangeUpdateDesc);
@@ -225,8 +269,31 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     return InitUI(NRI, NRI, *m_Device, swapChainFormat);
 }
 
+// Frames use all slots round robin, so the queue depth can change without idling: the slot of the frame is freed by
+// waiting for the frame "QUEUED_FRAMES_MAX_NUM" frames back, which is implied by the queue depth wait
+void Sample::PreserveFrameQueue(uint32_t frameIndex) {
+    if (frameIndex >= m_QueuedFrameNum)
+        m_LatencyLimiter.Wait(frameIndex - m_QueuedFrameNum);
+
+    if (frameIndex >= m_Frames.size()) {
+        const Frame& frame = m_Frames[frameIndex % m_Frames.size()];
+        NRI.ResetCommandAllocator(*frame.commandAllocator);
+    }
+
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+}
+
+// GPU completions are observed by the latency limiter
+void Sample::RecordGpuCompletions() {
+    for (; m_RecordedCompletionNum < m_LatencyLimiter.GetCompletedFrameNum(); m_RecordedCompletionNum++) {
+        const uint32_t frameIndex = (uint32_t)m_RecordedCompletionNum;
+        m_LatencyRecorder.Record(frameIndex, LatencyRecorder::GPU_END, m_LatencyLimiter.GetCompletionTime(frameIndex));
+    }
+}
+
 void Sample::LatencySleep(uint32_t frameIndex) {
     // Marker
+    m_LatencyRecorder.Record(frameIndex, LatencyRecorder::SIMULATION_START);
     if (m_AllowLowLatency)
         NRI.SetLatencyMarker(*m_SwapChain, nri::LatencyMarker::SIMULATION_START);
 
@@ -235,22 +302,21 @@ void Sample::LatencySleep(uint32_t frameIndex) {
         NRI.WaitForPresent(*m_SwapChain);
 
     // Preserve frame queue (optimal place for "non-waitable" swap chain)
-    if constexpr (WAITABLE_SWAP_CHAIN == EMULATE_BAD_PRACTICE) {
-        const Frame& frame = m_Frames[frameIndex % m_QueuedFrameNum];
-        if (frameIndex >= m_QueuedFrameNum) {
-            NRI.Wait(*m_FrameFence, 1 + frameIndex - m_QueuedFrameNum);
-            NRI.ResetCommandAllocator(*frame.commandAllocator);
-        }
-    }
+    if constexpr (WAITABLE_SWAP_CHAIN == EMULATE_BAD_PRACTICE)
+        PreserveFrameQueue(frameIndex);
 
     // Sleep just before sampling input
-    if (m_AllowLowLatency) {
+    if (m_AllowLowLatency)
         NRI.LatencySleep(*m_SwapChain);
+
+    m_LatencyLimiter.Sleep(frameIndex, m_EnableLatencyLimiter && !m_EnableLowLatency);
+
+    m_LatencyRecorder.Record(frameIndex, LatencyRecorder::INPUT_SAMPLE);
+    if (m_AllowLowLatency)
         NRI.SetLatencyMarker(*m_SwapChain, nri::LatencyMarker::INPUT_SAMPLE);
-    }
 }
 
-void Sample::PrepareFrame(uint32_t) {
+void Sample::PrepareFrame(uint32_t frameIndex) {
     // Emulate CPU workload
     double begin = m_Timer.GetTimeStamp() + m_CpuWorkload;
     while (m_Timer.GetTimeStamp() < begin)
@@ -263,8 +329,14 @@ void Sample::PrepareFrame(uint32_t) {
     ImGui::GetForegroundDrawList()->AddRectFilled(p, ImVec2(p.x + 20, p.y + 20), IM_COL32(128, 10, 10, 255));
 
     // Stats
+    RecordGpuCompletions();
+    m_LatencyRecorder.Resolve();
+
+    LatencyRecorder::Breakdown breakdown;
+    m_LatencyRecorder.GetRecentBreakdown(breakdown);
+
     bool enableLowLatencyPrev = m_EnableLowLatency;
-    uint32_t queuedFrameNumPrev = m_QueuedFrameNum;
+    bool enableQueuedFrameControllerPrev = m_EnableQueuedFrameController;
 
     nri::LatencyReport latencyReport = {};
     if (m_AllowLowLatency)
@@ -286,6 +358,19 @@ void Sample::PrepareFrame(uint32_t) {
         ImGui::Separator();
         ImGui::Text("Frame time         : %6.2f ms", m_Timer.GetSmoothedFrameTime());
         ImGui::Separator();
+        ImGui::Text("Software limiter (fence based):");
+        ImGui::Text("  GPU              : %6.2f ms", m_LatencyLimiter.GetGpuTime());
+        ImGui::Text("  Input - submit   : %6.2f ms", m_LatencyLimiter.GetCpuTime());
+        ImGui::Text("  Sleep            : %6.2f ms", m_LatencyLimiter.GetSleepTime());
+        ImGui::Text("  Latency, queuing : %6.2f ms", m_LatencyLimiter.GetLatency(LatencyLimiter::QUEUING));
+        ImGui::Text("  Latency, limiter : %6.2f ms", m_LatencyLimiter.GetLatency(LatencyLimiter::LIMITER));
+        ImGui::Separator();
+        ImGui::Text("Markers (ms)            p50    p95    p99");
+        for (uint32_t i = 0; i < LatencyRecorder::STAGE_NUM; i++) {
+            const std::array<double, LatencyRecorder::PERCENTILE_NUM>& percentiles = breakdown[i];
+            ImGui::Text("  %-16s : %6.2f %6.2f %6.2f", LatencyRecorder::GetStageName((LatencyRecorder::Stage)i), percentiles[0], percentiles[1], percentiles[2]);
+        }
+        ImGui::Separator();
 
         ImGui::Text("CPU workload (ms):");
         ImGui::SetNextItemWidth(210.0f);
@@ -295,7 +380,21 @@ void Sample::PrepareFrame(uint32_t) {
         ImGui::SliderInt("##GPU", (int32_t*)&m_GpuWorkload, 1, 20, "%d", ImGuiSliderFlags_NoInput);
         ImGui::Text("Queued frames:");
         ImGui::SetNextItemWidth(210.0f);
+        if (m_EnableQueuedFrameController)
+            ImGui::BeginDisabled();
         ImGui::SliderInt("##Frames", (int32_t*)&m_QueuedFrameNum, 1, (int32_t)m_Frames.size(), "%d", ImGuiSliderFlags_NoInput);
+        if (m_EnableQueuedFrameController)
+            ImGui::EndDisabled();
+        ImGui::Checkbox("Adaptive queued frames (F3)", &m_EnableQueuedFrameController);
+        if (IsKeyToggled(Key::F3))
+            m_EnableQueuedFrameController = !m_EnableQueuedFrameController;
+
+        if (m_EnableQueuedFrameController) {
+            for (uint32_t i = 0; i < m_QueuedFrameController.GetDecisionNum(); i++) {
+                const QueuedFrameController::Decision& decision = m_QueuedFrameController.GetDecision(i);
+                ImGui::Text("  #%-7u -> %u  CPU %5.2f  GPU %5.2f  frame %5.2f", decision.frameIndex, decision.queuedFrameNum, decision.cpuTime, decision.gpuTime, decision.frameTime);
+            }
+        }
 
         if (!m_AllowLowLatency)
             ImGui::BeginDisabled();
@@ -305,6 +404,15 @@ void Sample::PrepareFrame(uint32_t) {
         if (!m_AllowLowLatency)
             ImGui::EndDisabled();
 
+        // Doesn't stack with the driver limiter
+        if (m_EnableLowLatency)
+            ImGui::BeginDisabled();
+        ImGui::Checkbox("Software limiter (F2)", &m_EnableLatencyLimiter);
+        if (!m_EnableLowLatency && IsKeyToggled(Key::F2))
+            m_EnableLatencyLimiter = !m_EnableLatencyLimiter;
+        if (m_EnableLowLatency)
+            ImGui::EndDisabled();
+
         ImGui::BeginDisabled();
         bool waitable = WAITABLE_SWAP_CHAIN;
         ImGui::Checkbox("Waitable swapchain (" STRINGIFY(WAITABLE_SWAP_CHAIN_MAX_FRAME_LATENCY) ")", &waitable);
@@ -325,10 +433,17 @@ void Sample::PrepareFrame(uint32_t) {
         NRI.SetLatencySleepMode(*m_SwapChain, sleepMode);
     }
 
-    if (queuedFrameNumPrev != m_QueuedFrameNum)
-        NRI.WaitForIdle(*m_CommandQueue);
+    // The next frame waits for the frame "m_QueuedFrameNum" back, no need to idle
+    if (m_EnableQueuedFrameController) {
+        if (!enableQueuedFrameControllerPrev)
+            m_QueuedFrameController.Reset(m_QueuedFrameNum);
+
+        if (m_QueuedFrameController.Update(frameIndex, m_LatencyLimiter.GetCpuTime(), m_LatencyLimiter.GetGpuTime()))
+            m_QueuedFrameNum = m_QueuedFrameController.GetQueuedFrameNum();
+    }
 
     // Marker
+    m_LatencyRecorder.Record(frameIndex, LatencyRecorder::SIMULATION_END);
     if (m_AllowLowLatency)
         NRI.SetLatencyMarker(*m_SwapChain, nri::LatencyMarker::SIMULATION_END);
 }
@@ -336,19 +451,15 @@ void Sample::PrepareFrame(uint32_t) {
 void Sample::RenderFrame(uint32_t frameIndex) {
     const uint32_t backBufferIndex = NRI.AcquireNextSwapChainTexture(*m_SwapChain);
     const BackBuffer& backBuffer = m_SwapChainBuffers[backBufferIndex];
-    const Frame& frame = m_Frames[frameIndex % m_QueuedFrameNum];
+    const Frame& frame = m_Frames[frameIndex % m_Frames.size()];
 
     // Preserve frame queue (optimal place for "waitable" swapchain)
-    if constexpr (WAITABLE_SWAP_CHAIN != EMULATE_BAD_PRACTICE) {
-        if (frameIndex >= m_QueuedFrameNum) {
-            NRI.Wait(*m_FrameFence, 1 + frameIndex - m_QueuedFrameNum);
-            NRI.ResetCommandAllocator(*frame.commandAllocator);
-        }
-    }
+    if constexpr (WAITABLE_SWAP_CHAIN != EMULATE_BAD_PRACTICE)
+        PreserveFrameQueue(frameIndex);
 
     // Record
     nri::CommandBuffer& commandBuffer = *frame.commandBuffer;
-    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
     {
         nri::TextureBarrierDesc swapchainBarrier = {};
         swapchainBarrier.texture = backBuffer.texture;
@@ -427,16 +538,22 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         queueSubmitDesc.signalFences = &signalFence;
         queueSubmitDesc.signalFenceNum = 1;
 
+        m_LatencyRecorder.Record(frameIndex, LatencyRecorder::RENDER_SUBMIT_START);
         if (m_AllowLowLatency) {
             NRI.SetLatencyMarker(*m_SwapChain, nri::LatencyMarker::RENDER_SUBMIT_START);
             NRI.QueueSubmitTrackable(*m_CommandQueue, queueSubmitDesc, *m_SwapChain);
             NRI.SetLatencyMarker(*m_SwapChain, nri::LatencyMarker::RENDER_SUBMIT_END);
         } else
             NRI.QueueSubmit(*m_CommandQueue, queueSubmitDesc);
+        m_LatencyRecorder.Record(frameIndex, LatencyRecorder::RENDER_SUBMIT_END);
+
+        m_LatencyLimiter.Submit(frameIndex);
     }
 
     // Present
+    m_LatencyRecorder.Record(frameIndex, LatencyRecorder::PRESENT_START);
     NRI.QueuePresent(*m_SwapChain);
+    m_LatencyRecorder.Record(frameIndex, LatencyRecorder::PRESENT_END);
 }
 
 SAMPLE_MAIN(Sample, 0);
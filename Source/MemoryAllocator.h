@@ -0,0 +1,479 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#ifdef _MSC_VER
+#    include <intrin.h>
+#endif
+
+// Sub-allocates resources from large memory blocks, one set of blocks per memory type. Free ranges of a block are
+// tracked with TLSF (two-level segregated fit): allocation and free are O(1), neighbor free ranges are merged on free.
+// Resources which must be dedicated or are larger than half of a block get their own memory object. An empty block is
+// released, unless it's the last such block of its memory type. Linear (buffers, acceleration structures) and non-linear
+// (textures) resources never share a block, so "bufferImageGranularity" can't be violated by neighbors
+class MemoryAllocator {
+public:
+    struct Allocation {
+        nri::Memory* memory;
+        uint64_t offset;
+        uint32_t blockIndex;
+        uint32_t nodeIndex;
+    };
+
+    struct Stats {
+        uint64_t blockBytes;       // memory allocated from the device, including dedicated allocations
+        uint64_t usedBytes;        // memory bound to resources
+        uint64_t wastedBytes;      // size rounding, not usable by resources
+        uint64_t largestFreeBytes; // the largest free range across all blocks
+        uint32_t blockNum;
+        uint32_t dedicatedNum;
+        uint32_t allocationNum;
+        float fragmentation; // "1 - sum of the largest free ranges of blocks / total free bytes"
+    };
+
+    ~MemoryAllocator() {
+        Destroy();
+    }
+
+    void Create(const nri::CoreInterface& NRI, nri::Device& device, uint64_t blockSize = 64 * 1024 * 1024) {
+        m_NRI = &NRI;
+        m_Device = &device;
+        m_BlockSize = blockSize;
+    }
+
+    void Destroy() {
+        if (!m_NRI)
+            return;
+
+        for (Block& block : m_Blocks) {
+            if (block.memory)
+                m_NRI->FreeMemory(*block.memory);
+        }
+
+        m_Blocks.clear();
+        m_FreeBlockSlots.clear();
+        m_NRI = nullptr;
+    }
+
+    // Drop-in replacement for "AllocateAndBindMemory". Optionally returns allocations for buffers followed by textures
+    void AllocateAndBind(const nri::ResourceGroupDesc& resourceGroupDesc, Allocation* allocations = nullptr) {
+        std::vector<nri::BufferMemoryBindingDesc> bufferBindings(resourceGroupDesc.bufferNum);
+        for (uint32_t i = 0; i < resourceGroupDesc.bufferNum; i++) {
+            nri::Buffer* buffer = resourceGroupDesc.buffers[i];
+
+            nri::MemoryDesc memoryDesc = {};
+            m_NRI->GetBufferMemoryDesc(*m_Device, m_NRI->GetBufferDesc(*buffer), resourceGroupDesc.memoryLocation, memoryDesc);
+
+            Allocation allocation = Allocate(memoryDesc);
+            bufferBindings[i] = {allocation.memory, buffer, allocation.offset};
+
+            if (allocations)
+                allocations[i] = allocation;
+        }
+
+        std::vector<nri::TextureMemoryBindingDesc> textureBindings(resourceGroupDesc.textureNum);
+        for (uint32_t i = 0; i < resourceGroupDesc.textureNum; i++) {
+            nri::Texture* texture = resourceGroupDesc.textures[i];
+
+            nri::MemoryDesc memoryDesc = {};
+            m_NRI->GetTextureMemoryDesc(*m_Device, m_NRI->GetTextureDesc(*texture), resourceGroupDesc.memoryLocation, memoryDesc);
+
+            Allocation allocation = Allocate(memoryDesc, false);
+            textureBindings[i] = {allocation.memory, texture, allocation.offset};
+
+            if (allocations)
+                allocations[resourceGroupDesc.bufferNum + i] = allocation;
+        }
+
+        if (!bufferBindings.empty())
+            NRI_ABORT_ON_FAILURE(m_NRI->BindBufferMemory(*m_Device, bufferBindings.data(), (uint32_t)bufferBindings.size()));
+
+        if (!textureBindings.empty())
+            NRI_ABORT_ON_FAILURE(m_NRI->BindTextureMemory(*m_Device, textureBindings.data(), (uint32_t)textureBindings.size()));
+    }
+
+    // Acceleration structures don't expose their desc, so the memory desc is provided by the caller
+    Allocation AllocateAndBind(nri::AccelerationStructure& accelerationStructure, const nri::MemoryDesc& memoryDesc) {
+        Allocation allocation = Allocate(memoryDesc);
+
+        const nri::AccelerationStructureMemoryBindingDesc memoryBindingDesc = {allocation.memory, &accelerationStructure, allocation.offset};
+        NRI_ABORT_ON_FAILURE(m_NRI->BindAccelerationStructureMemory(*m_Device, &memoryBindingDesc, 1));
+
+        return allocation;
+    }
+
+    // "isLinear" is "false" for textures
+    Allocation Allocate(const nri::MemoryDesc& memoryDesc, bool isLinear = true) {
+        uint64_t alignment = std::max<uint64_t>(memoryDesc.alignment, MIN_SIZE);
+        uint64_t size = helper::Align(memoryDesc.size, MIN_SIZE);
+
+        if (memoryDesc.mustBeDedicated || size > m_BlockSize / 2)
+            return AllocateDedicated(memoryDesc);
+
+        // Any free range of the found class fits the resource placed at any alignment
+        uint64_t searchSize = size + alignment - MIN_SIZE;
+
+        for (uint32_t i = 0; i < m_Blocks.size(); i++) {
+            Block& block = m_Blocks[i];
+            if (!block.memory || block.isDedicated || block.memoryType != memoryDesc.type || block.isLinear != isLinear)
+                continue;
+
+            uint32_t nodeIndex = FindFreeNode(block, searchSize);
+            if (nodeIndex != INVALID_NODE)
+                return Place(i, nodeIndex, size, alignment, size - memoryDesc.size);
+        }
+
+        uint32_t blockIndex = CreateBlock(memoryDesc.type, m_BlockSize, false);
+        m_Blocks[blockIndex].isLinear = isLinear;
+
+        uint32_t nodeIndex = FindFreeNode(m_Blocks[blockIndex], searchSize);
+        NRI_ABORT_ON_FALSE(nodeIndex != INVALID_NODE);
+
+        return Place(blockIndex, nodeIndex, size, alignment, size - memoryDesc.size);
+    }
+
+    // The resource must be destroyed (or no longer used by the GPU) before its memory gets reused
+    void Free(const Allocation& allocation) {
+        Block& block = m_Blocks[allocation.blockIndex];
+        if (block.isDedicated) {
+            m_NRI->FreeMemory(*block.memory);
+
+            block = {};
+            m_FreeBlockSlots.push_back(allocation.blockIndex);
+
+            return;
+        }
+
+        uint32_t nodeIndex = allocation.nodeIndex;
+        Node& node = block.nodes[nodeIndex];
+        block.usedBytes -= node.size;
+        block.wastedBytes -= node.wastedBytes;
+        block.allocationNum--;
+
+        // Merge with physical neighbors
+        if (node.nextPhys != INVALID_NODE && block.nodes[node.nextPhys].isFree) {
+            uint32_t next = node.nextPhys;
+            RemoveFree(block, next);
+            MergeWithNext(block, nodeIndex);
+        }
+
+        if (node.prevPhys != INVALID_NODE && block.nodes[node.prevPhys].isFree) {
+            uint32_t prev = node.prevPhys;
+            RemoveFree(block, prev);
+            MergeWithNext(block, prev);
+            nodeIndex = prev;
+        }
+
+        InsertFree(block, nodeIndex);
+
+        if (!block.allocationNum) {
+            uint32_t sameTypeBlockNum = 0;
+            for (const Block& other : m_Blocks)
+                sameTypeBlockNum += (other.memory && !other.isDedicated && other.memoryType == block.memoryType && other.isLinear == block.isLinear) ? 1 : 0;
+
+            if (sameTypeBlockNum > 1) {
+                m_NRI->FreeMemory(*block.memory);
+
+                block = {};
+                m_FreeBlockSlots.push_back(allocation.blockIndex);
+            }
+        }
+    }
+
+    Stats GetStats() const {
+        Stats stats = {};
+
+        uint64_t freeBytes = 0;
+        uint64_t largestFreeBytesSum = 0;
+        for (const Block& block : m_Blocks) {
+            if (!block.memory)
+                continue;
+
+            stats.blockBytes += block.size;
+            stats.allocationNum += block.allocationNum;
+
+            if (block.isDedicated) {
+                stats.usedBytes += block.size;
+                stats.dedicatedNum++;
+                continue;
+            }
+
+            stats.usedBytes += block.usedBytes;
+            stats.wastedBytes += block.wastedBytes;
+            stats.blockNum++;
+
+            uint64_t largestFreeBytes = 0;
+            for (const Node& node : block.nodes) {
+                if (node.isFree) {
+                    freeBytes += node.size;
+                    largestFreeBytes = std::max(largestFreeBytes, node.size);
+                }
+            }
+
+            largestFreeBytesSum += largestFreeBytes;
+            stats.largestFreeBytes = std::max(stats.largestFreeBytes, largestFreeBytes);
+        }
+
+        stats.fragmentation = freeBytes ? 1.0f - float(double(largestFreeBytesSum) / double(freeBytes)) : 0.0f;
+
+        return stats;
+    }
+
+private:
+    static constexpr uint32_t INVALID_NODE = uint32_t(-1);
+    static constexpr uint32_t MIN_SIZE = 256;   // all offsets and sizes are multiples of it
+    static constexpr uint32_t FL_OFFSET = 8;    // log2(MIN_SIZE)
+    static constexpr uint32_t FL_NUM = 32;      // sizes up to 2^40
+    static constexpr uint32_t SL_LOG2 = 4;
+    static constexpr uint32_t SL_NUM = 1 << SL_LOG2;
+
+    struct Node {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t prevPhys;
+        uint32_t nextPhys;
+        uint32_t prevFree;
+        uint32_t nextFree;
+        uint32_t wastedBytes;
+        bool isFree;
+    };
+
+    struct Block {
+        nri::Memory* memory;
+        std::vector<Node> nodes;
+        std::vector<uint32_t> unusedNodes;
+        uint64_t size;
+        uint64_t usedBytes;
+        uint64_t wastedBytes;
+        uint32_t freeHeads[FL_NUM][SL_NUM];
+        uint32_t slBitmaps[FL_NUM];
+        uint32_t flBitmap;
+        uint32_t allocationNum;
+        nri::MemoryType memoryType;
+        bool isDedicated;
+        bool isLinear;
+    };
+
+    static inline uint32_t FindLsb(uint32_t x) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return (uint32_t)index;
+#else
+        return (uint32_t)__builtin_ctz(x);
+#endif
+    }
+
+    static inline uint32_t FindMsb(uint64_t x) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, x);
+        return (uint32_t)index;
+#else
+        return 63 - (uint32_t)__builtin_clzll(x);
+#endif
+    }
+
+    static inline void Mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+        uint32_t msb = FindMsb(size);
+        sl = uint32_t(size >> (msb - SL_LOG2)) & (SL_NUM - 1);
+        fl = msb - FL_OFFSET;
+    }
+
+    uint32_t CreateBlock(nri::MemoryType memoryType, uint64_t size, bool isDedicated) {
+        nri::AllocateMemoryDesc allocateMemoryDesc = {};
+        allocateMemoryDesc.size = size;
+        allocateMemoryDesc.type = memoryType;
+
+        uint32_t blockIndex = (uint32_t)m_Blocks.size();
+        if (m_FreeBlockSlots.empty())
+            m_Blocks.emplace_back();
+        else {
+            blockIndex = m_FreeBlockSlots.back();
+            m_FreeBlockSlots.pop_back();
+        }
+
+        Block& block = m_Blocks[blockIndex];
+        block = {};
+        block.size = size;
+        block.memoryType = memoryType;
+        block.isDedicated = isDedicated;
+        NRI_ABORT_ON_FAILURE(m_NRI->AllocateMemory(*m_Device, allocateMemoryDesc, block.memory));
+
+        if (!isDedicated) {
+            for (uint32_t fl = 0; fl < FL_NUM; fl++) {
+                for (uint32_t sl = 0; sl < SL_NUM; sl++)
+                    block.freeHeads[fl][sl] = INVALID_NODE;
+            }
+
+            uint32_t nodeIndex = CreateNode(block, 0, size);
+            InsertFree(block, nodeIndex);
+        }
+
+        return blockIndex;
+    }
+
+    Allocation AllocateDedicated(const nri::MemoryDesc& memoryDesc) {
+        uint32_t blockIndex = CreateBlock(memoryDesc.type, memoryDesc.size, true);
+
+        Block& block = m_Blocks[blockIndex];
+        block.allocationNum = 1;
+
+        return {block.memory, 0, blockIndex, INVALID_NODE};
+    }
+
+    uint32_t CreateNode(Block& block, uint64_t offset, uint64_t size) {
+        uint32_t nodeIndex = (uint32_t)block.nodes.size();
+        if (block.unusedNodes.empty())
+            block.nodes.emplace_back();
+        else {
+            nodeIndex = block.unusedNodes.back();
+            block.unusedNodes.pop_back();
+        }
+
+        Node& node = block.nodes[nodeIndex];
+        node = {offset, size, INVALID_NODE, INVALID_NODE, INVALID_NODE, INVALID_NODE, 0, false};
+
+        return nodeIndex;
+    }
+
+    void InsertFree(Block& block, uint32_t nodeIndex) {
+        Node& node = block.nodes[nodeIndex];
+
+        uint32_t fl, sl;
+        Mapping(node.size, fl, sl);
+
+        uint32_t head = block.freeHeads[fl][sl];
+        node.isFree = true;
+        node.prevFree = INVALID_NODE;
+        node.nextFree = head;
+
+        if (head != INVALID_NODE)
+            block.nodes[head].prevFree = nodeIndex;
+
+        block.freeHeads[fl][sl] = nodeIndex;
+        block.slBitmaps[fl] |= 1u << sl;
+        block.flBitmap |= 1u << fl;
+    }
+
+    void RemoveFree(Block& block, uint32_t nodeIndex) {
+        Node& node = block.nodes[nodeIndex];
+
+        uint32_t fl, sl;
+        Mapping(node.size, fl, sl);
+
+        if (node.prevFree != INVALID_NODE)
+            block.nodes[node.prevFree].nextFree = node.nextFree;
+        else
+            block.freeHeads[fl][sl] = node.nextFree;
+
+        if (node.nextFree != INVALID_NODE)
+            block.nodes[node.nextFree].prevFree = node.prevFree;
+
+        if (block.freeHeads[fl][sl] == INVALID_NODE) {
+            block.slBitmaps[fl] &= ~(1u << sl);
+            if (!block.slBitmaps[fl])
+                block.flBitmap &= ~(1u << fl);
+        }
+
+        node.isFree = false;
+    }
+
+    // Absorbs the physically next node into "nodeIndex"
+    void MergeWithNext(Block& block, uint32_t nodeIndex) {
+        Node& node = block.nodes[nodeIndex];
+        uint32_t nextIndex = node.nextPhys;
+        Node& next = block.nodes[nextIndex];
+
+        node.size += next.size;
+        node.nextPhys = next.nextPhys;
+        if (next.nextPhys != INVALID_NODE)
+            block.nodes[next.nextPhys].prevPhys = nodeIndex;
+
+        block.unusedNodes.push_back(nextIndex);
+    }
+
+    // Splits "nodeIndex" at "size", the remainder becomes a new free node
+    void Split(Block& block, uint32_t nodeIndex, uint64_t size) {
+        uint64_t offset = block.nodes[nodeIndex].offset + size;
+        uint64_t remainder = block.nodes[nodeIndex].size - size;
+
+        uint32_t newIndex = CreateNode(block, offset, remainder); // may reallocate "nodes"
+
+        Node& node = block.nodes[nodeIndex];
+        Node& newNode = block.nodes[newIndex];
+        newNode.prevPhys = nodeIndex;
+        newNode.nextPhys = node.nextPhys;
+        if (node.nextPhys != INVALID_NODE)
+            block.nodes[node.nextPhys].prevPhys = newIndex;
+
+        node.size = size;
+        node.nextPhys = newIndex;
+
+        InsertFree(block, newIndex);
+    }
+
+    uint32_t FindFreeNode(const Block& block, uint64_t size) const {
+        // Round up to the next class, so any node of the found class is large enough
+        uint32_t msb = FindMsb(size);
+        size += (uint64_t(1) << (msb - SL_LOG2)) - 1;
+
+        uint32_t fl, sl;
+        Mapping(size, fl, sl);
+        if (fl >= FL_NUM)
+            return INVALID_NODE;
+
+        uint32_t slMap = block.slBitmaps[fl] & (~0u << sl);
+        if (!slMap) {
+            uint32_t flMap = fl + 1 < FL_NUM ? block.flBitmap & (~0u << (fl + 1)) : 0;
+            if (!flMap)
+                return INVALID_NODE;
+
+            fl = FindLsb(flMap);
+            slMap = block.slBitmaps[fl];
+        }
+
+        sl = FindLsb(slMap);
+
+        return block.freeHeads[fl][sl];
+    }
+
+    Allocation Place(uint32_t blockIndex, uint32_t nodeIndex, uint64_t size, uint64_t alignment, uint64_t wastedBytes) {
+        Block& block = m_Blocks[blockIndex];
+        RemoveFree(block, nodeIndex);
+
+        // Front padding goes back to free lists
+        uint64_t offset = block.nodes[nodeIndex].offset;
+        uint64_t padding = helper::Align(offset, alignment) - offset;
+        if (padding) {
+            Split(block, nodeIndex, padding);
+
+            uint32_t paddingIndex = nodeIndex;
+            nodeIndex = block.nodes[paddingIndex].nextPhys;
+            RemoveFree(block, nodeIndex);
+            InsertFree(block, paddingIndex);
+        }
+
+        // Back remainder goes back to free lists (sizes are multiples of "MIN_SIZE", so it's either empty or usable)
+        if (block.nodes[nodeIndex].size > size)
+            Split(block, nodeIndex, size);
+
+        Node& node = block.nodes[nodeIndex];
+        node.wastedBytes = (uint32_t)wastedBytes;
+
+        block.usedBytes += node.size;
+        block.wastedBytes += wastedBytes;
+        block.allocationNum++;
+
+        return {block.memory, node.offset, blockIndex, nodeIndex};
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::Device* m_Device = nullptr;
+    std::vector<Block> m_Blocks;
+    std::vector<uint32_t> m_FreeBlockSlots;
+    uint64_t m_BlockSize = 0;
+};
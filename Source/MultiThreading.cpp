@@ -6,6 +6,10 @@
 
 #include "NRIFramework.h"
 
+#include "HostAllocator.h"
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+
 #include <array>
 #include <atomic>
 #include <thread>
@@ -50,6 +54,8 @@ public:
     ~Sample();
 
 private:
+    void InitCmdLine(cmdline::parser& cmdLine) override;
+    void ReadCmdLine(cmdline::parser& cmdLine) override;
     bool Initialize(nri::GraphicsAPI graphicsAPI) override;
     void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
@@ -57,11 +63,12 @@ private:
     void RenderBoxes(nri::CommandBuffer& commandBuffer, uint32_t offset, uint32_t number);
     void ThreadEntryPoint(uint32_t threadIndex);
     void CreateSwapChain(nri::Format& swapChainFormat);
+    void ResizeSwapChain(uint32_t frameIndex);
     void CreateCommandBuffers();
     bool CreatePipeline(nri::Format swapChainFormat);
     void CreateDepthTexture();
     void CreateVertexBuffer();
-    void CreateDescriptorPool();
+    void ReserveDescriptorSets();
     void LoadTextures();
     void CreateTransformConstantBuffer();
     void CreateDescriptorSets();
@@ -77,7 +84,6 @@ private:
     nri::SwapChain* m_SwapChain = nullptr;
     nri::CommandQueue* m_CommandQueue = nullptr;
     nri::PipelineLayout* m_PipelineLayout = nullptr;
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::Fence* m_FrameFence = nullptr;
     nri::Texture* m_DepthTexture = nullptr;
     nri::Descriptor* m_DepthTextureView = nullptr;
@@ -100,7 +106,13 @@ private:
     std::vector<nri::Descriptor*> m_FakeConstantBufferViews;
     std::vector<Box> m_Boxes;
     std::vector<BackBuffer> m_SwapChainBuffers;
-    std::vector<nri::Memory*> m_MemoryAllocations;
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
+    HostAllocator m_HostAllocator;
+    std::string m_HostAllocatorName = "pool";
+    uint64_t m_RecordingAllocationNum = 0;
+    uint64_t m_RecordingAllocationBytes = 0;
+    uint2 m_MaxResolution = {};
     uint32_t m_FrameIndex = 0;
     uint32_t m_ThreadNum = 0;
     uint32_t m_BoxesPerThread = 0;
@@ -108,6 +120,8 @@ private:
     const BackBuffer* m_BackBuffer = nullptr;
     double m_RecordingTime = 0.0;
     double m_SubmitTime = 0.0;
+    double m_ResizeTime = 0.0;
+    double m_ResizeWaitTime = 0.0;
     bool m_IsMultithreadingEnabled = true;
 
     std::atomic_uint32_t m_ReadyCount;
@@ -157,13 +171,12 @@ Sample::~Sample() {
     NRI.DestroyBuffer(*m_VertexBuffer);
     NRI.DestroyBuffer(*m_IndexBuffer);
     NRI.DestroyPipelineLayout(*m_PipelineLayout);
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
+    m_DescriptorAllocator.Destroy();
     NRI.DestroyFence(*m_FrameFence);
     NRI.DestroySwapChain(*m_SwapChain);
     NRI.DestroyStreamer(*m_Streamer);
 
-    for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
-        NRI.FreeMemory(*m_MemoryAllocations[i]);
+    m_MemoryAllocator.Destroy();
 
     DestroyUI(NRI);
 
@@ -201,6 +214,13 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     deviceCreationDesc.spirvBindingOffsets = SPIRV_BINDING_OFFSETS;
     deviceCreationDesc.adapterDesc = &bestAdapterDesc;
     deviceCreationDesc.allocationCallbacks = m_AllocationCallbacks;
+
+    // "default" keeps the framework callbacks
+    if (m_HostAllocatorName != "default") {
+        m_HostAllocator.Create(m_HostAllocatorName == "pool" ? HostAllocator::Mode::POOL : HostAllocator::Mode::SYSTEM);
+        deviceCreationDesc.allocationCallbacks = m_HostAllocator.GetAllocationCallbacks();
+    }
+
     NRI_ABORT_ON_FAILURE(nri::nriCreateDevice(deviceCreationDesc, m_Device));
 
     // NRI
@@ -217,10 +237,22 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     streamerDesc.frameInFlightNum = BUFFERED_FRAME_MAX_NUM;
     NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
+    // Memory allocator
+    m_MemoryAllocator.Create(NRI, *m_Device);
+
+    // Descriptor allocator
+    m_DescriptorAllocator.Create(NRI, *m_Device);
+
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_CommandQueue));
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
     m_DepthFormat = nri::GetSupportedDepthFormat(NRI, *m_Device, 24, false);
+
+    // The depth buffer is sized for the largest resolution the window can get, resizing only recreates the swap chain
+    const GLFWvidmode* vidmode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    m_MaxResolution = uint2(std::max((uint32_t)vidmode->width, GetWindowResolution().x), std::max((uint32_t)vidmode->height, GetWindowResolution().y));
+
+    glfwSetWindowAttrib(m_Window, GLFW_RESIZABLE, GLFW_TRUE);
     nri::Format swapChainFormat = nri::Format::UNKNOWN;
 
     CreateCommandBuffers();
@@ -233,7 +265,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     CreateFakeConstantBuffers();
     CreateViewConstantBuffer();
     CreateVertexBuffer();
-    CreateDescriptorPool();
+    ReserveDescriptorSets();
 
     CreateTransformConstantBuffer();
     CreateDescriptorSets();
@@ -246,7 +278,30 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     return InitUI(NRI, NRI, *m_Device, swapChainFormat);
 }
 
-void Sample::PrepareFrame(uint32_t) {
+void Sample::InitCmdLine(cmdline::parser& cmdLine) {
+    cmdLine.add<std::string>("hostAllocator", 0, "NRI host allocator: default, system or pool", false, "pool", cmdline::oneof<std::string>("default", "system", "pool"));
+}
+
+void Sample::ReadCmdLine(cmdline::parser& cmdLine) {
+    m_HostAllocatorName = cmdLine.get<std::string>("hostAllocator");
+}
+
+void Sample::PrepareFrame(uint32_t frameIndex) {
+    m_HostAllocator.BeginFrame();
+
+    // Resize (zero size means minimized)
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(m_Window, &width, &height);
+
+    if (width && height) {
+        const uint2 resolution = uint2(std::min((uint32_t)width, m_MaxResolution.x), std::min((uint32_t)height, m_MaxResolution.y));
+        if (resolution.x != m_WindowResolution.x || resolution.y != m_WindowResolution.y) {
+            m_WindowResolution = resolution;
+            ResizeSwapChain(frameIndex);
+        }
+    }
+
     BeginUI();
 
     ImGui::SetNextWindowPos(ImVec2(30, 30), ImGuiCond_Always);
@@ -258,6 +313,18 @@ void Sample::PrepareFrame(uint32_t) {
 
         ImGui::Text("Command buffer recording: %.2f ms", m_RecordingTime);
         ImGui::Text("Command buffer submit: %.2f ms", m_SubmitTime);
+        ImGui::Text("Last resize: %.2f ms (%.2f ms waiting)", m_ResizeTime, m_ResizeWaitTime);
+
+        if (m_HostAllocatorName != "default") {
+            const HostAllocator::Stats& hostStats = m_HostAllocator.GetFrameStats();
+
+            ImGui::Separator();
+            ImGui::Text("Host allocator: %s", m_HostAllocatorName.c_str());
+            ImGui::Text("  Recording: %llu allocations, %.1f KB", (unsigned long long)m_RecordingAllocationNum, m_RecordingAllocationBytes / 1024.0);
+            ImGui::Text("  Frame: %llu allocations, %llu frees, %.1f KB", (unsigned long long)hostStats.allocationNum, (unsigned long long)hostStats.freeNum, hostStats.allocatedBytes / 1024.0);
+            ImGui::Text("  Peak: %.1f KB", hostStats.peakBytes / 1024.0);
+            ImGui::Separator();
+        }
 
         bool isMultithreadingEnabled = m_IsMultithreadingEnabled;
         ImGui::Checkbox("Multithreading", &isMultithreadingEnabled);
@@ -292,6 +359,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     const uint32_t backBufferIndex = NRI.AcquireNextSwapChainTexture(*m_SwapChain);
     m_BackBuffer = &m_SwapChainBuffers[backBufferIndex];
 
+    const HostAllocator::Stats hostStatsBegin = m_HostAllocator.GetTotals();
     m_RecordingTime = m_Timer.GetTimeStamp();
 
     const uint32_t threadIndex0 = 0;
@@ -303,6 +371,8 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.ResetCommandAllocator(*context0.commandAllocators[bufferedFrameIndex]);
     }
 
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+
     if (m_IsMultithreadingEnabled) {
         m_ReadyCount.store(0, std::memory_order_seq_cst);
 
@@ -319,7 +389,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     m_FrameCommandBuffers[threadIndex0] = &commandBuffer;
 
     // Record
-    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
     {
         helper::Annotation annotation1(NRI, commandBuffer, "Frame");
 
@@ -387,6 +457,10 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
     m_RecordingTime = m_Timer.GetTimeStamp() - m_RecordingTime;
 
+    const HostAllocator::Stats hostStatsEnd = m_HostAllocator.GetTotals();
+    m_RecordingAllocationNum = hostStatsEnd.allocationNum - hostStatsBegin.allocationNum;
+    m_RecordingAllocationBytes = hostStatsEnd.allocatedBytes - hostStatsBegin.allocatedBytes;
+
     { // Submit
         m_SubmitTime = m_Timer.GetTimeStamp();
 
@@ -454,7 +528,7 @@ void Sample::ThreadEntryPoint(uint32_t threadIndex) {
         nri::CommandBuffer& commandBuffer = *context.commandBuffers[bufferedFrameIndex];
         m_FrameCommandBuffers[threadIndex] = &commandBuffer;
 
-        NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+        NRI.BeginCommandBuffer(commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
         {
             nri::AttachmentsDesc attachmentsDesc = {};
             attachmentsDesc.colorNum = 1;
@@ -527,6 +601,32 @@ void Sample::CreateSwapChain(nri::Format& swapChainFormat) {
     }
 }
 
+void Sample::ResizeSwapChain(uint32_t frameIndex) {
+    const double resizeBegin = m_Timer.GetTimeStamp();
+
+    // Render targets are sized for "m_MaxResolution", only the swap chain changes. A window can't have two swap chains
+    // and NRI has no in-place resize, so the old one and its views can't go to a deletion queue: they must be released
+    // before the new one is created. D3D11 defers the destruction of objects in use by the GPU itself, D3D12 and Vulkan
+    // need the last submitted frame, which signals "frameIndex", to finish (see "Resize")
+    if (frameIndex && NRI.GetDeviceDesc(*m_Device).graphicsAPI != nri::GraphicsAPI::D3D11)
+        NRI.Wait(*m_FrameFence, frameIndex);
+
+    m_ResizeWaitTime = m_Timer.GetTimeStamp() - resizeBegin;
+
+    // Views before their textures
+    for (BackBuffer& backBuffer : m_SwapChainBuffers)
+        NRI.DestroyDescriptor(*backBuffer.colorAttachment);
+
+    m_SwapChainBuffers.clear();
+
+    NRI.DestroySwapChain(*m_SwapChain);
+
+    nri::Format swapChainFormat = nri::Format::UNKNOWN;
+    CreateSwapChain(swapChainFormat);
+
+    m_ResizeTime = m_Timer.GetTimeStamp() - resizeBegin;
+}
+
 void Sample::CreateCommandBuffers() {
     for (uint32_t j = 0; j < BUFFERED_FRAME_MAX_NUM; j++) {
         for (uint32_t i = 0; i < m_ThreadNum; i++) {
@@ -566,6 +666,7 @@ bool Sample::CreatePipeline(nri::Format swapChainFormat) {
     pipelineLayoutDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
 
     NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+    m_DescriptorAllocator.AddPipelineLayout(*m_PipelineLayout, pipelineLayoutDesc);
 
     constexpr uint32_t pipelineNum = 8;
 
@@ -646,7 +747,7 @@ bool Sample::CreatePipeline(nri::Format swapChainFormat) {
 }
 
 void Sample::CreateDepthTexture() {
-    nri::TextureDesc textureDesc = nri::Texture2D(m_DepthFormat, (uint16_t)GetWindowResolution().x, (uint16_t)GetWindowResolution().y, 1, 1,
+    nri::TextureDesc textureDesc = nri::Texture2D(m_DepthFormat, (uint16_t)m_MaxResolution.x, (uint16_t)m_MaxResolution.y, 1, 1,
         nri::TextureUsageBits::DEPTH_STENCIL_ATTACHMENT);
 
     NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, textureDesc, m_DepthTexture));
@@ -656,9 +757,7 @@ void Sample::CreateDepthTexture() {
     resourceGroupDesc.textureNum = 1;
     resourceGroupDesc.textures = &m_DepthTexture;
 
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     nri::Texture2DViewDesc texture2DViewDesc = {m_DepthTexture, nri::Texture2DViewType::DEPTH_STENCIL_ATTACHMENT, m_DepthFormat};
     NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, m_DepthTextureView));
@@ -725,9 +824,7 @@ void Sample::CreateVertexBuffer() {
     resourceGroupDesc.bufferNum = helper::GetCountOf(buffers);
     resourceGroupDesc.buffers = buffers;
 
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     nri::BufferUploadDesc vertexBufferUpdate = {};
     vertexBufferUpdate.buffer = m_VertexBuffer;
@@ -761,9 +858,7 @@ void Sample::CreateTransformConstantBuffer() {
     resourceGroupDesc.bufferNum = 1;
     resourceGroupDesc.buffers = &m_TransformConstantBuffer;
 
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     nri::BufferViewDesc constantBufferViewDesc = {};
     constantBufferViewDesc.viewType = nri::BufferViewType::CONSTANT;
@@ -802,10 +897,7 @@ void Sample::CreateTransformConstantBuffer() {
 }
 
 void Sample::CreateDescriptorSets() {
-    // DescriptorSet 0 (per box)
-    std::vector<nri::DescriptorSet*> descriptorSets(m_Boxes.size());
-    NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 0, descriptorSets.data(), (uint32_t)descriptorSets.size(), 0);
-
+    // DescriptorSet 0 (per box, allocated in place, since the allocator may move sets)
     for (size_t i = 0; i < m_Boxes.size(); i++) {
         Box& box = m_Boxes[i];
 
@@ -824,7 +916,7 @@ void Sample::CreateDescriptorSets() {
 
         box.pipeline = m_Pipelines[(i / DRAW_CALLS_PER_PIPELINE) % m_Pipelines.size()];
 
-        box.descriptorSet = descriptorSets[i];
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, 0, &box.descriptorSet, 1);
         NRI.UpdateDescriptorRanges(*box.descriptorSet, 0, helper::GetCountOf(rangeUpdates), rangeUpdates);
         NRI.UpdateDynamicConstantBuffers(*box.descriptorSet, 0, 1, &m_TransformConstantBufferView);
     }
@@ -834,22 +926,14 @@ void Sample::CreateDescriptorSets() {
         const nri::DescriptorRangeUpdateDesc rangeUpdates[] = {
             {&m_Sampler, 1}};
 
-        NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 1, &m_DescriptorSetWithSharedSampler, 1, 0);
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, 1, &m_DescriptorSetWithSharedSampler, 1);
         NRI.UpdateDescriptorRanges(*m_DescriptorSetWithSharedSampler, 0, helper::GetCountOf(rangeUpdates), rangeUpdates);
     }
 }
 
-void Sample::CreateDescriptorPool() {
-    const uint32_t boxNum = (uint32_t)m_Boxes.size();
-
-    nri::DescriptorPoolDesc descriptorPoolDesc = {};
-    descriptorPoolDesc.constantBufferMaxNum = 3 * boxNum;
-    descriptorPoolDesc.dynamicConstantBufferMaxNum = 1 * boxNum;
-    descriptorPoolDesc.textureMaxNum = 3 * boxNum;
-    descriptorPoolDesc.descriptorSetMaxNum = boxNum + 1;
-    descriptorPoolDesc.samplerMaxNum = 1;
-
-    NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
+void Sample::ReserveDescriptorSets() {
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 0, (uint32_t)m_Boxes.size());
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 1, 1);
 }
 
 void Sample::LoadTextures() {
@@ -879,9 +963,7 @@ void Sample::LoadTextures() {
     resourceGroupDesc.textureNum = (uint32_t)m_Textures.size();
     resourceGroupDesc.textures = m_Textures.data();
 
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     constexpr uint32_t MAX_MIP_NUM = 16;
     std::vector<nri::TextureUploadDesc> textureUpdates(m_Textures.size());
@@ -927,9 +1009,7 @@ void Sample::CreateFakeConstantBuffers() {
     resourceGroupDesc.bufferNum = 1;
     resourceGroupDesc.buffers = &m_FakeConstantBuffer;
 
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     nri::BufferViewDesc constantBufferViewDesc = {};
     constantBufferViewDesc.viewType = nri::BufferViewType::CONSTANT;
@@ -967,9 +1047,7 @@ void Sample::CreateViewConstantBuffer() {
     resourceGroupDesc.bufferNum = 1;
     resourceGroupDesc.buffers = &m_ViewConstantBuffer;
 
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     nri::BufferViewDesc constantBufferViewDesc = {};
     constantBufferViewDesc.viewType = nri::BufferViewType::CONSTANT;
@@ -0,0 +1,153 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+
+// Picks the number of queued frames from measured CPU and GPU frame times. With one queued frame the CPU waits for the
+// GPU, a frame takes "CPU + GPU". With two frames the processors overlap, a frame takes "max(CPU, GPU)". Every queued
+// frame adds latency, so the shallowest depth within "THROUGHPUT_TOLERANCE" of the best throughput wins. A third frame
+// is added only if frames still come slower than the slower processor (jitter), and dropped once a workload change
+// invalidates that measurement. A new depth must be wanted for "HYSTERESIS_FRAME_NUM" frames in a row
+class QueuedFrameController {
+public:
+    static constexpr double THROUGHPUT_TOLERANCE = 0.05;
+    static constexpr double WORKLOAD_CHANGE_TOLERANCE = 0.25;
+    static constexpr uint32_t HYSTERESIS_FRAME_NUM = 30;
+    static constexpr uint32_t HISTORY_SIZE = 8;
+    static constexpr uint32_t QUEUED_FRAME_MAX_NUM = 8;
+
+    struct Decision {
+        uint32_t frameIndex;
+        uint32_t queuedFrameNum;
+        float cpuTime;
+        float gpuTime;
+        float frameTime;
+    };
+
+    inline uint32_t GetQueuedFrameNum() const {
+        return m_QueuedFrameNum;
+    }
+
+    inline double GetFrameTime() const {
+        return m_FrameTime;
+    }
+
+    inline uint32_t GetDecisionNum() const {
+        return std::min(m_DecisionNum, HISTORY_SIZE);
+    }
+
+    // 0 is the latest
+    inline const Decision& GetDecision(uint32_t i) const {
+        return m_History[(m_DecisionNum - 1 - i) % HISTORY_SIZE];
+    }
+
+    void Create(uint32_t queuedFrameMaxNum, uint32_t queuedFrameNum) {
+        NRI_ABORT_ON_FALSE(queuedFrameMaxNum <= QUEUED_FRAME_MAX_NUM);
+
+        m_QueuedFrameMaxNum = queuedFrameMaxNum;
+        Reset(queuedFrameNum);
+    }
+
+    // Call if the depth has been changed externally or updates were paused
+    void Reset(uint32_t queuedFrameNum) {
+        m_MeasuredFrameTimes = {};
+        m_PrevTime = Now();
+        m_QueuedFrameNum = queuedFrameNum;
+        m_Candidate = queuedFrameNum;
+        m_CandidateFrameNum = 0;
+        m_SettleFrameNum = queuedFrameNum;
+    }
+
+    // Call once per frame, returns "true" if the depth has changed
+    bool Update(uint32_t frameIndex, double cpuTime, double gpuTime) {
+        // Frame interval at the current depth, the first frames after a change are skipped
+        const double now = Now();
+        const double frameTime = now - m_PrevTime;
+        m_PrevTime = now;
+
+        if (m_SettleFrameNum)
+            m_SettleFrameNum--;
+        else {
+            double& measuredFrameTime = m_MeasuredFrameTimes[m_QueuedFrameNum - 1];
+            measuredFrameTime = measuredFrameTime == 0.0 ? frameTime : measuredFrameTime * 0.9 + frameTime * 0.1;
+            m_FrameTime = measuredFrameTime;
+        }
+
+        // Measurements are stale if the bottleneck has moved
+        const double bottleneck = std::max(cpuTime, gpuTime);
+        if (std::abs(bottleneck - m_Bottleneck) > m_Bottleneck * WORKLOAD_CHANGE_TOLERANCE) {
+            m_MeasuredFrameTimes = {};
+            m_Bottleneck = bottleneck;
+        }
+
+        // Model
+        uint32_t queuedFrameNum = cpuTime + gpuTime > bottleneck * (1.0 + THROUGHPUT_TOLERANCE) ? 2 : 1;
+
+        // Deeper only while it pays off
+        for (uint32_t i = queuedFrameNum; i < m_QueuedFrameMaxNum; i++) {
+            const double shallow = m_MeasuredFrameTimes[i - 1];
+            const double deep = m_MeasuredFrameTimes[i];
+
+            bool isDeeper = false;
+            if (deep != 0.0)
+                isDeeper = deep * (1.0 + THROUGHPUT_TOLERANCE) < shallow;
+            else if (i == m_QueuedFrameNum)
+                isDeeper = shallow > bottleneck * (1.0 + THROUGHPUT_TOLERANCE);
+
+            if (!isDeeper)
+                break;
+
+            queuedFrameNum = i + 1;
+        }
+
+        queuedFrameNum = std::min(queuedFrameNum, m_QueuedFrameMaxNum);
+
+        // Hysteresis
+        if (queuedFrameNum == m_QueuedFrameNum || queuedFrameNum != m_Candidate) {
+            m_Candidate = queuedFrameNum;
+            m_CandidateFrameNum = 0;
+
+            return false;
+        }
+
+        if (++m_CandidateFrameNum < HYSTERESIS_FRAME_NUM)
+            return false;
+
+        // Apply, the history is shown in the UI
+        Decision& decision = m_History[m_DecisionNum++ % HISTORY_SIZE];
+        decision.frameIndex = frameIndex;
+        decision.queuedFrameNum = queuedFrameNum;
+        decision.cpuTime = (float)cpuTime;
+        decision.gpuTime = (float)gpuTime;
+        decision.frameTime = (float)m_FrameTime;
+
+        m_QueuedFrameNum = queuedFrameNum;
+        m_SettleFrameNum = queuedFrameNum;
+        m_CandidateFrameNum = 0;
+
+        return true;
+    }
+
+private:
+    static double Now() {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    std::array<Decision, HISTORY_SIZE> m_History = {};
+    std::array<double, QUEUED_FRAME_MAX_NUM> m_MeasuredFrameTimes = {}; // per depth, 0 if unknown
+    double m_PrevTime = 0.0;
+    double m_FrameTime = 0.0;
+    double m_Bottleneck = 0.0;
+    uint32_t m_DecisionNum = 0;
+    uint32_t m_QueuedFrameMaxNum = 1;
+    uint32_t m_QueuedFrameNum = 1;
+    uint32_t m_Candidate = 1;
+    uint32_t m_CandidateFrameNum = 0;
+    uint32_t m_SettleFrameNum = 0;
+};
@@ -2,11 +2,26 @@
 
 #include "NRIFramework.h"
 
+#include "AccelerationStructureBuilder.h"
+#include "CpuRayTracer.h"
+#include "DeletionQueue.h"
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "ShaderBindingTable.h"
+#include "UploadManager.h"
+
+#include "../Shaders/RayTracingBoxesStructs.h"
+
 #include <array>
 
 constexpr auto BUILD_FLAGS = nri::AccelerationStructureBuildBits::PREFER_FAST_TRACE;
+constexpr auto TLAS_BUILD_FLAGS = BUILD_FLAGS | nri::AccelerationStructureBuildBits::ALLOW_UPDATE;
 constexpr uint32_t BOX_NUM = 100000;
+constexpr uint32_t GEOMETRY_NUM = 1; // all boxes share one BLAS, its hit record ("InstanceID" on D3D12) selects its entry in the geometry tables
 constexpr float BOX_HALF_SIZE = 0.5f;
+constexpr uint64_t INSTANCE_BUFFER_SLICE_SIZE = BOX_NUM * sizeof(nri::GeometryObjectInstance);
+constexpr uint32_t PROGRESSIVE_SAMPLE_MAX_NUM = 256; // per pixel, dispatching stops after that
+constexpr CpuRayTracer::View CPU_VIEW = {{0.0f, 0.0f, -2.0f}, 0.001f, 1000.0f}; // as in "RayTracingBox.rgen"
 
 static const float positions[12 * 6] = {
     -BOX_HALF_SIZE,
@@ -152,6 +167,7 @@ struct NRIInterface
     : public nri::CoreInterface,
       public nri::SwapChainInterface,
       public nri::HelperInterface,
+      public nri::StreamerInterface,
       public nri::RayTracingInterface {};
 
 struct Frame {
@@ -159,6 +175,49 @@ struct Frame {
     nri::CommandBuffer* commandBuffer;
 };
 
+enum class TlasBuild : uint8_t {
+    NONE,
+    UPDATE,
+    REBUILD
+};
+
+// Boxes spin and bob in place, "time = 0" gives the static layout
+static void SetInstanceTransform(nri::GeometryObjectInstance& instance, uint32_t index, float time) {
+    const float lineWidth = 120.0f;
+    const uint32_t lineSize = 100;
+    const float step = lineWidth / (lineSize - 1);
+
+    const float angle = time * (0.5f + 0.1f * (index % 8));
+    const float phase = 0.37f * index;
+    const float c = cosf(angle);
+    const float s = sinf(angle);
+
+    instance.transform[0][0] = c;
+    instance.transform[0][1] = 0.0f;
+    instance.transform[0][2] = s;
+    instance.transform[0][3] = -lineWidth * 0.5f + (index % lineSize) * step;
+    instance.transform[1][0] = 0.0f;
+    instance.transform[1][1] = 1.0f;
+    instance.transform[1][2] = 0.0f;
+    instance.transform[1][3] = -10.0f + (index / lineSize) * step + 0.3f * (sinf(2.0f * time + phase) - sinf(phase));
+    instance.transform[2][0] = -s;
+    instance.transform[2][1] = 0.0f;
+    instance.transform[2][2] = c;
+    instance.transform[2][3] = 10.0f + (index / lineSize) * step;
+}
+
+// As written by the raygen shader into the output texture: UNORM, "alpha = 0"
+static uint32_t PackColor(float r, float g, float b, nri::Format format) {
+    uint32_t ri = uint32_t(std::min(std::max(r, 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t gi = uint32_t(std::min(std::max(g, 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t bi = uint32_t(std::min(std::max(b, 0.0f), 1.0f) * 255.0f + 0.5f);
+
+    if (format == nri::Format::BGRA8_UNORM)
+        std::swap(ri, bi);
+
+    return ri | (gi << 8) | (bi << 16);
+}
+
 class Sample : public SampleBase {
 public:
     Sample() {
@@ -167,6 +226,8 @@ public:
     ~Sample();
 
 private:
+    void InitCmdLine(cmdline::parser& cmdLine) override;
+    void ReadCmdLine(cmdline::parser& cmdLine) override;
     bool Initialize(nri::GraphicsAPI graphicsAPI) override;
     void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
@@ -179,14 +240,17 @@ private:
     void CreateBottomLevelAccelerationStructure();
     void CreateTopLevelAccelerationStructure();
     void CreateShaderTable();
-    void CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory);
-    void CreateScratchBuffer(nri::AccelerationStructure& accelerationStructure, nri::Buffer*& buffer, nri::Memory*& memory);
-    void BuildBottomLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, const nri::GeometryObject* objects, const uint32_t objectNum);
-    void BuildTopLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer);
+    void CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, MemoryAllocator::Allocation& allocation);
     void CreateShaderResources();
+    void CreateTimestampQueries();
+    void CreateCpuReference();
+    TlasBuild UpdateInstances(uint32_t bufferedFrameIndex);
+    void TraceOnCpu(const nri::GeometryObjectInstance* instances);
+    void CompareWithCpuReference();
 
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
+    nri::Streamer* m_Streamer = nullptr;
     nri::SwapChain* m_SwapChain = nullptr;
     nri::CommandQueue* m_CommandQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
@@ -196,29 +260,78 @@ private:
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     nri::Pipeline* m_Pipeline = nullptr;
 
-    nri::Buffer* m_ShaderTable = nullptr;
-    uint64_t m_ShaderGroupIdentifierSize = 0;
-    uint64_t m_MissShaderOffset = 0;
-    uint64_t m_HitShaderGroupOffset = 0;
-
     nri::Texture* m_RayTracingOutput = nullptr;
     nri::Descriptor* m_RayTracingOutputView = nullptr;
 
+    // Progressive mode, accumulated samples
+    nri::Texture* m_History = nullptr;
+    nri::Descriptor* m_HistoryView = nullptr;
+
     nri::Buffer* m_TexCoordBuffer = nullptr;
     nri::Buffer* m_IndexBuffer = nullptr;
     nri::Descriptor* m_TexCoordBufferView = nullptr;
     nri::Descriptor* m_IndexBufferView = nullptr;
 
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::DescriptorSet* m_DescriptorSets[3] = {};
 
     nri::AccelerationStructure* m_BLAS = nullptr;
     nri::AccelerationStructure* m_TLAS = nullptr;
     nri::Descriptor* m_TLASDescriptor = nullptr;
+    MemoryAllocator::Allocation m_BLASAllocation = {};
+    MemoryAllocator::Allocation m_TLASAllocation = {};
+    nri::AccelerationStructureBuildBits m_BLASFlags = BUILD_FLAGS;
+    nri::AccelerationStructureBuildBits m_TLASFlags = TLAS_BUILD_FLAGS;
+
+    // Animated instances, a slice per buffered frame, persistently mapped
+    nri::Buffer* m_InstanceBuffer = nullptr;
+    nri::GeometryObjectInstance* m_Instances = nullptr;
+
+    nri::QueryPool* m_TimestampQueryPool = nullptr;
+    nri::Buffer* m_ReadbackBuffer = nullptr;
+    std::array<TlasBuild, BUFFERED_FRAME_MAX_NUM> m_TimedBuilds = {};
+    const nri::GeometryObjectInstance* m_TLASInstances = nullptr; // what the TLAS was last built from
+
+    // CPU reference, which replaces ray tracing or checks its output
+    CpuRayTracer m_CpuRayTracer;
+    UploadManager m_UploadManager;
+    std::vector<uint32_t> m_CpuPixels;
+    std::vector<nri::GeometryObjectInstance> m_CpuInstances;
+    nri::Buffer* m_CompareBuffer = nullptr;
+    uint32_t m_CompareRowPitch = 0;
+    uint32_t m_CompareFrameIndex = 0;
+    uint32_t m_MismatchNum = 0;
+    nri::Format m_SwapChainFormat = nri::Format::UNKNOWN;
 
     const BackBuffer* m_BackBuffer = nullptr;
     std::vector<BackBuffer> m_SwapChainBuffers;
-    std::vector<nri::Memory*> m_MemoryAllocations;
+    DeletionQueue m_DeletionQueue;
+    AccelerationStructureBuilder m_AccelerationStructureBuilder;
+    ShaderBindingTable m_ShaderBindingTable;
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
+
+    uint64_t m_BLASMemorySize = 0;
+    uint64_t m_TLASMemorySize = 0;
+    uint64_t m_BLASCompactedSize = 0;
+    uint64_t m_TLASCompactedSize = 0;
+    double m_UpdateTime = 0.0;
+    double m_RebuildTime = 0.0;
+    uint32_t m_FramesSinceRebuild = 0;
+    int32_t m_RebuildPeriod = 64;
+    int32_t m_RayBudget = 0;
+    uint32_t m_TileNum = 0;
+    uint32_t m_TilesPerFrame = 0;
+    uint32_t m_FirstTile = 0;
+    uint32_t m_ResetTileNum = 0; // tiles left to be dispatched without history
+    uint64_t m_TileNumSinceReset = 0;
+    bool m_Animate = false;
+    bool m_EnableCompaction = false;
+    bool m_IsCpuReference = false;
+    bool m_IsProgressive = false;
+    bool m_IsHistoryValid = false;
+    bool m_IsCompareRequested = false;
+    bool m_IsComparePending = false;
+    bool m_HasCompareResult = false;
 };
 
 Sample::~Sample() {
@@ -232,36 +345,66 @@ Sample::~Sample() {
     for (uint32_t i = 0; i < m_SwapChainBuffers.size(); i++)
         NRI.DestroyDescriptor(*m_SwapChainBuffers[i].colorAttachment);
 
-    NRI.DestroyDescriptor(*m_RayTracingOutputView);
     NRI.DestroyTexture(*m_RayTracingOutput);
 
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
+    m_DescriptorAllocator.Destroy();
+    m_UploadManager.Destroy();
+
+    if (!m_IsCpuReference) {
+        NRI.DestroyDescriptor(*m_RayTracingOutputView);
+        NRI.DestroyDescriptor(*m_HistoryView);
+        NRI.DestroyTexture(*m_History);
 
-    NRI.DestroyAccelerationStructure(*m_BLAS);
-    NRI.DestroyAccelerationStructure(*m_TLAS);
-    NRI.DestroyDescriptor(*m_TLASDescriptor);
-    NRI.DestroyBuffer(*m_ShaderTable);
+        NRI.DestroyAccelerationStructure(*m_BLAS);
+        NRI.DestroyAccelerationStructure(*m_TLAS);
+        NRI.DestroyDescriptor(*m_TLASDescriptor);
 
-    NRI.DestroyDescriptor(*m_TexCoordBufferView);
-    NRI.DestroyDescriptor(*m_IndexBufferView);
-    NRI.DestroyBuffer(*m_TexCoordBuffer);
-    NRI.DestroyBuffer(*m_IndexBuffer);
+        NRI.UnmapBuffer(*m_InstanceBuffer);
+        NRI.DestroyBuffer(*m_InstanceBuffer);
+        NRI.DestroyBuffer(*m_ReadbackBuffer);
+        NRI.DestroyBuffer(*m_CompareBuffer);
+        NRI.DestroyQueryPool(*m_TimestampQueryPool);
 
-    NRI.DestroyPipeline(*m_Pipeline);
-    NRI.DestroyPipelineLayout(*m_PipelineLayout);
+        NRI.DestroyDescriptor(*m_TexCoordBufferView);
+        NRI.DestroyDescriptor(*m_IndexBufferView);
+        NRI.DestroyBuffer(*m_TexCoordBuffer);
+        NRI.DestroyBuffer(*m_IndexBuffer);
+
+        NRI.DestroyPipeline(*m_Pipeline);
+        NRI.DestroyPipelineLayout(*m_PipelineLayout);
+    }
+
+    m_ShaderBindingTable.Destroy();
+    m_DeletionQueue.Destroy();
+    m_AccelerationStructureBuilder.Destroy();
 
     NRI.DestroyFence(*m_FrameFence);
 
     NRI.DestroySwapChain(*m_SwapChain);
+    NRI.DestroyStreamer(*m_Streamer);
 
-    for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
-        NRI.FreeMemory(*m_MemoryAllocations[i]);
+    m_MemoryAllocator.Destroy();
 
     DestroyUI(NRI);
 
     nri::nriDestroyDevice(*m_Device);
 }
 
+void Sample::InitCmdLine(cmdline::parser& cmdLine) {
+    cmdLine.add("compaction", 0, "compact acceleration structures after building");
+    cmdLine.add("cpuReference", 0, "trace rays on the CPU (no ray tracing hardware needed)");
+}
+
+void Sample::ReadCmdLine(cmdline::parser& cmdLine) {
+    m_EnableCompaction = cmdLine.exist("compaction");
+    m_IsCpuReference = cmdLine.exist("cpuReference");
+
+    if (m_EnableCompaction) {
+        m_BLASFlags = BUILD_FLAGS | nri::AccelerationStructureBuildBits::ALLOW_COMPACTION;
+        m_TLASFlags = TLAS_BUILD_FLAGS | nri::AccelerationStructureBuildBits::ALLOW_COMPACTION;
+    }
+}
+
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     nri::AdapterDesc bestAdapterDesc = {};
     uint32_t adapterDescsNum = 1;
@@ -278,29 +421,131 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
 
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
-    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::RayTracingInterface), (nri::RayTracingInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
+    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
+
+    if (!m_IsCpuReference)
+        NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::RayTracingInterface), (nri::RayTracingInterface*)&NRI));
+
+    nri::StreamerDesc streamerDesc = {};
+    streamerDesc.dynamicBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+    streamerDesc.dynamicBufferUsageBits = nri::BufferUsageBits::VERTEX_BUFFER | nri::BufferUsageBits::INDEX_BUFFER;
+    streamerDesc.constantBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+    streamerDesc.frameInFlightNum = BUFFERED_FRAME_MAX_NUM;
+    NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_CommandQueue));
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
+    m_MemoryAllocator.Create(NRI, *m_Device);
+    m_DescriptorAllocator.Create(NRI, *m_Device);
+    m_DeletionQueue.Create(NRI, *m_FrameFence);
+
     CreateCommandBuffers();
 
     nri::Format swapChainFormat = nri::Format::UNKNOWN;
     CreateSwapChain(swapChainFormat);
 
-    CreateRayTracingPipeline();
-    CreateDescriptorSets();
-    CreateRayTracingOutput(swapChainFormat);
-    CreateBottomLevelAccelerationStructure();
-    CreateTopLevelAccelerationStructure();
-    CreateShaderTable();
-    CreateShaderResources();
+    if (m_IsCpuReference)
+        CreateRayTracingOutput(swapChainFormat);
+    else {
+        m_AccelerationStructureBuilder.Create(NRI, NRI, *m_Device, *m_CommandQueue, m_MemoryAllocator, &m_DeletionQueue);
+
+        CreateRayTracingPipeline();
+        CreateDescriptorSets();
+        CreateRayTracingOutput(swapChainFormat);
+        CreateBottomLevelAccelerationStructure();
+        CreateTopLevelAccelerationStructure();
+        m_AccelerationStructureBuilder.Flush();
+        CreateShaderTable();
+        CreateShaderResources();
+        CreateTimestampQueries();
+    }
+
+    CreateCpuReference();
 
-    return true;
+    m_RayBudget = int32_t(GetWindowResolution().x * GetWindowResolution().y / 8);
+
+    return InitUI(NRI, NRI, *m_Device, swapChainFormat);
 }
 
 void Sample::PrepareFrame(uint32_t) {
+    BeginUI();
+
+    ImGui::SetNextWindowPos(ImVec2(30, 30), ImGuiCond_Once);
+    ImGui::SetNextWindowSize(ImVec2(0, 0));
+    ImGui::Begin("Settings", nullptr, ImGuiWindowFlags_NoResize);
+    {
+        // A compacted TLAS is too small to be rebuilt in place
+        if (m_EnableCompaction)
+            ImGui::BeginDisabled();
+        ImGui::Checkbox("Animate", &m_Animate);
+        if (m_EnableCompaction)
+            ImGui::EndDisabled();
+
+        if (m_IsCpuReference) {
+            const CpuRayTracer::Stats& stats = m_CpuRayTracer.GetStats();
+
+            ImGui::Separator();
+            ImGui::Text("CPU BVH build : %.1f ms", stats.instanceBuildTime);
+            ImGui::Text("CPU render    : %.1f ms (%u threads)", stats.renderTime, stats.threadNum);
+            ImGui::Text("Rays per core : %.2f M/s", m_CpuRayTracer.GetRaysPerSecondPerCore() * 1e-6);
+        } else {
+            if (!m_Animate)
+                ImGui::BeginDisabled();
+            ImGui::SliderInt("Rebuild period", &m_RebuildPeriod, 1, 256, "%d frames");
+            if (!m_Animate)
+                ImGui::EndDisabled();
+
+            // Progressive: a ray budget per frame, samples are accumulated while nothing moves
+            ImGui::Separator();
+            ImGui::Checkbox("Progressive", &m_IsProgressive);
+            if (m_IsProgressive) {
+                const uint32_t pixelNum = GetWindowResolution().x * GetWindowResolution().y;
+                const uint32_t tilePixelNum = PROGRESSIVE_TILE_SIZE * PROGRESSIVE_TILE_SIZE;
+                const uint32_t rayNum = m_TilesPerFrame * tilePixelNum;
+
+                ImGui::SliderInt("Ray budget", &m_RayBudget, (int32_t)tilePixelNum, (int32_t)pixelNum, "%d rays", ImGuiSliderFlags_Logarithmic);
+                ImGui::Text("Rays per frame    : %u (%.1f%% of pixels)", rayNum, 100.0 * rayNum / pixelNum);
+                if (m_TilesPerFrame) {
+                    ImGui::Text("Full pass every   : %u frames", (m_TileNum + m_TilesPerFrame - 1) / m_TilesPerFrame);
+                    ImGui::Text("Samples per pixel : %.1f / %u", double(m_TileNumSinceReset) / m_TileNum, PROGRESSIVE_SAMPLE_MAX_NUM);
+                }
+            }
+
+            ImGui::Separator();
+            ImGui::Text("TLAS update  : %.3f ms", m_UpdateTime);
+            ImGui::Text("TLAS rebuild : %.3f ms", m_RebuildTime);
+            if (m_UpdateTime != 0.0 && m_RebuildTime != 0.0)
+                ImGui::Text("Update is %.1fx faster", m_RebuildTime / m_UpdateTime);
+
+            // Jittered samples don't match the CPU reference
+            ImGui::Separator();
+            const bool isCompareDisabled = m_IsComparePending || m_IsProgressive;
+            if (isCompareDisabled)
+                ImGui::BeginDisabled();
+            if (ImGui::Button("Compare with CPU"))
+                m_IsCompareRequested = true;
+            if (isCompareDisabled)
+                ImGui::EndDisabled();
+
+            if (m_HasCompareResult) {
+                const uint32_t pixelNum = GetWindowResolution().x * GetWindowResolution().y;
+                ImGui::SameLine();
+                ImGui::Text("%u pixels differ (%.3f%%)", m_MismatchNum, 100.0 * m_MismatchNum / pixelNum);
+            }
+        }
+
+        if (m_EnableCompaction) {
+            ImGui::Separator();
+            ImGui::Text("BLAS memory  : %.1f -> %.1f KB", m_BLASMemorySize / 1024.0, m_BLASCompactedSize / 1024.0);
+            ImGui::Text("TLAS memory  : %.2f -> %.2f MB", m_TLASMemorySize / (1024.0 * 1024.0), m_TLASCompactedSize / (1024.0 * 1024.0));
+        }
+    }
+    ImGui::End();
+
+    EndUI(NRI, *m_Streamer);
+    NRI.CopyStreamerUpdateRequests(*m_Streamer);
 }
 
 void Sample::RenderFrame(uint32_t frameIndex) {
@@ -312,56 +557,199 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.ResetCommandAllocator(*frame.commandAllocator);
     }
 
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+
+    // Objects retired from now on wait for this frame
+    m_DeletionQueue.SetFenceValue(1 + frameIndex);
+    m_DeletionQueue.Update();
+
+    // The frame which read the output back is done
+    if (m_IsComparePending && frameIndex >= m_CompareFrameIndex + BUFFERED_FRAME_MAX_NUM)
+        CompareWithCpuReference();
+
+    // TLAS build time of the frame which used this slot last time
+    TlasBuild& timedBuild = m_TimedBuilds[bufferedFrameIndex];
+    if (timedBuild != TlasBuild::NONE) {
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+        const uint64_t* timestamps = (uint64_t*)NRI.MapBuffer(*m_ReadbackBuffer, bufferedFrameIndex * 2 * sizeof(uint64_t), 2 * sizeof(uint64_t));
+        const double buildTime = double(timestamps[1] - timestamps[0]) * 1000.0 / double(deviceDesc.timestampFrequencyHz);
+        NRI.UnmapBuffer(*m_ReadbackBuffer);
+
+        double& averageTime = timedBuild == TlasBuild::REBUILD ? m_RebuildTime : m_UpdateTime;
+        averageTime = averageTime == 0.0 ? buildTime : averageTime * 0.9 + buildTime * 0.1;
+    }
+
+    if (m_IsCpuReference) {
+        if (m_Animate) {
+            const float time = float(m_Timer.GetTimeStamp() * 0.001);
+            for (uint32_t i = 0; i < BOX_NUM; i++)
+                SetInstanceTransform(m_CpuInstances[i], i, time);
+        }
+
+        TraceOnCpu(m_Animate ? m_CpuInstances.data() : nullptr);
+
+        // Submitted before the frame, which copies the output to the back buffer
+        nri::TextureSubresourceUploadDesc subresource = {};
+        subresource.slices = m_CpuPixels.data();
+        subresource.sliceNum = 1;
+        subresource.rowPitch = GetWindowResolution().x * (uint32_t)sizeof(uint32_t);
+        subresource.slicePitch = subresource.rowPitch * GetWindowResolution().y;
+
+        m_UploadManager.UploadTexture(*m_RayTracingOutput, &subresource, {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY});
+        m_UploadManager.Flush();
+    } else
+        timedBuild = m_Animate ? UpdateInstances(bufferedFrameIndex) : TlasBuild::NONE;
+
     const uint32_t backBufferIndex = NRI.AcquireNextSwapChainTexture(*m_SwapChain);
     m_BackBuffer = &m_SwapChainBuffers[backBufferIndex];
 
-    nri::TextureBarrierDesc textureTransitions[2] = {};
+    nri::TextureBarrierDesc textureTransitions[3] = {};
     nri::BarrierGroupDesc barrierGroupDesc = {};
 
     // Record
     nri::CommandBuffer& commandBuffer = *frame.commandBuffer;
-    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
     {
+        // TLAS update or rebuild
+        if (timedBuild != TlasBuild::NONE) {
+            const uint32_t queryOffset = bufferedFrameIndex * 2;
+
+            NRI.CmdResetQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, 2);
+            NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset);
+            m_AccelerationStructureBuilder.Record(commandBuffer);
+            NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, queryOffset + 1);
+            NRI.CmdCopyQueries(commandBuffer, *m_TimestampQueryPool, queryOffset, 2, *m_ReadbackBuffer, queryOffset * sizeof(uint64_t));
+        }
+
         // Rendering
         textureTransitions[0].texture = m_BackBuffer->texture;
         textureTransitions[0].after = {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION};
         textureTransitions[0].layerNum = 1;
         textureTransitions[0].mipNum = 1;
 
-        textureTransitions[1].texture = m_RayTracingOutput;
-        textureTransitions[1].before = {frameIndex == 0 ? nri::AccessBits::UNKNOWN : nri::AccessBits::COPY_SOURCE, frameIndex == 0 ? nri::Layout::UNKNOWN : nri::Layout::COPY_SOURCE};
-        textureTransitions[1].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE};
-        textureTransitions[1].layerNum = 1;
-        textureTransitions[1].mipNum = 1;
-
-        barrierGroupDesc.textures = textureTransitions;
-        barrierGroupDesc.textureNum = 2;
-
-        NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
-        NRI.CmdSetPipelineLayout(commandBuffer, *m_PipelineLayout);
-        NRI.CmdSetPipeline(commandBuffer, *m_Pipeline);
-
-        for (uint32_t i = 0; i < helper::GetCountOf(m_DescriptorSets); i++)
-            NRI.CmdSetDescriptorSet(commandBuffer, i, *m_DescriptorSets[i], nullptr);
-
-        nri::DispatchRaysDesc dispatchRaysDesc = {};
-        dispatchRaysDesc.raygenShader = {m_ShaderTable, 0, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.missShaders = {m_ShaderTable, m_MissShaderOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.hitShaderGroups = {m_ShaderTable, m_HitShaderGroupOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.x = (uint16_t)GetWindowResolution().x;
-        dispatchRaysDesc.y = (uint16_t)GetWindowResolution().y;
-        dispatchRaysDesc.z = 1;
-        NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+        if (m_IsCpuReference) {
+            barrierGroupDesc.textures = textureTransitions;
+            barrierGroupDesc.textureNum = 1;
+
+            NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+        } else {
+            textureTransitions[1].texture = m_RayTracingOutput;
+            textureTransitions[1].before = {frameIndex == 0 ? nri::AccessBits::UNKNOWN : nri::AccessBits::COPY_SOURCE, frameIndex == 0 ? nri::Layout::UNKNOWN : nri::Layout::COPY_SOURCE};
+            textureTransitions[1].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE};
+            textureTransitions[1].layerNum = 1;
+            textureTransitions[1].mipNum = 1;
+
+            // Also orders accesses to the history between frames
+            textureTransitions[2].texture = m_History;
+            textureTransitions[2].before = {frameIndex == 0 ? nri::AccessBits::UNKNOWN : nri::AccessBits::SHADER_RESOURCE_STORAGE, frameIndex == 0 ? nri::Layout::UNKNOWN : nri::Layout::SHADER_RESOURCE_STORAGE};
+            textureTransitions[2].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE};
+            textureTransitions[2].layerNum = 1;
+            textureTransitions[2].mipNum = 1;
+
+            barrierGroupDesc.textures = textureTransitions;
+            barrierGroupDesc.textureNum = 3;
+
+            m_ShaderBindingTable.Update(commandBuffer, bufferedFrameIndex);
+
+            NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+            NRI.CmdSetPipelineLayout(commandBuffer, *m_PipelineLayout);
+            NRI.CmdSetPipeline(commandBuffer, *m_Pipeline);
+
+            for (uint32_t i = 0; i < helper::GetCountOf(m_DescriptorSets); i++)
+                NRI.CmdSetDescriptorSet(commandBuffer, i, *m_DescriptorSets[i], nullptr);
+
+            RayGenConstants rayGenConstants = {};
+            rayGenConstants.screenWidth = GetWindowResolution().x;
+            rayGenConstants.screenHeight = GetWindowResolution().y;
+            rayGenConstants.isProgressive = m_IsProgressive ? 1 : 0;
+
+            if (m_IsProgressive) {
+                // Tiles rotate over frames, the rest of the output keeps what was accumulated before
+                const uint32_t tileNumX = (rayGenConstants.screenWidth + PROGRESSIVE_TILE_SIZE - 1) / PROGRESSIVE_TILE_SIZE;
+                const uint32_t tileNumY = (rayGenConstants.screenHeight + PROGRESSIVE_TILE_SIZE - 1) / PROGRESSIVE_TILE_SIZE;
+
+                m_TileNum = tileNumX * tileNumY;
+                m_TilesPerFrame = std::min(std::max(uint32_t(m_RayBudget) / (PROGRESSIVE_TILE_SIZE * PROGRESSIVE_TILE_SIZE), 1u), m_TileNum); // a tile is dispatched once at most
+
+                // Moving instances invalidate the history, the next full pass starts over
+                if (!m_IsHistoryValid || m_Animate) {
+                    m_ResetTileNum = m_TileNum;
+                    m_TileNumSinceReset = 0;
+                    m_IsHistoryValid = true;
+                }
+
+                if (m_TileNumSinceReset < uint64_t(m_TileNum) * PROGRESSIVE_SAMPLE_MAX_NUM) {
+                    rayGenConstants.tileNumX = tileNumX;
+                    rayGenConstants.tileNum = m_TileNum;
+                    rayGenConstants.firstTile = m_FirstTile;
+                    rayGenConstants.resetTileNum = m_ResetTileNum;
+
+                    NRI.CmdSetConstants(commandBuffer, 0, &rayGenConstants, sizeof(rayGenConstants));
+
+                    const nri::DispatchRaysDesc dispatchRaysDesc = m_ShaderBindingTable.GetDispatchRaysDesc(PROGRESSIVE_TILE_SIZE, PROGRESSIVE_TILE_SIZE, m_TilesPerFrame);
+                    NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+
+                    m_FirstTile = (m_FirstTile + m_TilesPerFrame) % m_TileNum;
+                    m_ResetTileNum -= std::min(m_ResetTileNum, m_TilesPerFrame);
+                    m_TileNumSinceReset += m_TilesPerFrame;
+                }
+            } else {
+                m_IsHistoryValid = false;
+
+                NRI.CmdSetConstants(commandBuffer, 0, &rayGenConstants, sizeof(rayGenConstants));
+
+                const nri::DispatchRaysDesc dispatchRaysDesc = m_ShaderBindingTable.GetDispatchRaysDesc(GetWindowResolution().x, GetWindowResolution().y);
+                NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+            }
+
+            textureTransitions[1].before = textureTransitions[1].after;
+            textureTransitions[1].after = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE};
+
+            barrierGroupDesc.textures = textureTransitions + 1;
+            barrierGroupDesc.textureNum = 1;
+
+            NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+
+            // Read back for "CompareWithCpuReference", along with the instances the TLAS holds
+            if (m_IsCompareRequested) {
+                nri::TextureDataLayoutDesc dstDataLayoutDesc = {};
+                dstDataLayoutDesc.rowPitch = m_CompareRowPitch;
+                dstDataLayoutDesc.slicePitch = m_CompareRowPitch * GetWindowResolution().y;
+
+                nri::TextureRegionDesc srcRegionDesc = {};
+                srcRegionDesc.width = (uint16_t)GetWindowResolution().x;
+                srcRegionDesc.height = (uint16_t)GetWindowResolution().y;
+                srcRegionDesc.depth = 1;
+
+                NRI.CmdReadbackTextureToBuffer(commandBuffer, *m_CompareBuffer, dstDataLayoutDesc, *m_RayTracingOutput, srcRegionDesc);
+
+                m_CpuInstances.assign(m_TLASInstances, m_TLASInstances + BOX_NUM);
+                m_CompareFrameIndex = frameIndex;
+                m_IsCompareRequested = false;
+                m_IsComparePending = true;
+            }
+        }
 
         // Copy
-        textureTransitions[1].before = textureTransitions[1].after;
-        textureTransitions[1].after = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE};
+        NRI.CmdCopyTexture(commandBuffer, *m_BackBuffer->texture, nullptr, *m_RayTracingOutput, nullptr);
+
+        // UI
+        textureTransitions[0].before = textureTransitions[0].after;
+        textureTransitions[0].after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
 
-        barrierGroupDesc.textures = textureTransitions + 1;
+        barrierGroupDesc.textures = textureTransitions;
         barrierGroupDesc.textureNum = 1;
 
         NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
-        NRI.CmdCopyTexture(commandBuffer, *m_BackBuffer->texture, nullptr, *m_RayTracingOutput, nullptr);
+
+        nri::AttachmentsDesc attachmentsDesc = {};
+        attachmentsDesc.colorNum = 1;
+        attachmentsDesc.colors = &m_BackBuffer->colorAttachment;
+
+        NRI.CmdBeginRendering(commandBuffer, attachmentsDesc);
+        RenderUI(NRI, NRI, *m_Streamer, commandBuffer, 1.0f, true);
+        NRI.CmdEndRendering(commandBuffer);
 
         // Present
         textureTransitions[0].before = textureTransitions[0].after;
@@ -431,21 +819,27 @@ void Sample::CreateRayTracingPipeline() {
     nri::DescriptorRangeDesc descriptorRanges[] = {
         {0, 1, nri::DescriptorType::STORAGE_TEXTURE, nri::StageBits::RAYGEN_SHADER},
         {1, 1, nri::DescriptorType::ACCELERATION_STRUCTURE, nri::StageBits::RAYGEN_SHADER},
-        {0, BOX_NUM, nri::DescriptorType::BUFFER, nri::StageBits::CLOSEST_HIT_SHADER, nri::DescriptorRangeBits::VARIABLE_SIZED_ARRAY | nri::DescriptorRangeBits::PARTIALLY_BOUND},
+        {2, 1, nri::DescriptorType::STORAGE_TEXTURE, nri::StageBits::RAYGEN_SHADER},
+        {0, GEOMETRY_NUM, nri::DescriptorType::BUFFER, nri::StageBits::CLOSEST_HIT_SHADER, nri::DescriptorRangeBits::VARIABLE_SIZED_ARRAY | nri::DescriptorRangeBits::PARTIALLY_BOUND},
     };
 
     nri::DescriptorSetDesc descriptorSetDescs[] = {
-        {0, descriptorRanges, 2},
-        {1, descriptorRanges + 2, 1},
-        {2, descriptorRanges + 2, 1},
+        {0, descriptorRanges, 3},
+        {1, descriptorRanges + 3, 1},
+        {2, descriptorRanges + 3, 1},
     };
 
+    nri::PushConstantDesc pushConstantDesc = {0, sizeof(RayGenConstants), nri::StageBits::RAYGEN_SHADER};
+
     nri::PipelineLayoutDesc pipelineLayoutDesc = {};
     pipelineLayoutDesc.descriptorSets = descriptorSetDescs;
     pipelineLayoutDesc.descriptorSetNum = helper::GetCountOf(descriptorSetDescs);
+    pipelineLayoutDesc.pushConstants = &pushConstantDesc;
+    pipelineLayoutDesc.pushConstantNum = 1;
     pipelineLayoutDesc.shaderStages = nri::StageBits::RAYGEN_SHADER | nri::StageBits::CLOSEST_HIT_SHADER;
 
     NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+    m_DescriptorAllocator.AddPipelineLayout(*m_PipelineLayout, pipelineLayoutDesc);
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     utils::ShaderCodeStorage shaderCodeStorage;
@@ -486,38 +880,47 @@ void Sample::CreateRayTracingOutput(nri::Format swapChainFormat) {
     rayTracingOutputDesc.usageMask = nri::TextureUsageBits::SHADER_RESOURCE_STORAGE;
     NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, rayTracingOutputDesc, m_RayTracingOutput));
 
-    nri::MemoryDesc memoryDesc = {};
-    NRI.GetTextureMemoryDesc(*m_Device, rayTracingOutputDesc, nri::MemoryLocation::DEVICE, memoryDesc);
-
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
+    nri::ResourceGroupDesc resourceGroupDesc = {};
+    resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
+    resourceGroupDesc.textureNum = 1;
+    resourceGroupDesc.textures = &m_RayTracingOutput;
 
-    nri::Memory* memory = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
-    m_MemoryAllocations.push_back(memory);
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
-    const nri::TextureMemoryBindingDesc memoryBindingDesc = {memory, m_RayTracingOutput};
-    NRI_ABORT_ON_FAILURE(NRI.BindTextureMemory(*m_Device, &memoryBindingDesc, 1));
+    // The CPU reference uploads into it
+    if (m_IsCpuReference)
+        return;
 
     nri::Texture2DViewDesc textureViewDesc = {m_RayTracingOutput, nri::Texture2DViewType::SHADER_RESOURCE_STORAGE_2D, swapChainFormat};
     NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(textureViewDesc, m_RayTracingOutputView));
 
-    const nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDesc = {&m_RayTracingOutputView, 1, 0};
-    NRI.UpdateDescriptorRanges(*m_DescriptorSets[0], 0, 1, &descriptorRangeUpdateDesc);
+    // History: accumulated color and sample count
+    nri::TextureDesc historyDesc = rayTracingOutputDesc;
+    historyDesc.format = nri::Format::RGBA32_SFLOAT;
+    NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, historyDesc, m_History));
+
+    resourceGroupDesc.textures = &m_History;
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
+
+    textureViewDesc = {m_History, nri::Texture2DViewType::SHADER_RESOURCE_STORAGE_2D, nri::Format::RGBA32_SFLOAT};
+    NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(textureViewDesc, m_HistoryView));
+
+    const nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs[] = {
+        {&m_RayTracingOutputView, 1, 0},
+        {&m_HistoryView, 1, 0},
+    };
+    NRI.UpdateDescriptorRanges(*m_DescriptorSets[0], 0, 1, descriptorRangeUpdateDescs);
+    NRI.UpdateDescriptorRanges(*m_DescriptorSets[0], 2, 1, descriptorRangeUpdateDescs + 1);
 }
 
 void Sample::CreateDescriptorSets() {
-    nri::DescriptorPoolDesc descriptorPoolDesc = {};
-    descriptorPoolDesc.storageTextureMaxNum = 1;
-    descriptorPoolDesc.accelerationStructureMaxNum = 1;
-    descriptorPoolDesc.bufferMaxNum = BOX_NUM * 2;
-    descriptorPoolDesc.descriptorSetMaxNum = helper::GetCountOf(m_DescriptorSets);
-
-    NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 0, &m_DescriptorSets[0], 1, 0));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 1, &m_DescriptorSets[1], 1, BOX_NUM));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 2, &m_DescriptorSets[2], 1, BOX_NUM));
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 0, 1);
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 1, 1, GEOMETRY_NUM);
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 2, 1, GEOMETRY_NUM);
+
+    m_DescriptorAllocator.Allocate(*m_PipelineLayout, 0, &m_DescriptorSets[0], 1);
+    m_DescriptorAllocator.Allocate(*m_PipelineLayout, 1, &m_DescriptorSets[1], 1, GEOMETRY_NUM);
+    m_DescriptorAllocator.Allocate(*m_PipelineLayout, 2, &m_DescriptorSets[2], 1, GEOMETRY_NUM);
 }
 
 void Sample::CreateShaderResources() {
@@ -541,9 +944,7 @@ void Sample::CreateShaderResources() {
     resourceGroupDesc.bufferNum = helper::GetCountOf(buffers);
     resourceGroupDesc.buffers = buffers;
 
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     nri::BufferUploadDesc dataDescArray[] = {
         {texCoords, texCoordBufferDesc.size, m_TexCoordBuffer, 0, {nri::AccessBits::SHADER_RESOURCE}},
@@ -565,28 +966,23 @@ void Sample::CreateShaderResources() {
     NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(texCoordBufferViewDesc, m_TexCoordBufferView));
     NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(indexBufferViewDesc, m_IndexBufferView));
 
-    nri::DescriptorRangeUpdateDesc rangeUpdateDesc = {};
-    rangeUpdateDesc.descriptorNum = 1;
-    rangeUpdateDesc.descriptors = &m_TexCoordBufferView;
-
-    for (uint32_t i = 0; i < BOX_NUM; i++) {
-        rangeUpdateDesc.offsetInRange = i;
-        NRI.UpdateDescriptorRanges(*m_DescriptorSets[1], 0, 1, &rangeUpdateDesc);
-    }
+    // Geometry tables, entry "i" describes geometry "i". Each table is written as one contiguous range
+    std::array<nri::Descriptor*, GEOMETRY_NUM> texCoordBufferViews;
+    std::array<nri::Descriptor*, GEOMETRY_NUM> indexBufferViews;
+    texCoordBufferViews.fill(m_TexCoordBufferView);
+    indexBufferViews.fill(m_IndexBufferView);
 
-    rangeUpdateDesc.descriptorNum = 1;
-    rangeUpdateDesc.descriptors = &m_IndexBufferView;
+    const nri::DescriptorRangeUpdateDesc texCoordRangeUpdateDesc = {texCoordBufferViews.data(), GEOMETRY_NUM, 0};
+    const nri::DescriptorRangeUpdateDesc indexRangeUpdateDesc = {indexBufferViews.data(), GEOMETRY_NUM, 0};
 
-    for (uint32_t i = 0; i < BOX_NUM; i++) {
-        rangeUpdateDesc.offsetInRange = i;
-        NRI.UpdateDescriptorRanges(*m_DescriptorSets[2], 0, 1, &rangeUpdateDesc);
-    }
+    NRI.UpdateDescriptorRanges(*m_DescriptorSets[1], 0, 1, &texCoordRangeUpdateDesc);
+    NRI.UpdateDescriptorRanges(*m_DescriptorSets[2], 0, 1, &indexRangeUpdateDesc);
 }
 
 void Sample::CreateBottomLevelAccelerationStructure() {
     nri::Buffer* buffer = nullptr;
-    nri::Memory* memory = nullptr;
-    CreateUploadBuffer(sizeof(positions) + sizeof(indices), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ, buffer, memory);
+    MemoryAllocator::Allocation allocation = {};
+    CreateUploadBuffer(sizeof(positions) + sizeof(indices), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ, buffer, allocation);
 
     uint8_t* data = (uint8_t*)NRI.MapBuffer(*buffer, 0, sizeof(positions) + sizeof(indices));
     memcpy(data, positions, sizeof(positions));
@@ -607,7 +1003,7 @@ void Sample::CreateBottomLevelAccelerationStructure() {
 
     nri::AccelerationStructureDesc accelerationStructureBLASDesc = {};
     accelerationStructureBLASDesc.type = nri::AccelerationStructureType::BOTTOM_LEVEL;
-    accelerationStructureBLASDesc.flags = BUILD_FLAGS;
+    accelerationStructureBLASDesc.flags = m_BLASFlags;
     accelerationStructureBLASDesc.instanceOrGeometryObjectNum = 1;
     accelerationStructureBLASDesc.geometryObjects = &object;
 
@@ -616,27 +1012,25 @@ void Sample::CreateBottomLevelAccelerationStructure() {
     nri::MemoryDesc memoryDesc = {};
     NRI.GetAccelerationStructureMemoryDesc(*m_Device, accelerationStructureBLASDesc, nri::MemoryLocation::DEVICE, memoryDesc);
 
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-
-    nri::Memory* ASMemory = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, ASMemory));
-    m_MemoryAllocations.push_back(ASMemory);
+    m_BLASAllocation = m_MemoryAllocator.AllocateAndBind(*m_BLAS, memoryDesc);
+    m_BLASMemorySize = memoryDesc.size;
 
-    const nri::AccelerationStructureMemoryBindingDesc memoryBindingDesc = {ASMemory, m_BLAS};
-    NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(*m_Device, &memoryBindingDesc, 1));
+    m_AccelerationStructureBuilder.AddBottomLevel(*m_BLAS, &object, 1, m_BLASFlags);
 
-    BuildBottomLevelAccelerationStructure(*m_BLAS, &object, 1);
+    // Instances reference the BLAS by address, so it gets compacted before the TLAS is built
+    if (m_EnableCompaction) {
+        m_AccelerationStructureBuilder.Flush();
+        m_BLASCompactedSize = m_AccelerationStructureBuilder.AddCompaction(m_BLAS, m_BLASAllocation, accelerationStructureBLASDesc);
+    }
 
-    NRI.DestroyBuffer(*buffer);
-    NRI.FreeMemory(*memory);
+    m_DeletionQueue.Push(*buffer);
+    m_DeletionQueue.Push([this, allocation]() { m_MemoryAllocator.Free(allocation); });
 }
 
 void Sample::CreateTopLevelAccelerationStructure() {
     nri::AccelerationStructureDesc accelerationStructureTLASDesc = {};
     accelerationStructureTLASDesc.type = nri::AccelerationStructureType::TOP_LEVEL;
-    accelerationStructureTLASDesc.flags = BUILD_FLAGS;
+    accelerationStructureTLASDesc.flags = m_TLASFlags;
     accelerationStructureTLASDesc.instanceOrGeometryObjectNum = BOX_NUM;
 
     NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructure(*m_Device, accelerationStructureTLASDesc, m_TLAS));
@@ -644,48 +1038,56 @@ void Sample::CreateTopLevelAccelerationStructure() {
     nri::MemoryDesc memoryDesc = {};
     NRI.GetAccelerationStructureMemoryDesc(*m_Device, accelerationStructureTLASDesc, nri::MemoryLocation::DEVICE, memoryDesc);
 
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-
-    nri::Memory* ASMemory = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, ASMemory));
-    m_MemoryAllocations.push_back(ASMemory);
-
-    const nri::AccelerationStructureMemoryBindingDesc memoryBindingDesc = {ASMemory, m_TLAS};
-    NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(*m_Device, &memoryBindingDesc, 1));
+    m_TLASAllocation = m_MemoryAllocator.AllocateAndBind(*m_TLAS, memoryDesc);
+    m_TLASMemorySize = memoryDesc.size;
 
     std::vector<nri::GeometryObjectInstance> geometryObjectInstances(BOX_NUM, nri::GeometryObjectInstance{});
 
-    const float lineWidth = 120.0f;
-    const uint32_t lineSize = 100;
-    const float step = lineWidth / (lineSize - 1);
-
     for (uint32_t i = 0; i < geometryObjectInstances.size(); i++) {
         nri::GeometryObjectInstance& instance = geometryObjectInstances[i];
         instance.accelerationStructureHandle = NRI.GetAccelerationStructureHandle(*m_BLAS);
-        instance.instanceId = i;
-        instance.transform[0][0] = 1.0f;
-        instance.transform[1][1] = 1.0f;
-        instance.transform[2][2] = 1.0f;
-        instance.transform[0][3] = -lineWidth * 0.5f + (i % lineSize) * step;
-        instance.transform[1][3] = -10.0f + (i / lineSize) * step;
-        instance.transform[2][3] = 10.0f + (i / lineSize) * step;
+        instance.instanceId = 0;                    // geometry index, D3D12 fallback for the hit record
+        instance.shaderBindingTableLocalOffset = 0; // hit record of the geometry
         instance.mask = 0xff;
+
+        SetInstanceTransform(instance, i, 0.0f);
     }
 
     nri::Buffer* buffer = nullptr;
-    nri::Memory* memory = nullptr;
-    CreateUploadBuffer(helper::GetByteSizeOf(geometryObjectInstances), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ, buffer, memory);
+    MemoryAllocator::Allocation allocation = {};
+    CreateUploadBuffer(helper::GetByteSizeOf(geometryObjectInstances), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ, buffer, allocation);
 
     void* data = NRI.MapBuffer(*buffer, 0, nri::WHOLE_SIZE);
     memcpy(data, geometryObjectInstances.data(), helper::GetByteSizeOf(geometryObjectInstances));
     NRI.UnmapBuffer(*buffer);
 
-    BuildTopLevelAccelerationStructure(*m_TLAS, (uint32_t)geometryObjectInstances.size(), *buffer);
+    m_AccelerationStructureBuilder.AddTopLevel(*m_TLAS, (uint32_t)geometryObjectInstances.size(), *buffer, 0, m_TLASFlags);
+
+    if (m_EnableCompaction) {
+        m_AccelerationStructureBuilder.Flush();
+        m_TLASCompactedSize = m_AccelerationStructureBuilder.AddCompaction(m_TLAS, m_TLASAllocation, accelerationStructureTLASDesc);
+    }
+
+    m_DeletionQueue.Push(*buffer);
+    m_DeletionQueue.Push([this, allocation]() { m_MemoryAllocator.Free(allocation); });
+
+    { // Instances for animation. The build above uses its own copy, since the first frames don't wait for the GPU
+        const nri::BufferDesc bufferDesc = {INSTANCE_BUFFER_SLICE_SIZE * BUFFERED_FRAME_MAX_NUM, 0, nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ};
+        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_InstanceBuffer));
+
+        nri::ResourceGroupDesc resourceGroupDesc = {};
+        resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+        resourceGroupDesc.bufferNum = 1;
+        resourceGroupDesc.buffers = &m_InstanceBuffer;
+
+        m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
-    NRI.DestroyBuffer(*buffer);
-    NRI.FreeMemory(*memory);
+        m_Instances = (nri::GeometryObjectInstance*)NRI.MapBuffer(*m_InstanceBuffer, 0, nri::WHOLE_SIZE);
+        for (uint32_t i = 0; i < BUFFERED_FRAME_MAX_NUM; i++)
+            memcpy(m_Instances + i * BOX_NUM, geometryObjectInstances.data(), INSTANCE_BUFFER_SLICE_SIZE);
+
+        m_TLASInstances = m_Instances;
+    }
 
     NRI.CreateAccelerationStructureDescriptor(*m_TLAS, m_TLASDescriptor);
 
@@ -693,126 +1095,176 @@ void Sample::CreateTopLevelAccelerationStructure() {
     NRI.UpdateDescriptorRanges(*m_DescriptorSets[0], 1, 1, &descriptorRangeUpdateDesc);
 }
 
-void Sample::CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory) {
-    const nri::BufferDesc bufferDesc = {size, 0, usage};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+void Sample::CreateTimestampQueries() {
+    // A begin-end pair around the TLAS build per buffered frame
+    nri::QueryPoolDesc queryPoolDesc = {};
+    queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+    queryPoolDesc.capacity = 2 * BUFFERED_FRAME_MAX_NUM;
 
-    nri::MemoryDesc memoryDesc = {};
-    NRI.GetBufferMemoryDesc(*m_Device, bufferDesc, nri::MemoryLocation::HOST_UPLOAD, memoryDesc);
+    NRI_ABORT_ON_FAILURE(NRI.CreateQueryPool(*m_Device, queryPoolDesc, m_TimestampQueryPool));
 
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
+    const nri::BufferDesc bufferDesc = {2 * sizeof(uint64_t) * BUFFERED_FRAME_MAX_NUM, 0, nri::BufferUsageBits::NONE};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_ReadbackBuffer));
 
-    const nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {memory, buffer};
-    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(*m_Device, &bufferMemoryBindingDesc, 1));
+    nri::ResourceGroupDesc resourceGroupDesc = {};
+    resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_READBACK;
+    resourceGroupDesc.bufferNum = 1;
+    resourceGroupDesc.buffers = &m_ReadbackBuffer;
+
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 }
 
-void Sample::CreateScratchBuffer(nri::AccelerationStructure& accelerationStructure, nri::Buffer*& buffer, nri::Memory*& memory) {
-    const uint64_t scratchBufferSize = NRI.GetAccelerationStructureBuildScratchBufferSize(accelerationStructure);
+void Sample::CreateCpuReference() {
+    const uint32_t width = GetWindowResolution().x;
+    const uint32_t height = GetWindowResolution().y;
 
-    const nri::BufferDesc bufferDesc = {scratchBufferSize, 0, nri::BufferUsageBits::RAY_TRACING_BUFFER};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+    m_SwapChainFormat = NRI.GetTextureDesc(*m_RayTracingOutput).format;
+    NRI_ABORT_ON_FALSE(m_SwapChainFormat == nri::Format::RGBA8_UNORM || m_SwapChainFormat == nri::Format::BGRA8_UNORM);
 
-    nri::MemoryDesc memoryDesc = {};
-    NRI.GetBufferMemoryDesc(*m_Device, bufferDesc, nri::MemoryLocation::DEVICE, memoryDesc);
+    m_CpuPixels.resize(width * height);
+    m_CpuInstances.resize(BOX_NUM);
 
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
+    for (uint32_t i = 0; i < BOX_NUM; i++) {
+        nri::GeometryObjectInstance& instance = m_CpuInstances[i];
+        instance = {};
+        instance.instanceId = 0; // geometry index
+        instance.mask = 0xff;
 
-    const nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {memory, buffer};
-    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(*m_Device, &bufferMemoryBindingDesc, 1));
+        SetInstanceTransform(instance, i, 0.0f);
+    }
+
+    const CpuRayTracer::Geometry geometry = {positions, indices, helper::GetCountOf(indices) / 3};
+    m_CpuRayTracer.SetGeometries(&geometry, GEOMETRY_NUM);
+    m_CpuRayTracer.SetInstances(m_CpuInstances.data(), BOX_NUM);
+
+    if (m_IsCpuReference) {
+        m_UploadManager.Create(NRI, *m_Device, *m_CommandQueue);
+        return;
+    }
+
+    // Readback for comparisons
+    m_CompareRowPitch = helper::Align(width * (uint32_t)sizeof(uint32_t), NRI.GetDeviceDesc(*m_Device).uploadBufferTextureRowAlignment);
+
+    const nri::BufferDesc bufferDesc = {uint64_t(m_CompareRowPitch) * height, 0, nri::BufferUsageBits::NONE};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_CompareBuffer));
+
+    nri::ResourceGroupDesc resourceGroupDesc = {};
+    resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_READBACK;
+    resourceGroupDesc.bufferNum = 1;
+    resourceGroupDesc.buffers = &m_CompareBuffer;
+
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 }
 
-void Sample::BuildBottomLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, const nri::GeometryObject* objects, const uint32_t objectNum) {
-    nri::Buffer* scratchBuffer = nullptr;
-    nri::Memory* scratchBufferMemory = nullptr;
-    CreateScratchBuffer(accelerationStructure, scratchBuffer, scratchBufferMemory);
+void Sample::TraceOnCpu(const nri::GeometryObjectInstance* instances) {
+    if (instances)
+        m_CpuRayTracer.SetInstances(instances, BOX_NUM);
 
-    nri::CommandAllocator* commandAllocator = nullptr;
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI.CreateCommandAllocator(*m_CommandQueue, commandAllocator);
-    NRI.CreateCommandBuffer(*commandAllocator, commandBuffer);
+    // As "RayTracingBox.rchit" and "RayTracingBox.rmiss", all boxes use geometry 0
+    const nri::Format format = m_SwapChainFormat;
+    const CpuRayTracer::Shader shader = [format](const CpuRayTracer::Hit& hit) {
+        if (hit.instanceIndex == CpuRayTracer::INVALID_INDEX)
+            return PackColor(0.4f, 0.3f, 0.35f, format);
 
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
+        const uint16_t* triangle = indices + hit.primitiveIndex * 3;
+        const float w0 = 1.0f - hit.barycentrics[0] - hit.barycentrics[1];
+        const float* uv0 = texCoords + triangle[0] * 2;
+        const float* uv1 = texCoords + triangle[1] * 2;
+        const float* uv2 = texCoords + triangle[2] * 2;
 
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    NRI.CmdBuildBottomLevelAccelerationStructure(*commandBuffer, objectNum, objects, BUILD_FLAGS, accelerationStructure, *scratchBuffer, 0);
-    NRI.EndCommandBuffer(*commandBuffer);
-    NRI.QueueSubmit(*m_CommandQueue, queueSubmitDesc);
-    NRI.WaitForIdle(*m_CommandQueue);
+        const float u = w0 * uv0[0] + hit.barycentrics[0] * uv1[0] + hit.barycentrics[1] * uv2[0];
+        const float v = w0 * uv0[1] + hit.barycentrics[0] * uv1[1] + hit.barycentrics[1] * uv2[1];
+
+        return PackColor(u, v, 0.0f, format);
+    };
+
+    m_CpuRayTracer.Render(m_CpuPixels.data(), GetWindowResolution().x, GetWindowResolution().y, CPU_VIEW, shader);
+}
+
+void Sample::CompareWithCpuReference() {
+    const uint32_t width = GetWindowResolution().x;
+    const uint32_t height = GetWindowResolution().y;
+
+    TraceOnCpu(m_CpuInstances.data());
 
-    NRI.DestroyCommandBuffer(*commandBuffer);
-    NRI.DestroyCommandAllocator(*commandAllocator);
+    // UNORM rounding can differ by 1, triangle edges can go either way
+    m_MismatchNum = 0;
 
-    NRI.DestroyBuffer(*scratchBuffer);
-    NRI.FreeMemory(*scratchBufferMemory);
+    const uint8_t* data = (uint8_t*)NRI.MapBuffer(*m_CompareBuffer, 0, nri::WHOLE_SIZE);
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* gpu = data + y * m_CompareRowPitch;
+        const uint8_t* cpu = (uint8_t*)(m_CpuPixels.data() + y * width);
+
+        for (uint32_t x = 0; x < width * 4; x += 4) {
+            for (uint32_t c = 0; c < 3; c++) {
+                if (std::abs(int32_t(gpu[x + c]) - int32_t(cpu[x + c])) > 1) {
+                    m_MismatchNum++;
+                    break;
+                }
+            }
+        }
+    }
+    NRI.UnmapBuffer(*m_CompareBuffer);
+
+    m_IsComparePending = false;
+    m_HasCompareResult = true;
 }
 
-void Sample::BuildTopLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer) {
-    nri::Buffer* scratchBuffer = nullptr;
-    nri::Memory* scratchBufferMemory = nullptr;
-    CreateScratchBuffer(accelerationStructure, scratchBuffer, scratchBufferMemory);
+TlasBuild Sample::UpdateInstances(uint32_t bufferedFrameIndex) {
+    const float time = float(m_Timer.GetTimeStamp() * 0.001);
 
-    nri::CommandAllocator* commandAllocator = nullptr;
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI.CreateCommandAllocator(*m_CommandQueue, commandAllocator);
-    NRI.CreateCommandBuffer(*commandAllocator, commandBuffer);
+    // The slice was last read by the frame waited for above
+    nri::GeometryObjectInstance* instances = m_Instances + bufferedFrameIndex * BOX_NUM;
+    for (uint32_t i = 0; i < BOX_NUM; i++)
+        SetInstanceTransform(instances[i], i, time);
 
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
+    m_TLASInstances = instances;
 
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    NRI.CmdBuildTopLevelAccelerationStructure(*commandBuffer, instanceNum, instanceBuffer, 0, BUILD_FLAGS, accelerationStructure, *scratchBuffer, 0);
-    NRI.EndCommandBuffer(*commandBuffer);
-    NRI.QueueSubmit(*m_CommandQueue, queueSubmitDesc);
-    NRI.WaitForIdle(*m_CommandQueue);
+    // An update keeps the BVH topology of the last rebuild, so tracing slows down as boxes move away from it
+    const uint64_t instanceOffset = bufferedFrameIndex * INSTANCE_BUFFER_SLICE_SIZE;
+    if (++m_FramesSinceRebuild >= (uint32_t)m_RebuildPeriod) {
+        m_FramesSinceRebuild = 0;
+        m_AccelerationStructureBuilder.AddTopLevel(*m_TLAS, BOX_NUM, *m_InstanceBuffer, instanceOffset, m_TLASFlags);
 
-    NRI.DestroyCommandBuffer(*commandBuffer);
-    NRI.DestroyCommandAllocator(*commandAllocator);
+        return TlasBuild::REBUILD;
+    }
+
+    m_AccelerationStructureBuilder.AddTopLevelUpdate(*m_TLAS, BOX_NUM, *m_InstanceBuffer, instanceOffset, m_TLASFlags);
+
+    return TlasBuild::UPDATE;
+}
+
+void Sample::CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, MemoryAllocator::Allocation& allocation) {
+    const nri::BufferDesc bufferDesc = {size, 0, usage};
+    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+
+    nri::MemoryDesc memoryDesc = {};
+    NRI.GetBufferMemoryDesc(*m_Device, bufferDesc, nri::MemoryLocation::HOST_UPLOAD, memoryDesc);
+
+    allocation = m_MemoryAllocator.Allocate(memoryDesc);
 
-    NRI.DestroyBuffer(*scratchBuffer);
-    NRI.FreeMemory(*scratchBufferMemory);
+    const nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {allocation.memory, buffer, allocation.offset};
+    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(*m_Device, &bufferMemoryBindingDesc, 1));
 }
 
 void Sample::CreateShaderTable() {
-    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
-    const uint64_t identifierSize = deviceDesc.rayTracingShaderGroupIdentifierSize;
-    const uint64_t tableAlignment = deviceDesc.rayTracingShaderTableAlignment;
+    const ShaderBindingTable::SectionDesc sectionDescs[ShaderBindingTable::MAX_NUM] = {
+        {1, 0},
+        {1, 0},
+        {GEOMETRY_NUM, (uint32_t)sizeof(HitRecordData)},
+    };
 
-    m_ShaderGroupIdentifierSize = identifierSize;
-    m_MissShaderOffset = helper::Align(identifierSize, tableAlignment);
-    m_HitShaderGroupOffset = helper::Align(m_MissShaderOffset + identifierSize, tableAlignment);
-    const uint64_t shaderTableSize = helper::Align(m_HitShaderGroupOffset + identifierSize, tableAlignment);
+    m_ShaderBindingTable.Create(NRI, NRI, *m_Device, *m_Pipeline, m_MemoryAllocator, sectionDescs);
 
-    const nri::BufferDesc bufferDesc = {shaderTableSize, 0, nri::BufferUsageBits::RAY_TRACING_BUFFER};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_ShaderTable));
+    // Uploaded by the first frame
+    m_ShaderBindingTable.SetRecord(ShaderBindingTable::RAYGEN, 0, 0);
+    m_ShaderBindingTable.SetRecord(ShaderBindingTable::MISS, 0, 1);
 
-    nri::ResourceGroupDesc resourceGroupDesc = {};
-    resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
-    resourceGroupDesc.bufferNum = 1;
-    resourceGroupDesc.buffers = &m_ShaderTable;
-
-    const size_t baseAllocation = m_MemoryAllocations.size();
-    m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
-
-    std::vector<uint8_t> content((size_t)shaderTableSize, 0);
-    for (uint32_t i = 0; i < 3; i++)
-        NRI.WriteShaderGroupIdentifiers(*m_Pipeline, i, 1, content.data() + i * helper::Align(identifierSize, tableAlignment));
-
-    nri::BufferUploadDesc dataDesc = {};
-    dataDesc.data = content.data();
-    dataDesc.dataSize = content.size();
-    dataDesc.buffer = m_ShaderTable;
-    dataDesc.after = {nri::AccessBits::UNKNOWN};
-    NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_CommandQueue, nullptr, 0, &dataDesc, 1));
+    // A hit record per geometry, all geometries live at the start of their own buffers
+    for (uint32_t i = 0; i < GEOMETRY_NUM; i++) {
+        const HitRecordData hitRecordData = {i, 0, 0};
+        m_ShaderBindingTable.SetRecord(ShaderBindingTable::HIT_GROUP, i, 2, &hitRecordData, (uint32_t)sizeof(hitRecordData));
+    }
 }
 
 SAMPLE_MAIN(Sample, 0);
@@ -2,9 +2,21 @@
 
 #include "NRIFramework.h"
 
+#include "AccelerationStructureBuilder.h"
+#include "CpuRayTracer.h"
+#include "DeletionQueue.h"
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "ShaderBindingTable.h"
+#include "UploadManager.h"
+
 #include <array>
 
 constexpr auto BUILD_FLAGS = nri::AccelerationStructureBuildBits::PREFER_FAST_TRACE;
+constexpr CpuRayTracer::View CPU_VIEW = {{0.0f, 0.0f, -2.0f}, 0.001f, 100.0f}; // as in "RayTracingTriangle.rgen"
+
+static const float positions[] = {-0.5f, -0.5f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f, -0.5f, 0.0f};
+static const uint16_t indices[] = {0, 1, 2};
 
 struct NRIInterface
     : public nri::CoreInterface,
@@ -25,6 +37,8 @@ public:
     ~Sample();
 
 private:
+    void InitCmdLine(cmdline::parser& cmdLine) override;
+    void ReadCmdLine(cmdline::parser& cmdLine) override;
     bool Initialize(nri::GraphicsAPI graphicsAPI) override;
     void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
@@ -37,10 +51,8 @@ private:
     void CreateBottomLevelAccelerationStructure();
     void CreateTopLevelAccelerationStructure();
     void CreateShaderTable();
-    void CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory);
-    void CreateScratchBuffer(nri::AccelerationStructure& accelerationStructure, nri::Buffer*& buffer, nri::Memory*& memory);
-    void BuildBottomLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, const nri::GeometryObject* objects, const uint32_t objectNum);
-    void BuildTopLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer);
+    void CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, MemoryAllocator::Allocation& allocation);
+    void RenderCpuReference();
 
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
@@ -53,27 +65,28 @@ private:
     nri::Pipeline* m_Pipeline = nullptr;
     nri::PipelineLayout* m_PipelineLayout = nullptr;
 
-    nri::Buffer* m_ShaderTable = nullptr;
-    nri::Memory* m_ShaderTableMemory = nullptr;
-    uint64_t m_ShaderGroupIdentifierSize = 0;
-    uint64_t m_MissShaderOffset = 0;
-    uint64_t m_HitShaderGroupOffset = 0;
-
     nri::Texture* m_RayTracingOutput = nullptr;
     nri::Descriptor* m_RayTracingOutputView = nullptr;
 
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::DescriptorSet* m_DescriptorSet = nullptr;
 
     nri::AccelerationStructure* m_BLAS = nullptr;
     nri::AccelerationStructure* m_TLAS = nullptr;
     nri::Descriptor* m_TLASDescriptor = nullptr;
-    nri::Memory* m_BLASMemory = nullptr;
-    nri::Memory* m_TLASMemory = nullptr;
+    MemoryAllocator::Allocation m_BLASAllocation = {};
+    MemoryAllocator::Allocation m_TLASAllocation = {};
+    nri::AccelerationStructureBuildBits m_BuildFlags = BUILD_FLAGS;
 
     const BackBuffer* m_BackBuffer = nullptr;
     std::vector<BackBuffer> m_SwapChainBuffers;
-    std::vector<nri::Memory*> m_MemoryAllocations;
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
+    DeletionQueue m_DeletionQueue;
+    AccelerationStructureBuilder m_AccelerationStructureBuilder;
+    ShaderBindingTable m_ShaderBindingTable;
+
+    bool m_EnableCompaction = false;
+    bool m_IsCpuReference = false;
 };
 
 Sample::~Sample() {
@@ -87,35 +100,49 @@ Sample::~Sample() {
     for (uint32_t i = 0; i < m_SwapChainBuffers.size(); i++)
         NRI.DestroyDescriptor(*m_SwapChainBuffers[i].colorAttachment);
 
-    NRI.DestroyDescriptor(*m_RayTracingOutputView);
     NRI.DestroyTexture(*m_RayTracingOutput);
 
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
+    m_DescriptorAllocator.Destroy();
 
-    NRI.DestroyAccelerationStructure(*m_BLAS);
-    NRI.DestroyAccelerationStructure(*m_TLAS);
-    NRI.DestroyDescriptor(*m_TLASDescriptor);
-    NRI.DestroyBuffer(*m_ShaderTable);
+    if (!m_IsCpuReference) {
+        NRI.DestroyDescriptor(*m_RayTracingOutputView);
 
-    NRI.DestroyPipeline(*m_Pipeline);
-    NRI.DestroyPipelineLayout(*m_PipelineLayout);
+        NRI.DestroyAccelerationStructure(*m_BLAS);
+        NRI.DestroyAccelerationStructure(*m_TLAS);
+        NRI.DestroyDescriptor(*m_TLASDescriptor);
+
+        NRI.DestroyPipeline(*m_Pipeline);
+        NRI.DestroyPipelineLayout(*m_PipelineLayout);
+    }
+
+    m_ShaderBindingTable.Destroy();
+    m_DeletionQueue.Destroy();
+    m_AccelerationStructureBuilder.Destroy();
 
     NRI.DestroyFence(*m_FrameFence);
 
     NRI.DestroySwapChain(*m_SwapChain);
 
-    for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
-        NRI.FreeMemory(*m_MemoryAllocations[i]);
-
-    NRI.FreeMemory(*m_BLASMemory);
-    NRI.FreeMemory(*m_TLASMemory);
-    NRI.FreeMemory(*m_ShaderTableMemory);
+    m_MemoryAllocator.Destroy();
 
     DestroyUI(NRI);
 
     nri::nriDestroyDevice(*m_Device);
 }
 
+void Sample::InitCmdLine(cmdline::parser& cmdLine) {
+    cmdLine.add("compaction", 0, "compact acceleration structures after building");
+    cmdLine.add("cpuReference", 0, "trace rays on the CPU (no ray tracing hardware needed)");
+}
+
+void Sample::ReadCmdLine(cmdline::parser& cmdLine) {
+    m_EnableCompaction = cmdLine.exist("compaction");
+    m_IsCpuReference = cmdLine.exist("cpuReference");
+
+    if (m_EnableCompaction)
+        m_BuildFlags = BUILD_FLAGS | nri::AccelerationStructureBuildBits::ALLOW_COMPACTION;
+}
+
 bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     nri::AdapterDesc bestAdapterDesc = {};
     uint32_t adapterDescsNum = 1;
@@ -132,23 +159,37 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
 
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::CoreInterface), (nri::CoreInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
-    NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::RayTracingInterface), (nri::RayTracingInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::HelperInterface), (nri::HelperInterface*)&NRI));
 
+    if (!m_IsCpuReference)
+        NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::RayTracingInterface), (nri::RayTracingInterface*)&NRI));
+
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_CommandQueue));
     NRI_ABORT_ON_FAILURE(NRI.CreateFence(*m_Device, 0, m_FrameFence));
 
+    m_MemoryAllocator.Create(NRI, *m_Device);
+    m_DescriptorAllocator.Create(NRI, *m_Device);
+    m_DeletionQueue.Create(NRI, *m_FrameFence);
+
     CreateCommandBuffers();
 
     nri::Format swapChainFormat = nri::Format::UNKNOWN;
     CreateSwapChain(swapChainFormat);
 
-    CreateRayTracingPipeline();
-    CreateDescriptorSet();
-    CreateRayTracingOutput(swapChainFormat);
-    CreateBottomLevelAccelerationStructure();
-    CreateTopLevelAccelerationStructure();
-    CreateShaderTable();
+    if (m_IsCpuReference) {
+        CreateRayTracingOutput(swapChainFormat);
+        RenderCpuReference();
+    } else {
+        m_AccelerationStructureBuilder.Create(NRI, NRI, *m_Device, *m_CommandQueue, m_MemoryAllocator, &m_DeletionQueue);
+
+        CreateRayTracingPipeline();
+        CreateDescriptorSet();
+        CreateRayTracingOutput(swapChainFormat);
+        CreateBottomLevelAccelerationStructure();
+        CreateTopLevelAccelerationStructure();
+        m_AccelerationStructureBuilder.Flush();
+        CreateShaderTable();
+    }
 
     return InitUI(NRI, NRI, *m_Device, swapChainFormat);
 }
@@ -165,6 +206,12 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.ResetCommandAllocator(*frame.commandAllocator);
     }
 
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+
+    // Objects retired from now on wait for this frame
+    m_DeletionQueue.SetFenceValue(1 + frameIndex);
+    m_DeletionQueue.Update();
+
     const uint32_t backBufferIndex = NRI.AcquireNextSwapChainTexture(*m_SwapChain);
     m_BackBuffer = &m_SwapChainBuffers[backBufferIndex];
 
@@ -173,7 +220,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
     // Record
     nri::CommandBuffer& commandBuffer = *frame.commandBuffer;
-    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
     {
         // Rendering
         textureTransitions[0].texture = m_BackBuffer->texture;
@@ -181,37 +228,42 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         textureTransitions[0].layerNum = 1;
         textureTransitions[0].mipNum = 1;
 
-        textureTransitions[1].texture = m_RayTracingOutput;
-        textureTransitions[1].before = {frameIndex == 0 ? nri::AccessBits::UNKNOWN : nri::AccessBits::COPY_SOURCE, frameIndex == 0 ? nri::Layout::UNKNOWN : nri::Layout::COPY_SOURCE};
-        textureTransitions[1].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE};
-        textureTransitions[1].layerNum = 1;
-        textureTransitions[1].mipNum = 1;
+        // The CPU reference is uploaded once and stays in "COPY_SOURCE"
+        if (m_IsCpuReference) {
+            barrierGroupDesc.textures = textureTransitions;
+            barrierGroupDesc.textureNum = 1;
 
-        barrierGroupDesc.textures = textureTransitions;
-        barrierGroupDesc.textureNum = 2;
+            NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+        } else {
+            textureTransitions[1].texture = m_RayTracingOutput;
+            textureTransitions[1].before = {frameIndex == 0 ? nri::AccessBits::UNKNOWN : nri::AccessBits::COPY_SOURCE, frameIndex == 0 ? nri::Layout::UNKNOWN : nri::Layout::COPY_SOURCE};
+            textureTransitions[1].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE};
+            textureTransitions[1].layerNum = 1;
+            textureTransitions[1].mipNum = 1;
 
-        NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
-        NRI.CmdSetPipelineLayout(commandBuffer, *m_PipelineLayout);
-        NRI.CmdSetPipeline(commandBuffer, *m_Pipeline);
-        NRI.CmdSetDescriptorSet(commandBuffer, 0, *m_DescriptorSet, nullptr);
-
-        nri::DispatchRaysDesc dispatchRaysDesc = {};
-        dispatchRaysDesc.raygenShader = {m_ShaderTable, 0, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.missShaders = {m_ShaderTable, m_MissShaderOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.hitShaderGroups = {m_ShaderTable, m_HitShaderGroupOffset, m_ShaderGroupIdentifierSize, m_ShaderGroupIdentifierSize};
-        dispatchRaysDesc.x = (uint16_t)GetWindowResolution().x;
-        dispatchRaysDesc.y = (uint16_t)GetWindowResolution().y;
-        dispatchRaysDesc.z = 1;
-        NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+            barrierGroupDesc.textures = textureTransitions;
+            barrierGroupDesc.textureNum = 2;
 
-        // Copy
-        textureTransitions[1].before = textureTransitions[1].after;
-        textureTransitions[1].after = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE};
+            m_ShaderBindingTable.Update(commandBuffer, bufferedFrameIndex);
 
-        barrierGroupDesc.textures = textureTransitions + 1;
-        barrierGroupDesc.textureNum = 1;
+            NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+            NRI.CmdSetPipelineLayout(commandBuffer, *m_PipelineLayout);
+            NRI.CmdSetPipeline(commandBuffer, *m_Pipeline);
+            NRI.CmdSetDescriptorSet(commandBuffer, 0, *m_DescriptorSet, nullptr);
 
-        NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+            const nri::DispatchRaysDesc dispatchRaysDesc = m_ShaderBindingTable.GetDispatchRaysDesc(GetWindowResolution().x, GetWindowResolution().y);
+            NRI.CmdDispatchRays(commandBuffer, dispatchRaysDesc);
+
+            textureTransitions[1].before = textureTransitions[1].after;
+            textureTransitions[1].after = {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE};
+
+            barrierGroupDesc.textures = textureTransitions + 1;
+            barrierGroupDesc.textureNum = 1;
+
+            NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+        }
+
+        // Copy
         NRI.CmdCopyTexture(commandBuffer, *m_BackBuffer->texture, nullptr, *m_RayTracingOutput, nullptr);
 
         // Present
@@ -298,6 +350,7 @@ void Sample::CreateRayTracingPipeline() {
     pipelineLayoutDesc.shaderStages = nri::StageBits::RAYGEN_SHADER;
 
     NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+    m_DescriptorAllocator.AddPipelineLayout(*m_PipelineLayout, pipelineLayoutDesc);
 
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     utils::ShaderCodeStorage shaderCodeStorage;
@@ -338,19 +391,16 @@ void Sample::CreateRayTracingOutput(nri::Format swapChainFormat) {
     rayTracingOutputDesc.usageMask = nri::TextureUsageBits::SHADER_RESOURCE_STORAGE;
     NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, rayTracingOutputDesc, m_RayTracingOutput));
 
-    nri::MemoryDesc memoryDesc = {};
-    NRI.GetTextureMemoryDesc(*m_Device, rayTracingOutputDesc, nri::MemoryLocation::DEVICE, memoryDesc);
-
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
+    nri::ResourceGroupDesc resourceGroupDesc = {};
+    resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
+    resourceGroupDesc.textureNum = 1;
+    resourceGroupDesc.textures = &m_RayTracingOutput;
 
-    nri::Memory* memory = nullptr;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
-    m_MemoryAllocations.push_back(memory);
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
-    const nri::TextureMemoryBindingDesc memoryBindingDesc = {memory, m_RayTracingOutput};
-    NRI_ABORT_ON_FAILURE(NRI.BindTextureMemory(*m_Device, &memoryBindingDesc, 1));
+    // The CPU reference uploads into it
+    if (m_IsCpuReference)
+        return;
 
     nri::Texture2DViewDesc textureViewDesc = {m_RayTracingOutput, nri::Texture2DViewType::SHADER_RESOURCE_STORAGE_2D, swapChainFormat};
     NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(textureViewDesc, m_RayTracingOutputView));
@@ -360,25 +410,16 @@ void Sample::CreateRayTracingOutput(nri::Format swapChainFormat) {
 }
 
 void Sample::CreateDescriptorSet() {
-    nri::DescriptorPoolDesc descriptorPoolDesc = {};
-    descriptorPoolDesc.storageTextureMaxNum = 1;
-    descriptorPoolDesc.accelerationStructureMaxNum = 1;
-    descriptorPoolDesc.descriptorSetMaxNum = 1;
-
-    NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
-    NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 0, &m_DescriptorSet, 1, 0));
+    m_DescriptorAllocator.Allocate(*m_PipelineLayout, 0, &m_DescriptorSet, 1);
 }
 
 void Sample::CreateBottomLevelAccelerationStructure() {
-    const uint64_t vertexDataSize = 3 * 3 * sizeof(float);
-    const uint64_t indexDataSize = 3 * sizeof(uint16_t);
+    const uint64_t vertexDataSize = sizeof(positions);
+    const uint64_t indexDataSize = sizeof(indices);
 
     nri::Buffer* buffer = nullptr;
-    nri::Memory* memory = nullptr;
-    CreateUploadBuffer(vertexDataSize + indexDataSize, nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ, buffer, memory);
-
-    const float positions[] = {-0.5f, -0.5f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f, -0.5f, 0.0f};
-    const uint16_t indices[] = {0, 1, 2};
+    MemoryAllocator::Allocation allocation = {};
+    CreateUploadBuffer(vertexDataSize + indexDataSize, nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ, buffer, allocation);
 
     uint8_t* data = (uint8_t*)NRI.MapBuffer(*buffer, 0, vertexDataSize + indexDataSize);
     memcpy(data, positions, sizeof(positions));
@@ -399,7 +440,7 @@ void Sample::CreateBottomLevelAccelerationStructure() {
 
     nri::AccelerationStructureDesc accelerationStructureBLASDesc = {};
     accelerationStructureBLASDesc.type = nri::AccelerationStructureType::BOTTOM_LEVEL;
-    accelerationStructureBLASDesc.flags = BUILD_FLAGS;
+    accelerationStructureBLASDesc.flags = m_BuildFlags;
     accelerationStructureBLASDesc.instanceOrGeometryObjectNum = 1;
     accelerationStructureBLASDesc.geometryObjects = &object;
 
@@ -408,41 +449,37 @@ void Sample::CreateBottomLevelAccelerationStructure() {
     nri::MemoryDesc memoryDesc = {};
     NRI.GetAccelerationStructureMemoryDesc(*m_Device, accelerationStructureBLASDesc, nri::MemoryLocation::DEVICE, memoryDesc);
 
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, m_BLASMemory));
+    m_BLASAllocation = m_MemoryAllocator.AllocateAndBind(*m_BLAS, memoryDesc);
 
-    const nri::AccelerationStructureMemoryBindingDesc memoryBindingDesc = {m_BLASMemory, m_BLAS};
-    NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(*m_Device, &memoryBindingDesc, 1));
+    m_AccelerationStructureBuilder.AddBottomLevel(*m_BLAS, &object, 1, m_BuildFlags);
 
-    BuildBottomLevelAccelerationStructure(*m_BLAS, &object, 1);
+    // The instance references the BLAS by address, so it gets compacted before the TLAS is built
+    if (m_EnableCompaction) {
+        m_AccelerationStructureBuilder.Flush();
 
-    NRI.DestroyBuffer(*buffer);
-    NRI.FreeMemory(*memory);
+        const uint64_t compactedSize = m_AccelerationStructureBuilder.AddCompaction(m_BLAS, m_BLASAllocation, accelerationStructureBLASDesc);
+        printf("BLAS memory: %llu -> %llu bytes\n", (unsigned long long)memoryDesc.size, (unsigned long long)compactedSize);
+    }
+
+    m_DeletionQueue.Push(*buffer);
+    m_DeletionQueue.Push([this, allocation]() { m_MemoryAllocator.Free(allocation); });
 }
 
 void Sample::CreateTopLevelAccelerationStructure() {
     nri::AccelerationStructureDesc accelerationStructureTLASDesc = {};
     accelerationStructureTLASDesc.type = nri::AccelerationStructureType::TOP_LEVEL;
-    accelerationStructureTLASDesc.flags = BUILD_FLAGS;
+    accelerationStructureTLASDesc.flags = m_BuildFlags;
     accelerationStructureTLASDesc.instanceOrGeometryObjectNum = 1;
     NRI_ABORT_ON_FAILURE(NRI.CreateAccelerationStructure(*m_Device, accelerationStructureTLASDesc, m_TLAS));
 
     nri::MemoryDesc memoryDesc = {};
     NRI.GetAccelerationStructureMemoryDesc(*m_Device, accelerationStructureTLASDesc, nri::MemoryLocation::DEVICE, memoryDesc);
 
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, m_TLASMemory));
-
-    const nri::AccelerationStructureMemoryBindingDesc memoryBindingDesc = {m_TLASMemory, m_TLAS};
-    NRI_ABORT_ON_FAILURE(NRI.BindAccelerationStructureMemory(*m_Device, &memoryBindingDesc, 1));
+    m_TLASAllocation = m_MemoryAllocator.AllocateAndBind(*m_TLAS, memoryDesc);
 
     nri::Buffer* buffer = nullptr;
-    nri::Memory* memory = nullptr;
-    CreateUploadBuffer(sizeof(nri::GeometryObjectInstance), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ, buffer, memory);
+    MemoryAllocator::Allocation allocation = {};
+    CreateUploadBuffer(sizeof(nri::GeometryObjectInstance), nri::BufferUsageBits::ACCELERATION_STRUCTURE_BUILD_READ, buffer, allocation);
 
     nri::GeometryObjectInstance geometryObjectInstance = {};
     geometryObjectInstance.accelerationStructureHandle = NRI.GetAccelerationStructureHandle(*m_BLAS);
@@ -456,10 +493,17 @@ void Sample::CreateTopLevelAccelerationStructure() {
     memcpy(data, &geometryObjectInstance, sizeof(geometryObjectInstance));
     NRI.UnmapBuffer(*buffer);
 
-    BuildTopLevelAccelerationStructure(*m_TLAS, 1, *buffer);
+    m_AccelerationStructureBuilder.AddTopLevel(*m_TLAS, 1, *buffer, 0, m_BuildFlags);
+
+    if (m_EnableCompaction) {
+        m_AccelerationStructureBuilder.Flush();
+
+        const uint64_t compactedSize = m_AccelerationStructureBuilder.AddCompaction(m_TLAS, m_TLASAllocation, accelerationStructureTLASDesc);
+        printf("TLAS memory: %llu -> %llu bytes\n", (unsigned long long)memoryDesc.size, (unsigned long long)compactedSize);
+    }
 
-    NRI.DestroyBuffer(*buffer);
-    NRI.FreeMemory(*memory);
+    m_DeletionQueue.Push(*buffer);
+    m_DeletionQueue.Push([this, allocation]() { m_MemoryAllocator.Free(allocation); });
 
     NRI.CreateAccelerationStructureDescriptor(*m_TLAS, m_TLASDescriptor);
 
@@ -467,147 +511,82 @@ void Sample::CreateTopLevelAccelerationStructure() {
     NRI.UpdateDescriptorRanges(*m_DescriptorSet, 1, 1, &descriptorRangeUpdateDesc);
 }
 
-void Sample::CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, nri::Memory*& memory) {
+void Sample::CreateUploadBuffer(uint64_t size, nri::BufferUsageBits usage, nri::Buffer*& buffer, MemoryAllocator::Allocation& allocation) {
     nri::BufferDesc bufferDesc = {size, 0, usage};
     NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
 
     nri::MemoryDesc memoryDesc = {};
     NRI.GetBufferMemoryDesc(*m_Device, bufferDesc, nri::MemoryLocation::HOST_UPLOAD, memoryDesc);
 
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
-
-    nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {memory, buffer};
-    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(*m_Device, &bufferMemoryBindingDesc, 1));
-}
-
-void Sample::CreateScratchBuffer(nri::AccelerationStructure& accelerationStructure, nri::Buffer*& buffer, nri::Memory*& memory) {
-    uint64_t scratchBufferSize = NRI.GetAccelerationStructureBuildScratchBufferSize(accelerationStructure);
-
-    nri::BufferDesc bufferDesc = {scratchBufferSize, 0, nri::BufferUsageBits::RAY_TRACING_BUFFER};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
-
-    nri::MemoryDesc memoryDesc = {};
-    NRI.GetBufferMemoryDesc(*m_Device, bufferDesc, nri::MemoryLocation::DEVICE, memoryDesc);
-
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, memory));
+    allocation = m_MemoryAllocator.Allocate(memoryDesc);
 
-    nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {memory, buffer};
+    nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {allocation.memory, buffer, allocation.offset};
     NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(*m_Device, &bufferMemoryBindingDesc, 1));
 }
 
-void Sample::BuildBottomLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, const nri::GeometryObject* objects, const uint32_t objectNum) {
-    nri::Buffer* scratchBuffer = nullptr;
-    nri::Memory* scratchBufferMemory = nullptr;
-    CreateScratchBuffer(accelerationStructure, scratchBuffer, scratchBufferMemory);
+void Sample::RenderCpuReference() {
+    const uint32_t width = GetWindowResolution().x;
+    const uint32_t height = GetWindowResolution().y;
 
-    nri::CommandAllocator* commandAllocator = nullptr;
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI.CreateCommandAllocator(*m_CommandQueue, commandAllocator);
-    NRI.CreateCommandBuffer(*commandAllocator, commandBuffer);
+    const nri::Format format = NRI.GetTextureDesc(*m_RayTracingOutput).format;
+    NRI_ABORT_ON_FALSE(format == nri::Format::RGBA8_UNORM || format == nri::Format::BGRA8_UNORM);
 
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
+    // The same instance as the TLAS gets
+    nri::GeometryObjectInstance geometryObjectInstance = {};
+    geometryObjectInstance.transform[0][0] = 1.0f;
+    geometryObjectInstance.transform[1][1] = 1.0f;
+    geometryObjectInstance.transform[2][2] = 1.0f;
+    geometryObjectInstance.mask = 0xFF;
 
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    NRI.CmdBuildBottomLevelAccelerationStructure(*commandBuffer, objectNum, objects, BUILD_FLAGS, accelerationStructure, *scratchBuffer, 0);
-    NRI.EndCommandBuffer(*commandBuffer);
-    NRI.QueueSubmit(*m_CommandQueue, queueSubmitDesc);
-    NRI.WaitForIdle(*m_CommandQueue);
+    const CpuRayTracer::Geometry geometry = {positions, indices, 1};
 
-    NRI.DestroyCommandBuffer(*commandBuffer);
-    NRI.DestroyCommandAllocator(*commandAllocator);
+    CpuRayTracer cpuRayTracer;
+    cpuRayTracer.SetGeometries(&geometry, 1);
+    cpuRayTracer.SetInstances(&geometryObjectInstance, 1);
 
-    NRI.DestroyBuffer(*scratchBuffer);
-    NRI.FreeMemory(*scratchBufferMemory);
-}
+    // As "RayTracingTriangle.rchit" and "RayTracingTriangle.rmiss", UNORM with "alpha = 0"
+    const bool isBgra = format == nri::Format::BGRA8_UNORM;
+    const CpuRayTracer::Shader shader = [isBgra](const CpuRayTracer::Hit& hit) {
+        float color[3] = {0.4f, 0.3f, 0.35f};
+        if (hit.instanceIndex != CpuRayTracer::INVALID_INDEX) {
+            color[0] = 1.0f - hit.barycentrics[0] - hit.barycentrics[1];
+            color[1] = hit.barycentrics[0];
+            color[2] = hit.barycentrics[1];
+        }
 
-void Sample::BuildTopLevelAccelerationStructure(nri::AccelerationStructure& accelerationStructure, uint32_t instanceNum, nri::Buffer& instanceBuffer) {
-    nri::Buffer* scratchBuffer = nullptr;
-    nri::Memory* scratchBufferMemory = nullptr;
-    CreateScratchBuffer(accelerationStructure, scratchBuffer, scratchBufferMemory);
+        uint32_t packed = 0;
+        for (uint32_t i = 0; i < 3; i++)
+            packed |= uint32_t(std::min(std::max(color[isBgra ? 2 - i : i], 0.0f), 1.0f) * 255.0f + 0.5f) << (i * 8);
 
-    nri::CommandAllocator* commandAllocator = nullptr;
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI.CreateCommandAllocator(*m_CommandQueue, commandAllocator);
-    NRI.CreateCommandBuffer(*commandAllocator, commandBuffer);
+        return packed;
+    };
 
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
+    std::vector<uint32_t> pixels(width * height);
+    cpuRayTracer.Render(pixels.data(), width, height, CPU_VIEW, shader);
 
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    NRI.CmdBuildTopLevelAccelerationStructure(*commandBuffer, instanceNum, instanceBuffer, 0, BUILD_FLAGS, accelerationStructure, *scratchBuffer, 0);
-    NRI.EndCommandBuffer(*commandBuffer);
-    NRI.QueueSubmit(*m_CommandQueue, queueSubmitDesc);
-    NRI.WaitForIdle(*m_CommandQueue);
+    const CpuRayTracer::Stats& stats = cpuRayTracer.GetStats();
+    printf("CPU reference: %.2f ms, %u threads, %.2f Mrays/s per core\n", stats.renderTime, stats.threadNum, cpuRayTracer.GetRaysPerSecondPerCore() * 1e-6);
 
-    NRI.DestroyCommandBuffer(*commandBuffer);
-    NRI.DestroyCommandAllocator(*commandAllocator);
+    nri::TextureSubresourceUploadDesc subresource = {};
+    subresource.slices = pixels.data();
+    subresource.sliceNum = 1;
+    subresource.rowPitch = width * (uint32_t)sizeof(uint32_t);
+    subresource.slicePitch = subresource.rowPitch * height;
 
-    NRI.DestroyBuffer(*scratchBuffer);
-    NRI.FreeMemory(*scratchBufferMemory);
+    UploadManager uploadManager;
+    uploadManager.Create(NRI, *m_Device, *m_CommandQueue);
+    uploadManager.UploadTexture(*m_RayTracingOutput, &subresource, {nri::AccessBits::COPY_SOURCE, nri::Layout::COPY_SOURCE, nri::StageBits::COPY});
+    uploadManager.Destroy();
 }
 
 void Sample::CreateShaderTable() {
-    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
-    const uint64_t identifierSize = deviceDesc.rayTracingShaderGroupIdentifierSize;
-    const uint64_t tableAlignment = deviceDesc.rayTracingShaderTableAlignment;
-
-    m_ShaderGroupIdentifierSize = identifierSize;
-    m_MissShaderOffset = helper::Align(identifierSize, tableAlignment);
-    m_HitShaderGroupOffset = helper::Align(m_MissShaderOffset + identifierSize, tableAlignment);
-    const uint64_t shaderTableSize = helper::Align(m_HitShaderGroupOffset + identifierSize, tableAlignment);
-
-    const nri::BufferDesc bufferDesc = {shaderTableSize, 0, nri::BufferUsageBits::RAY_TRACING_BUFFER};
-    NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_ShaderTable));
-
-    nri::MemoryDesc memoryDesc = {};
-    NRI.GetBufferMemoryDesc(*m_Device, bufferDesc, nri::MemoryLocation::DEVICE, memoryDesc);
-
-    nri::AllocateMemoryDesc allocateMemoryDesc = {};
-    allocateMemoryDesc.size = memoryDesc.size;
-    allocateMemoryDesc.type = memoryDesc.type;
-    NRI_ABORT_ON_FAILURE(NRI.AllocateMemory(*m_Device, allocateMemoryDesc, m_ShaderTableMemory));
-
-    const nri::BufferMemoryBindingDesc bufferMemoryBindingDesc = {m_ShaderTableMemory, m_ShaderTable};
-    NRI_ABORT_ON_FAILURE(NRI.BindBufferMemory(*m_Device, &bufferMemoryBindingDesc, 1));
-
-    nri::Buffer* buffer = nullptr;
-    nri::Memory* memory = nullptr;
-    CreateUploadBuffer(shaderTableSize, nri::BufferUsageBits::NONE, buffer, memory);
-
-    uint8_t* data = (uint8_t*)NRI.MapBuffer(*buffer, 0, shaderTableSize);
-    for (uint32_t i = 0; i < 3; i++)
-        NRI.WriteShaderGroupIdentifiers(*m_Pipeline, i, 1, data + i * helper::Align(identifierSize, tableAlignment));
-    NRI.UnmapBuffer(*buffer);
-
-    nri::CommandAllocator* commandAllocator = nullptr;
-    nri::CommandBuffer* commandBuffer = nullptr;
-    NRI.CreateCommandAllocator(*m_CommandQueue, commandAllocator);
-    NRI.CreateCommandBuffer(*commandAllocator, commandBuffer);
-
-    nri::QueueSubmitDesc queueSubmitDesc = {};
-    queueSubmitDesc.commandBuffers = &commandBuffer;
-    queueSubmitDesc.commandBufferNum = 1;
-
-    NRI.BeginCommandBuffer(*commandBuffer, nullptr);
-    NRI.CmdCopyBuffer(*commandBuffer, *m_ShaderTable, 0, *buffer, 0, shaderTableSize);
-    NRI.EndCommandBuffer(*commandBuffer);
-    NRI.QueueSubmit(*m_CommandQueue, queueSubmitDesc);
-    NRI.WaitForIdle(*m_CommandQueue);
-
-    NRI.DestroyCommandBuffer(*commandBuffer);
-    NRI.DestroyCommandAllocator(*commandAllocator);
+    const ShaderBindingTable::SectionDesc sectionDescs[ShaderBindingTable::MAX_NUM] = {{1, 0}, {1, 0}, {1, 0}};
+    m_ShaderBindingTable.Create(NRI, NRI, *m_Device, *m_Pipeline, m_MemoryAllocator, sectionDescs);
 
-    NRI.DestroyBuffer(*buffer);
-    NRI.FreeMemory(*memory);
+    // Uploaded by the first frame
+    m_ShaderBindingTable.SetRecord(ShaderBindingTable::RAYGEN, 0, 0);
+    m_ShaderBindingTable.SetRecord(ShaderBindingTable::MISS, 0, 1);
+    m_ShaderBindingTable.SetRecord(ShaderBindingTable::HIT_GROUP, 0, 2);
 }
 
 SAMPLE_MAIN(Sample, 0);
@@ -2,6 +2,8 @@
 
 #include "NRIFramework.h"
 
+#include "MemoryAllocator.h"
+
 #include <array>
 
 struct NRIInterface
@@ -36,7 +38,7 @@ private:
     nri::Fence* m_FrameFence = nullptr;
 
     std::array<Frame, BUFFERED_FRAME_MAX_NUM> m_Frames = {};
-    std::vector<nri::Memory*> m_MemoryAllocations;
+    MemoryAllocator m_MemoryAllocator;
     std::vector<BackBuffer> m_SwapChainBuffers;
 
     nri::Format m_SwapChainFormat;
@@ -58,8 +60,7 @@ Sample::~Sample() {
     NRI.DestroySwapChain(*m_SwapChain);
     NRI.DestroyStreamer(*m_Streamer);
 
-    for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
-        NRI.FreeMemory(*m_MemoryAllocations[i]);
+    m_MemoryAllocator.Destroy();
 
     DestroyUI(NRI);
 
@@ -96,6 +97,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     streamerDesc.frameInFlightNum = BUFFERED_FRAME_MAX_NUM;
     NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
+    // Memory allocator
+    m_MemoryAllocator.Create(NRI, *m_Device);
+
     // Command queue
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_CommandQueue));
 
@@ -146,8 +150,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         resourceGroupDesc.bufferNum = 1;
         resourceGroupDesc.buffers = &m_ReadbackBuffer;
 
-        m_MemoryAllocations.resize(1, nullptr);
-        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data()));
+        m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
     }
 
     return InitUI(NRI, NRI, *m_Device, m_SwapChainFormat);
@@ -25,7 +25,7 @@ public:
     bool Initialize(nri::GraphicsAPI graphicsAPI) override;
     void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
-    void ResizeSwapChain();
+    void ResizeSwapChain(uint32_t frameIndex);
 
 private:
     NRIInterface NRI = {};
@@ -41,6 +41,8 @@ private:
 
     nri::Format m_SwapChainFormat;
     uint2 m_PrevWindowResolution;
+    double m_ResizeTime = 0.0;
+    double m_ResizeWaitTime = 0.0;
     bool m_IsFullscreen = false;
 };
 
@@ -145,11 +147,11 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
     uint32_t n = N - 1 - (frameIndex % N);
 
     // Info text
-    char s[64];
+    char s[128];
     if (m_IsFullscreen)
-        snprintf(s, sizeof(s), "Going windowed in %u...", n / 1000);
+        snprintf(s, sizeof(s), "Going windowed in %u... (last resize %.2f ms, %.2f ms waiting)", n / 1000, m_ResizeTime, m_ResizeWaitTime);
     else
-        snprintf(s, sizeof(s), "Going fullscreen in %u...", n / 1000);
+        snprintf(s, sizeof(s), "Going fullscreen in %u... (last resize %.2f ms, %.2f ms waiting)", n / 1000, m_ResizeTime, m_ResizeWaitTime);
 
     // Resize
     if (n == 0) {
@@ -172,7 +174,7 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
         glfwSetWindowPos(m_Window, x, y);
         glfwSetWindowSize(m_Window, m_WindowResolution.x, m_WindowResolution.y);
 
-        ResizeSwapChain();
+        ResizeSwapChain(frameIndex);
     }
 
     // UI
@@ -195,11 +197,19 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
     NRI.CopyStreamerUpdateRequests(*m_Streamer);
 }
 
-void Sample::ResizeSwapChain() {
-    // Wait for idle
-    NRI.WaitForIdle(*m_CommandQueue);
+void Sample::ResizeSwapChain(uint32_t frameIndex) {
+    const double resizeBegin = m_Timer.GetTimeStamp();
+
+    // A window can't have two swap chains and NRI has no in-place resize, so the old swap chain and its views can't be
+    // retired through a deletion queue: they must be gone before the new one is created. D3D11 defers the destruction
+    // of objects in use by the GPU itself. D3D12 and Vulkan require the GPU to be done with the back buffers, i.e. the
+    // last submitted frame, which signals "frameIndex" (a full drain, reported as the resize wait time)
+    if (frameIndex && NRI.GetDeviceDesc(*m_Device).graphicsAPI != nri::GraphicsAPI::D3D11)
+        NRI.Wait(*m_FrameFence, frameIndex);
 
-    // Destroy old swapchain
+    m_ResizeWaitTime = m_Timer.GetTimeStamp() - resizeBegin;
+
+    // Views before their textures
     for (BackBuffer& backBuffer : m_SwapChainBuffers)
         NRI.DestroyDescriptor(*backBuffer.colorAttachment);
 
@@ -230,6 +240,8 @@ void Sample::ResizeSwapChain() {
         const BackBuffer backBuffer = {colorAttachment, swapChainTextures[i]};
         m_SwapChainBuffers.push_back(backBuffer);
     }
+
+    m_ResizeTime = m_Timer.GetTimeStamp() - resizeBegin;
 }
 
 void Sample::RenderFrame(uint32_t frameIndex) {
@@ -3,21 +3,54 @@
 #include "NRICompatibility.hlsli"
 #include "NRIFramework.h"
 
+#include "../Shaders/SceneViewerDrsStructs.h"
+#include "../Shaders/SceneViewerMeshletStructs.h"
+#include "../Shaders/SceneViewerVrsStructs.h"
+#include "ConstantAllocator.h"
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+
+#include <algorithm>
 #include <array>
 
 constexpr uint32_t GLOBAL_DESCRIPTOR_SET = 0;
 constexpr uint32_t MATERIAL_DESCRIPTOR_SET = 1;
+constexpr uint32_t MESHLET_DESCRIPTOR_SET = 2;
 constexpr float CLEAR_DEPTH = 0.0f;
 constexpr uint32_t TEXTURES_PER_MATERIAL = 4;
-
-constexpr uint32_t CONSTANT_BUFFER = 0;
-constexpr uint32_t READBACK_BUFFER = 1;
-constexpr uint32_t INDEX_BUFFER = 2;
-constexpr uint32_t VERTEX_BUFFER = 3;
+constexpr uint32_t MESHLET_PIPELINE_OFFSET = 3;
+constexpr uint32_t VRS_READBACK_OFFSET = sizeof(nri::PipelineStatisticsDesc) * BUFFERED_FRAME_MAX_NUM;
+constexpr float VRS_MOTION_SENSITIVITY = 0.1f; // per pixel of motion
+constexpr uint32_t TIMESTAMP_READBACK_OFFSET = VRS_READBACK_OFFSET + sizeof(uint64_t) * BUFFERED_FRAME_MAX_NUM; // a VRS slot per frame, 8 bytes to keep alignment
+constexpr uint32_t READBACK_BUFFER_SIZE = TIMESTAMP_READBACK_OFFSET + 2 * sizeof(uint64_t) * BUFFERED_FRAME_MAX_NUM;
+constexpr float DRS_SCALE_MIN = 0.5f;
+constexpr float DRS_SCALE_STEP = 1.0f / 32.0f; // render resolution changes in steps, keeping VRS history valid in between
+constexpr float DRS_KP = 0.3f;
+constexpr float DRS_KI = 0.05f;
+
+constexpr uint32_t CONSTANT_FRAME_SIZE = 64 * 1024;
+
+constexpr uint32_t READBACK_BUFFER = 0;
+constexpr uint32_t INDEX_BUFFER = 1;
+constexpr uint32_t VERTEX_BUFFER = 2;
+constexpr uint32_t MESHLET_BUFFER = 3;
+constexpr uint32_t MESHLET_VERTEX_BUFFER = 4;
+constexpr uint32_t MESHLET_PRIMITIVE_BUFFER = 5;
+constexpr uint32_t MESHLET_INDEX_BUFFER = 6;
+constexpr uint32_t MESHLET_CULLING_ITEM_BUFFER = 7;
+constexpr uint32_t MESHLET_INDIRECT_BUFFER = 8;
+
+enum GeometryMode : int32_t {
+    VERTEX_SHADER,
+    MESHLETS_COMPUTE_CULLING,
+    MESHLETS_MESH_SHADER
+};
 
 struct NRIInterface
     : public nri::CoreInterface,
       public nri::HelperInterface,
+      public nri::MeshShaderInterface,
       public nri::StreamerInterface,
       public nri::SwapChainInterface {};
 
@@ -29,9 +62,208 @@ struct GlobalConstantBufferLayout {
 struct Frame {
     nri::CommandAllocator* commandAllocator;
     nri::CommandBuffer* commandBuffer;
-    uint32_t globalConstantBufferViewOffsets;
 };
 
+static nri::Format GetDepthShaderResourceFormat(nri::Format depthFormat) {
+    switch (depthFormat) {
+        case nri::Format::D16_UNORM:
+            return nri::Format::R16_UNORM;
+        case nri::Format::D24_UNORM_S8_UINT:
+            return nri::Format::R24_UNORM_X8;
+        case nri::Format::D32_SFLOAT:
+            return nri::Format::R32_SFLOAT;
+        case nri::Format::D32_SFLOAT_S8_UINT_X24:
+            return nri::Format::R32_SFLOAT_X8_X24;
+        default:
+            return nri::Format::UNKNOWN;
+    }
+}
+
+struct MeshletRange {
+    uint32_t meshletOffset;
+    uint32_t meshletNum;
+};
+
+// Rows of a 3x4 "object to scene" matrix, fetched as a per-instance vertex stream
+struct InstanceData {
+    float4 rows[3];
+};
+
+// Instances sharing mesh, material and pipeline, drawn with a single instanced draw
+struct DrawBucket {
+    uint32_t meshIndex;
+    uint32_t materialIndex;
+    uint32_t pipelineIndex;
+    uint32_t instanceOffset; // in "m_BucketInstances"
+    uint32_t instanceNum;
+    uint32_t visibleOffset; // in the per-frame instance buffer region, updated every frame
+    uint32_t visibleNum;
+};
+
+static float3 TransformPoint(const InstanceData& transform, const float3& p) {
+    const float4* r = transform.rows;
+
+    return float3(r[0].x * p.x + r[0].y * p.y + r[0].z * p.z + r[0].w,
+        r[1].x * p.x + r[1].y * p.y + r[1].z * p.z + r[1].w,
+        r[2].x * p.x + r[2].y * p.y + r[2].z * p.z + r[2].w);
+}
+
+// Conservative: culled only if all box corners are outside of the same frustum plane (reversed infinite depth: no far plane)
+static bool IsBoxVisible(const float4x4& worldToClip, const InstanceData& transform, const cBoxf& box) {
+    uint32_t outsideMask = 0x1F;
+    for (uint32_t i = 0; i < 8; i++) {
+        float3 corner = float3((i & 1) ? box.vMax.x : box.vMin.x, (i & 2) ? box.vMax.y : box.vMin.y, (i & 4) ? box.vMax.z : box.vMin.z);
+        float3 p = TransformPoint(transform, corner);
+        float4 clip = worldToClip * float4(p.x, p.y, p.z, 1.0f);
+
+        uint32_t mask = 0;
+        mask |= clip.x < -clip.w ? 0x1 : 0;
+        mask |= clip.x > clip.w ? 0x2 : 0;
+        mask |= clip.y < -clip.w ? 0x4 : 0;
+        mask |= clip.y > clip.w ? 0x8 : 0;
+        mask |= clip.z > clip.w ? 0x10 : 0;
+
+        outsideMask &= mask;
+        if (!outsideMask)
+            return true;
+    }
+
+    return false;
+}
+
+static float3 UnpackNormal(uint32_t packed) {
+    float x = float(packed & 1023) / 1023.0f;
+    float y = float((packed >> 10) & 1023) / 1023.0f;
+    float z = float((packed >> 20) & 1023) / 1023.0f;
+
+    return float3(x * 2.0f - 1.0f, y * 2.0f - 1.0f, z * 2.0f - 1.0f);
+}
+
+// Greedy in-order meshletizer: a meshlet is closed as soon as the next triangle doesn't fit
+static MeshletRange BuildMeshlets(const utils::Scene& scene, const utils::Mesh& mesh, std::vector<MeshletData>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint32_t>& meshletPrimitives) {
+    constexpr uint32_t INVALID_INDEX = uint32_t(-1);
+
+    MeshletRange range = {(uint32_t)meshlets.size(), 0};
+    std::vector<uint32_t> localIndices(mesh.vertexNum, INVALID_INDEX);
+
+    MeshletData meshlet = {};
+    meshlet.vertexOffset = (uint32_t)meshletVertices.size();
+    meshlet.primitiveOffset = (uint32_t)meshletPrimitives.size();
+
+    auto getPosition = [&](uint32_t vertexIndex) {
+        const utils::Vertex& vertex = scene.vertices[vertexIndex];
+        return float3(vertex.pos[0], vertex.pos[1], vertex.pos[2]);
+    };
+
+    auto flush = [&]() {
+        if (!meshlet.primitiveNum)
+            return;
+
+        // Bounding sphere
+        cBoxf aabb;
+        aabb.Clear();
+        for (uint32_t i = 0; i < meshlet.vertexNum; i++)
+            aabb.Add(getPosition(meshletVertices[meshlet.vertexOffset + i]));
+
+        float3 center = aabb.GetCenter();
+        float radius = 0.0f;
+        for (uint32_t i = 0; i < meshlet.vertexNum; i++)
+            radius = std::max(radius, Length(getPosition(meshletVertices[meshlet.vertexOffset + i]) - center));
+
+        // Normal cone (face normals are oriented by vertex normals to be winding-agnostic)
+        float3 faceNormals[MESHLET_PRIMITIVE_MAX_NUM];
+        uint32_t faceNormalNum = 0;
+        float3 axis = float3(0.0f, 0.0f, 0.0f);
+        for (uint32_t i = 0; i < meshlet.primitiveNum; i++) {
+            uint32_t packed = meshletPrimitives[meshlet.primitiveOffset + i];
+            uint32_t v0 = meshletVertices[meshlet.vertexOffset + (packed & 0xFF)];
+            uint32_t v1 = meshletVertices[meshlet.vertexOffset + ((packed >> 8) & 0xFF)];
+            uint32_t v2 = meshletVertices[meshlet.vertexOffset + ((packed >> 16) & 0xFF)];
+
+            float3 p0 = getPosition(v0);
+            float3 n = Cross(getPosition(v1) - p0, getPosition(v2) - p0);
+            float len = Length(n);
+            if (len == 0.0f)
+                continue;
+
+            n = n / len;
+
+            float3 vertexNormalSum = UnpackNormal(scene.vertices[v0].N) + UnpackNormal(scene.vertices[v1].N) + UnpackNormal(scene.vertices[v2].N);
+            if (Dot33(n, vertexNormalSum) < 0.0f)
+                n = n * -1.0f;
+
+            faceNormals[faceNormalNum++] = n;
+            axis = axis + n;
+        }
+
+        float cutoff = 1.0f;
+        float axisLength = Length(axis);
+        if (axisLength > 1e-6f) {
+            axis = axis / axisLength;
+
+            float minDot = 1.0f;
+            for (uint32_t i = 0; i < faceNormalNum; i++)
+                minDot = std::min(minDot, Dot33(axis, faceNormals[i]));
+
+            // Cones wider than ~85 degrees are not worth testing
+            if (minDot > 0.1f)
+                cutoff = sqrtf(1.0f - minDot * minDot);
+        } else
+            axis = float3(0.0f, 0.0f, 1.0f);
+
+        meshlet.sphere = float4(center.x, center.y, center.z, radius);
+        meshlet.cone = float4(axis.x, axis.y, axis.z, cutoff);
+
+        meshlets.push_back(meshlet);
+        range.meshletNum++;
+
+        // Reset
+        for (uint32_t i = 0; i < meshlet.vertexNum; i++)
+            localIndices[meshletVertices[meshlet.vertexOffset + i] - mesh.vertexOffset] = INVALID_INDEX;
+
+        meshlet = {};
+        meshlet.vertexOffset = (uint32_t)meshletVertices.size();
+        meshlet.primitiveOffset = (uint32_t)meshletPrimitives.size();
+    };
+
+    for (uint32_t i = 0; i < mesh.indexNum; i += 3) {
+        uint32_t indices[3] = {
+            scene.indices[mesh.indexOffset + i],
+            scene.indices[mesh.indexOffset + i + 1],
+            scene.indices[mesh.indexOffset + i + 2],
+        };
+
+        // Degenerate triangles produce no pixels
+        if (indices[0] == indices[1] || indices[1] == indices[2] || indices[0] == indices[2])
+            continue;
+
+        uint32_t newVertexNum = 0;
+        for (uint32_t index : indices)
+            newVertexNum += localIndices[index] == INVALID_INDEX ? 1 : 0;
+
+        if (meshlet.vertexNum + newVertexNum > MESHLET_VERTEX_MAX_NUM || meshlet.primitiveNum + 1 > MESHLET_PRIMITIVE_MAX_NUM)
+            flush();
+
+        uint32_t packed = 0;
+        for (uint32_t j = 0; j < 3; j++) {
+            uint32_t& localIndex = localIndices[indices[j]];
+            if (localIndex == INVALID_INDEX) {
+                localIndex = meshlet.vertexNum++;
+                meshletVertices.push_back(mesh.vertexOffset + indices[j]);
+            }
+
+            packed |= localIndex << (j * 8);
+        }
+
+        meshletPrimitives.push_back(packed);
+        meshlet.primitiveNum++;
+    }
+
+    flush();
+
+    return range;
+}
+
 class Sample : public SampleBase {
 public:
     Sample() {
@@ -43,6 +275,11 @@ public:
     void PrepareFrame(uint32_t frameIndex) override;
     void RenderFrame(uint32_t frameIndex) override;
 
+private:
+    void CreateSwapChain(nri::Format& swapChainFormat);
+    void ResizeSwapChain(uint32_t frameIndex);
+    void UpdateDynamicResolution(uint32_t bufferedFrameIndex);
+
 private:
     NRIInterface NRI = {};
     nri::Device* m_Device = nullptr;
@@ -50,22 +287,75 @@ private:
     nri::SwapChain* m_SwapChain = nullptr;
     nri::CommandQueue* m_CommandQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     nri::Descriptor* m_DepthAttachment = nullptr;
     nri::Descriptor* m_ShadingRateAttachment = nullptr;
+    nri::Descriptor* m_SceneColorAttachment = nullptr;
     nri::QueryPool* m_QueryPool = nullptr;
-
+    nri::QueryPool* m_TimestampQueryPool = nullptr;
+    nri::PipelineLayout* m_CullingPipelineLayout = nullptr;
+    nri::Pipeline* m_CullingPipeline = nullptr;
+    nri::DescriptorSet* m_MeshletDescriptorSet = nullptr;
+    nri::DescriptorSet* m_CullingDescriptorSet = nullptr;
+    nri::PipelineLayout* m_VrsPipelineLayout = nullptr;
+    nri::Pipeline* m_VrsPipeline = nullptr;
+    nri::DescriptorSet* m_VrsDescriptorSet = nullptr;
+    nri::PipelineLayout* m_UpscalePipelineLayout = nullptr;
+    nri::Pipeline* m_UpscalePipeline = nullptr;
+    nri::Descriptor* m_SceneColorView = nullptr;
+    nri::Descriptor* m_LinearClampSampler = nullptr;
+    nri::Texture* m_DepthTexture = nullptr;
+    nri::Texture* m_ShadingRateTexture = nullptr;
+    nri::Texture* m_SceneColorTexture = nullptr;
+    nri::Buffer* m_VrsCounterBuffer = nullptr;
+    nri::Buffer* m_InstanceBuffer = nullptr;
+    InstanceData* m_InstanceData = nullptr;
+
+    ConstantAllocator m_ConstantAllocator;
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
     std::array<Frame, BUFFERED_FRAME_MAX_NUM> m_Frames = {};
     std::vector<nri::Pipeline*> m_Pipelines;
     std::vector<BackBuffer> m_SwapChainBuffers;
     std::vector<nri::DescriptorSet*> m_DescriptorSets;
     std::vector<nri::Texture*> m_Textures;
     std::vector<nri::Buffer*> m_Buffers;
-    std::vector<nri::Memory*> m_MemoryAllocations;
     std::vector<nri::Descriptor*> m_Descriptors;
+    std::vector<MeshletRange> m_MeshletRanges;
+    std::vector<cBoxf> m_MeshBoxes;
+    std::vector<InstanceData> m_InstanceTransforms;
+    std::vector<DrawBucket> m_DrawBuckets;
+    std::vector<uint32_t> m_BucketInstances;
 
     nri::Format m_DepthFormat = nri::Format::UNKNOWN;
+    uint2 m_MaxResolution = {};
+    uint2 m_RenderResolution = {};
+    uint32_t m_MeshletNum = 0;
+    uint32_t m_CullingItemNum = 0;
+    uint32_t m_DrawCallNum = 0;
+    uint32_t m_VisibleInstanceNum = 0;
+    int32_t m_GeometryMode = VERTEX_SHADER;
+    bool m_IsMeshletSupported = false;
+    bool m_IsMeshShaderSupported = false;
+    bool m_EnableConeCulling = true;
+    bool m_EnableInstancing = true;
+    float m_VrsThreshold = 0.1f;
+    uint32_t m_VrsSavedFragmentNum = 0;
+    bool m_IsAdaptiveVrsSupported = false;
+    bool m_EnableAdaptiveVrs = true;
+    bool m_IsHistoryValid = false;
+    float m_DrsScale = 1.0f;
+    float m_DrsPrevError = 0.0f;
+    float m_DrsTargetTime = 1000.0f / 60.0f;
+    float m_DrsSharpness = 0.5f;
+    double m_GpuFrameTime = 0.0;
+    bool m_EnableDrs = true;
+    UploadManager::Stats m_UploadStats = {};
+    uint64_t m_UploadRingSize = 0;
+    double m_UploadTime = 0.0;
+    double m_ResizeTime = 0.0;
+    double m_ResizeWaitTime = 0.0;
+    uint32_t m_ResizeNum = 0;
 
     utils::Scene m_Scene;
 };
@@ -87,18 +377,35 @@ Sample::~Sample() {
     for (size_t i = 0; i < m_Textures.size(); i++)
         NRI.DestroyTexture(*m_Textures[i]);
 
+    if (m_InstanceData)
+        NRI.UnmapBuffer(*m_InstanceBuffer);
+
     for (size_t i = 0; i < m_Buffers.size(); i++)
         NRI.DestroyBuffer(*m_Buffers[i]);
 
-    for (size_t i = 0; i < m_MemoryAllocations.size(); i++)
-        NRI.FreeMemory(*m_MemoryAllocations[i]);
+    m_MemoryAllocator.Destroy();
 
     for (size_t i = 0; i < m_Pipelines.size(); i++)
         NRI.DestroyPipeline(*m_Pipelines[i]);
 
+    m_ConstantAllocator.Destroy();
+
+    if (m_CullingPipeline) {
+        NRI.DestroyPipeline(*m_CullingPipeline);
+        NRI.DestroyPipelineLayout(*m_CullingPipelineLayout);
+    }
+
+    if (m_VrsPipeline) {
+        NRI.DestroyPipeline(*m_VrsPipeline);
+        NRI.DestroyPipelineLayout(*m_VrsPipelineLayout);
+    }
+
+    NRI.DestroyPipeline(*m_UpscalePipeline);
+    NRI.DestroyPipelineLayout(*m_UpscalePipelineLayout);
     NRI.DestroyQueryPool(*m_QueryPool);
+    NRI.DestroyQueryPool(*m_TimestampQueryPool);
     NRI.DestroyPipelineLayout(*m_PipelineLayout);
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
+    m_DescriptorAllocator.Destroy();
     NRI.DestroyFence(*m_FrameFence);
     NRI.DestroySwapChain(*m_SwapChain);
     NRI.DestroyStreamer(*m_Streamer);
@@ -130,6 +437,18 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::StreamerInterface), (nri::StreamerInterface*)&NRI));
     NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::SwapChainInterface), (nri::SwapChainInterface*)&NRI));
 
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+    // Meshlets (D3D11 can't have structured views of vertex buffers)
+    m_IsMeshletSupported = graphicsAPI != nri::GraphicsAPI::D3D11;
+    m_IsMeshShaderSupported = m_IsMeshletSupported && deviceDesc.isMeshShaderSupported;
+
+    if (m_IsMeshShaderSupported)
+        NRI_ABORT_ON_FAILURE(nri::nriGetInterface(*m_Device, NRI_INTERFACE(nri::MeshShaderInterface), (nri::MeshShaderInterface*)&NRI));
+
+    // Content adaptive VRS needs a shading rate attachment
+    m_IsAdaptiveVrsSupported = deviceDesc.shadingRateTier >= 2;
+
     // Create streamer
     nri::StreamerDesc streamerDesc = {};
     streamerDesc.dynamicBufferMemoryLocation = nri::MemoryLocation::HOST_UPLOAD;
@@ -138,6 +457,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     streamerDesc.frameInFlightNum = BUFFERED_FRAME_MAX_NUM;
     NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
+    // Memory allocator
+    m_MemoryAllocator.Create(NRI, *m_Device);
+
+    // Descriptor allocator
+    m_DescriptorAllocator.Create(NRI, *m_Device);
+
     // Command queue
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_CommandQueue));
 
@@ -146,21 +471,14 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
 
     m_DepthFormat = nri::GetSupportedDepthFormat(NRI, *m_Device, 24, true);
 
-    { // Swap chain
-        nri::SwapChainDesc swapChainDesc = {};
-        swapChainDesc.window = GetWindow();
-        swapChainDesc.commandQueue = m_CommandQueue;
-        swapChainDesc.format = nri::SwapChainFormat::BT709_G22_10BIT;
-        swapChainDesc.verticalSyncInterval = m_VsyncInterval;
-        swapChainDesc.width = (uint16_t)GetWindowResolution().x;
-        swapChainDesc.height = (uint16_t)GetWindowResolution().y;
-        swapChainDesc.textureNum = SWAP_CHAIN_TEXTURE_NUM;
-        NRI_ABORT_ON_FAILURE(NRI.CreateSwapChain(*m_Device, swapChainDesc, m_SwapChain));
-    }
+    // Render targets are sized for the largest resolution the window can get, resizing only recreates the swap chain
+    const GLFWvidmode* vidmode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    m_MaxResolution = uint2(std::max((uint32_t)vidmode->width, GetWindowResolution().x), std::max((uint32_t)vidmode->height, GetWindowResolution().y));
 
-    uint32_t swapChainTextureNum;
-    nri::Texture* const* swapChainTextures = NRI.GetSwapChainTextures(*m_SwapChain, swapChainTextureNum);
-    nri::Format swapChainFormat = NRI.GetTextureDesc(*swapChainTextures[0]).format;
+    glfwSetWindowAttrib(m_Window, GLFW_RESIZABLE, GLFW_TRUE);
+
+    nri::Format swapChainFormat = nri::Format::UNKNOWN;
+    CreateSwapChain(swapChainFormat);
 
     // Buffered resources
     for (Frame& frame : m_Frames) {
@@ -169,35 +487,126 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     }
 
     { // Pipeline layout
-        nri::DescriptorRangeDesc globalDescriptorRange[2];
-        globalDescriptorRange[0] = {0, 1, nri::DescriptorType::CONSTANT_BUFFER, nri::StageBits::ALL};
-        globalDescriptorRange[1] = {0, 1, nri::DescriptorType::SAMPLER, nri::StageBits::FRAGMENT_SHADER};
+        nri::DescriptorRangeDesc globalDescriptorRange[1];
+        globalDescriptorRange[0] = {0, 1, nri::DescriptorType::SAMPLER, nri::StageBits::FRAGMENT_SHADER};
+
+        nri::DynamicConstantBufferDesc globalDynamicConstantBuffer = {0, nri::StageBits::ALL};
 
         nri::DescriptorRangeDesc materialDescriptorRange[1];
         materialDescriptorRange[0] = {0, TEXTURES_PER_MATERIAL, nri::DescriptorType::TEXTURE, nri::StageBits::FRAGMENT_SHADER};
 
+        nri::DescriptorRangeDesc meshletDescriptorRange[1];
+        meshletDescriptorRange[0] = {0, 4, nri::DescriptorType::STRUCTURED_BUFFER, nri::StageBits::ALL};
+
         nri::DescriptorSetDesc descriptorSetDescs[] = {
-            {0, globalDescriptorRange, helper::GetCountOf(globalDescriptorRange)},
+            {0, globalDescriptorRange, helper::GetCountOf(globalDescriptorRange), &globalDynamicConstantBuffer, 1},
             {1, materialDescriptorRange, helper::GetCountOf(materialDescriptorRange)},
+            {2, meshletDescriptorRange, helper::GetCountOf(meshletDescriptorRange)},
         };
 
+        nri::PushConstantDesc pushConstantDesc = {};
+        pushConstantDesc.registerIndex = 1; // "b0" is taken by "Global"
+        pushConstantDesc.shaderStages = nri::StageBits::ALL;
+        pushConstantDesc.size = sizeof(MeshletDrawConstants);
+
         nri::PipelineLayoutDesc pipelineLayoutDesc = {};
         pipelineLayoutDesc.descriptorSetNum = helper::GetCountOf(descriptorSetDescs);
         pipelineLayoutDesc.descriptorSets = descriptorSetDescs;
         pipelineLayoutDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
 
+        if (m_IsMeshShaderSupported) {
+            pipelineLayoutDesc.pushConstantNum = 1;
+            pipelineLayoutDesc.pushConstants = &pushConstantDesc;
+            pipelineLayoutDesc.shaderStages = pipelineLayoutDesc.shaderStages | nri::StageBits::MESH_SHADERS;
+        } else if (!m_IsMeshletSupported)
+            pipelineLayoutDesc.descriptorSetNum--;
+
         NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_PipelineLayout, pipelineLayoutDesc);
+    }
+
+    if (m_IsMeshletSupported) { // Meshlet culling pipeline layout
+        nri::DescriptorRangeDesc descriptorRanges[2];
+        descriptorRanges[0] = {0, 2, nri::DescriptorType::STRUCTURED_BUFFER, nri::StageBits::COMPUTE_SHADER};
+        descriptorRanges[1] = {0, 1, nri::DescriptorType::STORAGE_BUFFER, nri::StageBits::COMPUTE_SHADER};
+
+        nri::DescriptorSetDesc descriptorSetDesc = {0, descriptorRanges, helper::GetCountOf(descriptorRanges)};
+
+        nri::PushConstantDesc pushConstantDesc = {};
+        pushConstantDesc.registerIndex = 0;
+        pushConstantDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
+        pushConstantDesc.size = sizeof(MeshletCullingConstants);
+
+        nri::PipelineLayoutDesc pipelineLayoutDesc = {};
+        pipelineLayoutDesc.pushConstantNum = 1;
+        pipelineLayoutDesc.pushConstants = &pushConstantDesc;
+        pipelineLayoutDesc.descriptorSetNum = 1;
+        pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
+        pipelineLayoutDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_CullingPipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_CullingPipelineLayout, pipelineLayoutDesc);
+    }
+
+    if (m_IsAdaptiveVrsSupported) { // Shading rate pipeline layout
+        nri::DescriptorRangeDesc descriptorRanges[3];
+        descriptorRanges[0] = {0, 2, nri::DescriptorType::TEXTURE, nri::StageBits::COMPUTE_SHADER};
+        descriptorRanges[1] = {0, 1, nri::DescriptorType::STORAGE_TEXTURE, nri::StageBits::COMPUTE_SHADER};
+        descriptorRanges[2] = {1, 1, nri::DescriptorType::STORAGE_BUFFER, nri::StageBits::COMPUTE_SHADER};
+
+        nri::DescriptorSetDesc descriptorSetDesc = {0, descriptorRanges, helper::GetCountOf(descriptorRanges)};
+
+        nri::PushConstantDesc pushConstantDesc = {};
+        pushConstantDesc.registerIndex = 0;
+        pushConstantDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
+        pushConstantDesc.size = sizeof(VrsConstants);
+
+        nri::PipelineLayoutDesc pipelineLayoutDesc = {};
+        pipelineLayoutDesc.pushConstantNum = 1;
+        pipelineLayoutDesc.pushConstants = &pushConstantDesc;
+        pipelineLayoutDesc.descriptorSetNum = 1;
+        pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
+        pipelineLayoutDesc.shaderStages = nri::StageBits::COMPUTE_SHADER;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_VrsPipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_VrsPipelineLayout, pipelineLayoutDesc);
+    }
+
+    { // Upscale pipeline layout
+        nri::DescriptorRangeDesc descriptorRanges[2];
+        descriptorRanges[0] = {0, 1, nri::DescriptorType::TEXTURE, nri::StageBits::FRAGMENT_SHADER};
+        descriptorRanges[1] = {0, 1, nri::DescriptorType::SAMPLER, nri::StageBits::FRAGMENT_SHADER};
+
+        nri::DescriptorSetDesc descriptorSetDesc = {0, descriptorRanges, helper::GetCountOf(descriptorRanges)};
+
+        nri::PushConstantDesc pushConstantDesc = {};
+        pushConstantDesc.registerIndex = 0;
+        pushConstantDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
+        pushConstantDesc.size = sizeof(UpscaleConstants);
+
+        nri::PipelineLayoutDesc pipelineLayoutDesc = {};
+        pipelineLayoutDesc.pushConstantNum = 1;
+        pipelineLayoutDesc.pushConstants = &pushConstantDesc;
+        pipelineLayoutDesc.descriptorSetNum = 1;
+        pipelineLayoutDesc.descriptorSets = &descriptorSetDesc;
+        pipelineLayoutDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_UpscalePipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_UpscalePipelineLayout, pipelineLayoutDesc);
     }
 
     // Pipeline
-    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     utils::ShaderCodeStorage shaderCodeStorage;
     {
-        nri::VertexStreamDesc vertexStreamDesc = {};
-        vertexStreamDesc.bindingSlot = 0;
-        vertexStreamDesc.stride = sizeof(utils::Vertex);
+        nri::VertexStreamDesc vertexStreamDescs[2] = {};
+        vertexStreamDescs[0].bindingSlot = 0;
+        vertexStreamDescs[0].stride = sizeof(utils::Vertex);
+
+        vertexStreamDescs[1].bindingSlot = 1;
+        vertexStreamDescs[1].stride = sizeof(InstanceData);
+        vertexStreamDescs[1].stepRate = nri::VertexStreamStepRate::PER_INSTANCE;
 
-        nri::VertexAttributeDesc vertexAttributeDesc[4] = {};
+        nri::VertexAttributeDesc vertexAttributeDesc[7] = {};
         {
             vertexAttributeDesc[0].format = nri::Format::RGB32_SFLOAT;
             vertexAttributeDesc[0].offset = helper::GetOffsetOf(&utils::Vertex::pos);
@@ -218,13 +627,21 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
             vertexAttributeDesc[3].offset = helper::GetOffsetOf(&utils::Vertex::T);
             vertexAttributeDesc[3].d3d = {"TANGENT", 0};
             vertexAttributeDesc[3].vk = {3};
+
+            for (uint32_t i = 0; i < 3; i++) {
+                vertexAttributeDesc[4 + i].format = nri::Format::RGBA32_SFLOAT;
+                vertexAttributeDesc[4 + i].offset = i * sizeof(float4);
+                vertexAttributeDesc[4 + i].d3d = {"TEXCOORD", 1 + i};
+                vertexAttributeDesc[4 + i].vk = {4 + i};
+                vertexAttributeDesc[4 + i].streamIndex = 1;
+            }
         }
 
         nri::VertexInputDesc vertexInputDesc = {};
         vertexInputDesc.attributes = vertexAttributeDesc;
         vertexInputDesc.attributeNum = (uint8_t)helper::GetCountOf(vertexAttributeDesc);
-        vertexInputDesc.streams = &vertexStreamDesc;
-        vertexInputDesc.streamNum = 1;
+        vertexInputDesc.streams = vertexStreamDescs;
+        vertexInputDesc.streamNum = (uint8_t)helper::GetCountOf(vertexStreamDescs);
 
         nri::InputAssemblyDesc inputAssemblyDesc = {};
         inputAssemblyDesc.topology = nri::Topology::TRIANGLE_LIST;
@@ -294,6 +711,84 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
             NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, pipeline));
             m_Pipelines.push_back(pipeline);
         }
+
+        if (m_IsMeshShaderSupported) { // Meshlets: opaque, alpha opaque and transparent (the same order as above)
+            nri::ShaderDesc meshletShaderStages[] = {
+                utils::LoadShader(deviceDesc.graphicsAPI, "Meshlet.as", shaderCodeStorage),
+                utils::LoadShader(deviceDesc.graphicsAPI, "Meshlet.ms", shaderCodeStorage),
+                utils::LoadShader(deviceDesc.graphicsAPI, "Forward.fs", shaderCodeStorage),
+            };
+            meshletShaderStages[0].stage = nri::StageBits::MESH_CONTROL_SHADER;
+            meshletShaderStages[1].stage = nri::StageBits::MESH_EVALUATION_SHADER;
+
+            graphicsPipelineDesc.vertexInput = nullptr;
+            graphicsPipelineDesc.shaders = meshletShaderStages;
+            graphicsPipelineDesc.shaderNum = helper::GetCountOf(meshletShaderStages);
+
+            outputMergerDesc.depth.write = true;
+            colorAttachmentDesc.blendEnabled = false;
+            NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, pipeline));
+            m_Pipelines.push_back(pipeline);
+
+            meshletShaderStages[2] = utils::LoadShader(deviceDesc.graphicsAPI, "ForwardDiscard.fs", shaderCodeStorage);
+            NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, pipeline));
+            m_Pipelines.push_back(pipeline);
+
+            meshletShaderStages[2] = utils::LoadShader(deviceDesc.graphicsAPI, "ForwardTransparent.fs", shaderCodeStorage);
+            outputMergerDesc.depth.write = false;
+            colorAttachmentDesc.blendEnabled = true;
+            NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, pipeline));
+            m_Pipelines.push_back(pipeline);
+        }
+    }
+
+    if (m_IsMeshletSupported) { // Meshlet culling pipeline
+        nri::ComputePipelineDesc computePipelineDesc = {};
+        computePipelineDesc.pipelineLayout = m_CullingPipelineLayout;
+        computePipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "MeshletCulling.cs", shaderCodeStorage);
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_CullingPipeline));
+    }
+
+    if (m_IsAdaptiveVrsSupported) { // Shading rate pipeline
+        nri::ComputePipelineDesc computePipelineDesc = {};
+        computePipelineDesc.pipelineLayout = m_VrsPipelineLayout;
+        computePipelineDesc.shader = utils::LoadShader(deviceDesc.graphicsAPI, "ShadingRate.cs", shaderCodeStorage);
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateComputePipeline(*m_Device, computePipelineDesc, m_VrsPipeline));
+    }
+
+    { // Upscale pipeline (vertices come from "SV_VertexID")
+        nri::InputAssemblyDesc inputAssemblyDesc = {};
+        inputAssemblyDesc.topology = nri::Topology::TRIANGLE_LIST;
+
+        nri::RasterizationDesc rasterizationDesc = {};
+        rasterizationDesc.viewportNum = 1;
+        rasterizationDesc.fillMode = nri::FillMode::SOLID;
+        rasterizationDesc.cullMode = nri::CullMode::NONE;
+
+        nri::ColorAttachmentDesc colorAttachmentDesc = {};
+        colorAttachmentDesc.format = swapChainFormat;
+        colorAttachmentDesc.colorWriteMask = nri::ColorWriteBits::RGBA;
+
+        nri::OutputMergerDesc outputMergerDesc = {};
+        outputMergerDesc.colorNum = 1;
+        outputMergerDesc.color = &colorAttachmentDesc;
+
+        nri::ShaderDesc shaderStages[] = {
+            utils::LoadShader(deviceDesc.graphicsAPI, "Upscale.vs", shaderCodeStorage),
+            utils::LoadShader(deviceDesc.graphicsAPI, "Upscale.fs", shaderCodeStorage),
+        };
+
+        nri::GraphicsPipelineDesc graphicsPipelineDesc = {};
+        graphicsPipelineDesc.pipelineLayout = m_UpscalePipelineLayout;
+        graphicsPipelineDesc.inputAssembly = inputAssemblyDesc;
+        graphicsPipelineDesc.rasterization = rasterizationDesc;
+        graphicsPipelineDesc.outputMerger = outputMergerDesc;
+        graphicsPipelineDesc.shaders = shaderStages;
+        graphicsPipelineDesc.shaderNum = helper::GetCountOf(shaderStages);
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_UpscalePipeline));
     }
 
     // Scene
@@ -306,6 +801,95 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     const uint32_t textureNum = (uint32_t)m_Scene.textures.size();
     const uint32_t materialNum = (uint32_t)m_Scene.materials.size();
 
+    // Meshlets
+    std::vector<MeshletData> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletPrimitives;
+    std::vector<uint32_t> meshletIndices;
+    std::vector<MeshletCullingItem> cullingItems;
+    if (m_IsMeshletSupported) {
+        for (const utils::Mesh& mesh : m_Scene.meshes)
+            m_MeshletRanges.push_back(BuildMeshlets(m_Scene, mesh, meshlets, meshletVertices, meshletPrimitives));
+
+        m_MeshletNum = (uint32_t)meshlets.size();
+
+        // Fallback index buffer: primitive "i" of the meshlet list maps to indices "[3 * i; 3 * i + 2]"
+        meshletIndices.reserve(meshletPrimitives.size() * 3);
+        for (const MeshletData& meshlet : meshlets) {
+            for (uint32_t i = 0; i < meshlet.primitiveNum; i++) {
+                uint32_t packed = meshletPrimitives[meshlet.primitiveOffset + i];
+                for (uint32_t j = 0; j < 3; j++)
+                    meshletIndices.push_back(meshletVertices[meshlet.vertexOffset + ((packed >> (j * 8)) & 0xFF)]);
+            }
+        }
+
+        // Culling items: one per meshlet of every instance, instance ranges are contiguous
+        for (const utils::Instance& instance : m_Scene.instances) {
+            const utils::Material& material = m_Scene.materials[instance.materialIndex];
+            const MeshletRange& meshletRange = m_MeshletRanges[instance.meshInstanceIndex];
+
+            for (uint32_t i = 0; i < meshletRange.meshletNum; i++)
+                cullingItems.push_back({meshletRange.meshletOffset + i, material.IsAlphaOpaque() || material.IsTransparent() ? 0u : 1u});
+        }
+
+        m_CullingItemNum = (uint32_t)cullingItems.size();
+    }
+
+    { // Instanced draws
+        m_MeshBoxes.resize(m_Scene.meshes.size());
+        for (size_t i = 0; i < m_Scene.meshes.size(); i++) {
+            const utils::Mesh& mesh = m_Scene.meshes[i];
+
+            cBoxf& box = m_MeshBoxes[i];
+            box.Clear();
+            for (uint32_t j = 0; j < mesh.vertexNum; j++) {
+                const utils::Vertex& vertex = m_Scene.vertices[mesh.vertexOffset + j];
+                box.Add(float3(vertex.pos[0], vertex.pos[1], vertex.pos[2]));
+            }
+        }
+
+        // "LoadScene" bakes instance transforms into per-instance geometry, so all transforms are identity and instances
+        // don't share meshes. Only true duplicates merge, in practice draw calls go down due to culling, not instancing
+        const InstanceData identity = {{float4(1.0f, 0.0f, 0.0f, 0.0f), float4(0.0f, 1.0f, 0.0f, 0.0f), float4(0.0f, 0.0f, 1.0f, 0.0f)}};
+        m_InstanceTransforms.resize(m_Scene.instances.size(), identity);
+
+        // Sorted by pipeline first, so transparent buckets go last
+        auto getPipelineIndex = [&](const utils::Instance& instance) {
+            const utils::Material& material = m_Scene.materials[instance.materialIndex];
+            return material.IsAlphaOpaque() ? 1u : (material.IsTransparent() ? 2u : 0u);
+        };
+
+        m_BucketInstances.resize(m_Scene.instances.size());
+        for (uint32_t i = 0; i < (uint32_t)m_BucketInstances.size(); i++)
+            m_BucketInstances[i] = i;
+
+        std::stable_sort(m_BucketInstances.begin(), m_BucketInstances.end(), [&](uint32_t a, uint32_t b) {
+            const utils::Instance& instanceA = m_Scene.instances[a];
+            const utils::Instance& instanceB = m_Scene.instances[b];
+
+            uint32_t pipelineA = getPipelineIndex(instanceA);
+            uint32_t pipelineB = getPipelineIndex(instanceB);
+            if (pipelineA != pipelineB)
+                return pipelineA < pipelineB;
+
+            if (instanceA.materialIndex != instanceB.materialIndex)
+                return instanceA.materialIndex < instanceB.materialIndex;
+
+            return instanceA.meshInstanceIndex < instanceB.meshInstanceIndex;
+        });
+
+        for (uint32_t i = 0; i < (uint32_t)m_BucketInstances.size(); i++) {
+            const utils::Instance& instance = m_Scene.instances[m_BucketInstances[i]];
+            uint32_t pipelineIndex = getPipelineIndex(instance);
+
+            DrawBucket* bucket = m_DrawBuckets.empty() ? nullptr : &m_DrawBuckets.back();
+            if (!bucket || bucket->meshIndex != instance.meshInstanceIndex || bucket->materialIndex != instance.materialIndex || bucket->pipelineIndex != pipelineIndex)
+                m_DrawBuckets.push_back({instance.meshInstanceIndex, instance.materialIndex, pipelineIndex, i, 0, 0, 0});
+
+            m_DrawBuckets.back().instanceNum++;
+        }
+    }
+
     // Textures
     for (const utils::Texture* textureData : m_Scene.textures) {
         nri::TextureDesc textureDesc = nri::Texture2D(textureData->GetFormat(), textureData->GetWidth(), textureData->GetHeight(), textureData->GetMipNum(), textureData->GetArraySize());
@@ -316,51 +900,48 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     }
 
     // Depth attachment
-    nri::Texture* depthTexture = nullptr;
     {
-        nri::TextureDesc textureDesc = nri::Texture2D(m_DepthFormat, (uint16_t)GetWindowResolution().x, (uint16_t)GetWindowResolution().y, 1, 1, nri::TextureUsageBits::DEPTH_STENCIL_ATTACHMENT);
+        nri::TextureUsageBits usageBits = nri::TextureUsageBits::DEPTH_STENCIL_ATTACHMENT;
+        if (m_IsAdaptiveVrsSupported)
+            usageBits = usageBits | nri::TextureUsageBits::SHADER_RESOURCE;
+
+        nri::TextureDesc textureDesc = nri::Texture2D(m_DepthFormat, (uint16_t)m_MaxResolution.x, (uint16_t)m_MaxResolution.y, 1, 1, usageBits);
 
-        NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, textureDesc, depthTexture));
-        m_Textures.push_back(depthTexture);
+        NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, textureDesc, m_DepthTexture));
+        m_Textures.push_back(m_DepthTexture);
     }
 
-    // Shading rate attachment
-    nri::Texture* shadingRateTexture = nullptr;
+    // Shading rate attachment (filled by a compute pass every frame, starts as 1x1)
     uint8_t* shadingRateData = nullptr;
-    uint32_t shadingRateTexWidth = (GetWindowResolution().x + deviceDesc.shadingRateAttachmentTileSize - 1) / deviceDesc.shadingRateAttachmentTileSize;
-    uint32_t shadingRateTexHeight = (GetWindowResolution().y + deviceDesc.shadingRateAttachmentTileSize - 1) / deviceDesc.shadingRateAttachmentTileSize;
-    if (deviceDesc.shadingRateTier >= 2) {
-        nri::TextureDesc textureDesc = nri::Texture2D(nri::Format::R8_UINT, (uint16_t)shadingRateTexWidth, (uint16_t)shadingRateTexHeight, 1, 1, nri::TextureUsageBits::SHADING_RATE_ATTACHMENT);
+    uint32_t shadingRateTexWidth = (m_MaxResolution.x + deviceDesc.shadingRateAttachmentTileSize - 1) / deviceDesc.shadingRateAttachmentTileSize;
+    uint32_t shadingRateTexHeight = (m_MaxResolution.y + deviceDesc.shadingRateAttachmentTileSize - 1) / deviceDesc.shadingRateAttachmentTileSize;
+    if (m_IsAdaptiveVrsSupported) {
+        nri::TextureDesc textureDesc = nri::Texture2D(nri::Format::R8_UINT, (uint16_t)shadingRateTexWidth, (uint16_t)shadingRateTexHeight, 1, 1, nri::TextureUsageBits::SHADING_RATE_ATTACHMENT | nri::TextureUsageBits::SHADER_RESOURCE_STORAGE);
 
-        NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, textureDesc, shadingRateTexture));
-        m_Textures.push_back(shadingRateTexture);
+        NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, textureDesc, m_ShadingRateTexture));
+        m_Textures.push_back(m_ShadingRateTexture);
 
-        // Fill with some values
         shadingRateData = (uint8_t*)malloc(shadingRateTexWidth * shadingRateTexHeight);
+        memset(shadingRateData, NRI_SHADING_RATE(0, 0), shadingRateTexWidth * shadingRateTexHeight);
+    }
 
-        uint8_t* p = shadingRateData;
-        for (uint32_t j = 0; j < shadingRateTexHeight; j++) {
-            for (uint32_t i = 0; i < shadingRateTexWidth; i++) {
-                *p = i < shadingRateTexWidth / 2 ? NRI_SHADING_RATE(0, 0) : NRI_SHADING_RATE(2, 2);
-                p++;
-            }
-        }
+    // Scene color, rendered at the dynamic resolution and upscaled to the back buffer. Until the next scene pass it
+    // holds the previous frame, which is the input of the shading rate pass
+    {
+        nri::TextureDesc textureDesc = nri::Texture2D(swapChainFormat, (uint16_t)m_MaxResolution.x, (uint16_t)m_MaxResolution.y, 1, 1, nri::TextureUsageBits::COLOR_ATTACHMENT | nri::TextureUsageBits::SHADER_RESOURCE);
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, textureDesc, m_SceneColorTexture));
+        m_Textures.push_back(m_SceneColorTexture);
     }
 
-    const uint32_t constantBufferSize = helper::Align((uint32_t)sizeof(GlobalConstantBufferLayout), deviceDesc.constantBufferOffsetAlignment);
+    m_ConstantAllocator.Create(NRI, *m_Device, CONSTANT_FRAME_SIZE, BUFFERED_FRAME_MAX_NUM, sizeof(GlobalConstantBufferLayout));
 
     { // Buffers
-        // CONSTANT_BUFFER
-        nri::BufferDesc bufferDesc = {};
-        bufferDesc.size = constantBufferSize * BUFFERED_FRAME_MAX_NUM;
-        bufferDesc.usageMask = nri::BufferUsageBits::CONSTANT_BUFFER;
-        nri::Buffer* buffer;
-        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
-        m_Buffers.push_back(buffer);
-
         // READBACK_BUFFER
-        bufferDesc.size = sizeof(nri::PipelineStatisticsDesc) * BUFFERED_FRAME_MAX_NUM;
+        nri::BufferDesc bufferDesc = {};
+        bufferDesc.size = READBACK_BUFFER_SIZE;
         bufferDesc.usageMask = nri::BufferUsageBits::NONE;
+        nri::Buffer* buffer;
         NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
         m_Buffers.push_back(buffer);
 
@@ -373,43 +954,106 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         // VERTEX_BUFFER
         bufferDesc.size = helper::GetByteSizeOf(m_Scene.vertices);
         bufferDesc.usageMask = nri::BufferUsageBits::VERTEX_BUFFER;
+        if (m_IsMeshletSupported) {
+            bufferDesc.structureStride = sizeof(utils::Vertex);
+            bufferDesc.usageMask = nri::BufferUsageBits::VERTEX_BUFFER | nri::BufferUsageBits::SHADER_RESOURCE;
+        }
         NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
         m_Buffers.push_back(buffer);
+
+        if (m_IsMeshletSupported) {
+            // MESHLET_BUFFER
+            bufferDesc.size = helper::GetByteSizeOf(meshlets);
+            bufferDesc.structureStride = sizeof(MeshletData);
+            bufferDesc.usageMask = nri::BufferUsageBits::SHADER_RESOURCE;
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+            m_Buffers.push_back(buffer);
+
+            // MESHLET_VERTEX_BUFFER
+            bufferDesc.size = helper::GetByteSizeOf(meshletVertices);
+            bufferDesc.structureStride = sizeof(uint32_t);
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+            m_Buffers.push_back(buffer);
+
+            // MESHLET_PRIMITIVE_BUFFER
+            bufferDesc.size = helper::GetByteSizeOf(meshletPrimitives);
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+            m_Buffers.push_back(buffer);
+
+            // MESHLET_INDEX_BUFFER
+            bufferDesc.size = helper::GetByteSizeOf(meshletIndices);
+            bufferDesc.structureStride = 0;
+            bufferDesc.usageMask = nri::BufferUsageBits::INDEX_BUFFER;
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+            m_Buffers.push_back(buffer);
+
+            // MESHLET_CULLING_ITEM_BUFFER
+            bufferDesc.size = helper::GetByteSizeOf(cullingItems);
+            bufferDesc.structureStride = sizeof(MeshletCullingItem);
+            bufferDesc.usageMask = nri::BufferUsageBits::SHADER_RESOURCE;
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+            m_Buffers.push_back(buffer);
+
+            // MESHLET_INDIRECT_BUFFER
+            bufferDesc.size = m_CullingItemNum * sizeof(nri::DrawIndexedDesc);
+            bufferDesc.structureStride = 0;
+            bufferDesc.usageMask = nri::BufferUsageBits::SHADER_RESOURCE_STORAGE | nri::BufferUsageBits::ARGUMENT_BUFFER;
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, buffer));
+            m_Buffers.push_back(buffer);
+        }
+
+        if (m_IsAdaptiveVrsSupported) {
+            // "Saved fragments" counter, zeroed every frame
+            bufferDesc.size = sizeof(uint32_t);
+            bufferDesc.structureStride = 0;
+            bufferDesc.usageMask = nri::BufferUsageBits::SHADER_RESOURCE_STORAGE;
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_VrsCounterBuffer));
+            m_Buffers.push_back(m_VrsCounterBuffer);
+        }
     }
 
     { // Memory
         nri::ResourceGroupDesc resourceGroupDesc = {};
-        resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
-        resourceGroupDesc.bufferNum = 1;
-        resourceGroupDesc.buffers = &m_Buffers[CONSTANT_BUFFER];
-
-        size_t baseAllocation = m_MemoryAllocations.size();
-        m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
-
         resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_READBACK;
         resourceGroupDesc.bufferNum = 1;
         resourceGroupDesc.buffers = &m_Buffers[READBACK_BUFFER];
 
-        baseAllocation = m_MemoryAllocations.size();
-        m_MemoryAllocations.resize(baseAllocation + 1, nullptr);
-        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+        m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
         resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
-        resourceGroupDesc.bufferNum = 2;
+        resourceGroupDesc.bufferNum = (uint32_t)m_Buffers.size() - INDEX_BUFFER;
         resourceGroupDesc.buffers = &m_Buffers[INDEX_BUFFER];
         resourceGroupDesc.textureNum = (uint32_t)m_Textures.size();
         resourceGroupDesc.textures = m_Textures.data();
 
-        baseAllocation = m_MemoryAllocations.size();
-        uint32_t allocationNum = NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc);
-        m_MemoryAllocations.resize(baseAllocation + allocationNum, nullptr);
-        NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + baseAllocation));
+        m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
+    }
+
+    { // Instance buffer: a region per buffered frame, each region starts with an identity transform for non-instanced draws
+        nri::BufferDesc bufferDesc = {};
+        bufferDesc.size = BUFFERED_FRAME_MAX_NUM * (1 + m_Scene.instances.size()) * sizeof(InstanceData);
+        bufferDesc.usageMask = nri::BufferUsageBits::VERTEX_BUFFER;
+        NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_InstanceBuffer));
+        m_Buffers.push_back(m_InstanceBuffer);
+
+        nri::ResourceGroupDesc resourceGroupDesc = {};
+        resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+        resourceGroupDesc.bufferNum = 1;
+        resourceGroupDesc.buffers = &m_InstanceBuffer;
+
+        m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
+
+        // Mapped once for the whole lifetime
+        m_InstanceData = (InstanceData*)NRI.MapBuffer(*m_InstanceBuffer, 0, nri::WHOLE_SIZE);
     }
 
     // Create descriptors
     nri::Descriptor* anisotropicSampler;
-    nri::Descriptor* constantBufferViews[BUFFERED_FRAME_MAX_NUM];
+    nri::Descriptor* meshletResourceViews[4] = {};
+    nri::Descriptor* cullingResourceViews[2] = {};
+    nri::Descriptor* cullingStorageView = nullptr;
+    nri::Descriptor* vrsTextureViews[2] = {};
+    nri::Descriptor* vrsStorageViews[2] = {};
     {
         // Material textures
         m_Descriptors.resize(textureNum);
@@ -429,73 +1073,118 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         NRI_ABORT_ON_FAILURE(NRI.CreateSampler(*m_Device, samplerDesc, anisotropicSampler));
         m_Descriptors.push_back(anisotropicSampler);
 
-        // Constant buffer
-        for (uint32_t i = 0; i < BUFFERED_FRAME_MAX_NUM; i++) {
-            m_Frames[i].globalConstantBufferViewOffsets = i * constantBufferSize;
+        samplerDesc = {};
+        samplerDesc.addressModes = {nri::AddressMode::CLAMP_TO_EDGE, nri::AddressMode::CLAMP_TO_EDGE};
+        samplerDesc.filters = {nri::Filter::LINEAR, nri::Filter::LINEAR, nri::Filter::NEAREST};
+        NRI_ABORT_ON_FAILURE(NRI.CreateSampler(*m_Device, samplerDesc, m_LinearClampSampler));
+        m_Descriptors.push_back(m_LinearClampSampler);
 
-            nri::BufferViewDesc bufferViewDesc = {};
-            bufferViewDesc.buffer = m_Buffers[CONSTANT_BUFFER];
-            bufferViewDesc.viewType = nri::BufferViewType::CONSTANT;
-            bufferViewDesc.offset = i * constantBufferSize;
-            bufferViewDesc.size = constantBufferSize;
-            NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, constantBufferViews[i]));
-            m_Descriptors.push_back(constantBufferViews[i]);
+        { // Scene color
+            nri::Texture2DViewDesc texture2DViewDesc = {m_SceneColorTexture, nri::Texture2DViewType::COLOR_ATTACHMENT, swapChainFormat};
+
+            NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, m_SceneColorAttachment));
+            m_Descriptors.push_back(m_SceneColorAttachment);
+
+            texture2DViewDesc = {m_SceneColorTexture, nri::Texture2DViewType::SHADER_RESOURCE_2D, swapChainFormat};
+            NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, m_SceneColorView));
+            m_Descriptors.push_back(m_SceneColorView);
         }
 
         { // Depth buffer
-            nri::Texture2DViewDesc texture2DViewDesc = {depthTexture, nri::Texture2DViewType::DEPTH_STENCIL_ATTACHMENT, m_DepthFormat};
+            nri::Texture2DViewDesc texture2DViewDesc = {m_DepthTexture, nri::Texture2DViewType::DEPTH_STENCIL_ATTACHMENT, m_DepthFormat};
 
             NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, m_DepthAttachment));
             m_Descriptors.push_back(m_DepthAttachment);
         }
 
-        { // Shading rate attachment
-            nri::Texture2DViewDesc texture2DViewDesc = {shadingRateTexture, nri::Texture2DViewType::SHADING_RATE_ATTACHMENT, nri::Format::R8_UINT};
+        if (m_IsAdaptiveVrsSupported) { // Shading rate attachment
+            nri::Texture2DViewDesc texture2DViewDesc = {m_ShadingRateTexture, nri::Texture2DViewType::SHADING_RATE_ATTACHMENT, nri::Format::R8_UINT};
 
             NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, m_ShadingRateAttachment));
             m_Descriptors.push_back(m_ShadingRateAttachment);
-        }
 
-        // Swap chain
-        for (uint32_t i = 0; i < swapChainTextureNum; i++) {
-            nri::Texture2DViewDesc textureViewDesc = {swapChainTextures[i], nri::Texture2DViewType::COLOR_ATTACHMENT, swapChainFormat};
+            // Shading rate pass resources
+            vrsTextureViews[0] = m_SceneColorView;
 
-            nri::Descriptor* colorAttachment;
-            NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(textureViewDesc, colorAttachment));
+            texture2DViewDesc = {m_DepthTexture, nri::Texture2DViewType::SHADER_RESOURCE_2D, GetDepthShaderResourceFormat(m_DepthFormat)};
+            NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, vrsTextureViews[1]));
+            m_Descriptors.push_back(vrsTextureViews[1]);
 
-            const BackBuffer backBuffer = {colorAttachment, swapChainTextures[i]};
-            m_SwapChainBuffers.push_back(backBuffer);
+            texture2DViewDesc = {m_ShadingRateTexture, nri::Texture2DViewType::SHADER_RESOURCE_STORAGE_2D, nri::Format::R8_UINT};
+            NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(texture2DViewDesc, vrsStorageViews[0]));
+            m_Descriptors.push_back(vrsStorageViews[0]);
+
+            nri::BufferViewDesc bufferViewDesc = {};
+            bufferViewDesc.buffer = m_VrsCounterBuffer;
+            bufferViewDesc.viewType = nri::BufferViewType::SHADER_RESOURCE_STORAGE;
+            bufferViewDesc.format = nri::Format::R32_UINT;
+            bufferViewDesc.size = sizeof(uint32_t);
+            NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, vrsStorageViews[1]));
+            m_Descriptors.push_back(vrsStorageViews[1]);
+        }
+
+        if (m_IsMeshletSupported) { // Meshlets
+            const uint32_t meshletBuffers[] = {MESHLET_BUFFER, MESHLET_VERTEX_BUFFER, MESHLET_PRIMITIVE_BUFFER, VERTEX_BUFFER};
+            for (uint32_t i = 0; i < helper::GetCountOf(meshletBuffers); i++) {
+                nri::Buffer* buffer = m_Buffers[meshletBuffers[i]];
+
+                nri::BufferViewDesc bufferViewDesc = {};
+                bufferViewDesc.buffer = buffer;
+                bufferViewDesc.viewType = nri::BufferViewType::SHADER_RESOURCE;
+                bufferViewDesc.size = NRI.GetBufferDesc(*buffer).size;
+                NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, meshletResourceViews[i]));
+                m_Descriptors.push_back(meshletResourceViews[i]);
+            }
+
+            nri::BufferViewDesc bufferViewDesc = {};
+            bufferViewDesc.buffer = m_Buffers[MESHLET_CULLING_ITEM_BUFFER];
+            bufferViewDesc.viewType = nri::BufferViewType::SHADER_RESOURCE;
+            bufferViewDesc.size = helper::GetByteSizeOf(cullingItems);
+            NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, cullingResourceViews[1]));
+            m_Descriptors.push_back(cullingResourceViews[1]);
+
+            cullingResourceViews[0] = meshletResourceViews[0];
+
+            bufferViewDesc.buffer = m_Buffers[MESHLET_INDIRECT_BUFFER];
+            bufferViewDesc.viewType = nri::BufferViewType::SHADER_RESOURCE_STORAGE;
+            bufferViewDesc.format = nri::Format::R32_UINT;
+            bufferViewDesc.size = m_CullingItemNum * sizeof(nri::DrawIndexedDesc);
+            NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, cullingStorageView));
+            m_Descriptors.push_back(cullingStorageView);
         }
     }
 
     { // Descriptor pool
-        nri::DescriptorPoolDesc descriptorPoolDesc = {};
-        descriptorPoolDesc.descriptorSetMaxNum = materialNum + BUFFERED_FRAME_MAX_NUM;
-        descriptorPoolDesc.textureMaxNum = materialNum * TEXTURES_PER_MATERIAL;
-        descriptorPoolDesc.samplerMaxNum = BUFFERED_FRAME_MAX_NUM;
-        descriptorPoolDesc.constantBufferMaxNum = BUFFERED_FRAME_MAX_NUM;
+        m_DescriptorAllocator.Reserve(*m_PipelineLayout, GLOBAL_DESCRIPTOR_SET, 1);
+        m_DescriptorAllocator.Reserve(*m_PipelineLayout, MATERIAL_DESCRIPTOR_SET, materialNum);
 
-        NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
+        if (m_IsMeshletSupported) {
+            m_DescriptorAllocator.Reserve(*m_PipelineLayout, MESHLET_DESCRIPTOR_SET, 1);
+            m_DescriptorAllocator.Reserve(*m_CullingPipelineLayout, 0, 1);
+        }
+
+        if (m_IsAdaptiveVrsSupported)
+            m_DescriptorAllocator.Reserve(*m_VrsPipelineLayout, 0, 1);
+
+        m_DescriptorAllocator.ReserveTransient(*m_UpscalePipelineLayout, 0, 1);
     }
 
     { // Descriptor sets
-        m_DescriptorSets.resize(BUFFERED_FRAME_MAX_NUM + materialNum);
+        m_DescriptorSets.resize(1 + materialNum);
 
-        // Global
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, GLOBAL_DESCRIPTOR_SET, &m_DescriptorSets[0], BUFFERED_FRAME_MAX_NUM, 0));
+        // Global (constants are bound with a dynamic offset, so one set serves all frames)
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, GLOBAL_DESCRIPTOR_SET, &m_DescriptorSets[0], 1);
 
-        for (uint32_t i = 0; i < BUFFERED_FRAME_MAX_NUM; i++) {
-            nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs[2] = {};
-            descriptorRangeUpdateDescs[0].descriptorNum = 1;
-            descriptorRangeUpdateDescs[0].descriptors = &constantBufferViews[i];
-            descriptorRangeUpdateDescs[1].descriptorNum = 1;
-            descriptorRangeUpdateDescs[1].descriptors = &anisotropicSampler;
+        nri::DescriptorRangeUpdateDesc globalRangeUpdateDesc = {};
+        globalRangeUpdateDesc.descriptorNum = 1;
+        globalRangeUpdateDesc.descriptors = &anisotropicSampler;
+        NRI.UpdateDescriptorRanges(*m_DescriptorSets[0], 0, 1, &globalRangeUpdateDesc);
 
-            NRI.UpdateDescriptorRanges(*m_DescriptorSets[i], 0, helper::GetCountOf(descriptorRangeUpdateDescs), descriptorRangeUpdateDescs);
-        }
+        const nri::Descriptor* globalConstantBuffer = &m_ConstantAllocator.GetView();
+        NRI.UpdateDynamicConstantBuffers(*m_DescriptorSets[0], 0, 1, &globalConstantBuffer);
 
         // Material
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, MATERIAL_DESCRIPTOR_SET, &m_DescriptorSets[BUFFERED_FRAME_MAX_NUM], materialNum, 0));
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, MATERIAL_DESCRIPTOR_SET, &m_DescriptorSets[1], materialNum);
 
         for (uint32_t i = 0; i < materialNum; i++) {
             const utils::Material& material = m_Scene.materials[i];
@@ -510,67 +1199,101 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
             nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs = {};
             descriptorRangeUpdateDescs.descriptorNum = helper::GetCountOf(materialTextures);
             descriptorRangeUpdateDescs.descriptors = materialTextures;
-            NRI.UpdateDescriptorRanges(*m_DescriptorSets[BUFFERED_FRAME_MAX_NUM + i], 0, 1, &descriptorRangeUpdateDescs);
+            NRI.UpdateDescriptorRanges(*m_DescriptorSets[1 + i], 0, 1, &descriptorRangeUpdateDescs);
         }
-    }
 
-    { // Upload data
-        std::vector<nri::TextureUploadDesc> textureData(textureNum + 2);
+        if (m_IsMeshletSupported) {
+            // Meshlets
+            m_DescriptorAllocator.Allocate(*m_PipelineLayout, MESHLET_DESCRIPTOR_SET, &m_MeshletDescriptorSet, 1);
 
-        uint32_t subresourceNum = 0;
-        for (uint32_t i = 0; i < textureNum; i++) {
-            const utils::Texture& texture = *m_Scene.textures[i];
-            subresourceNum += texture.GetArraySize() * texture.GetMipNum();
+            nri::DescriptorRangeUpdateDesc meshletRangeUpdateDesc = {};
+            meshletRangeUpdateDesc.descriptorNum = helper::GetCountOf(meshletResourceViews);
+            meshletRangeUpdateDesc.descriptors = meshletResourceViews;
+            NRI.UpdateDescriptorRanges(*m_MeshletDescriptorSet, 0, 1, &meshletRangeUpdateDesc);
+
+            // Meshlet culling
+            m_DescriptorAllocator.Allocate(*m_CullingPipelineLayout, 0, &m_CullingDescriptorSet, 1);
+
+            nri::DescriptorRangeUpdateDesc cullingRangeUpdateDescs[2] = {};
+            cullingRangeUpdateDescs[0].descriptorNum = helper::GetCountOf(cullingResourceViews);
+            cullingRangeUpdateDescs[0].descriptors = cullingResourceViews;
+            cullingRangeUpdateDescs[1].descriptorNum = 1;
+            cullingRangeUpdateDescs[1].descriptors = &cullingStorageView;
+            NRI.UpdateDescriptorRanges(*m_CullingDescriptorSet, 0, helper::GetCountOf(cullingRangeUpdateDescs), cullingRangeUpdateDescs);
         }
 
-        std::vector<nri::TextureSubresourceUploadDesc> subresources(subresourceNum);
-        nri::TextureSubresourceUploadDesc* subresourceBegin = subresources.data();
+        if (m_IsAdaptiveVrsSupported) {
+            m_DescriptorAllocator.Allocate(*m_VrsPipelineLayout, 0, &m_VrsDescriptorSet, 1);
+
+            nri::DescriptorRangeUpdateDesc vrsRangeUpdateDescs[3] = {};
+            vrsRangeUpdateDescs[0].descriptorNum = helper::GetCountOf(vrsTextureViews);
+            vrsRangeUpdateDescs[0].descriptors = vrsTextureViews;
+            vrsRangeUpdateDescs[1].descriptorNum = 1;
+            vrsRangeUpdateDescs[1].descriptors = &vrsStorageViews[0];
+            vrsRangeUpdateDescs[2].descriptorNum = 1;
+            vrsRangeUpdateDescs[2].descriptors = &vrsStorageViews[1];
+            NRI.UpdateDescriptorRanges(*m_VrsDescriptorSet, 0, helper::GetCountOf(vrsRangeUpdateDescs), vrsRangeUpdateDescs);
+        }
+    }
+
+    { // Upload data
+        const double uploadBegin = m_Timer.GetTimeStamp();
+
+        UploadManager uploadManager;
+        uploadManager.Create(NRI, *m_Device, *m_CommandQueue);
 
         // Material textures
-        uint32_t i = 0;
-        for (; i < textureNum; i++) {
+        std::vector<nri::TextureSubresourceUploadDesc> subresources;
+        for (uint32_t i = 0; i < textureNum; i++) {
             const utils::Texture& texture = *m_Scene.textures[i];
 
+            subresources.resize(texture.GetArraySize() * texture.GetMipNum());
             for (uint32_t slice = 0; slice < texture.GetArraySize(); slice++) {
                 for (uint32_t mip = 0; mip < texture.GetMipNum(); mip++)
-                    texture.GetSubresource(subresourceBegin[slice * texture.GetMipNum() + mip], mip, slice);
+                    texture.GetSubresource(subresources[slice * texture.GetMipNum() + mip], mip, slice);
             }
 
-            textureData[i] = {};
-            textureData[i].subresources = subresourceBegin;
-            textureData[i].texture = m_Textures[i];
-            textureData[i].after = {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE};
-
-            subresourceBegin += texture.GetArraySize() * texture.GetMipNum();
+            uploadManager.UploadTexture(*m_Textures[i], subresources.data(), {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE});
         }
 
         // Depth attachment
-        textureData[i] = {};
-        textureData[i].subresources = nullptr;
-        textureData[i].texture = depthTexture;
-        textureData[i].after = {nri::AccessBits::DEPTH_STENCIL_ATTACHMENT_WRITE, nri::Layout::DEPTH_STENCIL_ATTACHMENT};
-        i++;
+        uploadManager.UploadTexture(*m_DepthTexture, nullptr, {nri::AccessBits::DEPTH_STENCIL_ATTACHMENT_WRITE, nri::Layout::DEPTH_STENCIL_ATTACHMENT});
 
         // Shading rate attachment
-        nri::TextureSubresourceUploadDesc shadingRateSubresource = {};
-        shadingRateSubresource.slices = shadingRateData;
-        shadingRateSubresource.sliceNum = 1;
-        shadingRateSubresource.rowPitch = shadingRateTexWidth;
-        shadingRateSubresource.slicePitch = shadingRateTexWidth * shadingRateTexHeight;
-
-        textureData[i] = {};
-        textureData[i].subresources = &shadingRateSubresource;
-        textureData[i].texture = shadingRateTexture;
-        textureData[i].after = {nri::AccessBits::SHADING_RATE_ATTACHMENT, nri::Layout::SHADING_RATE_ATTACHMENT};
-        i++;
+        if (m_IsAdaptiveVrsSupported) {
+            nri::TextureSubresourceUploadDesc shadingRateSubresource = {};
+            shadingRateSubresource.slices = shadingRateData;
+            shadingRateSubresource.sliceNum = 1;
+            shadingRateSubresource.rowPitch = shadingRateTexWidth;
+            shadingRateSubresource.slicePitch = shadingRateTexWidth * shadingRateTexHeight;
+
+            uploadManager.UploadTexture(*m_ShadingRateTexture, &shadingRateSubresource, {nri::AccessBits::SHADING_RATE_ATTACHMENT, nri::Layout::SHADING_RATE_ATTACHMENT});
+        }
+
+        uploadManager.UploadTexture(*m_SceneColorTexture, nullptr, {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE});
 
         // Buffers
-        nri::BufferUploadDesc bufferData[] = {
-            {m_Scene.vertices.data(), helper::GetByteSizeOf(m_Scene.vertices), m_Buffers[VERTEX_BUFFER], 0, {nri::AccessBits::VERTEX_BUFFER}},
-            {m_Scene.indices.data(), helper::GetByteSizeOf(m_Scene.indices), m_Buffers[INDEX_BUFFER], 0, {nri::AccessBits::INDEX_BUFFER}},
-        };
+        uploadManager.UploadBuffer(*m_Buffers[VERTEX_BUFFER], 0, m_Scene.vertices.data(), helper::GetByteSizeOf(m_Scene.vertices), {nri::AccessBits::VERTEX_BUFFER | (m_IsMeshletSupported ? nri::AccessBits::SHADER_RESOURCE : nri::AccessBits::UNKNOWN)});
+        uploadManager.UploadBuffer(*m_Buffers[INDEX_BUFFER], 0, m_Scene.indices.data(), helper::GetByteSizeOf(m_Scene.indices), {nri::AccessBits::INDEX_BUFFER});
+
+        if (m_IsMeshletSupported) {
+            uploadManager.UploadBuffer(*m_Buffers[MESHLET_BUFFER], 0, meshlets.data(), helper::GetByteSizeOf(meshlets), {nri::AccessBits::SHADER_RESOURCE});
+            uploadManager.UploadBuffer(*m_Buffers[MESHLET_VERTEX_BUFFER], 0, meshletVertices.data(), helper::GetByteSizeOf(meshletVertices), {nri::AccessBits::SHADER_RESOURCE});
+            uploadManager.UploadBuffer(*m_Buffers[MESHLET_PRIMITIVE_BUFFER], 0, meshletPrimitives.data(), helper::GetByteSizeOf(meshletPrimitives), {nri::AccessBits::SHADER_RESOURCE});
+            uploadManager.UploadBuffer(*m_Buffers[MESHLET_INDEX_BUFFER], 0, meshletIndices.data(), helper::GetByteSizeOf(meshletIndices), {nri::AccessBits::INDEX_BUFFER});
+            uploadManager.UploadBuffer(*m_Buffers[MESHLET_CULLING_ITEM_BUFFER], 0, cullingItems.data(), helper::GetByteSizeOf(cullingItems), {nri::AccessBits::SHADER_RESOURCE});
+            uploadManager.UploadBuffer(*m_Buffers[MESHLET_INDIRECT_BUFFER], 0, nullptr, 0, {nri::AccessBits::ARGUMENT_BUFFER, nri::StageBits::INDIRECT});
+        }
+
+        const uint32_t vrsCounter = 0;
+        if (m_IsAdaptiveVrsSupported)
+            uploadManager.UploadBuffer(*m_VrsCounterBuffer, 0, &vrsCounter, sizeof(vrsCounter), {nri::AccessBits::COPY_SOURCE, nri::StageBits::COPY});
+
+        uploadManager.Flush();
 
-        NRI_ABORT_ON_FAILURE(NRI.UploadData(*m_CommandQueue, textureData.data(), i, bufferData, helper::GetCountOf(bufferData)));
+        m_UploadStats = uploadManager.GetStats();
+        m_UploadRingSize = uploadManager.GetRingSize();
+        m_UploadTime = m_Timer.GetTimeStamp() - uploadBegin;
     }
 
     { // Pipeline statistics
@@ -581,6 +1304,14 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         NRI_ABORT_ON_FAILURE(NRI.CreateQueryPool(*m_Device, queryPoolDesc, m_QueryPool));
     }
 
+    { // Frame timestamps, a begin-end pair per buffered frame
+        nri::QueryPoolDesc queryPoolDesc = {};
+        queryPoolDesc.queryType = nri::QueryType::TIMESTAMP;
+        queryPoolDesc.capacity = 2 * BUFFERED_FRAME_MAX_NUM;
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateQueryPool(*m_Device, queryPoolDesc, m_TimestampQueryPool));
+    }
+
     m_Scene.UnloadGeometryData();
     m_Scene.UnloadTextureData();
 
@@ -591,10 +1322,24 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
 }
 
 void Sample::PrepareFrame(uint32_t frameIndex) {
+    // Resize (zero size means minimized)
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(m_Window, &width, &height);
+
+    if (width && height) {
+        const uint2 resolution = uint2(std::min((uint32_t)width, m_MaxResolution.x), std::min((uint32_t)height, m_MaxResolution.y));
+        if (resolution.x != m_WindowResolution.x || resolution.y != m_WindowResolution.y) {
+            m_WindowResolution = resolution;
+            ResizeSwapChain(frameIndex);
+        }
+    }
+
     BeginUI();
 
     // TODO: delay is not implemented
-    nri::PipelineStatisticsDesc* pipelineStats = (nri::PipelineStatisticsDesc*)NRI.MapBuffer(*m_Buffers[READBACK_BUFFER], 0, sizeof(nri::PipelineStatisticsDesc));
+    uint8_t* readback = (uint8_t*)NRI.MapBuffer(*m_Buffers[READBACK_BUFFER], 0, VRS_READBACK_OFFSET);
+    nri::PipelineStatisticsDesc* pipelineStats = (nri::PipelineStatisticsDesc*)readback;
     {
         ImGui::SetNextWindowPos(ImVec2(30, 30), ImGuiCond_Once);
         ImGui::SetNextWindowSize(ImVec2(0, 0));
@@ -606,6 +1351,54 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
             ImGui::Text("Rasterizer input primitives  : %llu", pipelineStats->rasterizerInPrimitiveNum);
             ImGui::Text("Rasterizer output primitives : %llu", pipelineStats->rasterizerOutPrimitiveNum);
             ImGui::Text("Fragment shader invocations  : %llu", pipelineStats->fragmentShaderInvocationNum);
+
+            ImGui::Separator();
+            if (m_GeometryMode == VERTEX_SHADER) {
+                ImGui::Text("Draw calls                   : %u (%u buckets, %u instances)", m_DrawCallNum, (uint32_t)m_DrawBuckets.size(), (uint32_t)m_Scene.instances.size());
+                ImGui::Text("Visible instances            : %u / %u", m_VisibleInstanceNum, (uint32_t)m_Scene.instances.size());
+            } else
+                ImGui::Text("Draw calls                   : %u", (uint32_t)m_Scene.instances.size());
+            ImGui::Checkbox("Instanced draws", &m_EnableInstancing);
+
+            if (m_IsMeshletSupported) {
+                ImGui::Separator();
+                ImGui::Text("Meshlets                     : %u", m_MeshletNum);
+
+                const char* geometryModes = m_IsMeshShaderSupported ? "Vertex shader\0Meshlets: compute + indirect\0Meshlets: mesh shaders\0\0" : "Vertex shader\0Meshlets: compute + indirect\0\0";
+                ImGui::Combo("Geometry", &m_GeometryMode, geometryModes);
+                ImGui::Checkbox("Meshlet cone culling", &m_EnableConeCulling);
+            }
+
+            ImGui::Separator();
+            ImGui::Checkbox("Dynamic resolution", &m_EnableDrs);
+            ImGui::SliderFloat("Target GPU time (ms)", &m_DrsTargetTime, 1.0f, 33.3f, "%.1f");
+            ImGui::SliderFloat("Sharpness", &m_DrsSharpness, 0.0f, 1.0f, "%.2f");
+            ImGui::Text("Scale                        : %.2f (%ux%u)", m_DrsScale, m_RenderResolution.x, m_RenderResolution.y);
+            ImGui::Text("GPU time                     : %.2f ms (target %.2f ms)", m_GpuFrameTime, m_DrsTargetTime);
+
+            ImGui::Separator();
+            if (m_IsAdaptiveVrsSupported) {
+                const uint32_t pixelNum = std::max(m_RenderResolution.x * m_RenderResolution.y, 1u);
+
+                ImGui::Checkbox("Adaptive VRS", &m_EnableAdaptiveVrs);
+                ImGui::SliderFloat("VRS threshold", &m_VrsThreshold, 0.0f, 0.5f, "%.3f");
+                ImGui::Text("Fragment invocations saved   : %u (%.1f%% of pixels)", m_VrsSavedFragmentNum, 100.0f * m_VrsSavedFragmentNum / pixelNum);
+            } else
+                ImGui::Text("Adaptive VRS is not supported (shading rate tier < 2)");
+
+            ImGui::Separator();
+            ImGui::Text("Upload                       : %.1f Mb in %.1f ms", m_UploadStats.uploadedBytes / (1024.0 * 1024.0), m_UploadTime);
+            ImGui::Text("Upload ring                  : %.1f Mb, %u submits, %u stalls", m_UploadRingSize / (1024.0 * 1024.0), m_UploadStats.submitNum, m_UploadStats.stallNum);
+
+            ImGui::Separator();
+            ImGui::Text("Resolution                   : %ux%u (targets %ux%u)", GetWindowResolution().x, GetWindowResolution().y, m_MaxResolution.x, m_MaxResolution.y);
+            ImGui::Text("Last resize                  : %.2f ms (%.2f ms waiting), %u resizes", m_ResizeTime, m_ResizeWaitTime, m_ResizeNum);
+
+            const MemoryAllocator::Stats memoryStats = m_MemoryAllocator.GetStats();
+            ImGui::Separator();
+            ImGui::Text("GPU memory                   : %.1f / %.1f Mb, %u allocations", memoryStats.usedBytes / (1024.0 * 1024.0), memoryStats.blockBytes / (1024.0 * 1024.0), memoryStats.allocationNum);
+            ImGui::Text("Memory blocks                : %u (+%u dedicated)", memoryStats.blockNum, memoryStats.dedicatedNum);
+            ImGui::Text("Fragmentation                : %.1f%%, %.1f Kb wasted", memoryStats.fragmentation * 100.0f, memoryStats.wastedBytes / 1024.0);
         }
         ImGui::End();
     }
@@ -624,6 +1417,89 @@ void Sample::PrepareFrame(uint32_t frameIndex) {
     m_Camera.Update(desc, frameIndex);
 }
 
+void Sample::CreateSwapChain(nri::Format& swapChainFormat) {
+    nri::SwapChainDesc swapChainDesc = {};
+    swapChainDesc.window = GetWindow();
+    swapChainDesc.commandQueue = m_CommandQueue;
+    swapChainDesc.format = nri::SwapChainFormat::BT709_G22_10BIT;
+    swapChainDesc.verticalSyncInterval = m_VsyncInterval;
+    swapChainDesc.width = (uint16_t)GetWindowResolution().x;
+    swapChainDesc.height = (uint16_t)GetWindowResolution().y;
+    swapChainDesc.textureNum = SWAP_CHAIN_TEXTURE_NUM;
+    NRI_ABORT_ON_FAILURE(NRI.CreateSwapChain(*m_Device, swapChainDesc, m_SwapChain));
+
+    uint32_t swapChainTextureNum;
+    nri::Texture* const* swapChainTextures = NRI.GetSwapChainTextures(*m_SwapChain, swapChainTextureNum);
+    swapChainFormat = NRI.GetTextureDesc(*swapChainTextures[0]).format;
+
+    for (uint32_t i = 0; i < swapChainTextureNum; i++) {
+        nri::Texture2DViewDesc textureViewDesc = {swapChainTextures[i], nri::Texture2DViewType::COLOR_ATTACHMENT, swapChainFormat};
+
+        nri::Descriptor* colorAttachment;
+        NRI_ABORT_ON_FAILURE(NRI.CreateTexture2DView(textureViewDesc, colorAttachment));
+
+        const BackBuffer backBuffer = {colorAttachment, swapChainTextures[i]};
+        m_SwapChainBuffers.push_back(backBuffer);
+    }
+}
+
+void Sample::ResizeSwapChain(uint32_t frameIndex) {
+    const double resizeBegin = m_Timer.GetTimeStamp();
+
+    // Render targets are sized for "m_MaxResolution", only the swap chain changes. A window can't have two swap chains
+    // and NRI has no in-place resize, so the old one and its views can't go to a deletion queue: they must be released
+    // before the new one is created. D3D11 defers the destruction of objects in use by the GPU itself, D3D12 and Vulkan
+    // need the last submitted frame, which signals "frameIndex", to finish (see "Resize")
+    if (frameIndex && NRI.GetDeviceDesc(*m_Device).graphicsAPI != nri::GraphicsAPI::D3D11)
+        NRI.Wait(*m_FrameFence, frameIndex);
+
+    m_ResizeWaitTime = m_Timer.GetTimeStamp() - resizeBegin;
+
+    // Views before their textures
+    for (BackBuffer& backBuffer : m_SwapChainBuffers)
+        NRI.DestroyDescriptor(*backBuffer.colorAttachment);
+
+    m_SwapChainBuffers.clear();
+
+    NRI.DestroySwapChain(*m_SwapChain);
+
+    // The format doesn't change, pipelines stay valid
+    nri::Format swapChainFormat = nri::Format::UNKNOWN;
+    CreateSwapChain(swapChainFormat);
+
+    // History holds the previous resolution
+    m_IsHistoryValid = false;
+
+    m_ResizeTime = m_Timer.GetTimeStamp() - resizeBegin;
+    m_ResizeNum++;
+}
+
+void Sample::UpdateDynamicResolution(uint32_t bufferedFrameIndex) {
+    const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
+
+    // Timestamps and VRS counter of the frame which used this slot last time, complete after the frame fence wait
+    const uint8_t* readback = (uint8_t*)NRI.MapBuffer(*m_Buffers[READBACK_BUFFER], 0, READBACK_BUFFER_SIZE);
+    const uint64_t* timestamps = (uint64_t*)(readback + TIMESTAMP_READBACK_OFFSET) + bufferedFrameIndex * 2;
+    m_GpuFrameTime = timestamps[1] > timestamps[0] ? double(timestamps[1] - timestamps[0]) * 1000.0 / double(deviceDesc.timestampFrequencyHz) : 0.0;
+    m_VrsSavedFragmentNum = m_IsAdaptiveVrsSupported ? *(uint32_t*)(readback + VRS_READBACK_OFFSET + bufferedFrameIndex * sizeof(uint64_t)) : 0;
+    NRI.UnmapBuffer(*m_Buffers[READBACK_BUFFER]);
+
+    if (!m_EnableDrs || m_GpuFrameTime == 0.0) {
+        m_DrsScale = m_EnableDrs ? m_DrsScale : 1.0f;
+        m_DrsPrevError = 0.0f;
+        return;
+    }
+
+    // PI controller in velocity form, i.e. it steps the scale. GPU time follows the pixel count, which is
+    // quadratic in the scale, hence the square root. The measurement lags by "BUFFERED_FRAME_MAX_NUM" frames, so gains are low
+    float error = sqrtf(m_DrsTargetTime / (float)m_GpuFrameTime) - 1.0f;
+    error = std::min(std::max(error, -0.5f), 0.5f);
+
+    m_DrsScale += DRS_KP * (error - m_DrsPrevError) + DRS_KI * error;
+    m_DrsScale = std::min(std::max(m_DrsScale, DRS_SCALE_MIN), 1.0f);
+    m_DrsPrevError = error;
+}
+
 void Sample::RenderFrame(uint32_t frameIndex) {
     const uint32_t bufferedFrameIndex = frameIndex % BUFFERED_FRAME_MAX_NUM;
     const Frame& frame = m_Frames[bufferedFrameIndex];
@@ -634,27 +1510,77 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     if (frameIndex >= BUFFERED_FRAME_MAX_NUM) {
         NRI.Wait(*m_FrameFence, 1 + frameIndex - BUFFERED_FRAME_MAX_NUM);
         NRI.ResetCommandAllocator(*frame.commandAllocator);
+
+        UpdateDynamicResolution(bufferedFrameIndex);
+    }
+
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+
+    // Render resolution
+    const float scale = std::floor(m_DrsScale / DRS_SCALE_STEP + 0.5f) * DRS_SCALE_STEP;
+    const uint32_t renderWidth = std::max((uint32_t)(windowWidth * scale + 0.5f), 1u);
+    const uint32_t renderHeight = std::max((uint32_t)(windowHeight * scale + 0.5f), 1u);
+
+    if (renderWidth != m_RenderResolution.x || renderHeight != m_RenderResolution.y) {
+        m_RenderResolution = uint2(renderWidth, renderHeight);
+        m_IsHistoryValid = false;
     }
 
     const uint32_t currentTextureIndex = NRI.AcquireNextSwapChainTexture(*m_SwapChain);
     BackBuffer& currentBackBuffer = m_SwapChainBuffers[currentTextureIndex];
 
     // Update constants
-    const uint64_t rangeOffset = m_Frames[bufferedFrameIndex].globalConstantBufferViewOffsets;
-    auto constants = (GlobalConstantBufferLayout*)NRI.MapBuffer(*m_Buffers[CONSTANT_BUFFER], rangeOffset, sizeof(GlobalConstantBufferLayout));
-    if (constants) {
-        constants->gWorldToClip = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
-        constants->gCameraPos = m_Camera.state.position;
+    m_ConstantAllocator.BeginFrame(bufferedFrameIndex);
+
+    uint32_t globalConstantsOffset = 0;
+    GlobalConstantBufferLayout* constants = m_ConstantAllocator.Allocate<GlobalConstantBufferLayout>(globalConstantsOffset);
+    constants->gWorldToClip = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
+    constants->gCameraPos = m_Camera.state.position;
+
+    // Cull instances and compact visible transforms per bucket
+    const uint32_t instanceRegionSize = 1 + (uint32_t)m_Scene.instances.size();
+    const uint64_t instanceRegionOffset = uint64_t(bufferedFrameIndex) * instanceRegionSize * sizeof(InstanceData);
+    const bool useInstancing = m_GeometryMode == VERTEX_SHADER && m_EnableInstancing;
+    {
+        InstanceData* instanceData = m_InstanceData + bufferedFrameIndex * instanceRegionSize;
+        instanceData[0] = {{float4(1.0f, 0.0f, 0.0f, 0.0f), float4(0.0f, 1.0f, 0.0f, 0.0f), float4(0.0f, 0.0f, 1.0f, 0.0f)}};
+
+        m_DrawCallNum = (uint32_t)m_Scene.instances.size();
+        m_VisibleInstanceNum = m_DrawCallNum;
+
+        if (useInstancing) {
+            const float4x4 worldToClip = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
 
-        NRI.UnmapBuffer(*m_Buffers[CONSTANT_BUFFER]);
+            uint32_t visibleNum = 1;
+            m_DrawCallNum = 0;
+            for (DrawBucket& bucket : m_DrawBuckets) {
+                bucket.visibleOffset = visibleNum;
+
+                const cBoxf& box = m_MeshBoxes[bucket.meshIndex];
+                for (uint32_t i = 0; i < bucket.instanceNum; i++) {
+                    const InstanceData& transform = m_InstanceTransforms[m_BucketInstances[bucket.instanceOffset + i]];
+                    if (IsBoxVisible(worldToClip, transform, box))
+                        instanceData[visibleNum++] = transform;
+                }
+
+                bucket.visibleNum = visibleNum - bucket.visibleOffset;
+                m_DrawCallNum += bucket.visibleNum ? 1 : 0;
+            }
+
+            m_VisibleInstanceNum = visibleNum - 1;
+        }
     }
 
     // Record
     nri::CommandBuffer& commandBuffer = *frame.commandBuffer;
-    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorPool);
+    NRI.BeginCommandBuffer(commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
     {
         helper::Annotation annotation(NRI, commandBuffer, "Scene");
 
+        // GPU frame time for dynamic resolution
+        NRI.CmdResetQueries(commandBuffer, *m_TimestampQueryPool, bufferedFrameIndex * 2, 2);
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, bufferedFrameIndex * 2);
+
         nri::TextureBarrierDesc textureBarrierDescs = {};
         textureBarrierDescs.texture = currentBackBuffer.texture;
         textureBarrierDescs.after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT};
@@ -667,6 +1593,118 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
         NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
 
+        if (m_GeometryMode == MESHLETS_COMPUTE_CULLING) {
+            helper::Annotation meshletAnnotation(NRI, commandBuffer, "Meshlet culling");
+
+            nri::BufferBarrierDesc bufferBarrierDesc = {};
+            bufferBarrierDesc.buffer = m_Buffers[MESHLET_INDIRECT_BUFFER];
+            bufferBarrierDesc.before = {nri::AccessBits::ARGUMENT_BUFFER, nri::StageBits::INDIRECT};
+            bufferBarrierDesc.after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER};
+
+            nri::BarrierGroupDesc bufferBarrierGroupDesc = {};
+            bufferBarrierGroupDesc.bufferNum = 1;
+            bufferBarrierGroupDesc.buffers = &bufferBarrierDesc;
+
+            NRI.CmdBarrier(commandBuffer, bufferBarrierGroupDesc);
+
+            const float3 cameraPos = m_Camera.state.position;
+
+            MeshletCullingConstants cullingConstants = {};
+            cullingConstants.worldToClip = m_Camera.state.mWorldToClip * m_Scene.mSceneToWorld;
+            cullingConstants.cameraPos = float4(cameraPos.x, cameraPos.y, cameraPos.z, 0.0f);
+            cullingConstants.itemNum = m_CullingItemNum;
+            cullingConstants.enableConeCulling = m_EnableConeCulling ? 1 : 0;
+
+            NRI.CmdSetPipelineLayout(commandBuffer, *m_CullingPipelineLayout);
+            NRI.CmdSetDescriptorSet(commandBuffer, 0, *m_CullingDescriptorSet, nullptr);
+            NRI.CmdSetConstants(commandBuffer, 0, &cullingConstants, sizeof(cullingConstants));
+            NRI.CmdSetPipeline(commandBuffer, *m_CullingPipeline);
+            NRI.CmdDispatch(commandBuffer, {(m_CullingItemNum + MESHLET_CULLING_GROUP_SIZE - 1) / MESHLET_CULLING_GROUP_SIZE, 1, 1});
+
+            bufferBarrierDesc.before = bufferBarrierDesc.after;
+            bufferBarrierDesc.after = {nri::AccessBits::ARGUMENT_BUFFER, nri::StageBits::INDIRECT};
+
+            NRI.CmdBarrier(commandBuffer, bufferBarrierGroupDesc);
+        }
+
+        // Saved fragments of this frame, stays "0" if the shading rate pass is skipped
+        nri::BufferBarrierDesc vrsCounterBarrier = {};
+        vrsCounterBarrier.buffer = m_VrsCounterBuffer;
+        vrsCounterBarrier.before = {nri::AccessBits::COPY_SOURCE, nri::StageBits::COPY};
+        vrsCounterBarrier.after = {nri::AccessBits::COPY_DESTINATION, nri::StageBits::COPY};
+
+        nri::BarrierGroupDesc vrsCounterBarrierGroupDesc = {};
+        vrsCounterBarrierGroupDesc.bufferNum = 1;
+        vrsCounterBarrierGroupDesc.buffers = &vrsCounterBarrier;
+
+        if (m_IsAdaptiveVrsSupported) {
+            NRI.CmdBarrier(commandBuffer, vrsCounterBarrierGroupDesc);
+            NRI.CmdZeroBuffer(commandBuffer, *m_VrsCounterBuffer, 0, sizeof(uint32_t));
+
+            vrsCounterBarrier.before = vrsCounterBarrier.after;
+        }
+
+        // Content adaptive shading rate, based on the previous frame
+        if (m_IsAdaptiveVrsSupported && m_EnableAdaptiveVrs && m_IsHistoryValid) {
+            helper::Annotation vrsAnnotation(NRI, commandBuffer, "Shading rate");
+
+            nri::TextureBarrierDesc vrsTextureBarriers[2] = {};
+            vrsTextureBarriers[0].texture = m_DepthTexture;
+            vrsTextureBarriers[0].before = {nri::AccessBits::DEPTH_STENCIL_ATTACHMENT_WRITE, nri::Layout::DEPTH_STENCIL_ATTACHMENT, nri::StageBits::DEPTH_STENCIL_ATTACHMENT};
+            vrsTextureBarriers[0].after = {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE, nri::StageBits::COMPUTE_SHADER};
+            vrsTextureBarriers[0].layerNum = 1;
+            vrsTextureBarriers[0].mipNum = 1;
+
+            vrsTextureBarriers[1].texture = m_ShadingRateTexture;
+            vrsTextureBarriers[1].before = {nri::AccessBits::SHADING_RATE_ATTACHMENT, nri::Layout::SHADING_RATE_ATTACHMENT, nri::StageBits::FRAGMENT_SHADER};
+            vrsTextureBarriers[1].after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::Layout::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER};
+            vrsTextureBarriers[1].layerNum = 1;
+            vrsTextureBarriers[1].mipNum = 1;
+
+            vrsCounterBarrier.after = {nri::AccessBits::SHADER_RESOURCE_STORAGE, nri::StageBits::COMPUTE_SHADER};
+
+            nri::BarrierGroupDesc vrsBarrierGroupDesc = {};
+            vrsBarrierGroupDesc.textureNum = helper::GetCountOf(vrsTextureBarriers);
+            vrsBarrierGroupDesc.textures = vrsTextureBarriers;
+            vrsBarrierGroupDesc.bufferNum = 1;
+            vrsBarrierGroupDesc.buffers = &vrsCounterBarrier;
+
+            NRI.CmdBarrier(commandBuffer, vrsBarrierGroupDesc);
+
+            vrsCounterBarrier.before = vrsCounterBarrier.after;
+
+            VrsConstants vrsConstants = {};
+            vrsConstants.prevClipToClip = m_Camera.state.mWorldToClip * m_Camera.statePrev.mClipToWorld;
+            vrsConstants.screenWidth = renderWidth;
+            vrsConstants.screenHeight = renderHeight;
+            vrsConstants.tileSize = deviceDesc.shadingRateAttachmentTileSize;
+            vrsConstants.threshold = m_VrsThreshold;
+            vrsConstants.motionSensitivity = VRS_MOTION_SENSITIVITY;
+
+            // The attachment is sized for the max resolution, only tiles covering the render resolution are updated
+            const uint32_t tileSize = deviceDesc.shadingRateAttachmentTileSize;
+
+            NRI.CmdSetPipelineLayout(commandBuffer, *m_VrsPipelineLayout);
+            NRI.CmdSetDescriptorSet(commandBuffer, 0, *m_VrsDescriptorSet, nullptr);
+            NRI.CmdSetConstants(commandBuffer, 0, &vrsConstants, sizeof(vrsConstants));
+            NRI.CmdSetPipeline(commandBuffer, *m_VrsPipeline);
+            NRI.CmdDispatch(commandBuffer, {(renderWidth + tileSize - 1) / tileSize, (renderHeight + tileSize - 1) / tileSize, 1});
+
+            for (nri::TextureBarrierDesc& barrier : vrsTextureBarriers)
+                std::swap(barrier.before, barrier.after);
+
+            vrsBarrierGroupDesc.bufferNum = 0;
+            NRI.CmdBarrier(commandBuffer, vrsBarrierGroupDesc);
+        }
+
+        // Each queued frame has its own readback slot, read after the frame fence wait
+        if (m_IsAdaptiveVrsSupported) {
+            vrsCounterBarrier.after = {nri::AccessBits::COPY_SOURCE, nri::StageBits::COPY};
+            NRI.CmdBarrier(commandBuffer, vrsCounterBarrierGroupDesc);
+
+            NRI.CmdCopyBuffer(commandBuffer, *m_Buffers[READBACK_BUFFER], VRS_READBACK_OFFSET + bufferedFrameIndex * sizeof(uint64_t), *m_VrsCounterBuffer, 0, sizeof(uint32_t));
+        }
+
         // Test PSL // TODO: D3D11 gets DEVICE_REMOVED if VRS is used with PSL...
         if (deviceDesc.sampleLocationsTier >= 2 && deviceDesc.graphicsAPI != nri::GraphicsAPI::D3D11) {
             static const nri::SampleLocation samplePos[4] = {
@@ -691,13 +1729,27 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.CmdResetQueries(commandBuffer, *m_QueryPool, 0, 1);
         NRI.CmdBeginQuery(commandBuffer, *m_QueryPool, 0);
 
+        // Scene color: previous frame -> render target
+        nri::TextureBarrierDesc sceneColorBarrier = {};
+        sceneColorBarrier.texture = m_SceneColorTexture;
+        sceneColorBarrier.before = {nri::AccessBits::SHADER_RESOURCE, nri::Layout::SHADER_RESOURCE, nri::StageBits::COMPUTE_SHADER | nri::StageBits::FRAGMENT_SHADER};
+        sceneColorBarrier.after = {nri::AccessBits::COLOR_ATTACHMENT, nri::Layout::COLOR_ATTACHMENT, nri::StageBits::COLOR_ATTACHMENT};
+        sceneColorBarrier.layerNum = 1;
+        sceneColorBarrier.mipNum = 1;
+
+        nri::BarrierGroupDesc sceneColorBarrierGroupDesc = {};
+        sceneColorBarrierGroupDesc.textureNum = 1;
+        sceneColorBarrierGroupDesc.textures = &sceneColorBarrier;
+
+        NRI.CmdBarrier(commandBuffer, sceneColorBarrierGroupDesc);
+
         { // Rendering
             nri::AttachmentsDesc attachmentsDesc = {};
             attachmentsDesc.colorNum = 1;
-            attachmentsDesc.colors = &currentBackBuffer.colorAttachment;
+            attachmentsDesc.colors = &m_SceneColorAttachment;
             attachmentsDesc.depthStencil = m_DepthAttachment;
 
-            if (deviceDesc.shadingRateTier >= 2)
+            if (m_EnableAdaptiveVrs && m_IsAdaptiveVrsSupported)
                 attachmentsDesc.shadingRate = m_ShadingRateAttachment;
 
             NRI.CmdBeginRendering(commandBuffer, attachmentsDesc);
@@ -708,33 +1760,79 @@ void Sample::RenderFrame(uint32_t frameIndex) {
                 clearDescs[1].planes = nri::PlaneBits::DEPTH;
                 clearDescs[1].value.depthStencil.depth = CLEAR_DEPTH;
 
-                NRI.CmdClearAttachments(commandBuffer, clearDescs, helper::GetCountOf(clearDescs), nullptr, 0);
+                // Attachments are sized for the max resolution, only the rendered part is touched
+                const nri::Rect scissor = {0, 0, (nri::Dim_t)renderWidth, (nri::Dim_t)renderHeight};
+                NRI.CmdClearAttachments(commandBuffer, clearDescs, helper::GetCountOf(clearDescs), &scissor, 1);
 
-                const nri::Viewport viewport = {0.0f, 0.0f, (float)windowWidth, (float)windowHeight, 0.0f, 1.0f};
+                const nri::Viewport viewport = {0.0f, 0.0f, (float)renderWidth, (float)renderHeight, 0.0f, 1.0f};
                 NRI.CmdSetViewports(commandBuffer, &viewport, 1);
-
-                const nri::Rect scissor = {0, 0, (nri::Dim_t)windowWidth, (nri::Dim_t)windowHeight};
                 NRI.CmdSetScissors(commandBuffer, &scissor, 1);
 
-                NRI.CmdSetIndexBuffer(commandBuffer, *m_Buffers[INDEX_BUFFER], 0, sizeof(utils::Index) == 2 ? nri::IndexType::UINT16 : nri::IndexType::UINT32);
+                if (m_GeometryMode == MESHLETS_COMPUTE_CULLING)
+                    NRI.CmdSetIndexBuffer(commandBuffer, *m_Buffers[MESHLET_INDEX_BUFFER], 0, nri::IndexType::UINT32);
+                else
+                    NRI.CmdSetIndexBuffer(commandBuffer, *m_Buffers[INDEX_BUFFER], 0, sizeof(utils::Index) == 2 ? nri::IndexType::UINT16 : nri::IndexType::UINT32);
 
                 NRI.CmdSetPipelineLayout(commandBuffer, *m_PipelineLayout);
-                NRI.CmdSetDescriptorSet(commandBuffer, GLOBAL_DESCRIPTOR_SET, *m_DescriptorSets[bufferedFrameIndex], nullptr);
+                NRI.CmdSetDescriptorSet(commandBuffer, GLOBAL_DESCRIPTOR_SET, *m_DescriptorSets[0], &globalConstantsOffset);
 
-                // TODO: no sorting per pipeline / material, transparency is not last
-                for (const utils::Instance& instance : m_Scene.instances) {
-                    const utils::Material& material = m_Scene.materials[instance.materialIndex];
-                    uint32_t pipelineIndex = material.IsAlphaOpaque() ? 1 : (material.IsTransparent() ? 2 : 0);
-                    NRI.CmdSetPipeline(commandBuffer, *m_Pipelines[pipelineIndex]);
+                if (m_GeometryMode == MESHLETS_MESH_SHADER)
+                    NRI.CmdSetDescriptorSet(commandBuffer, MESHLET_DESCRIPTOR_SET, *m_MeshletDescriptorSet, nullptr);
 
-                    constexpr uint64_t offset = 0;
-                    NRI.CmdSetVertexBuffers(commandBuffer, 0, 1, &m_Buffers[VERTEX_BUFFER], &offset);
-
-                    nri::DescriptorSet* descriptorSet = m_DescriptorSets[BUFFERED_FRAME_MAX_NUM + instance.materialIndex];
-                    NRI.CmdSetDescriptorSet(commandBuffer, MATERIAL_DESCRIPTOR_SET, *descriptorSet, nullptr);
+                if (m_GeometryMode != MESHLETS_MESH_SHADER) {
+                    nri::Buffer* vertexBuffers[] = {m_Buffers[VERTEX_BUFFER], m_InstanceBuffer};
+                    const uint64_t offsets[] = {0, instanceRegionOffset};
+                    NRI.CmdSetVertexBuffers(commandBuffer, 0, helper::GetCountOf(vertexBuffers), vertexBuffers, offsets);
+                }
 
-                    const utils::Mesh& mesh = m_Scene.meshes[instance.meshInstanceIndex];
-                    NRI.CmdDrawIndexed(commandBuffer, {mesh.indexNum, 1, mesh.indexOffset, (int32_t)mesh.vertexOffset, 0});
+                if (useInstancing) {
+                    for (const DrawBucket& bucket : m_DrawBuckets) {
+                        if (!bucket.visibleNum)
+                            continue;
+
+                        NRI.CmdSetPipeline(commandBuffer, *m_Pipelines[bucket.pipelineIndex]);
+                        NRI.CmdSetDescriptorSet(commandBuffer, MATERIAL_DESCRIPTOR_SET, *m_DescriptorSets[1 + bucket.materialIndex], nullptr);
+
+                        const utils::Mesh& mesh = m_Scene.meshes[bucket.meshIndex];
+                        NRI.CmdDrawIndexed(commandBuffer, {mesh.indexNum, bucket.visibleNum, mesh.indexOffset, (int32_t)mesh.vertexOffset, bucket.visibleOffset});
+                    }
+                } else {
+                    // Non-instanced draws use the identity transform at the start of the instance region
+                    // TODO: no sorting per pipeline / material, transparency is not last
+                    uint32_t commandOffset = 0;
+                    for (const utils::Instance& instance : m_Scene.instances) {
+                        const utils::Material& material = m_Scene.materials[instance.materialIndex];
+                        uint32_t pipelineIndex = material.IsAlphaOpaque() ? 1 : (material.IsTransparent() ? 2 : 0);
+                        bool allowConeCulling = pipelineIndex == 0;
+
+                        if (m_GeometryMode == MESHLETS_MESH_SHADER)
+                            pipelineIndex += MESHLET_PIPELINE_OFFSET;
+
+                        NRI.CmdSetPipeline(commandBuffer, *m_Pipelines[pipelineIndex]);
+
+                        nri::DescriptorSet* descriptorSet = m_DescriptorSets[1 + instance.materialIndex];
+                        NRI.CmdSetDescriptorSet(commandBuffer, MATERIAL_DESCRIPTOR_SET, *descriptorSet, nullptr);
+
+                        if (m_GeometryMode == MESHLETS_MESH_SHADER) {
+                            const MeshletRange& meshletRange = m_MeshletRanges[instance.meshInstanceIndex];
+
+                            MeshletDrawConstants drawConstants = {};
+                            drawConstants.meshletOffset = meshletRange.meshletOffset;
+                            drawConstants.meshletNum = meshletRange.meshletNum;
+                            drawConstants.enableConeCulling = m_EnableConeCulling && allowConeCulling ? 1 : 0;
+                            NRI.CmdSetConstants(commandBuffer, 0, &drawConstants, sizeof(drawConstants));
+
+                            NRI.CmdDrawMeshTasks(commandBuffer, {(meshletRange.meshletNum + MESHLET_TASK_GROUP_SIZE - 1) / MESHLET_TASK_GROUP_SIZE, 1, 1});
+                        } else if (m_GeometryMode == MESHLETS_COMPUTE_CULLING) {
+                            const MeshletRange& meshletRange = m_MeshletRanges[instance.meshInstanceIndex];
+
+                            NRI.CmdDrawIndexedIndirect(commandBuffer, *m_Buffers[MESHLET_INDIRECT_BUFFER], commandOffset * sizeof(nri::DrawIndexedDesc), meshletRange.meshletNum, sizeof(nri::DrawIndexedDesc), nullptr, 0);
+                            commandOffset += meshletRange.meshletNum;
+                        } else {
+                            const utils::Mesh& mesh = m_Scene.meshes[instance.meshInstanceIndex];
+                            NRI.CmdDrawIndexed(commandBuffer, {mesh.indexNum, 1, mesh.indexOffset, (int32_t)mesh.vertexOffset, 0});
+                        }
+                    }
                 }
             }
             NRI.CmdEndRendering(commandBuffer);
@@ -744,6 +1842,14 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.CmdEndQuery(commandBuffer, *m_QueryPool, 0);
         NRI.CmdCopyQueries(commandBuffer, *m_QueryPool, 0, 1, *m_Buffers[READBACK_BUFFER], 0);
 
+        // Scene color: render target -> upscale input (and the next frame shading rate pass input)
+        std::swap(sceneColorBarrier.before, sceneColorBarrier.after);
+        sceneColorBarrier.after.stages = nri::StageBits::FRAGMENT_SHADER;
+
+        NRI.CmdBarrier(commandBuffer, sceneColorBarrierGroupDesc);
+
+        m_IsHistoryValid = m_IsAdaptiveVrsSupported;
+
         // Reset VRS (per pipeline)
         if (deviceDesc.shadingRateTier) {
             nri::ShadingRateDesc shadingRateDesc = {};
@@ -754,13 +1860,45 @@ void Sample::RenderFrame(uint32_t frameIndex) {
             NRI.CmdSetShadingRate(commandBuffer, shadingRateDesc);
         }
 
-        { // UI
+        { // Upscale and UI
             nri::AttachmentsDesc attachmentsDesc = {};
             attachmentsDesc.colorNum = 1;
             attachmentsDesc.colors = &currentBackBuffer.colorAttachment;
 
             NRI.CmdBeginRendering(commandBuffer, attachmentsDesc);
             {
+                {
+                    helper::Annotation upscaleAnnotation(NRI, commandBuffer, "Upscale");
+
+                    const nri::Viewport viewport = {0.0f, 0.0f, (float)windowWidth, (float)windowHeight, 0.0f, 1.0f};
+                    NRI.CmdSetViewports(commandBuffer, &viewport, 1);
+
+                    const nri::Rect scissor = {0, 0, (nri::Dim_t)windowWidth, (nri::Dim_t)windowHeight};
+                    NRI.CmdSetScissors(commandBuffer, &scissor, 1);
+
+                    UpscaleConstants upscaleConstants = {};
+                    upscaleConstants.uvScale = float2(float(renderWidth) / float(m_MaxResolution.x), float(renderHeight) / float(m_MaxResolution.y));
+                    upscaleConstants.texelSize = float2(1.0f / float(m_MaxResolution.x), 1.0f / float(m_MaxResolution.y));
+                    upscaleConstants.sharpness = m_DrsSharpness;
+
+                    // The input is written every frame into a transient set, so a set the GPU may still read is never rewritten
+                    nri::DescriptorSet* upscaleDescriptorSet = m_DescriptorAllocator.AllocateTransient(*m_UpscalePipelineLayout, 0);
+
+                    nri::DescriptorRangeUpdateDesc upscaleRangeUpdateDescs[2] = {};
+                    upscaleRangeUpdateDescs[0].descriptorNum = 1;
+                    upscaleRangeUpdateDescs[0].descriptors = &m_SceneColorView;
+                    upscaleRangeUpdateDescs[1].descriptorNum = 1;
+                    upscaleRangeUpdateDescs[1].descriptors = &m_LinearClampSampler;
+                    NRI.UpdateDescriptorRanges(*upscaleDescriptorSet, 0, helper::GetCountOf(upscaleRangeUpdateDescs), upscaleRangeUpdateDescs);
+
+                    NRI.CmdSetDescriptorPool(commandBuffer, *m_DescriptorAllocator.GetTransientDescriptorPool());
+                    NRI.CmdSetPipelineLayout(commandBuffer, *m_UpscalePipelineLayout);
+                    NRI.CmdSetDescriptorSet(commandBuffer, 0, *upscaleDescriptorSet, nullptr);
+                    NRI.CmdSetConstants(commandBuffer, 0, &upscaleConstants, sizeof(upscaleConstants));
+                    NRI.CmdSetPipeline(commandBuffer, *m_UpscalePipeline);
+                    NRI.CmdDraw(commandBuffer, {3, 1, 0, 0});
+                }
+
                 RenderUI(NRI, NRI, *m_Streamer, commandBuffer, 1.0f, true);
             }
             NRI.CmdEndRendering(commandBuffer);
@@ -770,9 +1908,15 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         textureBarrierDescs.after = {nri::AccessBits::UNKNOWN, nri::Layout::PRESENT};
 
         NRI.CmdBarrier(commandBuffer, barrierGroupDesc);
+
+        const uint32_t timestampOffset = bufferedFrameIndex * 2;
+        NRI.CmdEndQuery(commandBuffer, *m_TimestampQueryPool, timestampOffset + 1);
+        NRI.CmdCopyQueries(commandBuffer, *m_TimestampQueryPool, timestampOffset, 2, *m_Buffers[READBACK_BUFFER], TIMESTAMP_READBACK_OFFSET + timestampOffset * sizeof(uint64_t));
     }
     NRI.EndCommandBuffer(commandBuffer);
 
+    m_ConstantAllocator.EndFrame();
+
     { // Submit
         nri::QueueSubmitDesc queueSubmitDesc = {};
         queueSubmitDesc.commandBuffers = &frame.commandBuffer;
@@ -0,0 +1,202 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include "MemoryAllocator.h"
+
+#include <array>
+
+// Shader binding table with raygen, miss and hit group sections. A record is a shader group identifier followed by
+// optional inline data, all records of a section share the stride of its largest record. Sections start at
+// "rayTracingShaderTableAlignment", records are aligned to the identifier size. Records are built on the CPU, "Update"
+// copies the changed range to the device table through a per-frame staging slice, so records can be changed between
+// frames without "WaitForIdle". Hit records are selected per instance by "shaderBindingTableLocalOffset" (plus the
+// geometry index within the BLAS). Inline data is laid out as local root arguments, but NRI pipelines don't declare
+// local root signatures, so shaders can only read it where the API allows it without one (SPIR-V "shaderRecordEXT")
+class ShaderBindingTable {
+public:
+    enum Section : uint32_t {
+        RAYGEN,
+        MISS,
+        HIT_GROUP,
+
+        MAX_NUM
+    };
+
+    struct SectionDesc {
+        uint32_t recordNum;
+        uint32_t dataSizeMax; // inline data per record
+    };
+
+    ~ShaderBindingTable() {
+        Destroy();
+    }
+
+    inline nri::Buffer* GetBuffer() const {
+        return m_Buffer;
+    }
+
+    inline uint64_t GetSize() const {
+        return m_Data.size();
+    }
+
+    void Create(const nri::CoreInterface& NRI, const nri::RayTracingInterface& RT, nri::Device& device, nri::Pipeline& pipeline, MemoryAllocator& memoryAllocator, const SectionDesc* sectionDescs) {
+        m_NRI = &NRI;
+        m_RT = &RT;
+        m_Pipeline = &pipeline;
+
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(device);
+        m_IdentifierSize = deviceDesc.rayTracingShaderGroupIdentifierSize;
+
+        uint64_t offset = 0;
+        for (uint32_t i = 0; i < MAX_NUM; i++) {
+            SectionLayout& section = m_Sections[i];
+            section.offset = offset;
+            section.stride = helper::Align(m_IdentifierSize + sectionDescs[i].dataSizeMax, m_IdentifierSize);
+            section.recordNum = sectionDescs[i].recordNum;
+
+            offset = helper::Align(offset + section.stride * section.recordNum, (uint64_t)deviceDesc.rayTracingShaderTableAlignment);
+        }
+
+        m_Data.resize((size_t)offset, 0);
+        m_DirtyBegin = 0;
+        m_DirtyEnd = offset;
+
+        { // Device table
+            const nri::BufferDesc bufferDesc = {offset, 0, nri::BufferUsageBits::RAY_TRACING_BUFFER};
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(device, bufferDesc, m_Buffer));
+
+            nri::ResourceGroupDesc resourceGroupDesc = {};
+            resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
+            resourceGroupDesc.bufferNum = 1;
+            resourceGroupDesc.buffers = &m_Buffer;
+
+            memoryAllocator.AllocateAndBind(resourceGroupDesc);
+        }
+
+        { // Staging, a slice per buffered frame
+            const nri::BufferDesc bufferDesc = {offset * BUFFERED_FRAME_MAX_NUM, 0, nri::BufferUsageBits::NONE};
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(device, bufferDesc, m_StagingBuffer));
+
+            nri::ResourceGroupDesc resourceGroupDesc = {};
+            resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+            resourceGroupDesc.bufferNum = 1;
+            resourceGroupDesc.buffers = &m_StagingBuffer;
+
+            memoryAllocator.AllocateAndBind(resourceGroupDesc);
+
+            m_StagingData = (uint8_t*)NRI.MapBuffer(*m_StagingBuffer, 0, nri::WHOLE_SIZE);
+        }
+    }
+
+    // The GPU must be idle
+    void Destroy() {
+        if (!m_NRI)
+            return;
+
+        m_NRI->UnmapBuffer(*m_StagingBuffer);
+        m_NRI->DestroyBuffer(*m_StagingBuffer);
+        m_NRI->DestroyBuffer(*m_Buffer);
+
+        m_Data.clear();
+        m_NRI = nullptr;
+    }
+
+    // "shaderGroupIndex" is an index in "RayTracingPipelineDesc::shaderGroupDescs"
+    void SetRecord(Section section, uint32_t recordIndex, uint32_t shaderGroupIndex, const void* data = nullptr, uint32_t dataSize = 0) {
+        const SectionLayout& layout = m_Sections[section];
+        NRI_ABORT_ON_FALSE(recordIndex < layout.recordNum);
+        NRI_ABORT_ON_FALSE(m_IdentifierSize + dataSize <= layout.stride);
+
+        const uint64_t offset = layout.offset + recordIndex * layout.stride;
+        uint8_t* record = m_Data.data() + offset;
+
+        m_RT->WriteShaderGroupIdentifiers(*m_Pipeline, shaderGroupIndex, 1, record);
+        if (dataSize)
+            memcpy(record + m_IdentifierSize, data, dataSize);
+
+        m_DirtyBegin = std::min(m_DirtyBegin, offset);
+        m_DirtyEnd = std::max(m_DirtyEnd, offset + layout.stride);
+    }
+
+    // Only rewrites the inline data
+    void SetRecordData(Section section, uint32_t recordIndex, const void* data, uint32_t dataSize) {
+        const SectionLayout& layout = m_Sections[section];
+        NRI_ABORT_ON_FALSE(recordIndex < layout.recordNum);
+        NRI_ABORT_ON_FALSE(m_IdentifierSize + dataSize <= layout.stride);
+
+        const uint64_t offset = layout.offset + recordIndex * layout.stride;
+        memcpy(m_Data.data() + offset + m_IdentifierSize, data, dataSize);
+
+        m_DirtyBegin = std::min(m_DirtyBegin, offset + m_IdentifierSize);
+        m_DirtyEnd = std::max(m_DirtyEnd, offset + m_IdentifierSize + dataSize);
+    }
+
+    // Copies changed records, if any. The caller must have waited for the frame which used this slot last time
+    void Update(nri::CommandBuffer& commandBuffer, uint32_t bufferedFrameIndex) {
+        if (m_DirtyBegin >= m_DirtyEnd)
+            return;
+
+        const uint64_t size = m_DirtyEnd - m_DirtyBegin;
+        const uint64_t stagingOffset = bufferedFrameIndex * m_Data.size() + m_DirtyBegin;
+        memcpy(m_StagingData + stagingOffset, m_Data.data() + m_DirtyBegin, (size_t)size);
+
+        // Earlier dispatches may still read the table
+        nri::BufferBarrierDesc bufferBarrierDesc = {};
+        bufferBarrierDesc.buffer = m_Buffer;
+        bufferBarrierDesc.before = {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::RAY_TRACING_SHADERS};
+        bufferBarrierDesc.after = {nri::AccessBits::COPY_DESTINATION, nri::StageBits::COPY};
+
+        nri::BarrierGroupDesc barrierGroupDesc = {};
+        barrierGroupDesc.bufferNum = 1;
+        barrierGroupDesc.buffers = &bufferBarrierDesc;
+
+        m_NRI->CmdBarrier(commandBuffer, barrierGroupDesc);
+        m_NRI->CmdCopyBuffer(commandBuffer, *m_Buffer, m_DirtyBegin, *m_StagingBuffer, stagingOffset, size);
+
+        bufferBarrierDesc.before = bufferBarrierDesc.after;
+        bufferBarrierDesc.after = {nri::AccessBits::SHADER_RESOURCE, nri::StageBits::RAY_TRACING_SHADERS};
+        m_NRI->CmdBarrier(commandBuffer, barrierGroupDesc);
+
+        m_DirtyBegin = UINT64_MAX;
+        m_DirtyEnd = 0;
+    }
+
+    // Tables for "CmdDispatchRays", the first raygen record is used
+    nri::DispatchRaysDesc GetDispatchRaysDesc(uint32_t width, uint32_t height, uint32_t depth = 1) const {
+        const SectionLayout& raygen = m_Sections[RAYGEN];
+        const SectionLayout& miss = m_Sections[MISS];
+        const SectionLayout& hitGroup = m_Sections[HIT_GROUP];
+
+        nri::DispatchRaysDesc dispatchRaysDesc = {};
+        dispatchRaysDesc.raygenShader = {m_Buffer, raygen.offset, raygen.stride, raygen.stride};
+        dispatchRaysDesc.missShaders = {m_Buffer, miss.offset, miss.stride * miss.recordNum, miss.stride};
+        dispatchRaysDesc.hitShaderGroups = {m_Buffer, hitGroup.offset, hitGroup.stride * hitGroup.recordNum, hitGroup.stride};
+        dispatchRaysDesc.x = (uint16_t)width;
+        dispatchRaysDesc.y = (uint16_t)height;
+        dispatchRaysDesc.z = (uint16_t)depth;
+
+        return dispatchRaysDesc;
+    }
+
+private:
+    struct SectionLayout {
+        uint64_t offset;
+        uint64_t stride;
+        uint32_t recordNum;
+    };
+
+    const nri::CoreInterface* m_NRI = nullptr;
+    const nri::RayTracingInterface* m_RT = nullptr;
+    nri::Pipeline* m_Pipeline = nullptr;
+    nri::Buffer* m_Buffer = nullptr;
+    nri::Buffer* m_StagingBuffer = nullptr;
+    uint8_t* m_StagingData = nullptr;
+    std::vector<uint8_t> m_Data;
+    std::array<SectionLayout, MAX_NUM> m_Sections = {};
+    uint64_t m_DirtyBegin = UINT64_MAX;
+    uint64_t m_DirtyEnd = 0;
+    uint32_t m_IdentifierSize = 0;
+};
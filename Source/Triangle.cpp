@@ -2,6 +2,10 @@
 
 #include "NRIFramework.h"
 
+#include "ConstantAllocator.h"
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+
 #include <array>
 
 constexpr nri::Color32f COLOR_0 = {1.0f, 1.0f, 0.0f, 1.0f};
@@ -33,9 +37,6 @@ struct NRIInterface
 struct Frame {
     nri::CommandAllocator* commandAllocator;
     nri::CommandBuffer* commandBuffer;
-    nri::Descriptor* constantBufferView;
-    nri::DescriptorSet* constantBufferDescriptorSet;
-    uint64_t constantBufferViewOffset;
 };
 
 class Sample : public SampleBase {
@@ -56,19 +57,20 @@ private:
     nri::SwapChain* m_SwapChain = nullptr;
     nri::CommandQueue* m_CommandQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     nri::Pipeline* m_Pipeline = nullptr;
     nri::DescriptorSet* m_TextureDescriptorSet = nullptr;
+    nri::DescriptorSet* m_ConstantBufferDescriptorSet = nullptr;
     nri::Descriptor* m_TextureShaderResource = nullptr;
     nri::Descriptor* m_Sampler = nullptr;
-    nri::Buffer* m_ConstantBuffer = nullptr;
     nri::Buffer* m_GeometryBuffer = nullptr;
     nri::Texture* m_Texture = nullptr;
 
+    ConstantAllocator m_ConstantAllocator;
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
     std::array<Frame, BUFFERED_FRAME_MAX_NUM> m_Frames = {};
     std::vector<BackBuffer> m_SwapChainBuffers;
-    std::vector<nri::Memory*> m_MemoryAllocations;
 
     uint64_t m_GeometryOffset = 0;
     float m_Transparency = 1.0f;
@@ -81,7 +83,6 @@ Sample::~Sample() {
     for (Frame& frame : m_Frames) {
         NRI.DestroyCommandBuffer(*frame.commandBuffer);
         NRI.DestroyCommandAllocator(*frame.commandAllocator);
-        NRI.DestroyDescriptor(*frame.constantBufferView);
     }
 
     for (BackBuffer& backBuffer : m_SwapChainBuffers)
@@ -91,16 +92,15 @@ Sample::~Sample() {
     NRI.DestroyPipelineLayout(*m_PipelineLayout);
     NRI.DestroyDescriptor(*m_TextureShaderResource);
     NRI.DestroyDescriptor(*m_Sampler);
-    NRI.DestroyBuffer(*m_ConstantBuffer);
+    m_ConstantAllocator.Destroy();
     NRI.DestroyBuffer(*m_GeometryBuffer);
     NRI.DestroyTexture(*m_Texture);
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
+    m_DescriptorAllocator.Destroy();
     NRI.DestroyFence(*m_FrameFence);
     NRI.DestroySwapChain(*m_SwapChain);
     NRI.DestroyStreamer(*m_Streamer);
 
-    for (nri::Memory* memory : m_MemoryAllocations)
-        NRI.FreeMemory(*memory);
+    m_MemoryAllocator.Destroy();
 
     DestroyUI(NRI);
 
@@ -137,6 +137,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     streamerDesc.frameInFlightNum = BUFFERED_FRAME_MAX_NUM;
     NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
+    // Descriptor allocator
+    m_DescriptorAllocator.Create(NRI, *m_Device);
+
     // Command queue
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_CommandQueue));
 
@@ -181,15 +184,14 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(*m_Device);
     utils::ShaderCodeStorage shaderCodeStorage;
     {
-        nri::DescriptorRangeDesc descriptorRangeConstant[1];
-        descriptorRangeConstant[0] = {0, 1, nri::DescriptorType::CONSTANT_BUFFER, nri::StageBits::ALL};
+        nri::DynamicConstantBufferDesc dynamicConstantBuffer = {0, nri::StageBits::ALL};
 
         nri::DescriptorRangeDesc descriptorRangeTexture[2];
         descriptorRangeTexture[0] = {0, 1, nri::DescriptorType::TEXTURE, nri::StageBits::FRAGMENT_SHADER};
         descriptorRangeTexture[1] = {0, 1, nri::DescriptorType::SAMPLER, nri::StageBits::FRAGMENT_SHADER};
 
         nri::DescriptorSetDesc descriptorSetDescs[] = {
-            {0, descriptorRangeConstant, helper::GetCountOf(descriptorRangeConstant)},
+            {0, nullptr, 0, &dynamicConstantBuffer, 1},
             {1, descriptorRangeTexture, helper::GetCountOf(descriptorRangeTexture)},
         };
 
@@ -203,6 +205,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         pipelineLayoutDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
 
         NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_PipelineLayout, pipelineLayoutDesc);
 
         nri::VertexStreamDesc vertexStreamDesc = {};
         vertexStreamDesc.bindingSlot = 0;
@@ -264,15 +267,9 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         NRI_ABORT_ON_FAILURE(NRI.CreateGraphicsPipeline(*m_Device, graphicsPipelineDesc, m_Pipeline));
     }
 
-    { // Descriptor pool
-        nri::DescriptorPoolDesc descriptorPoolDesc = {};
-        descriptorPoolDesc.descriptorSetMaxNum = BUFFERED_FRAME_MAX_NUM + 1;
-        descriptorPoolDesc.constantBufferMaxNum = BUFFERED_FRAME_MAX_NUM;
-        descriptorPoolDesc.textureMaxNum = 1;
-        descriptorPoolDesc.samplerMaxNum = 1;
-
-        NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
-    }
+    // Descriptor pool
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 0, 1);
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 1, 1);
 
     // Load texture
     utils::Texture texture;
@@ -281,7 +278,6 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         return false;
 
     // Resources
-    const uint32_t constantBufferSize = helper::Align((uint32_t)sizeof(ConstantBufferLayout), deviceDesc.constantBufferOffsetAlignment);
     const uint64_t indexDataSize = sizeof(g_IndexData);
     const uint64_t indexDataAlignedSize = helper::Align(indexDataSize, 16);
     const uint64_t vertexDataSize = sizeof(g_VertexData);
@@ -291,13 +287,6 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
             texture.GetWidth(), texture.GetHeight(), texture.GetMipNum());
         NRI_ABORT_ON_FAILURE(NRI.CreateTexture(*m_Device, textureDesc, m_Texture));
 
-        { // Constant buffer
-            nri::BufferDesc bufferDesc = {};
-            bufferDesc.size = constantBufferSize * BUFFERED_FRAME_MAX_NUM;
-            bufferDesc.usageMask = nri::BufferUsageBits::CONSTANT_BUFFER;
-            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(*m_Device, bufferDesc, m_ConstantBuffer));
-        }
-
         { // Geometry buffer
             nri::BufferDesc bufferDesc = {};
             bufferDesc.size = indexDataAlignedSize + vertexDataSize;
@@ -307,22 +296,17 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         m_GeometryOffset = indexDataAlignedSize;
     }
 
-    nri::ResourceGroupDesc resourceGroupDesc = {};
-    resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
-    resourceGroupDesc.bufferNum = 1;
-    resourceGroupDesc.buffers = &m_ConstantBuffer;
-
-    m_MemoryAllocations.resize(1, nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data()));
+    m_ConstantAllocator.Create(NRI, *m_Device, 0, BUFFERED_FRAME_MAX_NUM, sizeof(ConstantBufferLayout));
+    m_MemoryAllocator.Create(NRI, *m_Device);
 
+    nri::ResourceGroupDesc resourceGroupDesc = {};
     resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
     resourceGroupDesc.bufferNum = 1;
     resourceGroupDesc.buffers = &m_GeometryBuffer;
     resourceGroupDesc.textureNum = 1;
     resourceGroupDesc.textures = &m_Texture;
 
-    m_MemoryAllocations.resize(1 + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + 1));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     { // Descriptors
         // Texture
@@ -336,24 +320,11 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         samplerDesc.anisotropy = 4;
         samplerDesc.mipMax = 16.0f;
         NRI_ABORT_ON_FAILURE(NRI.CreateSampler(*m_Device, samplerDesc, m_Sampler));
-
-        // Constant buffer
-        for (uint32_t i = 0; i < BUFFERED_FRAME_MAX_NUM; i++) {
-            nri::BufferViewDesc bufferViewDesc = {};
-            bufferViewDesc.buffer = m_ConstantBuffer;
-            bufferViewDesc.viewType = nri::BufferViewType::CONSTANT;
-            bufferViewDesc.offset = i * constantBufferSize;
-            bufferViewDesc.size = constantBufferSize;
-            NRI_ABORT_ON_FAILURE(NRI.CreateBufferView(bufferViewDesc, m_Frames[i].constantBufferView));
-
-            m_Frames[i].constantBufferViewOffset = bufferViewDesc.offset;
-        }
     }
 
     { // Descriptor sets
         // Texture
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 1,
-            &m_TextureDescriptorSet, 1, 0));
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, 1, &m_TextureDescriptorSet, 1);
 
         nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs[2] = {};
         descriptorRangeUpdateDescs[0].descriptorNum = 1;
@@ -363,13 +334,11 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         descriptorRangeUpdateDescs[1].descriptors = &m_Sampler;
         NRI.UpdateDescriptorRanges(*m_TextureDescriptorSet, 0, helper::GetCountOf(descriptorRangeUpdateDescs), descriptorRangeUpdateDescs);
 
-        // Constant buffer
-        for (Frame& frame : m_Frames) {
-            NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 0, &frame.constantBufferDescriptorSet, 1, 0));
+        // Constant buffer (one set for all frames, bound with a dynamic offset)
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, 0, &m_ConstantBufferDescriptorSet, 1);
 
-            nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDesc = {&frame.constantBufferView, 1};
-            NRI.UpdateDescriptorRanges(*frame.constantBufferDescriptorSet, 0, 1, &descriptorRangeUpdateDesc);
-        }
+        const nri::Descriptor* constantBufferView = &m_ConstantAllocator.GetView();
+        NRI.UpdateDynamicConstantBuffers(*m_ConstantBufferDescriptorSet, 0, 1, &constantBufferView);
     }
 
     { // Upload data
@@ -431,18 +400,19 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.ResetCommandAllocator(*frame.commandAllocator);
     }
 
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+
     const uint32_t currentTextureIndex = NRI.AcquireNextSwapChainTexture(*m_SwapChain);
     BackBuffer& currentBackBuffer = m_SwapChainBuffers[currentTextureIndex];
 
-    ConstantBufferLayout* commonConstants = (ConstantBufferLayout*)NRI.MapBuffer(*m_ConstantBuffer, frame.constantBufferViewOffset, sizeof(ConstantBufferLayout));
-    if (commonConstants) {
-        commonConstants->color[0] = 0.8f;
-        commonConstants->color[1] = 0.5f;
-        commonConstants->color[2] = 0.1f;
-        commonConstants->scale = m_Scale;
+    m_ConstantAllocator.BeginFrame(bufferedFrameIndex);
 
-        NRI.UnmapBuffer(*m_ConstantBuffer);
-    }
+    uint32_t commonConstantsOffset = 0;
+    ConstantBufferLayout* commonConstants = m_ConstantAllocator.Allocate<ConstantBufferLayout>(commonConstantsOffset);
+    commonConstants->color[0] = 0.8f;
+    commonConstants->color[1] = 0.5f;
+    commonConstants->color[2] = 0.1f;
+    commonConstants->scale = m_Scale;
 
     nri::TextureBarrierDesc textureBarrierDescs = {};
     textureBarrierDescs.texture = currentBackBuffer.texture;
@@ -452,7 +422,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
     // Record
     nri::CommandBuffer* commandBuffer = frame.commandBuffer;
-    NRI.BeginCommandBuffer(*commandBuffer, m_DescriptorPool);
+    NRI.BeginCommandBuffer(*commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
     {
         nri::BarrierGroupDesc barrierGroupDesc = {};
         barrierGroupDesc.textureNum = 1;
@@ -494,7 +464,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
                 NRI.CmdSetConstants(*commandBuffer, 0, &m_Transparency, 4);
                 NRI.CmdSetIndexBuffer(*commandBuffer, *m_GeometryBuffer, 0, nri::IndexType::UINT16);
                 NRI.CmdSetVertexBuffers(*commandBuffer, 0, 1, &m_GeometryBuffer, &m_GeometryOffset);
-                NRI.CmdSetDescriptorSet(*commandBuffer, 0, *frame.constantBufferDescriptorSet, nullptr);
+                NRI.CmdSetDescriptorSet(*commandBuffer, 0, *m_ConstantBufferDescriptorSet, &commonConstantsOffset);
                 NRI.CmdSetDescriptorSet(*commandBuffer, 1, *m_TextureDescriptorSet, nullptr);
 
                 nri::Rect scissor = {0, 0, halfWidth, windowHeight};
@@ -521,6 +491,8 @@ void Sample::RenderFrame(uint32_t frameIndex) {
     }
     NRI.EndCommandBuffer(*commandBuffer);
 
+    m_ConstantAllocator.EndFrame();
+
     { // Submit
         nri::QueueSubmitDesc queueSubmitDesc = {};
         queueSubmitDesc.commandBuffers = &frame.commandBuffer;
@@ -0,0 +1,301 @@
+// © 2024 NVIDIA Corporation
+
+#pragma once
+
+#include "NRIFramework.h"
+
+#include <functional>
+
+// Uploads data through a fixed-size persistently mapped staging ring instead of a staging allocation as large as
+// everything being uploaded. The ring is split into slots, each with its own command buffer and fence value. When
+// a slot is full it gets submitted and the next one is reused as soon as the GPU is done with it, so filling the
+// staging memory for the next chunk (memcpy or file read) overlaps with GPU copies of the previous chunks
+class UploadManager {
+public:
+    // Writes "size" bytes of the source, starting at "offset", to "dst"
+    typedef std::function<void(uint8_t* dst, uint64_t offset, uint64_t size)> Reader;
+
+    struct Stats {
+        uint64_t uploadedBytes;
+        uint32_t submitNum;
+        uint32_t stallNum; // waits for a slot still in use by the GPU
+    };
+
+    ~UploadManager() {
+        Destroy();
+    }
+
+    inline uint64_t GetRingSize() const {
+        return m_SlotSize * m_Slots.size();
+    }
+
+    inline const Stats& GetStats() const {
+        return m_Stats;
+    }
+
+    void Create(const nri::CoreInterface& NRI, nri::Device& device, nri::CommandQueue& commandQueue, uint64_t ringSize = 64 * 1024 * 1024, uint32_t slotNum = 4) {
+        m_NRI = &NRI;
+        m_CommandQueue = &commandQueue;
+
+        const nri::DeviceDesc& deviceDesc = NRI.GetDeviceDesc(device);
+        m_RowAlignment = deviceDesc.uploadBufferTextureRowAlignment;
+        m_SliceAlignment = deviceDesc.uploadBufferTextureSliceAlignment;
+        m_SlotSize = (ringSize / slotNum) & ~(uint64_t(m_SliceAlignment) - 1);
+
+        { // Ring buffer
+            nri::BufferDesc bufferDesc = {};
+            bufferDesc.size = m_SlotSize * slotNum;
+
+            NRI_ABORT_ON_FAILURE(NRI.CreateBuffer(device, bufferDesc, m_RingBuffer));
+
+            nri::ResourceGroupDesc resourceGroupDesc = {};
+            resourceGroupDesc.memoryLocation = nri::MemoryLocation::HOST_UPLOAD;
+            resourceGroupDesc.bufferNum = 1;
+            resourceGroupDesc.buffers = &m_RingBuffer;
+
+            m_MemoryAllocations.resize(NRI.CalculateAllocationNumber(device, resourceGroupDesc), nullptr);
+            NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(device, resourceGroupDesc, m_MemoryAllocations.data()));
+
+            m_RingData = (uint8_t*)NRI.MapBuffer(*m_RingBuffer, 0, nri::WHOLE_SIZE);
+        }
+
+        NRI_ABORT_ON_FAILURE(NRI.CreateFence(device, 0, m_Fence));
+
+        m_Slots.resize(slotNum);
+        for (Slot& slot : m_Slots) {
+            NRI_ABORT_ON_FAILURE(NRI.CreateCommandAllocator(commandQueue, slot.commandAllocator));
+            NRI_ABORT_ON_FAILURE(NRI.CreateCommandBuffer(*slot.commandAllocator, slot.commandBuffer));
+        }
+    }
+
+    void Destroy() {
+        if (!m_NRI)
+            return;
+
+        Flush();
+
+        for (Slot& slot : m_Slots) {
+            m_NRI->DestroyCommandBuffer(*slot.commandBuffer);
+            m_NRI->DestroyCommandAllocator(*slot.commandAllocator);
+        }
+
+        m_NRI->UnmapBuffer(*m_RingBuffer);
+        m_NRI->DestroyBuffer(*m_RingBuffer);
+        m_NRI->DestroyFence(*m_Fence);
+
+        for (nri::Memory* memory : m_MemoryAllocations)
+            m_NRI->FreeMemory(*memory);
+
+        m_Slots.clear();
+        m_MemoryAllocations.clear();
+        m_NRI = nullptr;
+    }
+
+    // "data = nullptr" or "size = 0" only transitions the buffer to "after"
+    void UploadBuffer(nri::Buffer& buffer, uint64_t offset, const void* data, uint64_t size, nri::AccessStage after) {
+        const uint8_t* src = (const uint8_t*)data;
+
+        UploadBuffer(buffer, offset, data ? size : 0, after, [src](uint8_t* dst, uint64_t srcOffset, uint64_t chunkSize) {
+            memcpy(dst, src + srcOffset, chunkSize);
+        });
+    }
+
+    void UploadBuffer(nri::Buffer& buffer, uint64_t offset, uint64_t size, nri::AccessStage after, const Reader& reader) {
+        for (uint64_t srcOffset = 0; srcOffset < size;) {
+            uint64_t chunkSize = std::min(size - srcOffset, ReserveSpace(BUFFER_ALIGNMENT, std::min(size - srcOffset, MIN_CHUNK_SIZE)));
+
+            uint64_t ringOffset = 0;
+            uint8_t* dst = Allocate(chunkSize, BUFFER_ALIGNMENT, ringOffset);
+            reader(dst, srcOffset, chunkSize);
+
+            m_NRI->CmdCopyBuffer(*m_Slots[m_SlotIndex].commandBuffer, buffer, offset + srcOffset, *m_RingBuffer, ringOffset, chunkSize);
+
+            srcOffset += chunkSize;
+        }
+
+        nri::BufferBarrierDesc bufferBarrierDesc = {};
+        bufferBarrierDesc.buffer = &buffer;
+        if (size)
+            bufferBarrierDesc.before = {nri::AccessBits::COPY_DESTINATION, nri::StageBits::COPY};
+        bufferBarrierDesc.after = after;
+
+        nri::BarrierGroupDesc barrierGroupDesc = {};
+        barrierGroupDesc.bufferNum = 1;
+        barrierGroupDesc.buffers = &bufferBarrierDesc;
+
+        m_NRI->CmdBarrier(GetCommandBuffer(), barrierGroupDesc);
+    }
+
+    // "subresources" are "layerNum * mipNum" entries ordered by layer, then by mip. "nullptr" only transitions the texture to "after"
+    void UploadTexture(nri::Texture& texture, const nri::TextureSubresourceUploadDesc* subresources, nri::AccessLayoutStage after) {
+        const nri::TextureDesc& textureDesc = m_NRI->GetTextureDesc(texture);
+
+        nri::TextureBarrierDesc textureBarrierDesc = {};
+        textureBarrierDesc.texture = &texture;
+        textureBarrierDesc.mipNum = textureDesc.mipNum;
+        textureBarrierDesc.layerNum = textureDesc.layerNum;
+
+        nri::BarrierGroupDesc barrierGroupDesc = {};
+        barrierGroupDesc.textureNum = 1;
+        barrierGroupDesc.textures = &textureBarrierDesc;
+
+        if (subresources) {
+            textureBarrierDesc.after = {nri::AccessBits::COPY_DESTINATION, nri::Layout::COPY_DESTINATION, nri::StageBits::COPY};
+            m_NRI->CmdBarrier(GetCommandBuffer(), barrierGroupDesc);
+
+            const uint32_t blockHeight = nri::nriGetFormatProps(textureDesc.format)->blockHeight;
+
+            for (nri::Dim_t layer = 0; layer < textureDesc.layerNum; layer++) {
+                for (nri::Mip_t mip = 0; mip < textureDesc.mipNum; mip++)
+                    UploadSubresource(texture, subresources[layer * textureDesc.mipNum + mip], textureDesc, blockHeight, mip, layer);
+            }
+
+            textureBarrierDesc.before = textureBarrierDesc.after;
+        }
+
+        textureBarrierDesc.after = after;
+        m_NRI->CmdBarrier(GetCommandBuffer(), barrierGroupDesc);
+    }
+
+    // Submits pending copies and waits for all of them
+    void Flush() {
+        Submit();
+
+        m_NRI->Wait(*m_Fence, m_FenceValue);
+    }
+
+private:
+    struct Slot {
+        nri::CommandAllocator* commandAllocator = nullptr;
+        nri::CommandBuffer* commandBuffer = nullptr;
+        uint64_t fenceValue = 0;
+    };
+
+    static constexpr uint64_t BUFFER_ALIGNMENT = 16;
+    static constexpr uint64_t MIN_CHUNK_SIZE = 64 * 1024; // don't bother with smaller tails of a slot
+
+    void UploadSubresource(nri::Texture& texture, const nri::TextureSubresourceUploadDesc& subresource, const nri::TextureDesc& textureDesc, uint32_t blockHeight, nri::Mip_t mip, nri::Dim_t layer) {
+        const uint32_t rowNum = subresource.slicePitch / subresource.rowPitch;
+        const uint64_t alignedRowPitch = helper::Align((uint64_t)subresource.rowPitch, (uint64_t)m_RowAlignment);
+        const nri::Dim_t mipWidth = (nri::Dim_t)std::max(textureDesc.width >> mip, 1);
+        const nri::Dim_t mipHeight = (nri::Dim_t)std::max(textureDesc.height >> mip, 1);
+
+        NRI_ABORT_ON_FALSE(alignedRowPitch <= m_SlotSize);
+
+        // Split by rows, so any subresource fits the ring
+        for (uint32_t slice = 0; slice < subresource.sliceNum; slice++) {
+            const uint8_t* src = (const uint8_t*)subresource.slices + slice * subresource.slicePitch;
+
+            for (uint32_t row = 0; row < rowNum;) {
+                uint32_t chunkRowNum = std::min(rowNum - row, uint32_t(ReserveSpace(m_SliceAlignment, alignedRowPitch) / alignedRowPitch));
+
+                uint64_t ringOffset = 0;
+                uint8_t* dst = Allocate(chunkRowNum * alignedRowPitch, m_SliceAlignment, ringOffset);
+                for (uint32_t i = 0; i < chunkRowNum; i++)
+                    memcpy(dst + i * alignedRowPitch, src + (row + i) * subresource.rowPitch, subresource.rowPitch);
+
+                nri::TextureRegionDesc dstRegion = {};
+                dstRegion.y = nri::Dim_t(row * blockHeight);
+                dstRegion.z = nri::Dim_t(slice);
+                dstRegion.width = mipWidth;
+                dstRegion.height = nri::Dim_t(std::min(chunkRowNum * blockHeight, uint32_t(mipHeight - dstRegion.y)));
+                dstRegion.depth = 1;
+                dstRegion.mipOffset = mip;
+                dstRegion.layerOffset = layer;
+
+                nri::TextureDataLayoutDesc srcDataLayout = {};
+                srcDataLayout.offset = ringOffset;
+                srcDataLayout.rowPitch = (uint32_t)alignedRowPitch;
+                srcDataLayout.slicePitch = uint32_t(chunkRowNum * alignedRowPitch);
+
+                m_NRI->CmdUploadBufferToTexture(*m_Slots[m_SlotIndex].commandBuffer, texture, dstRegion, *m_RingBuffer, srcDataLayout);
+
+                row += chunkRowNum;
+            }
+        }
+    }
+
+    // Returns the space left in the current slot, moving to the next slot if less than "minSize" is left
+    uint64_t ReserveSpace(uint64_t alignment, uint64_t minSize) {
+        uint64_t offset = helper::Align(m_SlotOffset, alignment);
+        if (offset + minSize > m_SlotSize) {
+            Submit();
+            offset = 0;
+        }
+
+        return m_SlotSize - offset;
+    }
+
+    uint8_t* Allocate(uint64_t size, uint64_t alignment, uint64_t& ringOffset) {
+        GetCommandBuffer();
+
+        m_SlotOffset = helper::Align(m_SlotOffset, alignment);
+        ringOffset = m_SlotIndex * m_SlotSize + m_SlotOffset;
+        m_SlotOffset += size;
+        m_Stats.uploadedBytes += size;
+
+        return m_RingData + ringOffset;
+    }
+
+    // Begins recording into the current slot, waiting for its previous submission if needed
+    nri::CommandBuffer& GetCommandBuffer() {
+        Slot& slot = m_Slots[m_SlotIndex];
+
+        if (!m_IsRecording) {
+            if (m_NRI->GetFenceValue(*m_Fence) < slot.fenceValue) {
+                m_NRI->Wait(*m_Fence, slot.fenceValue);
+                m_Stats.stallNum++;
+            }
+
+            m_NRI->ResetCommandAllocator(*slot.commandAllocator);
+            m_NRI->BeginCommandBuffer(*slot.commandBuffer, nullptr);
+
+            m_IsRecording = true;
+        }
+
+        return *slot.commandBuffer;
+    }
+
+    void Submit() {
+        if (!m_IsRecording)
+            return;
+
+        Slot& slot = m_Slots[m_SlotIndex];
+        m_NRI->EndCommandBuffer(*slot.commandBuffer);
+
+        nri::FenceSubmitDesc signalFence = {};
+        signalFence.fence = m_Fence;
+        signalFence.value = ++m_FenceValue;
+
+        nri::QueueSubmitDesc queueSubmitDesc = {};
+        queueSubmitDesc.commandBuffers = &slot.commandBuffer;
+        queueSubmitDesc.commandBufferNum = 1;
+        queueSubmitDesc.signalFences = &signalFence;
+        queueSubmitDesc.signalFenceNum = 1;
+
+        m_NRI->QueueSubmit(*m_CommandQueue, queueSubmitDesc);
+
+        slot.fenceValue = m_FenceValue;
+        m_SlotIndex = (m_SlotIndex + 1) % (uint32_t)m_Slots.size();
+        m_SlotOffset = 0;
+        m_IsRecording = false;
+        m_Stats.submitNum++;
+    }
+
+private:
+    const nri::CoreInterface* m_NRI = nullptr;
+    nri::CommandQueue* m_CommandQueue = nullptr;
+    nri::Buffer* m_RingBuffer = nullptr;
+    nri::Fence* m_Fence = nullptr;
+    uint8_t* m_RingData = nullptr;
+    std::vector<Slot> m_Slots;
+    std::vector<nri::Memory*> m_MemoryAllocations;
+    Stats m_Stats = {};
+    uint64_t m_SlotSize = 0;
+    uint64_t m_SlotOffset = 0;
+    uint64_t m_FenceValue = 0;
+    uint32_t m_SlotIndex = 0;
+    uint32_t m_RowAlignment = 1;
+    uint32_t m_SliceAlignment = 1;
+    bool m_IsRecording = false;
+};
@@ -2,6 +2,9 @@
 
 #include "NRIFramework.h"
 
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+
 #ifdef _WIN32
 #    undef APIENTRY // defined in GLFW
 
@@ -84,7 +87,6 @@ private:
     nri::SwapChain* m_SwapChain = nullptr;
     nri::CommandQueue* m_CommandQueue = nullptr;
     nri::Fence* m_FrameFence = nullptr;
-    nri::DescriptorPool* m_DescriptorPool = nullptr;
     nri::PipelineLayout* m_PipelineLayout = nullptr;
     nri::Pipeline* m_Pipeline = nullptr;
     nri::DescriptorSet* m_TextureDescriptorSet = nullptr;
@@ -96,7 +98,8 @@ private:
 
     std::array<Frame, BUFFERED_FRAME_MAX_NUM> m_Frames = {};
     std::vector<BackBuffer> m_SwapChainBuffers;
-    std::vector<nri::Memory*> m_MemoryAllocations;
+    DescriptorAllocator m_DescriptorAllocator;
+    MemoryAllocator m_MemoryAllocator;
 
 #ifdef _WIN32
     ID3D11Device* m_D3D11Device = nullptr;
@@ -130,13 +133,12 @@ Sample::~Sample() {
     NRI.DestroyBuffer(*m_ConstantBuffer);
     NRI.DestroyBuffer(*m_GeometryBuffer);
     NRI.DestroyTexture(*m_Texture);
-    NRI.DestroyDescriptorPool(*m_DescriptorPool);
+    m_DescriptorAllocator.Destroy();
     NRI.DestroyFence(*m_FrameFence);
     NRI.DestroySwapChain(*m_SwapChain);
     NRI.DestroyStreamer(*m_Streamer);
 
-    for (nri::Memory* memory : m_MemoryAllocations)
-        NRI.FreeMemory(*memory);
+    m_MemoryAllocator.Destroy();
 
     DestroyUI(NRI);
 
@@ -317,6 +319,12 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     streamerDesc.frameInFlightNum = BUFFERED_FRAME_MAX_NUM;
     NRI_ABORT_ON_FAILURE(NRI.CreateStreamer(*m_Device, streamerDesc, m_Streamer));
 
+    // Memory allocator
+    m_MemoryAllocator.Create(NRI, *m_Device);
+
+    // Descriptor allocator
+    m_DescriptorAllocator.Create(NRI, *m_Device);
+
     // Command queue
     NRI_ABORT_ON_FAILURE(NRI.GetCommandQueue(*m_Device, nri::CommandQueueType::GRAPHICS, m_CommandQueue));
 
@@ -383,6 +391,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
         pipelineLayoutDesc.shaderStages = nri::StageBits::VERTEX_SHADER | nri::StageBits::FRAGMENT_SHADER;
 
         NRI_ABORT_ON_FAILURE(NRI.CreatePipelineLayout(*m_Device, pipelineLayoutDesc, m_PipelineLayout));
+        m_DescriptorAllocator.AddPipelineLayout(*m_PipelineLayout, pipelineLayoutDesc);
 
         nri::VertexStreamDesc vertexStreamDesc = {};
         vertexStreamDesc.bindingSlot = 0;
@@ -445,15 +454,8 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     }
 
     // Descriptor pool
-    {
-        nri::DescriptorPoolDesc descriptorPoolDesc = {};
-        descriptorPoolDesc.descriptorSetMaxNum = BUFFERED_FRAME_MAX_NUM + 1;
-        descriptorPoolDesc.constantBufferMaxNum = BUFFERED_FRAME_MAX_NUM;
-        descriptorPoolDesc.textureMaxNum = 1;
-        descriptorPoolDesc.samplerMaxNum = 1;
-
-        NRI_ABORT_ON_FAILURE(NRI.CreateDescriptorPool(*m_Device, descriptorPoolDesc, m_DescriptorPool));
-    }
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 0, BUFFERED_FRAME_MAX_NUM);
+    m_DescriptorAllocator.Reserve(*m_PipelineLayout, 1, 1);
 
     // Load texture
     utils::Texture texture;
@@ -495,8 +497,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     resourceGroupDesc.bufferNum = 1;
     resourceGroupDesc.buffers = &m_ConstantBuffer;
 
-    m_MemoryAllocations.resize(1, nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data()));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     resourceGroupDesc.memoryLocation = nri::MemoryLocation::DEVICE;
     resourceGroupDesc.bufferNum = 1;
@@ -504,8 +505,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     resourceGroupDesc.textureNum = 1;
     resourceGroupDesc.textures = &m_Texture;
 
-    m_MemoryAllocations.resize(1 + NRI.CalculateAllocationNumber(*m_Device, resourceGroupDesc), nullptr);
-    NRI_ABORT_ON_FAILURE(NRI.AllocateAndBindMemory(*m_Device, resourceGroupDesc, m_MemoryAllocations.data() + 1));
+    m_MemoryAllocator.AllocateAndBind(resourceGroupDesc);
 
     // Descriptors
     {
@@ -537,7 +537,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
     // Descriptor sets
     {
         // Texture
-        NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 1, &m_TextureDescriptorSet, 1, 0));
+        m_DescriptorAllocator.Allocate(*m_PipelineLayout, 1, &m_TextureDescriptorSet, 1);
 
         nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDescs[2] = {};
         descriptorRangeUpdateDescs[0].descriptorNum = 1;
@@ -549,7 +549,7 @@ bool Sample::Initialize(nri::GraphicsAPI graphicsAPI) {
 
         // Constant buffer
         for (Frame& frame : m_Frames) {
-            NRI_ABORT_ON_FAILURE(NRI.AllocateDescriptorSets(*m_DescriptorPool, *m_PipelineLayout, 0, &frame.constantBufferDescriptorSet, 1, 0));
+            m_DescriptorAllocator.Allocate(*m_PipelineLayout, 0, &frame.constantBufferDescriptorSet, 1);
 
             nri::DescriptorRangeUpdateDesc descriptorRangeUpdateDesc = {&frame.constantBufferView, 1};
             NRI.UpdateDescriptorRanges(*frame.constantBufferDescriptorSet, 0, 1, &descriptorRangeUpdateDesc);
@@ -616,6 +616,8 @@ void Sample::RenderFrame(uint32_t frameIndex) {
         NRI.ResetCommandAllocator(*frame.commandAllocator);
     }
 
+    m_DescriptorAllocator.BeginFrame(frameIndex);
+
     ConstantBufferLayout* commonConstants = (ConstantBufferLayout*)NRI.MapBuffer(*m_ConstantBuffer, frame.constantBufferViewOffset, sizeof(ConstantBufferLayout));
     if (commonConstants) {
         commonConstants->color[0] = 0.8f;
@@ -637,7 +639,7 @@ void Sample::RenderFrame(uint32_t frameIndex) {
 
     // Record
     nri::CommandBuffer* commandBuffer = frame.commandBuffer;
-    NRI.BeginCommandBuffer(*commandBuffer, m_DescriptorPool);
+    NRI.BeginCommandBuffer(*commandBuffer, m_DescriptorAllocator.GetDescriptorPool());
     {
         nri::BarrierGroupDesc barrierGroupDesc = {};
         barrierGroupDesc.textureNum = 1;